@@ -16,6 +16,9 @@
 #define APP_USER_AGENT "TriCord/" APP_VERSION " (Nintendo 3DS)"
 
 #define HTTP_TIMEOUT_SECONDS 30
+// Pooled connections idle longer than this are closed rather than reused;
+// home routers and phone hotspots often forget a TCP flow after a minute.
+#define HTTP_MAX_IDLE_SECONDS 30
 
 #define TOP_SCREEN_WIDTH 400
 #define TOP_SCREEN_HEIGHT 240
@@ -108,6 +111,8 @@ public:
   bool isFileLoggingEnabled() const { return fileLoggingEnabled; }
   void setFileLoggingEnabled(bool enabled);
 
+  int getTextureCacheMB() const { return textureCacheMB; }
+
   bool isDisclaimerAccepted() const { return disclaimerAccepted; }
   void setDisclaimerAccepted(bool accepted);
 
@@ -124,6 +129,7 @@ private:
   bool typingIndicatorEnabled;
   bool fileLoggingEnabled;
   bool disclaimerAccepted;
+  int textureCacheMB;
   Theme customTheme;
 
   mutable std::recursive_mutex mutex;
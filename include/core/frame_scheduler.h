@@ -0,0 +1,63 @@
+#pragma once
+
+#include <3ds.h>
+#include <atomic>
+
+namespace Core {
+
+enum RedrawTarget : u32 {
+  REDRAW_NONE = 0,
+  REDRAW_TOP = 1 << 0,
+  REDRAW_BOTTOM = 1 << 1,
+  REDRAW_ALL = REDRAW_TOP | REDRAW_BOTTOM
+};
+
+// Decides which screens need a new frame. Anything that changes what is on
+// screen marks it dirty; animations request a frame on every update they
+// run. When nothing is dirty the main loop sleeps instead of redrawing.
+class FrameScheduler {
+public:
+  static FrameScheduler &getInstance() {
+    static FrameScheduler instance;
+    return instance;
+  }
+
+  void init();
+
+  // Safe to call from any thread; wakes the main loop if it is idle.
+  void requestRedraw(u32 targets = REDRAW_ALL);
+  void requestAnimationFrame(u32 targets = REDRAW_ALL) {
+    requestRedraw(targets);
+  }
+
+  // Returns the targets to draw this iteration and clears them.
+  u32 beginFrame();
+  // Sleeps until a redraw is requested or one input poll interval passes.
+  void waitForWork();
+
+  u32 getFramesPerSecond() const { return framesPerSecond; }
+  u32 getBusyPercent() const { return busyPercent; }
+
+private:
+  FrameScheduler() = default;
+  ~FrameScheduler() = default;
+  FrameScheduler(const FrameScheduler &) = delete;
+  FrameScheduler &operator=(const FrameScheduler &) = delete;
+
+  void updateStats(u64 now);
+
+  static const u64 INPUT_POLL_NS = 16666667ULL;
+  static const u64 KEEPALIVE_MS = 1000;
+
+  LightEvent wakeEvent;
+  std::atomic<u32> dirtyTargets{REDRAW_ALL};
+  u64 lastFrameMs = 0;
+
+  u64 statsWindowStart = 0;
+  u64 idleMsInWindow = 0;
+  u32 framesInWindow = 0;
+  u32 framesPerSecond = 0;
+  u32 busyPercent = 100;
+};
+
+} // namespace Core
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <3ds.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Scoped timing probes. They only exist in builds with TRICORD_PROFILER
+// defined (the default; `make RELEASE=1` compiles them out).
+#ifdef TRICORD_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name)                                                    \
+  static const int PROFILE_CONCAT(profileProbe_, __LINE__) =                   \
+      Core::Profiler::getInstance().registerProbe(name);                       \
+  Core::ScopedProbe PROFILE_CONCAT(profileScope_, __LINE__)(                   \
+      PROFILE_CONCAT(profileProbe_, __LINE__))
+#define PROFILE_END_FRAME(rendered)                                            \
+  Core::Profiler::getInstance().endFrame(rendered)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_END_FRAME(rendered) ((void)0)
+#endif
+
+namespace Core {
+
+class Profiler {
+public:
+  static Profiler &getInstance() {
+    static Profiler instance;
+    return instance;
+  }
+
+  struct ProbeStats {
+    std::string name;
+    float minMs;
+    float avgMs;
+    float p95Ms;
+    float maxMs;
+  };
+
+  static const int MAX_PROBES = 32;
+  static const int HISTORY_FRAMES = 120;
+
+  // Returns the probe id for name, registering it on first use.
+  int registerProbe(const char *name);
+  void addSample(int probe, u64 ticks);
+
+  // Closes the current frame. Iterations that drew nothing are dropped so
+  // idle polling doesn't dilute the numbers.
+  void endFrame(bool rendered);
+
+  std::vector<ProbeStats> getStats() const;
+  int getFrameCount() const;
+  bool dumpToFile(const std::string &path) const;
+
+private:
+  Profiler() = default;
+  ~Profiler() = default;
+  Profiler(const Profiler &) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+
+  struct Probe {
+    const char *name = nullptr;
+    std::atomic<u64> pendingTicks{0};
+    float historyMs[HISTORY_FRAMES] = {};
+  };
+
+  Probe probes[MAX_PROBES];
+  std::atomic<int> probeCount{0};
+  int frameIndex = 0;
+  int framesRecorded = 0;
+  mutable std::mutex mutex;
+};
+
+class ScopedProbe {
+public:
+  explicit ScopedProbe(int probe) : probe(probe), start(svcGetSystemTick()) {}
+  ~ScopedProbe() {
+    Profiler::getInstance().addSample(probe, svcGetSystemTick() - start);
+  }
+
+private:
+  int probe;
+  u64 start;
+};
+
+} // namespace Core
@@ -1,16 +1,18 @@
 #ifndef AVATAR_CACHE_H
 #define AVATAR_CACHE_H
 
+#include "ui/texture_cache.h"
+#include "utils/image_utils.h"
 #include <citro2d.h>
 #include <map>
 #include <mutex>
 #include <string>
-#include <vector>
 
 namespace Discord {
 
+// Textures themselves live in UI::TextureCache under "avatar:<url>", most of
+// them packed into UI::TextureAtlas pages.
 struct AvatarInfo {
-  C3D_Tex *tex = nullptr;
   std::string url;
   bool loading = false;
 };
@@ -21,13 +23,16 @@ public:
 
   void init();
   void shutdown();
-  void update();
   void clear();
 
-  C3D_Tex *getAvatar(const std::string &userId, const std::string &avatarHash,
-                     const std::string &discriminator);
-  C3D_Tex *getGuildIcon(const std::string &guildId,
-                        const std::string &iconHash);
+  // image.tex is null until the texture is loaded.
+  C2D_Image getAvatar(const std::string &userId, const std::string &avatarHash,
+                      const std::string &discriminator);
+  C2D_Image getGuildIcon(const std::string &guildId,
+                         const std::string &iconHash);
+  // Pins the icon so it survives eviction while the handle is held.
+  UI::TextureHandle acquireGuildIcon(const std::string &guildId,
+                                     const std::string &iconHash);
 
   void prefetchAvatar(const std::string &userId, const std::string &avatarHash,
                       const std::string &discriminator);
@@ -41,11 +46,15 @@ private:
   std::map<std::string, AvatarInfo> cache;
   std::recursive_mutex cacheMutex;
 
-  struct PendingAvatar {
-    std::string id;
-    C3D_Tex *tex = nullptr;
-  };
-  std::vector<PendingAvatar> pendingAvatars;
+  static std::string cacheKey(const std::string &url);
+  C2D_Image lookup(const std::string &id);
+
+  // Disk cache first, then the network; decoded data comes back through
+  // UI::DecodePool to onDecoded() on the main thread.
+  void fetchTexture(const std::string &id, const std::string &url);
+  void fetchFromNetwork(const std::string &id, const std::string &url);
+  void onDecoded(const std::string &id, Utils::Image::TiledData &tiled);
+  void markFailed(const std::string &id);
 };
 
 } // namespace Discord
@@ -2,6 +2,7 @@
 #define DISCORD_CLIENT_H
 
 #include "discord/types.h"
+#include "network/network_manager.h"
 #include "network/websocket_client.h"
 #include <condition_variable>
 #include <deque>
@@ -28,6 +29,10 @@ enum class ConnectionState {
 };
 
 using MessagesCallback = std::function<void(const std::vector<Message> &)>;
+// success is false if the page could not be fetched, as opposed to an empty
+// page at the end of the channel.
+using MessagePageCallback =
+    std::function<void(const std::vector<Message> &, bool success)>;
 using SingleMessageCallback =
     std::function<void(const std::optional<Message> &)>;
 using SuccessCallback = std::function<void(bool success)>;
@@ -118,11 +123,19 @@ public:
   void setSelectedChannelId(const std::string &id) { selectedChannelId = id; }
   std::string getSelectedChannelId() const { return selectedChannelId; }
 
-  void fetchMessagesAsync(const std::string &channelId, int limit,
-                          MessagesCallback cb, const std::string &around = "");
-  void fetchMessagesBeforeAsync(const std::string &channelId,
-                                const std::string &beforeId, int limit,
-                                MessagesCallback cb);
+  // The fetches return their requests so that a screen can cancel them
+  // when it closes; the handle is empty if the callback has already run.
+  Network::RequestHandle fetchMessagesAsync(const std::string &channelId,
+                                            int limit, MessagesCallback cb,
+                                            const std::string &around = "");
+  Network::RequestHandle fetchMessagesBeforeAsync(const std::string &channelId,
+                                                  const std::string &beforeId,
+                                                  int limit,
+                                                  MessagePageCallback cb);
+  Network::RequestHandle fetchMessagesAfterAsync(const std::string &channelId,
+                                                 const std::string &afterId,
+                                                 int limit,
+                                                 MessagePageCallback cb);
   void fetchMessage(const std::string &channelId, const std::string &messageId,
                     SingleMessageCallback cb);
   void sendMessage(const std::string &channelId, const std::string &content);
@@ -141,12 +154,14 @@ public:
                      const std::string &messageId);
   void deleteMessageAsync(const std::string &channelId,
                           const std::string &messageId, SuccessCallback cb);
-  void fetchForumThreads(const std::string &channelId, ThreadsCallback cb);
+  std::vector<Network::RequestHandle>
+  fetchForumThreads(const std::string &channelId, ThreadsCallback cb);
   void fetchGuildDetails(const std::string &guildId,
                          std::function<void(bool)> cb = nullptr);
   void exchangeTicketForToken(const std::string &ticket, TokenCallback cb);
-  void fetchMember(const std::string &guildId, const std::string &userId,
-                   MemberCallback cb);
+  Network::RequestHandle fetchMember(const std::string &guildId,
+                                     const std::string &userId,
+                                     MemberCallback cb);
 
   void triggerTypingIndicator(const std::string &channelId);
   std::vector<TypingUser> getTypingUsers(const std::string &channelId);
@@ -2,6 +2,7 @@
 #define DISCORD_TYPES_H
 
 #include <cstdint>
+#include <ctime>
 #include <string>
 #include <vector>
 
@@ -172,6 +173,11 @@ struct Message {
   bool isForwarded = false;
   std::string originalAuthorName;
   std::string originalAuthorAvatar;
+
+  // Filled once by MessageUtils::stampMessage; 0 means "no known time"
+  // (pending/failed sends, forum thread rows). The local day is not stored:
+  // MessageUtils::getLocalDay derives it with the current timezone setting.
+  time_t epoch = 0;
 };
 
 } // namespace Discord
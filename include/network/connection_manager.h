@@ -0,0 +1,81 @@
+#ifndef CONNECTION_MANAGER_H
+#define CONNECTION_MANAGER_H
+
+#include <3ds.h>
+#include <atomic>
+#include <curl/curl.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace Network {
+
+class HttpClient;
+
+// Looks after the connections NetworkManager's transfers reuse. On start()
+// it resolves and connects to the hosts the app talks to most, on its own
+// thread so this overlaps logging in and the gateway connect; the
+// connections go into the share handle's pool for the first real requests
+// to pick up. The addresses those hosts resolve to are kept on SD so the
+// next launch can skip the lookups.
+//
+// It also watches how pooled connections fare: once a reused one has
+// failed, or the console has slept, a host's pooled connections are not
+// trusted again until a new one to it has worked.
+class ConnectionManager {
+public:
+  ConnectionManager() = default;
+  ~ConnectionManager();
+
+  // share is the handle whose connection pool the transfers use.
+  void start(CURLSH *share);
+  void stop();
+
+  // Whether a transfer to url should open a new connection instead of
+  // reusing one from the pool.
+  bool needsFreshConnection(const std::string &url);
+  // Reports how a finished transfer on easy went. True if it failed on a
+  // reused connection in a way a new connection may well fix.
+  bool noteTransfer(const std::string &url, CURLcode result, CURL *easy);
+  // Stops trusting every pooled connection.
+  void invalidateAll();
+
+  // url's host, without the scheme or port.
+  static std::string hostOf(const std::string &url);
+
+private:
+  ConnectionManager(const ConnectionManager &) = delete;
+  ConnectionManager &operator=(const ConnectionManager &) = delete;
+
+  struct DnsEntry {
+    std::string address;
+    u64 expires = 0; // osGetTime()
+  };
+
+  static void aptHookCallback(APT_HookType hook, void *param);
+
+  void warmLoop();
+  void loadDns();
+  void saveDns();
+
+  std::map<std::string, DnsEntry> dns; // warmed hosts only
+  bool dnsDirty = false;
+  std::map<std::string, bool> suspect; // host -> pooled connections suspect
+  std::mutex mutex;
+
+  std::unique_ptr<HttpClient> warmClient; // template for warm-up handles
+  std::thread warmThread;
+  std::atomic<bool> stopWarm{false};
+  aptHookCookie hookCookie;
+  bool hooked = false;
+
+  // The resolver reports no TTLs, so saved answers get a fixed lifetime;
+  // warming up checks them each launch.
+  static constexpr u64 DNS_LIFETIME_MS = 12ull * 60 * 60 * 1000;
+};
+
+} // namespace Network
+
+#endif // CONNECTION_MANAGER_H
@@ -0,0 +1,117 @@
+#ifndef HTTP_CACHE_H
+#define HTTP_CACHE_H
+
+#include "network/http_client.h"
+#include <3ds.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace Network {
+
+// SD-card cache of GET responses, keyed by the request's URL and headers (so
+// each account's token gets its own entries). Only hashes of the keys reach
+// the card, never the tokens in them. What is kept, and for how
+// long it may be served without asking the server, follows the response's
+// Cache-Control, ETag and Last-Modified headers. The index lives in memory,
+// so the lookups never touch the card; bodies are read and written on one
+// background thread, reads first.
+class HttpCache {
+public:
+  static HttpCache &getInstance();
+
+  using LoadCallback = std::function<void(bool found, std::string &body)>;
+
+  void init();
+  void shutdown();
+
+  // Whether key has an entry that can be served without asking the server.
+  bool isFresh(const std::string &key);
+  // Adds If-None-Match/If-Modified-Since for key's entry to headers; false
+  // if there is no entry to revalidate.
+  bool addValidators(const std::string &key,
+                     std::map<std::string, std::string> &headers);
+
+  // Reads key's body on the worker thread. If that fails the entry is
+  // dropped and done gets found == false. done never runs on the calling
+  // thread; false, without it ever running, if the cache is not running.
+  bool load(const std::string &key, LoadCallback done);
+
+  // Keeps a 200 response to key if its headers allow it, moving the body
+  // out of response to be written in the background.
+  void store(const std::string &key, HttpResponse &response);
+  // After a 304 for key: its entry is fresh again for as long as headers
+  // say.
+  void refresh(const std::string &key,
+               const std::map<std::string, std::string> &headers);
+  // Drops every entry, e.g. when the account they were fetched with goes.
+  void clear();
+
+private:
+  HttpCache() = default;
+  ~HttpCache();
+  HttpCache(const HttpCache &) = delete;
+  HttpCache &operator=(const HttpCache &) = delete;
+
+  struct IndexEntry {
+    u32 size = 0;
+    u64 lastAccess = 0;
+    u64 freshUntil = 0; // osGetTime()
+    std::string etag;
+    std::string lastModified;
+  };
+
+  struct Job {
+    u64 hash = 0;
+    u64 check = 0; // checkKey() of the key
+    u32 generation = 0;
+    bool isWrite = false;
+    IndexEntry entry; // writes
+    std::string body; // writes
+    LoadCallback done;
+  };
+
+  static u64 hashKey(const std::string &key);
+  static u64 checkKey(const std::string &key);
+  static std::string pathFor(u64 hash);
+  static bool policyOf(const std::map<std::string, std::string> &headers,
+                       u64 now, IndexEntry &entry);
+
+  void workerLoop();
+  void runLoad(Job &job);
+  void runWrite(Job &job);
+  void evictIfNeeded();
+  void loadIndex();
+  void saveIndex();
+  void removeAllFiles();
+  void removeOrphans();
+
+  std::unordered_map<u64, IndexEntry> index;
+  u64 totalBytes = 0;
+  bool indexDirty = false;
+  u64 lastIndexSave = 0;
+  u32 generation = 0; // bumped by clear(); older writes are thrown away
+
+  std::deque<Job> loads;
+  std::deque<Job> writes;
+  size_t queuedWriteBytes = 0;
+  std::mutex mutex;
+  std::condition_variable jobCv;
+  std::thread worker;
+  std::atomic<bool> stopWorker{false};
+  bool ready = false;
+
+  static constexpr u64 MAX_DISK_BYTES = 16ull * 1024 * 1024;
+  static constexpr size_t MAX_ENTRY_BYTES = 1024 * 1024;
+  static constexpr size_t MAX_QUEUED_WRITE_BYTES = 2 * 1024 * 1024;
+};
+
+} // namespace Network
+
+#endif // HTTP_CACHE_H
@@ -1,6 +1,7 @@
 #ifndef HTTP_CLIENT_H
 #define HTTP_CLIENT_H
 
+#include <cstdio>
 #include <curl/curl.h>
 #include <map>
 #include <string>
@@ -8,14 +9,68 @@
 
 namespace Network {
 
+// Takes a response body as it downloads, in place of HttpResponse::body.
+class ResponseSink {
+public:
+  virtual ~ResponseSink() = default;
+  // The Content-Length, when the server sends one, ahead of the data. Called
+  // again for each response if the request is redirected.
+  virtual void expect(size_t length) { (void)length; }
+  // False aborts the transfer.
+  virtual bool write(const char *data, size_t size) = 0;
+};
+
+// Writes into a buffer the caller owns; a body that does not fit fails the
+// transfer.
+class BufferSink : public ResponseSink {
+public:
+  BufferSink(void *buffer, size_t capacity)
+      : buffer(static_cast<char *>(buffer)), capacity(capacity) {}
+  bool write(const char *data, size_t size) override;
+  size_t size() const { return used; }
+
+private:
+  char *buffer;
+  size_t capacity;
+  size_t used = 0;
+};
+
+// Streams the body to a file, so it never has to be held in memory.
+class FileSink : public ResponseSink {
+public:
+  explicit FileSink(const std::string &path);
+  ~FileSink();
+  bool write(const char *data, size_t size) override;
+  bool isOpen() const { return file != nullptr; }
+  // Flushes and closes the file; false if any write failed.
+  bool close();
+
+private:
+  FILE *file;
+  bool failed = false;
+};
+
 struct HttpResponse {
   long statusCode;
   std::string body;
   std::map<std::string, std::string> headers;
   bool success;
   std::string error;
+  // Set while other callbacks still have to read this same response (see
+  // NetworkManager's request coalescing).
+  bool shared = false;
+  // Where the body went instead of body, if anywhere; not owned.
+  ResponseSink *sink = nullptr;
+
+  // The body, moved out unless the response is shared.
+  std::string takeBody() { return shared ? body : std::move(body); }
 };
 
+// The value of header name, or null. libcurl hands headers over in whatever
+// case the server used.
+const std::string *findHeader(const std::map<std::string, std::string> &headers,
+                              const char *name);
+
 class HttpClient {
 public:
   HttpClient();
@@ -43,6 +98,18 @@ public:
   void setVerifySSL(bool verify);
   void setShareHandle(CURLSH *share);
 
+  // For transfers driven elsewhere (a curl multi loop): a new easy handle
+  // with this client's connection options, request setup on such a handle
+  // the way get()/post() do it, and reading the result back once done. The
+  // returned header list, body and response must outlive the transfer.
+  CURL *duplicateHandle() const;
+  struct curl_slist *
+  prepare(CURL *handle, const std::string &url, const std::string &method,
+          const std::string &body,
+          const std::map<std::string, std::string> &extraHeaders,
+          HttpResponse &response);
+  static void finish(CURL *handle, CURLcode result, HttpResponse &response);
+
   void clearHeaders();
   void updateSuperProperties();
 
@@ -59,13 +126,16 @@ private:
                  const std::string &body = "",
                  const std::map<std::string, std::string> &extraHeaders = {});
   void setupCurl(const std::string &url);
-  void setupHeaders(struct curl_slist **headers,
+  void setupHeaders(CURL *handle, struct curl_slist **headers,
                     const std::map<std::string, std::string> &extraHeaders);
 
   static size_t writeCallback(void *contents, size_t size, size_t nmemb,
                               void *userp);
   static size_t headerCallback(char *buffer, size_t size, size_t nitems,
                                void *userdata);
+
+  // Content-Length beyond this is not trusted for reserving the body.
+  static const size_t MAX_BODY_RESERVE = 4 * 1024 * 1024;
 };
 
 } // namespace Network
@@ -1,32 +1,78 @@
 #ifndef NETWORK_MANAGER_H
 #define NETWORK_MANAGER_H
 
+#include "network/connection_manager.h"
 #include "network/http_client.h"
+#include "network/rate_limiter.h"
+#include "network/request_log.h"
+#include "network/transfer_slots.h"
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <thread>
 #include <vector>
 
 namespace Network {
 
-enum class RequestPriority { REALTIME, INTERACTIVE, BACKGROUND };
+// May take the body with HttpResponse::takeBody() rather than copy it.
+using ResponseCallback = std::function<void(HttpResponse &)>;
+
+struct RequestWaiter {
+  uint32_t id;
+  ResponseCallback callback;
+};
 
 struct AsyncRequest {
+  uint32_t id = 0;
   std::string url;
   std::string method;
   std::string body;
   std::map<std::string, std::string> headers;
   RequestPriority priority;
-  std::function<void(const HttpResponse &)> callback;
+  ResponseCallback callback;
+  uint64_t enqueuedAt = 0; // osGetTime()
+  uint64_t deadline = 0;   // osGetTime() it should start by; 0 for none
+  uint64_t notBefore = 0;  // osGetTime() before which it may not start
+  int attempts = 0;
+  bool freshConnect = false; // retrying after a dead pooled connection
+  bool useCache = false;     // answered from and stored in HttpCache
+  std::shared_ptr<ResponseSink> sink;
+  std::string coalesceKey; // set for GETs without a sink
+  // Identical GETs enqueued while this one was pending; they get the same
+  // response object, and one of them takes over if this one is cancelled.
+  std::vector<RequestWaiter> joined;
 
   bool operator<(const AsyncRequest &other) const {
     return priority > other.priority;
   }
 };
 
+// Refers to a request passed to NetworkManager::enqueue(). Copies refer to
+// the same request, and dropping one does not cancel it.
+class RequestHandle {
+public:
+  RequestHandle() = default;
+  explicit RequestHandle(uint32_t id) : requestId(id) {}
+
+  // See NetworkManager::cancel(). The handle is empty afterwards.
+  bool cancel();
+  bool setPriority(RequestPriority priority);
+  bool setDeadline(uint32_t withinMs);
+  // Until its callback has run or it has been cancelled.
+  bool isPending() const;
+
+  uint32_t id() const { return requestId; }
+  explicit operator bool() const { return requestId != 0; }
+
+private:
+  uint32_t requestId = 0;
+};
+
 class NetworkManager {
 public:
   static NetworkManager &getInstance() {
@@ -34,36 +80,162 @@ public:
     return instance;
   }
 
-  void init(int interactiveCount = 1, int backgroundCount = 2);
+  // Queued requests start earliest due first, in the shares of transfers
+  // that TransferSlots gives each class.
+  void init(int interactiveLimit = 6, int backgroundLimit = 2);
   void shutdown();
 
-  void enqueue(const std::string &url, const std::string &method,
-               const std::string &body, RequestPriority priority,
-               std::function<void(const HttpResponse &)> callback,
-               const std::map<std::string, std::string> &extraHeaders = {});
+  // A GET identical (URL and headers) to one already queued or in flight
+  // joins it instead of starting another transfer. With a sink the body is
+  // written there as it arrives instead of into HttpResponse::body.
+  RequestHandle enqueue(const std::string &url, const std::string &method,
+                        const std::string &body, RequestPriority priority,
+                        ResponseCallback callback,
+                        const std::map<std::string, std::string> &extraHeaders =
+                            {},
+                        std::shared_ptr<ResponseSink> sink = nullptr);
+  // A GET that also goes through HttpCache: a fresh entry is served from
+  // the SD card, a stale one is revalidated and a 304 comes back as a 200
+  // with the stored body. For Discord API reads; images have their own
+  // caches and should not pay for a second copy on the card.
+  RequestHandle enqueueCached(const std::string &url, RequestPriority priority,
+                              ResponseCallback callback,
+                              const std::map<std::string, std::string>
+                                  &extraHeaders = {});
+
+  // Drops a queued request, aborts its transfer if it has started, or
+  // drops its response if that is still waiting for the callback thread.
+  // Once this returns the callback is not running and never will, so
+  // callers may free what it captured; a callback that is running is
+  // waited for unless it is the one calling. False if it had completed.
+  bool cancel(uint32_t id);
+  // Changes the class of a request that is still queued, e.g. to raise one
+  // whose content has scrolled into view. Its due time counts from when it
+  // was enqueued, so a raised request keeps the age it has built up.
+  bool setPriority(uint32_t id, RequestPriority priority);
+  // Asks for a queued request to start within withinMs; only ever brings
+  // its due time forward.
+  bool setDeadline(uint32_t id, uint32_t withinMs);
+  bool isPending(uint32_t id);
+
+  struct CancelStats {
+    uint32_t dequeued = 0; // cancelled before they started
+    uint32_t aborted = 0;  // cancelled mid-transfer
+    uint64_t abortedBytes = 0;
+  };
+  CancelStats getCancelStats();
+
+  struct TransferStats {
+    uint32_t active = 0;
+    uint32_t queued = 0;
+    uint32_t coalesced = 0;   // GETs served by another's transfer
+    uint32_t rateLimited = 0; // 429s received
+    uint32_t staleRetries = 0; // GETs resent after a dead pooled connection
+    uint32_t cacheHits = 0;   // served from HttpCache without a transfer
+    uint32_t revalidated = 0; // 304s answered from HttpCache
+    uint64_t cacheBytesSaved = 0;
+  };
+  TransferStats getTransferStats();
+
+  // Timings of the latest transfers, oldest first, and per-host totals.
+  std::vector<RequestTiming> getRecentTimings(size_t count);
+  std::vector<HostTiming> getHostTimings();
+  // Writes every timing still held to path as CSV.
+  bool dumpTimings(const std::string &path);
 
   void get(const std::string &url, RequestPriority priority,
-           std::function<void(const HttpResponse &)> callback);
+           ResponseCallback callback);
   void post(const std::string &url, const std::string &body,
             RequestPriority priority,
-            std::function<void(const HttpResponse &)> callback);
+            ResponseCallback callback);
 
 private:
   NetworkManager();
   ~NetworkManager();
 
-  void workerThread(RequestPriority type);
-
-  std::vector<std::thread> interactiveWorkers;
-  std::vector<std::thread> backgroundWorkers;
-
-  std::queue<AsyncRequest> realtimeQueue;
-  std::queue<AsyncRequest> interactiveQueue;
-  std::queue<AsyncRequest> backgroundQueue;
+  struct Transfer {
+    AsyncRequest req;
+    CURL *easy = nullptr;
+    struct curl_slist *headers = nullptr;
+    HttpResponse response;
+    bool abort = false;
+    TransferSlots::Share share = TransferSlots::Share::NONE;
+    std::string route; // empty if not rate limited
+    std::string bucketKey;
+    uint64_t startedAt = 0; // osGetTime()
+  };
+
+  struct Completion {
+    std::vector<RequestWaiter> waiters;
+    HttpResponse response;
+    std::string cacheKey; // to offer the response to HttpCache under
+  };
+
+  // A request answered by HttpCache, waiting for its body to be read.
+  struct CacheRead {
+    AsyncRequest req;
+    HttpResponse response; // a 304's, or empty for a fresh entry
+  };
+
+  // All transfers run on one curl multi handle, driven by eventLoop();
+  // callbacks run on callbackThread so a slow one never stalls the sockets.
+  void eventLoop();
+  void callbackLoop();
+  void admit();
+  void start(AsyncRequest &&req, const std::string &route,
+             const std::string &bucketKey, TransferSlots::Share share);
+  void complete(Transfer *transfer, CURLcode result);
+  void reapAborted();
+  bool join(AsyncRequest &req);
+  void forgetGet(const std::string &coalesceKey);
+  static Completion completionFor(AsyncRequest &req, HttpResponse &&response);
+  static uint64_t dueOf(const AsyncRequest &req);
+  void schedule(AsyncRequest &&req);
+  RequestHandle add(AsyncRequest &&req);
+  bool readCache(AsyncRequest &req, HttpResponse &response);
+  void finishCacheRead(const std::string &key, bool found, std::string &body);
+
+  std::thread loopThread;
+  std::thread callbackThread;
+  CURLM *multi = nullptr;
+  std::unique_ptr<HttpClient> client; // template for transfer handles
+  std::vector<CURL *> idleHandles;
+  std::vector<std::unique_ptr<Transfer>> transfers;
+  int interactiveLimit = 6;
+  int backgroundLimit = 2;
+  TransferSlots slots;
+  int pollTimeoutMs = 1000;
+  // Until the next held-back request may start, or -1 if none is waiting
+  // on time. Loop thread only.
+  int64_t admitWaitMs = -1;
+  RateLimiter limiter;
+  ConnectionManager connections;
+  RequestLog requestLog;
+  static const int MAX_RATE_LIMIT_RETRIES = 3;
+  static const long STALL_SECONDS = 5;
+
+  std::deque<AsyncRequest> queue; // ordered by dueOf()
+  std::vector<CacheRead> cacheReads;
+  uint32_t nextRequestId = 1;
+  CancelStats cancelStats;
+  // coalesceKey -> requests pending with it, to skip the search in join()
+  // for the common case of no duplicate.
+  std::map<std::string, int> pendingGets;
+  uint32_t coalescedCount = 0;
+  uint32_t staleRetries = 0;
+  uint32_t cacheHits = 0;
+  uint32_t revalidatedCount = 0;
+  uint64_t cacheBytesSaved = 0;
 
   std::mutex mutex;
-  std::condition_variable condition;
-  bool stop;
+  std::atomic<bool> stop;
+
+  std::deque<Completion> completions;
+  std::mutex completionMutex;
+  std::condition_variable completionReady;
+  // Ids whose callbacks callbackThread is running, for cancel() to wait on.
+  std::vector<uint32_t> runningIds;
+  std::condition_variable callbacksDone;
 
   CURLSH *curlShare;
   std::mutex dnsMutex;
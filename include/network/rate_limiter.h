@@ -0,0 +1,64 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace Network {
+
+// Discord REST rate limits, tracked the way the API documents them: each
+// route (method plus path with the major parameters kept) maps to a bucket
+// learned from X-RateLimit-Bucket, and each bucket has a limit that refills
+// at X-RateLimit-Reset-After. A route seen for the first time gets one
+// request in flight until its headers arrive. On top of that sits the
+// global limit of 50 requests a second. Requests to the CDN are not
+// limited. Not thread-safe; NetworkManager calls it with its lock held.
+class RateLimiter {
+public:
+  // Empty for URLs that are not rate limited.
+  static std::string routeOf(const std::string &method,
+                             const std::string &url);
+
+  // Takes a slot in route's bucket and the global limit, returning the
+  // bucket's key for release(). When there is no slot, returns an empty
+  // string and sets waitMs to the time until one frees up (0 if that waits
+  // on a request in flight). Background requests leave the last slot of a
+  // bucket for interactive ones.
+  std::string acquire(const std::string &route, bool background, uint64_t now,
+                      uint64_t &waitMs);
+  // Returns the slot and learns from the response headers. For a 429
+  // returns how long to wait before retrying, otherwise 0.
+  uint64_t release(const std::string &bucketKey, const std::string &route,
+                   long statusCode,
+                   const std::map<std::string, std::string> &headers,
+                   uint64_t now);
+  // Returns a slot whose request never got a response.
+  void release(const std::string &bucketKey);
+
+  uint32_t getLimitedCount() const { return limitedCount; }
+
+private:
+  struct Bucket {
+    int limit = 1;
+    int remaining = 1;
+    int inFlight = 0;
+    uint64_t resetAt = 0; // when remaining refills to limit; 0 if unknown
+  };
+
+  std::string bucketKeyFor(const std::string &route) const;
+  void prune(uint64_t now);
+
+  std::map<std::string, std::string> routeBuckets; // route -> bucket hash
+  std::map<std::string, Bucket> buckets;
+  uint64_t globalUntil = 0;
+  double globalTokens = GLOBAL_PER_SECOND;
+  uint64_t globalRefilledAt = 0;
+  uint32_t limitedCount = 0; // 429s seen
+
+  static constexpr double GLOBAL_PER_SECOND = 50.0;
+};
+
+} // namespace Network
+
+#endif // RATE_LIMITER_H
@@ -0,0 +1,77 @@
+#ifndef REQUEST_LOG_H
+#define REQUEST_LOG_H
+
+#include <curl/curl.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Network {
+
+enum class RequestPriority;
+
+// How one transfer went. The phase ends are curl's, in microseconds from
+// when the transfer started; on a reused connection the lookup, connect and
+// TLS phases take no time.
+struct RequestTiming {
+  std::string method;
+  std::string url;
+  RequestPriority priority;
+  long status = 0; // 0 if there was no response
+  CURLcode result = CURLE_OK;
+  bool newConnection = false;
+  uint64_t enqueuedAt = 0; // osGetTime()
+  uint64_t startedAt = 0;  // osGetTime()
+  uint32_t dnsEndUs = 0;
+  uint32_t connectEndUs = 0;
+  uint32_t tlsEndUs = 0;
+  uint32_t firstByteUs = 0;
+  uint32_t totalUs = 0;
+  uint64_t bytes = 0;
+
+  uint32_t queueMs() const { return (uint32_t)(startedAt - enqueuedAt); }
+};
+
+// Totals for every transfer to one host since startup.
+struct HostTiming {
+  std::string host;
+  uint32_t requests = 0;
+  uint32_t failures = 0; // no response, or a 5xx
+  uint32_t newConnections = 0;
+  uint64_t queueMs = 0;
+  uint64_t firstByteUs = 0;
+  uint64_t totalUs = 0;
+  uint32_t maxTotalUs = 0;
+  uint64_t bytes = 0;
+};
+
+// The last HISTORY transfers NetworkManager ran, for the network page of
+// the debug overlay and the CSV dump. Not thread-safe; NetworkManager calls
+// it with its lock held.
+class RequestLog {
+public:
+  // Reads the timings of a finished transfer off easy.
+  void record(CURL *easy, const std::string &method, const std::string &url,
+              RequestPriority priority, long status, CURLcode result,
+              uint64_t enqueuedAt, uint64_t startedAt);
+
+  // Up to count of the latest transfers, oldest first.
+  std::vector<RequestTiming> recent(size_t count) const;
+  // Busiest host first.
+  std::vector<HostTiming> hosts() const;
+
+  static bool writeCsv(const std::string &path,
+                       const std::vector<RequestTiming> &timings);
+
+  static const size_t HISTORY = 256;
+
+private:
+  std::vector<RequestTiming> ring;
+  size_t next = 0; // slot the next record() fills once the ring is full
+  std::map<std::string, HostTiming> hostTotals;
+};
+
+} // namespace Network
+
+#endif // REQUEST_LOG_H
@@ -0,0 +1,53 @@
+#ifndef TRANSFER_SLOTS_H
+#define TRANSFER_SLOTS_H
+
+#include <cstdint>
+
+namespace Network {
+
+enum class RequestPriority { REALTIME, INTERACTIVE, BACKGROUND };
+
+// When a queued request is due and which transfer slots it may take.
+//
+// A request is due a fixed slack after it was enqueued (none for REALTIME,
+// INTERACTIVE_SLACK_MS, BACKGROUND_SLACK_MS) or at its deadline if that is
+// sooner, so one that has waited long enough outranks anything enqueued
+// since and nothing waits forever.
+//
+// The limits cap each class's share of transfers. REALTIME requests always
+// start at once; INTERACTIVE ones share interactiveLimit with them;
+// BACKGROUND ones get backgroundLimit of their own, and once overdue may
+// also borrow up to half of the interactive slots. Not thread-safe;
+// NetworkManager calls it with its lock held.
+class TransferSlots {
+public:
+  enum class Share { NONE, URGENT, BACKGROUND, BORROWED };
+
+  static const uint64_t INTERACTIVE_SLACK_MS = 250;
+  static const uint64_t BACKGROUND_SLACK_MS = 4000;
+
+  // deadline is 0 for none.
+  static uint64_t dueAt(RequestPriority priority, uint64_t enqueuedAt,
+                        uint64_t deadline);
+
+  void setLimits(int interactiveLimit, int backgroundLimit);
+  // The share a request may start in now, or NONE. A background request
+  // that could borrow a slot once it is due gets the time until then in
+  // waitMs.
+  Share shareFor(RequestPriority priority, uint64_t due, uint64_t now,
+                 uint64_t &waitMs) const;
+  void take(Share share);
+  void give(Share share);
+  void reset();
+
+private:
+  int interactiveLimit = 6;
+  int backgroundLimit = 2;
+  int urgent = 0;     // REALTIME and INTERACTIVE transfers
+  int background = 0; // in the backgroundLimit share
+  int borrowed = 0;   // BACKGROUND transfers in the interactive share
+};
+
+} // namespace Network
+
+#endif // TRANSFER_SLOTS_H
@@ -0,0 +1,50 @@
+#ifndef TRUST_STORE_H
+#define TRUST_STORE_H
+
+#include <atomic>
+#include <curl/curl.h>
+#include <mutex>
+
+struct mbedtls_x509_crt;
+
+namespace Network {
+
+// The CA roots every TLS connection is verified against, parsed once and
+// shared by all of them. It starts with just the roots Discord's hosts chain
+// to (cut from the full Mozilla bundle at build time) and moves to the full
+// bundle for good the first time a certificate fails to verify against
+// those. Without it curl's mbedTLS backend parses the whole bundle again for
+// every connection and keeps a copy per connection it holds open.
+class TrustStore {
+public:
+  static TrustStore &getInstance();
+
+  // The current roots, parsed on first use; null if none could be loaded.
+  // A parsed chain is never freed, so a pointer handed out stays valid.
+  mbedtls_x509_crt *roots();
+  // Switches to the full bundle after a verification failure. True if it
+  // did, so retrying the connection may now succeed.
+  bool widen();
+
+  // Makes handle verify against roots(), or against the full bundle file
+  // if curl's TLS backend can't take a shared chain.
+  void configure(CURL *handle);
+
+private:
+  TrustStore() = default;
+  TrustStore(const TrustStore &) = delete;
+  TrustStore &operator=(const TrustStore &) = delete;
+
+  static mbedtls_x509_crt *load(const char *path);
+  static CURLcode sslContextCallback(CURL *curl, void *sslContext,
+                                     void *userptr);
+
+  std::atomic<mbedtls_x509_crt *> active{nullptr};
+  bool loaded = false;
+  bool widened = false;
+  std::mutex mutex;
+};
+
+} // namespace Network
+
+#endif // TRUST_STORE_H
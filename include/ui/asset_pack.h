@@ -0,0 +1,71 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include "ui/texture_cache.h"
+#include <3ds.h>
+#include <citro2d.h>
+#include <string>
+#include <vector>
+
+namespace UI {
+
+// Read-only view of a pack built by tools/assetpack.cpp: pre-tiled,
+// compressed texture sheets plus an index sorted by key. open() reads only
+// the index, so a lookup is a binary search that never touches the
+// filesystem. A sheet is inflated on a DecodePool worker the first time one
+// of its images is asked for and then lives in TextureCache as
+// "<name>:<sheet>", so it is budgeted and evicted like any other texture.
+// Main thread only.
+class AssetPack {
+public:
+  AssetPack(const std::string &name, TextureClass cls)
+      : name(name), cls(cls) {}
+  ~AssetPack() { close(); }
+
+  bool open(const std::string &path);
+  void close();
+  bool isOpen() const { return !entries.empty(); }
+
+  // Index of key, or -1.
+  int find(const std::string &key) const;
+  // The image at index, or an empty image while its sheet is loading.
+  C2D_Image getImage(int index);
+
+  size_t size() const { return entries.size(); }
+  size_t sheetCount() const { return sheets.size(); }
+
+private:
+  AssetPack(const AssetPack &) = delete;
+  AssetPack &operator=(const AssetPack &) = delete;
+
+  struct Sheet {
+    u16 w, h;
+    GPU_TEXCOLOR format;
+    u32 offset;
+    u32 packedSize;
+    u32 rawSize;
+    bool loading = false;
+  };
+
+  struct Entry {
+    u32 keyOffset;
+    u16 keyLength;
+    u16 sheet;
+  };
+
+  static Utils::Image::TiledData loadSheet(const std::string &path,
+                                           const Sheet &sheet);
+  std::string sheetKey(int sheet) const;
+
+  std::string name;
+  TextureClass cls;
+  std::string path;
+  std::vector<Sheet> sheets;
+  std::vector<Entry> entries;
+  std::vector<Tex3DS_SubTexture> subtextures; // parallel to entries
+  std::string keys;
+};
+
+} // namespace UI
+
+#endif // ASSET_PACK_H
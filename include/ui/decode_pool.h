@@ -0,0 +1,106 @@
+#ifndef DECODE_POOL_H
+#define DECODE_POOL_H
+
+#include "network/network_manager.h"
+#include "utils/image_utils.h"
+#include <3ds.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace UI {
+
+// Every image decode (attachments, avatars, emoji) runs here rather than on
+// network or disk threads. One worker per spare core: two on New 3DS (one on
+// the extra core), one on Old 3DS, all below the main thread's priority.
+// Jobs are taken visible-first, then by request priority, then FIFO. Results
+// are handed back on the main thread in update(), where it is safe to create
+// textures; that step is also the one upload scheduler for every texture
+// source, limited per frame by time and bytes and visible-first again.
+class DecodePool {
+public:
+  static DecodePool &getInstance();
+
+  // Runs on the main thread and owns tiled.pixels; empty data on failure.
+  using DoneCallback = std::function<void(Utils::Image::TiledData &tiled)>;
+
+  struct Job {
+    std::string key; // texture cache key, matched against markVisible()
+    std::string data;
+    // If set, runs on the worker in place of decoding data.
+    std::function<Utils::Image::TiledData()> produce;
+    std::string diskKey; // if set, the result is also written to SD
+    Network::RequestPriority priority = Network::RequestPriority::BACKGROUND;
+    const void *owner = nullptr;
+    DoneCallback done;
+  };
+
+  void init();
+  void shutdown();
+
+  void submit(Job job);
+  // Queues already-decoded data (e.g. an SD cache hit) for the main thread.
+  void deliver(const std::string &key, const void *owner,
+               Utils::Image::TiledData &tiled, DoneCallback done);
+
+  // Called while drawing; jobs for keys seen last frame jump the queue.
+  void markVisible(const std::string &key);
+  // Drops queued jobs and undelivered results submitted by owner.
+  void cancel(const void *owner);
+
+  // Main thread: runs finished callbacks within the upload budget.
+  void update();
+
+  struct UploadStats {
+    u32 textures = 0;
+    u64 bytes = 0;
+    u64 ticks = 0;        // time spent in upload callbacks
+    u32 worstFrameUs = 0; // longest single update()
+  };
+  UploadStats getUploadStats();
+
+  int getWorkerCount() const { return (int)workers.size(); }
+  size_t getQueuedCount();
+
+private:
+  DecodePool() = default;
+  ~DecodePool();
+  DecodePool(const DecodePool &) = delete;
+  DecodePool &operator=(const DecodePool &) = delete;
+
+  struct Result {
+    std::string key;
+    const void *owner = nullptr;
+    Utils::Image::TiledData tiled;
+    DoneCallback done;
+  };
+
+  static void workerEntry(void *arg);
+  void workerLoop();
+  bool popBest(Job &out);
+  bool popUpload(size_t bytesUsed, bool first, Result &out);
+
+  std::deque<Job> jobs;
+  std::deque<Result> results;
+  std::unordered_set<std::string> visibleKeys;
+  std::unordered_set<std::string> frameVisible;
+  std::mutex mutex;
+  std::condition_variable jobCv;
+  std::vector<Thread> workers;
+  std::atomic<bool> stopWorkers{false};
+  UploadStats stats;
+
+  static constexpr size_t WORKER_STACK_SIZE = 128 * 1024;
+  // Roughly a fifth of a 60 fps frame, and one 512x512 RGB565 image.
+  static constexpr u32 UPLOAD_BUDGET_US = 3000;
+  static constexpr size_t UPLOAD_BUDGET_BYTES = 512 * 1024;
+};
+
+} // namespace UI
+
+#endif // DECODE_POOL_H
@@ -1,10 +1,10 @@
 #ifndef EMOJI_MANAGER_H
 #define EMOJI_MANAGER_H
 
+#include "ui/asset_pack.h"
 #include <citro2d.h>
-#include <map>
 #include <mutex>
-#include <shared_mutex>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -20,12 +20,17 @@ public:
 
   struct EmojiInfo {
     C3D_Tex *tex = nullptr;
+    C2D_Image image = {}; // a region of an atlas page or twemoji sheet
     int originalW = 0;
     int originalH = 0;
   };
 
   EmojiInfo getEmojiInfo(const std::string &emojiId);
+  // Unicode emoji come from the twemoji pack, keyed by codepoint sequence
+  // ("1f44d-1f3fd"). While a sheet is still loading the info is empty but
+  // hasTwemoji() is already true, so layout can reserve the space.
   EmojiInfo getTwemojiInfo(const std::string &codepointHex);
+  bool hasTwemoji(const std::string &codepointHex) const;
 
   void prefetchEmoji(const std::string &emojiId);
   void prefetchEmojisFromText(const std::string &text);
@@ -34,9 +39,14 @@ private:
   EmojiManager() = default;
   ~EmojiManager();
 
-  std::map<std::string, EmojiInfo> emojiCache;
-  std::map<std::string, EmojiInfo> twemojiCache;
-  std::shared_mutex cacheMutex;
+  // Custom emoji live in TextureCache under "emoji:<id>".
+  static EmojiInfo lookup(const std::string &key);
+  int findTwemoji(const std::string &codepointHex) const;
+
+  AssetPack twemoji{"twemoji", TextureClass::SHEET};
+
+  std::set<std::string> requestedEmoji;
+  std::mutex cacheMutex;
 };
 
 } // namespace UI
@@ -44,6 +44,8 @@ private:
   static const int REPEAT_DELAY_CONTINUOUS = 6;
 
   bool isLoading;
+  // The thread fetch under way; its callbacks capture this.
+  std::vector<Network::RequestHandle> requests;
 
   void fetchThreads();
   void renderThreadCard(int index, float y);
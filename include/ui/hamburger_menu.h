@@ -1,6 +1,7 @@
 #ifndef HAMBURGER_MENU_H
 #define HAMBURGER_MENU_H
 
+#include "ui/render_layer.h"
 #include <citro2d.h>
 #include <string>
 #include <vector>
@@ -27,7 +28,7 @@ public:
   ~HamburgerMenu() = default;
 
   void update();
-  void render();
+  void render(C3D_RenderTarget *target);
 
   void toggle();
   void open();
@@ -38,6 +39,7 @@ public:
   }
   bool isClosed() const { return state == State::CLOSED; }
   void refreshStrings();
+  void shutdown() { panelLayer.release(); }
 
 private:
   enum class State {
@@ -66,6 +68,8 @@ private:
   void drawMenuItem(int index, float y, float alpha);
   void drawAccountCard(float x, float y, float alpha);
   bool accountCardSelected = false;
+
+  RenderLayer panelLayer;
 };
 
 } // namespace UI
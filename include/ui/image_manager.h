@@ -2,14 +2,13 @@
 #define IMAGE_MANAGER_H
 
 #include "network/network_manager.h"
+#include "ui/asset_pack.h"
+#include "ui/texture_cache.h"
 #include "utils/image_utils.h"
 #include <atomic>
 #include <citro2d.h>
-#include <deque>
-#include <list>
 #include <map>
 #include <mutex>
-#include <set>
 #include <string>
 #include <vector>
 
@@ -34,61 +33,67 @@ public:
   ImageInfo getImageInfo(const std::string &url);
 
   C3D_Tex *getLocalImage(const std::string &path, bool noResize = false);
+  // For "romfs:/discord-icons/..." paths: served from the icon pack, falling
+  // back to getLocalImage() for anything the pack lacks. Empty until loaded.
+  C2D_Image getLocalIcon(const std::string &path);
+
+  // Keeps url resident while the handle is held (e.g. while on screen).
+  TextureHandle pin(const std::string &url);
 
   void prefetch(
       const std::string &url, int origW = 0, int origH = 0,
       Network::RequestPriority priority = Network::RequestPriority::BACKGROUND);
 
-  void update();
+  // Abandons a download that is no longer wanted, whether queued or in
+  // flight. Disk loads and decodes already under way are left to finish.
+  void cancel(const std::string &url);
+  // Moves a queued download to another priority.
+  void reprioritize(const std::string &url,
+                    Network::RequestPriority priority);
+  bool isFetching(const std::string &url);
+
+  struct PrefetchStats {
+    uint64_t fetchedBytes = 0;   // downloaded image bodies
+    uint64_t displayedBytes = 0; // ...of which were drawn at least once
+    uint64_t unseenBytes = 0;    // ...dropped or failed before being drawn
+    uint32_t cancelled = 0;
+  };
+  PrefetchStats getPrefetchStats();
 
   void clear();
   void clearFailed(const std::string &url);
-  void clearRemote();
+  // Drops queued downloads and decodes; cached textures are kept.
+  void cancelPending();
   uint32_t getGeneration() const { return generation; }
 
 private:
   ImageManager() = default;
   ~ImageManager();
 
-  struct PendingTexture {
-    std::string url;
-    C3D_Tex *tex = nullptr;
-    Utils::Image::TiledData tiled;
-    int width = 0;
-    int height = 0;
-    bool success = false;
-  };
-
-  struct DecodeRequest {
-    std::string url;
-    std::string body;
-    int maxWidth = 512;
-    int maxHeight = 512;
-    int sessionId = 0;
-    Network::RequestPriority priority;
-  };
-
-  std::map<std::string, ImageInfo> textureCache;
-  std::list<std::string> lruList;
-  std::set<std::string> fetchingUrls;
-  std::deque<PendingTexture> pendingTextures;
-  std::deque<DecodeRequest> decodeQueue;
-
+  // Downloads under way, with their network request while one is queued
+  // or in flight (empty while reading from disk or decoding).
+  std::map<std::string, Network::RequestHandle> fetchingUrls;
   std::mutex cacheMutex;
-  std::mutex decodeMutex;
-  std::condition_variable decodeCv;
-  std::thread decoderThread;
-  std::atomic<bool> stopDecoder{false};
+
+  // Bytes of images downloaded but not drawn yet, for PrefetchStats. An
+  // entry lives until the image is drawn or dropped.
+  std::map<std::string, size_t> undisplayedBytes;
+  PrefetchStats prefetchStats;
 
   std::atomic<int> currentSessionId{0};
   std::atomic<uint32_t> generation{0};
 
-  static constexpr size_t MAX_CACHE_BYTES = 8 * 1024 * 1024; // 8MB
-  static constexpr size_t MIN_CACHE_ENTRIES = 8;
-  size_t currentCacheBytes = 0;
-  void touchImage(const std::string &url);
-  void evictOldest();
-  void decoderWorker();
+  AssetPack icons{"icons", TextureClass::LOCAL};
+
+  static TextureClass classifyUrl(const std::string &url);
+  static ImageInfo toImageInfo(const TextureCache::TextureInfo &info);
+  void markDisplayed(const std::string &url);
+  void markUnseen(const std::string &url);
+  void dropPending();
+  void fetchFromNetwork(const std::string &url, const std::string &requestUrl,
+                        int sessionId, Network::RequestPriority priority);
+  void onDecoded(const std::string &url, int sessionId,
+                 Utils::Image::TiledData &tiled);
 };
 
 } // namespace UI
@@ -3,7 +3,11 @@
 
 #include "discord/discord_client.h"
 #include "discord/types.h"
+#include "ui/prefetch_planner.h"
+#include "ui/render_layer.h"
 #include "ui/screen_manager.h"
+#include "ui/texture_cache.h"
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -21,6 +25,7 @@ public:
   void renderTop(C3D_RenderTarget *target) override;
   void renderBottom(C3D_RenderTarget *target) override;
   void onEnter() override;
+  void onExit() override;
 
 private:
   std::string channelId;
@@ -49,22 +54,58 @@ private:
 
   std::vector<float> messagePositions;
   std::vector<float> messageHeights;
+  std::vector<bool> messageShowsHeader;
+  std::vector<bool> messageHasDateSeparator;
   std::unordered_map<size_t, float> embedHeightCache;
   float targetScrollY;
   float currentScrollY;
   float totalContentHeight;
 
+  // Messages scrolled far out of view are dropped to stubs that keep only
+  // what layout needs; they are refetched when scrolled back into range.
+  struct MessageStub {
+    std::string id;
+    std::string authorId;
+    time_t epoch;
+    float height; // includes the date separator above the message, if any
+  };
+  std::deque<MessageStub> olderStubs;
+  std::deque<MessageStub> newerStubs;
+  float olderStubsHeight;
+  float newerStubsHeight;
+  bool isFetchingNewer;
+  // A page that failed to load is retried from here, keeping its stubs.
+  uint64_t olderRetryAt;
+  uint64_t newerRetryAt;
+  static const uint32_t PAGE_RETRY_MS = 2000;
+  static const size_t WINDOW_MAX_MESSAGES = 150;
+  static const size_t WINDOW_TRIM_BATCH = 50;
+
   bool isMenuOpen;
   int menuIndex;
   std::vector<std::string> menuOptions;
   std::vector<std::string> menuActions;
   std::set<std::string> pendingMemberFetches;
   std::map<std::string, uint64_t> failedMemberFetches;
-  std::shared_ptr<bool> aliveToken;
+  // Fetches whose callbacks capture this, cancelled on destruction.
+  std::vector<Network::RequestHandle> requests;
+  std::mutex requestMutex;
+  RenderLayer bottomLayer;
+  // Images of the rows drawn last frame; held so they can't be evicted.
+  std::vector<TextureHandle> visiblePins;
+  PrefetchPlanner prefetchPlanner;
+  float scrollVelocity;
+  float lastPlannedScrollY;
+  int planIdleUpdates;
   void renderMenu();
+  void planPrefetch();
 
   void fetchMessages();
   void fetchOlderMessages();
+  void fetchNewerMessages();
+  void jumpToLatest();
+  void trimMessageWindow();
+  MessageStub makeStub(size_t index) const;
   float drawMessage(const Discord::Message &msg, float y, float maxWidth,
                     bool isSelected, bool showHeader);
   float drawForumMessage(const Discord::Message &msg, float y, bool isSelected);
@@ -93,6 +134,7 @@ private:
   void rebuildLayoutCache();
   void ensureSelectionVisible();
   void catchUpMessages();
+  void track(Network::RequestHandle request);
 };
 
 } // namespace UI
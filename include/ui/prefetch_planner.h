@@ -0,0 +1,44 @@
+#ifndef PREFETCH_PLANNER_H
+#define PREFETCH_PLANNER_H
+
+#include "network/network_manager.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace UI {
+
+// Decides which off-screen images of a scrolling list to download. Each
+// update the screen hands over the images in and around the viewport with
+// their vertical extent: those up to a screen ahead in the direction of
+// travel are fetched as INTERACTIVE, further ones (sized by scroll speed) as
+// BACKGROUND, ones just passed are demoted to BACKGROUND, and downloads
+// started for images that have left the window are cancelled so they stop
+// competing for the link. Main thread only.
+class PrefetchPlanner {
+public:
+  struct Item {
+    std::string url;
+    int width = 0; // original size, for the resize query
+    int height = 0;
+    float top = 0.0f; // content coordinates
+    float bottom = 0.0f;
+  };
+
+  ~PrefetchPlanner() { reset(); }
+
+  // velocity is in content pixels per update, positive when scrolling down.
+  void plan(const std::vector<Item> &items, float viewTop, float viewHeight,
+            float velocity);
+  // Cancels every download the planner still has running.
+  void reset();
+
+  size_t trackedCount() const { return tracked.size(); }
+
+private:
+  std::map<std::string, Network::RequestPriority> tracked;
+};
+
+} // namespace UI
+
+#endif // PREFETCH_PLANNER_H
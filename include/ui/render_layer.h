@@ -0,0 +1,55 @@
+#pragma once
+#include <3ds.h>
+#include <citro2d.h>
+#include <citro3d.h>
+#include <functional>
+#include <string>
+
+namespace UI {
+
+// Off-screen cache for a region whose content only changes on navigation.
+// The region is rendered into a texture once per content key and then
+// composited as a single quad until the key changes.
+class RenderLayer {
+public:
+  RenderLayer(u16 width, u16 height);
+  ~RenderLayer();
+
+  // Draws the layer at (x, y). drawContent is only called when key differs
+  // from the cached one; it draws in layer coordinates onto clearColor. If
+  // the layer cannot be allocated, drawContent draws straight to target.
+  void draw(C3D_RenderTarget *target, u32 key, u32 clearColor, float x,
+            float y, float z, const std::function<void()> &drawContent,
+            float alpha = 1.0f);
+  void invalidate() { valid = false; }
+  // Frees the VRAM; the layer reallocates on its next draw.
+  void release();
+
+  static u32 hashKey(u32 seed, const std::string &value);
+  static u32 hashKey(u32 seed, u32 value);
+  // Folds in which bundled icons and twemoji sheets are loaded, so a layer
+  // drawn while one was still loading is redrawn once it arrives.
+  static u32 hashLoadedImages(u32 seed);
+
+  static size_t getRebuildCount() { return rebuildCount; }
+
+private:
+  RenderLayer(const RenderLayer &) = delete;
+  RenderLayer &operator=(const RenderLayer &) = delete;
+
+  bool allocate();
+
+  u16 width;
+  u16 height;
+  C3D_Tex tex;
+  C3D_RenderTarget *layerTarget;
+  Tex3DS_SubTexture subtex;
+  bool allocated;
+  bool allocationFailed;
+  bool valid;
+  u32 contentKey;
+
+  static size_t rebuildCount;
+};
+
+} // namespace UI
@@ -54,7 +54,7 @@ public:
   ScreenType getCurrentType() const { return currentType; }
   void returnToPreviousScreen();
   void update();
-  void render();
+  void render(u32 targets);
   void showToast(const std::string &message);
 
   bool shouldCloseApplication() const { return appExitRequested; }
@@ -65,6 +65,10 @@ public:
   void renderDebugOverlay();
   bool isDebugOverlayEnabled() const { return debugOverlayEnabled; }
   void toggleDebugOverlay();
+  void renderProfilerOverlay();
+  void dumpProfile();
+  void renderNetworkOverlay();
+  void dumpNetworkTimings();
 
   HamburgerMenu &getHamburgerMenu() { return hamburgerMenu; }
 
@@ -148,10 +152,15 @@ private:
   C3D_RenderTarget *bottomTarget;
 
   std::unique_ptr<Screen> currentScreen;
+  // The screen replaced during update(), kept until its update() (and the
+  // locks it holds) has unwound.
+  std::unique_ptr<Screen> retiredScreen;
   ScreenType currentType;
   std::vector<ScreenType> screenHistory;
   std::string selectedGuildId;
   bool debugOverlayEnabled;
+  bool profilerOverlayEnabled = false;
+  bool networkOverlayEnabled = false;
   bool appExitRequested;
   HamburgerMenu hamburgerMenu;
   C2D_ImageTint tint;
@@ -167,6 +176,8 @@ private:
 
   void drawHamburgerButton();
   void drawToast();
+  void drawDebugLine(float x, float y, const std::string &line, u32 color,
+                     float scale = 0.4f);
 
   std::string toastMessage;
   int toastTimer = 0;
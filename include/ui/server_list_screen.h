@@ -2,6 +2,8 @@
 #define SERVER_LIST_SCREEN_H
 
 #include "discord/discord_client.h"
+#include "render_layer.h"
+#include "texture_cache.h"
 #include "screen_manager.h"
 #include <map>
 #include <set>
@@ -56,7 +58,7 @@ private:
   void refreshChannels();
   void drawChannelList(float x, float y, float alpha);
 
-  std::map<std::string, C3D_Tex *> iconCache;
+  std::map<std::string, TextureHandle> iconCache;
 
   enum class State {
     SELECTING_SERVER,
@@ -68,6 +70,7 @@ private:
   float animationProgress;
   float loadingAngle;
   float animTimer;
+  RenderLayer bottomLayer;
   static constexpr float SIDEBAR_WIDTH = 72.0f;
 
   float lerp(float a, float b, float t) { return a + (b - a) * t; }
@@ -0,0 +1,95 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include "utils/image_utils.h"
+#include <3ds.h>
+#include <citro2d.h>
+#include <list>
+#include <memory>
+#include <vector>
+
+namespace UI {
+
+struct AtlasSlot {
+  C3D_Tex *page = nullptr;
+  Tex3DS_SubTexture subtex = {};
+  u16 x = 0, y = 0;         // cell origin in the page, in texels
+  u16 cellW = 0, cellH = 0; // rounded up to whole 8x8 tiles
+  int refCount = 0;
+};
+
+// Packs small images (avatars, guild icons, custom emoji) into shared
+// 512x512 pages so that runs of them draw from one texture and the linear
+// heap is not carved into thousands of tiny allocations. Pages hold one
+// texture format each and are filled in shelves whose heights are multiples
+// of 8, so already-tiled data is copied in whole tiles. A page whose live
+// slots cover less than half of its shelves is repacked in place before a
+// new page is created. Main thread only.
+class TextureAtlas {
+public:
+  static TextureAtlas &getInstance();
+
+  static constexpr int PAGE_SIZE = 512;
+  static constexpr int MAX_ITEM_SIZE = 64;
+
+  // Copies tiled into a new slot (refCount 1) and frees tiled.pixels.
+  // Returns null, leaving tiled alone, if it does not fit anywhere.
+  AtlasSlot *insert(Utils::Image::TiledData &tiled);
+  void retain(AtlasSlot *slot);
+  void release(AtlasSlot *slot);
+
+  static C2D_Image imageOf(AtlasSlot *slot) {
+    return {slot->page, &slot->subtex};
+  }
+  static size_t bytesOf(const AtlasSlot *slot);
+
+  struct Stats {
+    u32 pages = 0;
+    u32 slots = 0;
+    size_t pageBytes = 0;
+    size_t liveBytes = 0;
+    u32 repacks = 0;
+  };
+  Stats getStats() const;
+
+private:
+  TextureAtlas() = default;
+  ~TextureAtlas();
+  TextureAtlas(const TextureAtlas &) = delete;
+  TextureAtlas &operator=(const TextureAtlas &) = delete;
+
+  struct Span {
+    int x, w;
+  };
+
+  struct Shelf {
+    int y = 0;
+    int height = 0;
+    int cursor = 0; // everything right of this is untouched
+    std::vector<Span> freeSpans;
+  };
+
+  struct Page {
+    C3D_Tex tex;
+    GPU_TEXCOLOR format;
+    std::vector<Shelf> shelves;
+    int nextShelfY = 0;
+    std::list<AtlasSlot> slots;
+    int liveArea = 0;
+  };
+
+  static bool place(Page &page, int cellW, int cellH, int &outX, int &outY);
+  static void freeCell(Page &page, const AtlasSlot &slot);
+  static int shelfArea(const Page &page);
+  Page *newPage(GPU_TEXCOLOR format);
+  bool repack(Page &page);
+
+  std::vector<std::unique_ptr<Page>> pages;
+  u32 repackCount = 0;
+
+  static constexpr int MAX_PAGES = 8;
+};
+
+} // namespace UI
+
+#endif // TEXTURE_ATLAS_H
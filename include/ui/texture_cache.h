@@ -0,0 +1,169 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "utils/image_utils.h"
+#include <3ds.h>
+#include <citro2d.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace UI {
+
+enum class TextureClass {
+  LOCAL, // romfs/SD assets; never evicted
+  AVATAR,
+  EMOJI,
+  ATTACHMENT,
+  SHEET, // asset pack sheets; many small images share each one
+  COUNT
+};
+
+class TextureHandle;
+struct AtlasSlot;
+
+// Owns every downloaded or loaded texture. Entries live in one LRU list per
+// class; pinned entries (refCount > 0) are parked on a separate list so
+// eviction always takes the tail in O(1). Inserts may come from any thread,
+// but textures are only freed from trim() on the main thread, before
+// rendering, so pointers fetched during a frame stay valid for that frame.
+// trim() also leaves alone anything looked up since the trim before it: a
+// texture the last frame drew would only be loaded straight back.
+class TextureCache {
+public:
+  static TextureCache &getInstance();
+
+  struct TextureInfo {
+    C3D_Tex *tex = nullptr; // an atlas page for atlased entries
+    C2D_Image image = {};   // the image's own region of tex
+    int originalW = 0;
+    int originalH = 0;
+    size_t bytes = 0;
+    bool failed = false;
+  };
+
+  struct Stats {
+    u32 hits = 0;
+    u32 misses = 0;
+    u32 evictions = 0;
+    u32 entries = 0;
+    size_t bytes = 0;
+    size_t quota = 0;
+  };
+
+  void init();
+  void shutdown();
+
+  // Looks key up, counting a hit or miss against cls and marking the entry
+  // as recently used. Failed entries count as hits.
+  bool find(const std::string &key, TextureClass cls, TextureInfo *out);
+  bool contains(const std::string &key);
+
+  // Takes ownership of tex. A null tex records a failed load. If the key
+  // already holds a texture the new one is discarded.
+  void insert(const std::string &key, TextureClass cls, C3D_Tex *tex,
+              int originalW, int originalH);
+  // Main thread: small images go into the shared TextureAtlas, anything
+  // else (or anything that does not fit) gets its own texture. Frees
+  // tiled.pixels; empty data records a failed load.
+  void insertTiled(const std::string &key, TextureClass cls,
+                   Utils::Image::TiledData &tiled);
+  void eraseFailed(const std::string &key);
+
+  // Pins key until the returned handle goes away; empty if not cached.
+  TextureHandle acquire(const std::string &key);
+
+  // Evicts until every class is within its quota and the total, atlas pages
+  // included, is within the budget. Main thread only.
+  void trim();
+  // Frees everything that is not pinned.
+  void clear();
+
+  void setBudget(size_t bytes);
+  size_t getBudget() const { return budgetBytes; }
+  void setQuota(TextureClass cls, size_t bytes);
+
+  Stats getStats(TextureClass cls);
+  // Including the unused part of atlas pages. Main thread only.
+  size_t getTotalBytes();
+  float getHitRate();
+  // Changes whenever a texture of cls is added or evicted, so a cached
+  // render of cls's images can tell when it went stale.
+  u32 getGeneration(TextureClass cls);
+
+private:
+  friend class TextureHandle;
+
+  TextureCache();
+  ~TextureCache();
+  TextureCache(const TextureCache &) = delete;
+  TextureCache &operator=(const TextureCache &) = delete;
+
+  struct Entry {
+    TextureInfo info;
+    Tex3DS_SubTexture subtex = {}; // backs info.image for standalone textures
+    AtlasSlot *slot = nullptr;
+    TextureClass cls = TextureClass::ATTACHMENT;
+    int refCount = 0;
+    u32 usedFrame = 0; // trim() count at the last find()
+    std::list<std::string>::iterator lruPos;
+  };
+
+  struct ClassState {
+    std::list<std::string> lru; // front = most recently used
+    size_t quota = 0;           // 0 = only bounded by the global budget
+    Stats stats;
+    u32 generation = 0;
+  };
+
+  void retain(const std::string &key);
+  void release(const std::string &key);
+  // Whether cls's least recently used entry may go.
+  bool canEvict(TextureClass cls);
+  bool evictOne(TextureClass cls);
+  void freeEntry(Entry &entry);
+  // False if key already holds a texture; drops a failed placeholder.
+  bool makeRoomFor(const std::string &key);
+  void addEntry(const std::string &key, TextureClass cls, Entry &entry);
+
+  std::unordered_map<std::string, Entry> entries;
+  std::list<std::string> pinned;
+  ClassState classes[(int)TextureClass::COUNT];
+  size_t budgetBytes;
+  size_t totalBytes = 0;
+  u32 frame = 1;
+  bool lookedUp = false; // find() called since the last trim()
+  std::mutex mutex;
+
+  // Keep this much linear heap free for decoders and network buffers.
+  static constexpr size_t LINEAR_RESERVE_BYTES = 2 * 1024 * 1024;
+};
+
+// Reference-counted pin on a cached texture. While any handle for a key is
+// alive, trim() will not evict it.
+class TextureHandle {
+public:
+  TextureHandle() = default;
+  TextureHandle(const TextureHandle &other);
+  TextureHandle(TextureHandle &&other) noexcept;
+  TextureHandle &operator=(TextureHandle other);
+  ~TextureHandle() { reset(); }
+
+  C3D_Tex *get() const { return image.tex; }
+  const C2D_Image &getImage() const { return image; }
+  explicit operator bool() const { return image.tex != nullptr; }
+  void reset();
+
+private:
+  friend class TextureCache;
+  TextureHandle(const std::string &key, const C2D_Image &image)
+      : key(key), image(image) {}
+
+  std::string key;
+  C2D_Image image = {};
+};
+
+} // namespace UI
+
+#endif // TEXTURE_CACHE_H
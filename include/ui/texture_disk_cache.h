@@ -0,0 +1,89 @@
+#ifndef TEXTURE_DISK_CACHE_H
+#define TEXTURE_DISK_CACHE_H
+
+#include "utils/image_utils.h"
+#include <3ds.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace UI {
+
+// SD-card cache of already-tiled texture data, keyed by a hash of the full
+// request URL (so size/format query parameters get separate entries). A hit
+// skips both the download and the stb_image decode. All file I/O happens on
+// one background thread; loads are served before pending writes.
+class TextureDiskCache {
+public:
+  static TextureDiskCache &getInstance();
+
+  using LoadCallback = std::function<void(Utils::Image::TiledData &tiled)>;
+
+  void init();
+  void shutdown();
+
+  bool contains(const std::string &url);
+
+  // Reads url on the worker thread and hands the tiled data to done. On a
+  // failed read done gets empty data and should fall back to the network.
+  // done owns tiled.pixels.
+  void load(const std::string &url, LoadCallback done);
+
+  // Copies tiled and writes it out in the background.
+  void store(const std::string &url, const Utils::Image::TiledData &tiled);
+
+private:
+  TextureDiskCache() = default;
+  ~TextureDiskCache();
+  TextureDiskCache(const TextureDiskCache &) = delete;
+  TextureDiskCache &operator=(const TextureDiskCache &) = delete;
+
+  struct IndexEntry {
+    u32 size = 0;
+    u64 lastAccess = 0;
+  };
+
+  struct Job {
+    u64 key = 0;
+    bool isWrite = false;
+    Utils::Image::TiledData tiled;
+    LoadCallback done;
+  };
+
+  static u64 hashUrl(const std::string &url);
+  static std::string pathFor(u64 key);
+
+  void workerLoop();
+  void runLoad(Job &job);
+  void runWrite(Job &job);
+  void evictIfNeeded();
+  void loadIndex();
+  void saveIndex();
+  void removeOrphans();
+
+  std::unordered_map<u64, IndexEntry> index;
+  u64 totalBytes = 0;
+  bool indexDirty = false;
+  u64 lastIndexSave = 0;
+
+  std::deque<Job> loads;
+  std::deque<Job> writes;
+  size_t queuedWriteBytes = 0;
+  std::mutex mutex;
+  std::condition_variable jobCv;
+  std::thread worker;
+  std::atomic<bool> stopWorker{false};
+  bool ready = false;
+
+  static constexpr u64 MAX_DISK_BYTES = 64ull * 1024 * 1024;
+  static constexpr size_t MAX_QUEUED_WRITE_BYTES = 4 * 1024 * 1024;
+};
+
+} // namespace UI
+
+#endif // TEXTURE_DISK_CACHE_H
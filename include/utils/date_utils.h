@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+// Calendar math on UTC epochs. No 3DS dependencies, so tools/datebench.cpp
+// can build it on the host.
+namespace Utils {
+namespace Date {
+
+// "YYYY-MM-DDTHH:MM:SS", optionally followed by a fraction and zone, which
+// are ignored. 0 if the string doesn't have that layout.
+time_t parseISO8601(const std::string &timestamp);
+
+// Howard Hinnant's days_from_civil and its inverse: days since 1970-01-01.
+int64_t daysFromCivil(int year, int month, int day);
+void civilFromDays(int64_t days, int &year, int &month, int &day);
+
+// Days since 1970-01-01 at utcEpoch + offsetSeconds, rounded down.
+int32_t localDay(time_t utcEpoch, int64_t offsetSeconds);
+
+} // namespace Date
+} // namespace Utils
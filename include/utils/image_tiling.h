@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace Utils {
+namespace Image {
+
+// The CPU half of turning a decoded RGBA bitmap into a texture. No 3DS
+// dependencies, so tools/imagebench.cpp can build it on the host.
+//
+// Texels below are RGBA bytes loaded as one little-endian word, i.e.
+// 0xAABBGGRR.
+inline uint32_t toRGBA8(uint32_t v) {
+  // GPU_RGBA8 wants 0xRRGGBBAA: a full byte reversal, which is a single REV
+  // on ARMv6.
+  return __builtin_bswap32(v);
+}
+
+inline uint16_t toRGB565(uint32_t v) {
+  return ((v << 8) & 0xF800) | ((v >> 5) & 0x07E0) | ((v >> 19) & 0x001F);
+}
+
+inline uint16_t toRGBA5551(uint32_t v) {
+  return ((v << 8) & 0xF800) | ((v >> 5) & 0x07C0) | ((v >> 18) & 0x003E) |
+         (v >> 31);
+}
+
+inline uint16_t toRGBA4(uint32_t v) {
+  return ((v << 8) & 0xF000) | ((v >> 4) & 0x0F00) | ((v >> 16) & 0x00F0) |
+         (v >> 28);
+}
+
+// Box-filters src (w x h) down to dst (dw x dh). Source spans per output
+// column/row are computed once up front so the inner loop is adds only.
+// Colour is averaged weighted by alpha, as tools/assetpack.cpp does.
+void boxDownscale(const uint32_t *src, int w, int h, uint32_t *dst, int dw,
+                  int dh);
+
+// Writes linear (w x h) into GPU tile order. Each 8x8 tile is 16 2x2 quads
+// in Morton order; full tiles are written with no bounds checks.
+template <typename T, T (*Convert)(uint32_t)>
+void swizzleTiles(const uint32_t *linear, int w, int h, int p2w, T *out) {
+  static const uint8_t quadX[16] = {0, 2, 0, 2, 4, 6, 4, 6,
+                                    0, 2, 0, 2, 4, 6, 4, 6};
+  static const uint8_t quadY[16] = {0, 0, 2, 2, 0, 0, 2, 2,
+                                    4, 4, 6, 6, 4, 4, 6, 6};
+
+  for (int ty = 0; ty < h; ty += 8) {
+    for (int tx = 0; tx < w; tx += 8) {
+      T *tile = out + ((size_t)(ty >> 3) * (p2w >> 3) + (tx >> 3)) * 64;
+      bool full = (tx + 8 <= w) && (ty + 8 <= h);
+
+      for (int q = 0; q < 16; q++, tile += 4) {
+        int x = tx + quadX[q];
+        int y = ty + quadY[q];
+        const uint32_t *r0 = linear + (size_t)y * w + x;
+        if (full) {
+          const uint32_t *r1 = r0 + w;
+          tile[0] = Convert(r0[0]);
+          tile[1] = Convert(r0[1]);
+          tile[2] = Convert(r1[0]);
+          tile[3] = Convert(r1[1]);
+          continue;
+        }
+        // Edge tile: texels past the image stay zero (transparent).
+        if (y < h) {
+          if (x < w)
+            tile[0] = Convert(r0[0]);
+          if (x + 1 < w)
+            tile[1] = Convert(r0[1]);
+        }
+        if (y + 1 < h) {
+          if (x < w)
+            tile[2] = Convert(r0[w]);
+          if (x + 1 < w)
+            tile[3] = Convert(r0[w + 1]);
+        }
+      }
+    }
+  }
+}
+
+} // namespace Image
+} // namespace Utils
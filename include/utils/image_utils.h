@@ -5,19 +5,43 @@
 namespace Utils {
 namespace Image {
 
+// Texels in GPU tile order, in the given format (2 or 4 bytes each).
 struct TiledData {
-  u32 *pixels = nullptr;
+  void *pixels = nullptr;
   int w = 0, h = 0;
   int p2w = 0, p2h = 0;
   size_t vramSize = 0;
+  GPU_TEXCOLOR format = GPU_RGBA8;
+  bool linear = false; // pixels came from linearAlloc (DMA-able)
 };
 
+// Large buffers go in linear memory when there is room, so createTexture
+// can DMA them instead of copying on the CPU.
+bool allocTiled(TiledData &tiled, size_t size);
+void freeTiled(TiledData &tiled);
+// Writes back the CPU cache once tiled.pixels is filled. Any thread.
+void flushTiled(const TiledData &tiled);
+
+// With compact set, the texture format follows the image's alpha: RGB565
+// when opaque, RGBA5551 for cut-out alpha, and for soft alpha RGBA4 at
+// emoji and avatar sizes or RGBA8 above them. Otherwise RGBA8 is always
+// used.
 TiledData decodeToTiled(const unsigned char *data, size_t size,
                         int maxWidth = 512, int maxHeight = 512,
-                        bool noResize = false);
+                        bool noResize = false, bool compact = true);
+
+// small: the texture is small enough that RGBA4's banding won't show.
+GPU_TEXCOLOR chooseFormat(const unsigned char *rgba, int w, int h,
+                          bool small);
+size_t bytesPerTexel(GPU_TEXCOLOR format);
+
+// Uploads tiled into a new texture and frees tiled.pixels either way.
+// Main thread only.
+C3D_Tex *createTexture(TiledData &tiled);
 
 C3D_Tex *loadTextureFromMemory(const unsigned char *data, size_t size,
-                               int &outW, int &outH, bool noResize = false);
+                               int &outW, int &outH, bool noResize = false,
+                               bool compact = false);
 
 C3D_Tex *loadTextureFromMemory(const unsigned char *data, size_t size);
 
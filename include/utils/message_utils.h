@@ -12,11 +12,19 @@ namespace MessageUtils {
 void syncClock(const std::string &dateStr);
 time_t getUtcNow();
 s64 get3DSLocalTimeOffset();
-time_t parseISO8601(const std::string &timestamp);
 time_t snowflakeToTimestamp(const std::string &snowflake);
 std::string formatTimestamp(const std::string &timestamp);
 std::string getLocalDateString(const std::string &timestamp);
 std::string formatTimeOnly(const std::string &timestamp);
+
+// Utils::Date::localDay with the timezone from the settings.
+int32_t getLocalDay(time_t utcEpoch);
+
+// Resolves msg.epoch once so the render path only does integer math.
+void stampMessage(Discord::Message &msg);
+std::string formatTimestamp(const Discord::Message &msg);
+std::string getLocalDateString(const Discord::Message &msg);
+std::string formatTimeOnly(const Discord::Message &msg);
 std::string getISOTimestamp(time_t epoch);
 std::string getRelativeTime(time_t targetEpoch);
 
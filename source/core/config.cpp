@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include <3ds.h>
+#include <algorithm>
 #include <citro2d.h>
 #include <cstdio>
 #include <cstring>
@@ -22,7 +23,7 @@
 Config::Config()
     : currentAccountIndex(-1), timezoneOffset(0), language("en"), themeType(0),
       typingIndicatorEnabled(true), fileLoggingEnabled(false),
-      disclaimerAccepted(false) {
+      disclaimerAccepted(false), textureCacheMB(12) {
   customTheme = getDarkPreset();
   customTheme.name = "Custom Theme";
 }
@@ -212,6 +213,10 @@ void Config::loadSettings() {
           doc["disclaimer_accepted"].IsBool()) {
         disclaimerAccepted = doc["disclaimer_accepted"].GetBool();
       }
+      if (doc.HasMember("texture_cache_mb") &&
+          doc["texture_cache_mb"].IsInt()) {
+        textureCacheMB = std::max(4, doc["texture_cache_mb"].GetInt());
+      }
     } else {
       saveSettings();
     }
@@ -240,6 +245,8 @@ void Config::saveSettings() {
   writer.Bool(fileLoggingEnabled);
   writer.Key("disclaimer_accepted");
   writer.Bool(disclaimerAccepted);
+  writer.Key("texture_cache_mb");
+  writer.Int(textureCacheMB);
   writer.EndObject();
 
   std::string settingsPath = std::string(CONFIG_DIR_PATH) + "/settings.json";
@@ -0,0 +1,59 @@
+#include "core/frame_scheduler.h"
+
+namespace Core {
+
+void FrameScheduler::init() {
+  LightEvent_Init(&wakeEvent, RESET_ONESHOT);
+  dirtyTargets = REDRAW_ALL;
+  lastFrameMs = osGetTime();
+  statsWindowStart = lastFrameMs;
+}
+
+void FrameScheduler::requestRedraw(u32 targets) {
+  if (targets == REDRAW_NONE)
+    return;
+  u32 previous = dirtyTargets.fetch_or(targets);
+  if (previous == REDRAW_NONE)
+    LightEvent_Signal(&wakeEvent);
+}
+
+u32 FrameScheduler::beginFrame() {
+  u64 now = osGetTime();
+  updateStats(now);
+
+  // Relative timestamps and typing indicators age without any event.
+  if (now - lastFrameMs >= KEEPALIVE_MS)
+    dirtyTargets.fetch_or(REDRAW_ALL);
+
+  u32 targets = dirtyTargets.exchange(REDRAW_NONE);
+  if (targets != REDRAW_NONE) {
+    lastFrameMs = now;
+    framesInWindow++;
+  }
+  return targets;
+}
+
+void FrameScheduler::waitForWork() {
+  if (dirtyTargets.load() != REDRAW_NONE)
+    return;
+
+  u64 start = osGetTime();
+  LightEvent_WaitTimeout(&wakeEvent, INPUT_POLL_NS);
+  idleMsInWindow += osGetTime() - start;
+}
+
+void FrameScheduler::updateStats(u64 now) {
+  u64 elapsed = now - statsWindowStart;
+  if (elapsed < 1000)
+    return;
+
+  framesPerSecond = (u32)(framesInWindow * 1000 / elapsed);
+  u64 idle = idleMsInWindow > elapsed ? elapsed : idleMsInWindow;
+  busyPercent = (u32)(100 - idle * 100 / elapsed);
+
+  statsWindowStart = now;
+  idleMsInWindow = 0;
+  framesInWindow = 0;
+}
+
+} // namespace Core
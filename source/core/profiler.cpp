@@ -0,0 +1,118 @@
+#include "core/profiler.h"
+#include "log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace Core {
+
+int Profiler::registerProbe(const char *name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  int count = probeCount.load();
+  for (int i = 0; i < count; i++) {
+    if (strcmp(probes[i].name, name) == 0)
+      return i;
+  }
+  if (count >= MAX_PROBES) {
+    Logger::log("[Profiler] Too many probes, ignoring %s", name);
+    return -1;
+  }
+  probes[count].name = name;
+  probeCount.store(count + 1);
+  return count;
+}
+
+void Profiler::addSample(int probe, u64 ticks) {
+  if (probe < 0)
+    return;
+  probes[probe].pendingTicks.fetch_add(ticks, std::memory_order_relaxed);
+}
+
+void Profiler::endFrame(bool rendered) {
+  int count = probeCount.load();
+  std::lock_guard<std::mutex> lock(mutex);
+  for (int i = 0; i < count; i++) {
+    u64 ticks = probes[i].pendingTicks.exchange(0);
+    if (rendered)
+      probes[i].historyMs[frameIndex] = (float)(ticks / CPU_TICKS_PER_MSEC);
+  }
+  if (!rendered)
+    return;
+
+  frameIndex = (frameIndex + 1) % HISTORY_FRAMES;
+  if (framesRecorded < HISTORY_FRAMES)
+    framesRecorded++;
+}
+
+std::vector<Profiler::ProbeStats> Profiler::getStats() const {
+  std::vector<ProbeStats> stats;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (framesRecorded == 0)
+    return stats;
+
+  int count = probeCount.load();
+  float samples[HISTORY_FRAMES];
+  for (int i = 0; i < count; i++) {
+    const Probe &probe = probes[i];
+    float sum = 0.0f;
+    for (int f = 0; f < framesRecorded; f++) {
+      samples[f] = probe.historyMs[f];
+      sum += samples[f];
+    }
+    std::sort(samples, samples + framesRecorded);
+
+    ProbeStats s;
+    s.name = probe.name;
+    s.minMs = samples[0];
+    s.maxMs = samples[framesRecorded - 1];
+    s.avgMs = sum / framesRecorded;
+    s.p95Ms = samples[(framesRecorded * 95 - 1) / 100];
+    stats.push_back(s);
+  }
+  return stats;
+}
+
+int Profiler::getFrameCount() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return framesRecorded;
+}
+
+bool Profiler::dumpToFile(const std::string &path) const {
+  std::vector<ProbeStats> stats = getStats();
+
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f) {
+    Logger::log("[Profiler] Could not open %s", path.c_str());
+    return false;
+  }
+
+  fprintf(f, "probe,min_ms,avg_ms,p95_ms,max_ms\n");
+  for (const auto &s : stats) {
+    fprintf(f, "%s,%.3f,%.3f,%.3f,%.3f\n", s.name.c_str(), s.minMs, s.avgMs,
+            s.p95Ms, s.maxMs);
+  }
+
+  // Raw per-frame samples, oldest first, one column per probe.
+  std::lock_guard<std::mutex> lock(mutex);
+  int count = probeCount.load();
+  fprintf(f, "\nframe");
+  for (int i = 0; i < count; i++)
+    fprintf(f, ",%s", probes[i].name);
+  fprintf(f, "\n");
+
+  int start = (framesRecorded < HISTORY_FRAMES) ? 0 : frameIndex;
+  for (int n = 0; n < framesRecorded; n++) {
+    int slot = (start + n) % HISTORY_FRAMES;
+    fprintf(f, "%d", n);
+    for (int i = 0; i < count; i++)
+      fprintf(f, ",%.3f", probes[i].historyMs[slot]);
+    fprintf(f, "\n");
+  }
+
+  fclose(f);
+  Logger::log("[Profiler] Dumped %d frames to %s", framesRecorded,
+              path.c_str());
+  return true;
+}
+
+} // namespace Core
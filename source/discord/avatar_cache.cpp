@@ -1,6 +1,9 @@
 #include "discord/avatar_cache.h"
+#include "core/frame_scheduler.h"
 #include "network/network_manager.h"
+#include "ui/decode_pool.h"
 #include "ui/emoji_manager.h"
+#include "ui/texture_disk_cache.h"
 
 #include "utils/image_utils.h"
 #include <malloc.h>
@@ -16,68 +19,72 @@ void AvatarCache::init() {}
 
 void AvatarCache::shutdown() { clear(); }
 
-void AvatarCache::update() {
+void AvatarCache::clear() {
+  UI::DecodePool::getInstance().cancel(this);
   std::lock_guard<std::recursive_mutex> lock(cacheMutex);
-  while (!pendingAvatars.empty()) {
-    PendingAvatar pa = pendingAvatars.back();
-    pendingAvatars.pop_back();
-
-    auto it = cache.find(pa.id);
-    if (it != cache.end() && it->second.loading) {
-      it->second.tex = pa.tex;
-      it->second.loading = false;
-    } else if (pa.tex) {
-      C3D_TexDelete(pa.tex);
-      free(pa.tex);
-    }
-  }
+  cache.clear();
 }
 
-void AvatarCache::clear() {
-  std::lock_guard<std::recursive_mutex> lock(cacheMutex);
-  for (auto &pair : cache) {
-    if (pair.second.tex) {
-      C3D_TexDelete(pair.second.tex);
-      free(pair.second.tex);
-    }
+std::string AvatarCache::cacheKey(const std::string &url) {
+  return "avatar:" + url;
+}
+
+C2D_Image AvatarCache::lookup(const std::string &id) {
+  auto it = cache.find(id);
+  if (it == cache.end())
+    return C2D_Image();
+  if (it->second.loading) {
+    UI::DecodePool::getInstance().markVisible(cacheKey(it->second.url));
+    return C2D_Image();
   }
-  cache.clear();
-  pendingAvatars.clear();
+
+  UI::TextureCache::TextureInfo info;
+  if (UI::TextureCache::getInstance().find(
+          cacheKey(it->second.url), UI::TextureClass::AVATAR, &info))
+    return info.image;
+
+  // Evicted since it was loaded; forget it so the next prefetch refetches.
+  cache.erase(it);
+  return C2D_Image();
 }
 
-C3D_Tex *AvatarCache::getAvatar(const std::string &userId,
-                                const std::string &avatarHash,
-                                const std::string &discriminator) {
+C2D_Image AvatarCache::getAvatar(const std::string &userId,
+                                 const std::string &avatarHash,
+                                 const std::string &discriminator) {
   if (avatarHash.empty() && discriminator.empty())
-    return nullptr;
+    return C2D_Image();
 
   std::lock_guard<std::recursive_mutex> lock(cacheMutex);
-  auto it = cache.find(userId);
-  if (it != cache.end()) {
-    if (it->second.tex)
-      return it->second.tex;
-    return nullptr;
-  }
+  if (cache.find(userId) != cache.end())
+    return lookup(userId);
 
   prefetchAvatar(userId, avatarHash, discriminator);
-  return nullptr;
+  return C2D_Image();
 }
 
-C3D_Tex *AvatarCache::getGuildIcon(const std::string &guildId,
-                                   const std::string &iconHash) {
+C2D_Image AvatarCache::getGuildIcon(const std::string &guildId,
+                                    const std::string &iconHash) {
   if (iconHash.empty())
-    return nullptr;
+    return C2D_Image();
 
   std::lock_guard<std::recursive_mutex> lock(cacheMutex);
-  auto it = cache.find(guildId);
-  if (it != cache.end()) {
-    if (it->second.tex)
-      return it->second.tex;
-    return nullptr;
-  }
+  if (cache.find(guildId) != cache.end())
+    return lookup(guildId);
 
   prefetchGuildIcon(guildId, iconHash);
-  return nullptr;
+  return C2D_Image();
+}
+
+UI::TextureHandle AvatarCache::acquireGuildIcon(const std::string &guildId,
+                                                const std::string &iconHash) {
+  if (!getGuildIcon(guildId, iconHash).tex)
+    return UI::TextureHandle();
+
+  std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+  auto it = cache.find(guildId);
+  if (it == cache.end())
+    return UI::TextureHandle();
+  return UI::TextureCache::getInstance().acquire(cacheKey(it->second.url));
 }
 
 void AvatarCache::prefetchAvatar(const std::string &userId,
@@ -89,7 +96,9 @@ void AvatarCache::prefetchAvatar(const std::string &userId,
   std::lock_guard<std::recursive_mutex> lock(cacheMutex);
   auto it = cache.find(userId);
   if (it != cache.end()) {
-    if (!it->second.tex && !it->second.loading) {
+    if (!it->second.loading &&
+        !UI::TextureCache::getInstance().contains(
+            cacheKey(it->second.url))) {
       cache.erase(it);
     } else {
       return;
@@ -121,25 +130,7 @@ void AvatarCache::prefetchAvatar(const std::string &userId,
   info.loading = true;
   cache[userId] = info;
 
-  Network::NetworkManager::getInstance().enqueue(
-      info.url, "GET", "", Network::RequestPriority::BACKGROUND,
-      [this, userId](const Network::HttpResponse &resp) {
-        if (resp.statusCode == 200 && !resp.body.empty()) {
-          C3D_Tex *tex = Utils::Image::loadTextureFromMemory(
-              (const unsigned char *)resp.body.data(), resp.body.size());
-
-          std::lock_guard<std::recursive_mutex> lock(this->cacheMutex);
-          PendingAvatar pa;
-          pa.id = userId;
-          pa.tex = tex;
-          this->pendingAvatars.push_back(pa);
-        } else {
-          std::lock_guard<std::recursive_mutex> lock(this->cacheMutex);
-          auto it = this->cache.find(userId);
-          if (it != this->cache.end())
-            it->second.loading = false;
-        }
-      });
+  fetchTexture(userId, info.url);
 }
 
 void AvatarCache::prefetchGuildIcon(const std::string &guildId,
@@ -150,7 +141,9 @@ void AvatarCache::prefetchGuildIcon(const std::string &guildId,
   std::lock_guard<std::recursive_mutex> lock(cacheMutex);
   auto it = cache.find(guildId);
   if (it != cache.end()) {
-    if (!it->second.tex && !it->second.loading) {
+    if (!it->second.loading &&
+        !UI::TextureCache::getInstance().contains(
+            cacheKey(it->second.url))) {
       cache.erase(it);
     } else {
       return;
@@ -163,25 +156,68 @@ void AvatarCache::prefetchGuildIcon(const std::string &guildId,
   info.loading = true;
   cache[guildId] = info;
 
+  fetchTexture(guildId, info.url);
+}
+
+void AvatarCache::fetchTexture(const std::string &id, const std::string &url) {
+  UI::TextureDiskCache &disk = UI::TextureDiskCache::getInstance();
+  if (disk.contains(url)) {
+    disk.load(url, [this, id, url](Utils::Image::TiledData &tiled) {
+      if (!tiled.pixels) {
+        fetchFromNetwork(id, url);
+        return;
+      }
+      UI::DecodePool::getInstance().deliver(
+          cacheKey(url), this, tiled,
+          [this, id](Utils::Image::TiledData &t) { onDecoded(id, t); });
+    });
+    return;
+  }
+  fetchFromNetwork(id, url);
+}
+
+void AvatarCache::fetchFromNetwork(const std::string &id,
+                                   const std::string &url) {
   Network::NetworkManager::getInstance().enqueue(
-      info.url, "GET", "", Network::RequestPriority::BACKGROUND,
-      [this, guildId](const Network::HttpResponse &resp) {
-        if (resp.statusCode == 200 && !resp.body.empty()) {
-          C3D_Tex *tex = Utils::Image::loadTextureFromMemory(
-              (const unsigned char *)resp.body.data(), resp.body.size());
-
-          std::lock_guard<std::recursive_mutex> lock(this->cacheMutex);
-          PendingAvatar pa;
-          pa.id = guildId;
-          pa.tex = tex;
-          this->pendingAvatars.push_back(pa);
-        } else {
-          std::lock_guard<std::recursive_mutex> lock(this->cacheMutex);
-          auto it = this->cache.find(guildId);
-          if (it != this->cache.end())
-            it->second.loading = false;
+      url, "GET", "", Network::RequestPriority::BACKGROUND,
+      [this, id, url](Network::HttpResponse &resp) {
+        if (resp.statusCode != 200 || resp.body.empty()) {
+          markFailed(id);
+          return;
         }
+        UI::DecodePool::Job job;
+        job.key = cacheKey(url);
+        job.data = resp.takeBody();
+        job.diskKey = url;
+        job.priority = Network::RequestPriority::BACKGROUND;
+        job.owner = this;
+        job.done = [this, id](Utils::Image::TiledData &tiled) {
+          onDecoded(id, tiled);
+        };
+        UI::DecodePool::getInstance().submit(std::move(job));
       });
 }
 
+void AvatarCache::onDecoded(const std::string &id,
+                            Utils::Image::TiledData &tiled) {
+  std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+  auto it = cache.find(id);
+  if (it == cache.end() || !it->second.loading) {
+    Utils::Image::freeTiled(tiled);
+    return;
+  }
+
+  UI::TextureCache::getInstance().insertTiled(
+      cacheKey(it->second.url), UI::TextureClass::AVATAR, tiled);
+  it->second.loading = false;
+  Core::FrameScheduler::getInstance().requestRedraw();
+}
+
+void AvatarCache::markFailed(const std::string &id) {
+  std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+  auto it = cache.find(id);
+  if (it != cache.end())
+    it->second.loading = false;
+}
+
 } // namespace Discord
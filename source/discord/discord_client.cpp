@@ -1,8 +1,11 @@
 #include "discord/discord_client.h"
 #include "core/config.h"
+#include "core/frame_scheduler.h"
 #include "core/i18n.h"
+#include "core/profiler.h"
 #include "discord/avatar_cache.h"
 #include "log.h"
+#include "network/http_cache.h"
 #include "network/http_client.h"
 #include "network/network_manager.h"
 #include "utils/json_utils.h"
@@ -22,6 +25,21 @@
 namespace Discord {
 
 namespace {
+// History pages are fetched at BACKGROUND so they don't crowd out what is
+// on screen, but someone is waiting at the end of the list for them, so
+// they go ahead of prefetches queued since.
+const uint32_t HISTORY_DEADLINE_MS = 1000;
+
+// A history page that parsed to no messages only marks the end of the
+// channel if the body really was an empty array, not a truncated read.
+bool isEmptyArray(const std::string &body) {
+  size_t open = body.find_first_not_of(" \t\r\n");
+  if (open == std::string::npos || body[open] != '[')
+    return false;
+  size_t close = body.find_first_not_of(" \t\r\n", open + 1);
+  return close != std::string::npos && body[close] == ']';
+}
+
 std::string statusToString(UserStatus status) {
   switch (status) {
   case UserStatus::ONLINE:
@@ -125,6 +143,7 @@ void DiscordClient::logout() {
   token.clear();
   selectedGuildId.clear();
   selectedChannelId.clear();
+  Network::HttpCache::getInstance().clear();
   setState(ConnectionState::DISCONNECTED, "Logged out");
 }
 
@@ -277,12 +296,14 @@ void DiscordClient::workerLoop() {
 
     if (!message.empty()) {
       processMessage(message);
+      Core::FrameScheduler::getInstance().requestRedraw();
     }
   }
   Logger::log("[Worker] Message processing thread stopped");
 }
 
 void DiscordClient::update() {
+  PROFILE_SCOPE("DiscordClient::update");
   time_t now = time(NULL);
   std::lock_guard<std::recursive_mutex> lock(clientMutex);
   for (auto it = typingUsers.begin(); it != typingUsers.end();) {
@@ -330,6 +351,7 @@ void DiscordClient::setState(ConnectionState newState,
     state = newState;
   }
   setStatus(message);
+  Core::FrameScheduler::getInstance().requestRedraw();
   Logger::log("[Gateway] State: %d, Msg: %s", (int)newState, message.c_str());
 }
 
@@ -1208,6 +1230,7 @@ Message DiscordClient::parseSingleMessage(const rapidjson::Value &d) {
     }
   }
 
+  UI::MessageUtils::stampMessage(msg);
   return msg;
 }
 
@@ -1279,13 +1302,14 @@ void DiscordClient::handleReconnect() {
   ws.disconnect();
 }
 
-void DiscordClient::fetchMessagesAsync(const std::string &channelId, int limit,
-                                       MessagesCallback cb,
-                                       const std::string &aroundId) {
+Network::RequestHandle
+DiscordClient::fetchMessagesAsync(const std::string &channelId, int limit,
+                                  MessagesCallback cb,
+                                  const std::string &aroundId) {
   if (channelId.empty() || token.empty()) {
     if (cb)
       cb({});
-    return;
+    return {};
   }
 
   std::string url = "https://discord.com/api/v10/channels/" + channelId +
@@ -1294,8 +1318,8 @@ void DiscordClient::fetchMessagesAsync(const std::string &channelId, int limit,
     url += "&around=" + aroundId;
   }
 
-  Network::NetworkManager::getInstance().enqueue(
-      url, "GET", "", Network::RequestPriority::INTERACTIVE,
+  return Network::NetworkManager::getInstance().enqueueCached(
+      url, Network::RequestPriority::INTERACTIVE,
       [this, cb, channelId](const Network::HttpResponse &resp) {
         std::vector<Message> messages;
         if (resp.success && resp.statusCode == 200) {
@@ -1316,33 +1340,74 @@ void DiscordClient::fetchMessagesAsync(const std::string &channelId, int limit,
       {{"Authorization", token}});
 }
 
-void DiscordClient::fetchMessagesBeforeAsync(const std::string &channelId,
-                                             const std::string &beforeId,
-                                             int limit, MessagesCallback cb) {
+Network::RequestHandle
+DiscordClient::fetchMessagesBeforeAsync(const std::string &channelId,
+                                        const std::string &beforeId, int limit,
+                                        MessagePageCallback cb) {
   if (channelId.empty() || token.empty() || beforeId.empty()) {
     if (cb)
-      cb({});
-    return;
+      cb({}, false);
+    return {};
   }
 
   std::string url = "https://discord.com/api/v10/channels/" + channelId +
                     "/messages?limit=" + std::to_string(limit) +
                     "&before=" + beforeId;
 
-  Network::NetworkManager::getInstance().enqueue(
-      url, "GET", "", Network::RequestPriority::BACKGROUND,
+  auto request = Network::NetworkManager::getInstance().enqueueCached(
+      url, Network::RequestPriority::BACKGROUND,
       [this, cb, channelId](const Network::HttpResponse &resp) {
         std::vector<Message> messages;
-        if (resp.success && resp.statusCode == 200) {
+        bool ok = resp.success && resp.statusCode == 200;
+        if (ok) {
           messages = parseMessages(resp.body);
-        } else {
+          ok = !messages.empty() || isEmptyArray(resp.body);
+        }
+        if (!ok) {
           Logger::log("Failed to fetch older messages for %s: Status %d",
                       channelId.c_str(), resp.statusCode);
         }
         if (cb)
-          cb(messages);
+          cb(messages, ok);
       },
       {{"Authorization", token}});
+  request.setDeadline(HISTORY_DEADLINE_MS);
+  return request;
+}
+
+Network::RequestHandle
+DiscordClient::fetchMessagesAfterAsync(const std::string &channelId,
+                                       const std::string &afterId, int limit,
+                                       MessagePageCallback cb) {
+  if (channelId.empty() || token.empty() || afterId.empty()) {
+    if (cb)
+      cb({}, false);
+    return {};
+  }
+
+  std::string url = "https://discord.com/api/v10/channels/" + channelId +
+                    "/messages?limit=" + std::to_string(limit) +
+                    "&after=" + afterId;
+
+  auto request = Network::NetworkManager::getInstance().enqueueCached(
+      url, Network::RequestPriority::BACKGROUND,
+      [this, cb, channelId](const Network::HttpResponse &resp) {
+        std::vector<Message> messages;
+        bool ok = resp.success && resp.statusCode == 200;
+        if (ok) {
+          messages = parseMessages(resp.body);
+          ok = !messages.empty() || isEmptyArray(resp.body);
+        }
+        if (!ok) {
+          Logger::log("Failed to fetch newer messages for %s: Status %d",
+                      channelId.c_str(), resp.statusCode);
+        }
+        if (cb)
+          cb(messages, ok);
+      },
+      {{"Authorization", token}});
+  request.setDeadline(HISTORY_DEADLINE_MS);
+  return request;
 }
 
 void DiscordClient::fetchMessage(const std::string &channelId,
@@ -1357,8 +1422,8 @@ void DiscordClient::fetchMessage(const std::string &channelId,
   std::string url = "https://discord.com/api/v10/channels/" + channelId +
                     "/messages/" + messageId;
 
-  Network::NetworkManager::getInstance().enqueue(
-      url, "GET", "", Network::RequestPriority::INTERACTIVE,
+  Network::NetworkManager::getInstance().enqueueCached(
+      url, Network::RequestPriority::INTERACTIVE,
       [this, cb](const Network::HttpResponse &resp) {
         if (resp.success && resp.statusCode == 200) {
           rapidjson::Document doc;
@@ -1515,8 +1580,8 @@ void DiscordClient::fetchGuildDetails(const std::string &guildId,
   std::string url =
       "https://discord.com/api/v10/guilds/" + guildId + "?with_counts=true";
 
-  Network::NetworkManager::getInstance().enqueue(
-      url, "GET", "", Network::RequestPriority::INTERACTIVE,
+  Network::NetworkManager::getInstance().enqueueCached(
+      url, Network::RequestPriority::INTERACTIVE,
       [this, guildId, cb](const Network::HttpResponse &resp) {
         if (resp.success) {
           rapidjson::Document doc;
@@ -1903,12 +1968,13 @@ struct ThreadFetchContext {
   std::mutex mutex;
 };
 
-void DiscordClient::fetchForumThreads(const std::string &channelId,
-                                      ThreadsCallback cb) {
+std::vector<Network::RequestHandle>
+DiscordClient::fetchForumThreads(const std::string &channelId,
+                                 ThreadsCallback cb) {
   if (token.empty() || channelId.empty()) {
     if (cb)
       cb({});
-    return;
+    return {};
   }
 
   auto ctx = std::make_shared<ThreadFetchContext>();
@@ -1920,8 +1986,8 @@ void DiscordClient::fetchForumThreads(const std::string &channelId,
         "&sort_by=last_message_time&sort_order=desc&limit=25&"
         "offset=0";
 
-    Network::NetworkManager::getInstance().enqueue(
-        url, "GET", "", Network::RequestPriority::INTERACTIVE,
+    return Network::NetworkManager::getInstance().enqueueCached(
+        url, Network::RequestPriority::INTERACTIVE,
         [this, channelId, cb, ctx](const Network::HttpResponse &resp) {
           {
             std::lock_guard<std::mutex> lock(ctx->mutex);
@@ -2048,8 +2114,7 @@ void DiscordClient::fetchForumThreads(const std::string &channelId,
         {{"Authorization", token}});
   };
 
-  performFetch(false);
-  performFetch(true);
+  return {performFetch(false), performFetch(true)};
 }
 
 bool DiscordClient::deleteMessage(const std::string &channelId,
@@ -2141,19 +2206,20 @@ void DiscordClient::exchangeTicketForToken(const std::string &ticket,
       {{"Content-Type", "application/json"}});
 }
 
-void DiscordClient::fetchMember(const std::string &guildId,
-                                const std::string &userId, MemberCallback cb) {
+Network::RequestHandle DiscordClient::fetchMember(const std::string &guildId,
+                                                  const std::string &userId,
+                                                  MemberCallback cb) {
   if (guildId.empty() || userId.empty()) {
     if (cb)
       cb(Member());
-    return;
+    return {};
   }
 
   std::string url =
       "https://discord.com/api/v10/guilds/" + guildId + "/members/" + userId;
 
-  Network::NetworkManager::getInstance().enqueue(
-      url, "GET", "", Network::RequestPriority::BACKGROUND,
+  return Network::NetworkManager::getInstance().enqueueCached(
+      url, Network::RequestPriority::BACKGROUND,
       [this, cb, userId, guildId](const Network::HttpResponse &resp) {
         if (!resp.success) {
           if (cb)
@@ -1,5 +1,6 @@
 #include "discord/remote_auth.h"
 #include "core/config.h"
+#include "core/frame_scheduler.h"
 #include "core/i18n.h"
 #include "log.h"
 #include "utils/base64_utils.h"
@@ -128,7 +129,10 @@ void RemoteAuth::poll() {
       setState(RemoteAuthState::CONNECTING,
                Core::I18n::getInstance().get("login.status.connecting_auth"));
 
-      ws.setOnMessage([this](std::string &message) { handleMessage(message); });
+      ws.setOnMessage([this](std::string &message) {
+        handleMessage(message);
+        Core::FrameScheduler::getInstance().requestRedraw();
+      });
 
       ws.setOnError([this](const std::string &error) {
         Logger::log("[RemoteAuth] Error: %s", error.c_str());
@@ -1,10 +1,17 @@
 #include "core/config.h"
+#include "core/frame_scheduler.h"
 #include "core/i18n.h"
+#include "core/profiler.h"
 #include "discord/discord_client.h"
 #include "log.h"
+#include "network/http_cache.h"
 #include "network/network_manager.h"
+#include "ui/decode_pool.h"
+#include "ui/emoji_manager.h"
 #include "ui/image_manager.h"
 #include "ui/screen_manager.h"
+#include "ui/texture_cache.h"
+#include "ui/texture_disk_cache.h"
 #include <3ds.h>
 #include <citro2d.h>
 #include <citro3d.h>
@@ -33,10 +40,16 @@ int main(int argc, char **argv) {
   Logger::init();
   Logger::log("TriCord - Discord for 3DS starting...");
   Config::getInstance().load();
-  Network::NetworkManager::getInstance().init(3, 2);
+  Network::NetworkManager::getInstance().init();
+  Network::HttpCache::getInstance().init();
+  UI::TextureCache::getInstance().init();
+  UI::TextureDiskCache::getInstance().init();
+  UI::DecodePool::getInstance().init();
   UI::ImageManager::getInstance().init();
+  UI::EmojiManager::getInstance().init();
   Discord::DiscordClient::getInstance().init();
   UI::ScreenManager::getInstance().init();
+  Core::FrameScheduler::getInstance().init();
 
   while (aptMainLoop()) {
     hidScanInput();
@@ -48,11 +61,21 @@ int main(int argc, char **argv) {
       break;
     }
 
-    UI::ScreenManager::getInstance().render();
+    Core::FrameScheduler &scheduler = Core::FrameScheduler::getInstance();
+    u32 targets = scheduler.beginFrame();
+    if (targets != Core::REDRAW_NONE) {
+      UI::ScreenManager::getInstance().render(targets);
+    } else {
+      scheduler.waitForWork();
+    }
+    PROFILE_END_FRAME(targets != Core::REDRAW_NONE);
   }
 
   UI::ScreenManager::getInstance().shutdown();
   Network::NetworkManager::getInstance().shutdown();
+  Network::HttpCache::getInstance().shutdown();
+  UI::DecodePool::getInstance().shutdown();
+  UI::TextureDiskCache::getInstance().shutdown();
   psExit();
   romfsExit();
   C2D_Fini();
@@ -0,0 +1,293 @@
+#include "network/connection_manager.h"
+#include "core/config.h"
+#include "log.h"
+#include "network/http_client.h"
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include <vector>
+
+#define DNS_CACHE_PATH CONFIG_DIR_PATH "/cache/dns.bin"
+
+namespace Network {
+
+namespace {
+
+const char *const WARM_HOSTS[] = {"discord.com", "cdn.discordapp.com",
+                                  "media.discordapp.net"};
+
+const u32 DNS_MAGIC = 0x534E4454; // "TDNS"
+const u16 FORMAT_VERSION = 1;
+
+struct DnsHeader {
+  u32 magic;
+  u16 version;
+  u16 count;
+};
+
+struct DnsRecord {
+  char host[64];
+  char address[48];
+  u64 expires;
+};
+
+bool isWarmHost(const std::string &host) {
+  for (const char *warm : WARM_HOSTS) {
+    if (host == warm)
+      return true;
+  }
+  return false;
+}
+
+// The connection went away under the request, rather than the server
+// answering badly.
+bool isConnectionError(CURLcode result) {
+  return result == CURLE_SEND_ERROR || result == CURLE_RECV_ERROR ||
+         result == CURLE_GOT_NOTHING || result == CURLE_OPERATION_TIMEDOUT;
+}
+
+} // namespace
+
+ConnectionManager::~ConnectionManager() { stop(); }
+
+void ConnectionManager::start(CURLSH *share) {
+  if (warmThread.joinable())
+    return;
+
+  loadDns();
+  aptHook(&hookCookie, aptHookCallback, this);
+  hooked = true;
+
+  // Same options as NetworkManager's template, or curl won't reuse the
+  // connections for its transfers.
+  warmClient.reset(new HttpClient());
+  warmClient->setVerifySSL(true);
+  warmClient->setShareHandle(share);
+  stopWarm = false;
+  warmThread = std::thread(&ConnectionManager::warmLoop, this);
+}
+
+void ConnectionManager::stop() {
+  stopWarm = true;
+  if (warmThread.joinable())
+    warmThread.join();
+  warmClient.reset();
+  if (hooked) {
+    aptUnhook(&hookCookie);
+    hooked = false;
+  }
+  saveDns();
+}
+
+std::string ConnectionManager::hostOf(const std::string &url) {
+  size_t start = url.find("://");
+  start = start == std::string::npos ? 0 : start + 3;
+  size_t end = url.find_first_of(":/?#", start);
+  return url.substr(start, end == std::string::npos ? end : end - start);
+}
+
+void ConnectionManager::aptHookCallback(APT_HookType hook, void *param) {
+  // Sockets do not survive sleep mode, but the pool still holds them.
+  if (hook == APTHOOK_ONWAKEUP)
+    static_cast<ConnectionManager *>(param)->invalidateAll();
+}
+
+bool ConnectionManager::needsFreshConnection(const std::string &url) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = suspect.find(hostOf(url));
+  return it != suspect.end() && it->second;
+}
+
+bool ConnectionManager::noteTransfer(const std::string &url, CURLcode result,
+                                     CURL *easy) {
+  long connects = 0;
+  curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+  std::string host = hostOf(url);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (result == CURLE_OK) {
+    if (connects == 0) {
+      suspect.emplace(host, false);
+      return false;
+    }
+    suspect[host] = false;
+
+    char *address = nullptr;
+    curl_easy_getinfo(easy, CURLINFO_PRIMARY_IP, &address);
+    if (isWarmHost(host) && address && *address) {
+      DnsEntry &entry = dns[host];
+      entry.address = address;
+      entry.expires = osGetTime() + DNS_LIFETIME_MS;
+      dnsDirty = true;
+    }
+    return false;
+  }
+
+  if (connects > 0 || !isConnectionError(result))
+    return false;
+  suspect[host] = true;
+  return true;
+}
+
+void ConnectionManager::invalidateAll() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &host : suspect)
+    host.second = true;
+}
+
+void ConnectionManager::warmLoop() {
+  u64 startedAt = osGetTime();
+  CURLM *multi = curl_multi_init();
+  if (!multi)
+    return;
+
+  struct Warm {
+    std::string host;
+    CURL *easy = nullptr;
+    struct curl_slist *resolve = nullptr;
+    bool savedAddress = false;
+  };
+  std::vector<Warm> warms;
+  warms.reserve(2 * sizeof(WARM_HOSTS) / sizeof(WARM_HOSTS[0]));
+
+  // resolve: "+host:443:addr" seeds curl's DNS cache with a saved answer,
+  // "-host:443" takes a bad one back out.
+  auto add = [&](const std::string &host, const std::string &resolve) {
+    Warm warm;
+    warm.host = host;
+    warm.easy = warmClient->duplicateHandle();
+    if (!warm.easy)
+      return;
+    if (!resolve.empty()) {
+      warm.resolve = curl_slist_append(nullptr, resolve.c_str());
+      warm.savedAddress = resolve[0] == '+';
+      curl_easy_setopt(warm.easy, CURLOPT_RESOLVE, warm.resolve);
+    }
+    std::string url = "https://" + host + "/";
+    curl_easy_setopt(warm.easy, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(warm.easy, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(warm.easy, CURLOPT_PRIVATE, (char *)warms.size());
+    curl_multi_add_handle(multi, warm.easy);
+    warms.push_back(warm);
+  };
+
+  int fromSaved = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    u64 now = osGetTime();
+    for (const char *host : WARM_HOSTS) {
+      auto it = dns.find(host);
+      std::string resolve;
+      if (it != dns.end() && it->second.expires > now) {
+        resolve = std::string("+") + host + ":443:" + it->second.address;
+        fromSaved++;
+      }
+      add(host, resolve);
+    }
+  }
+
+  int warmed = 0;
+  int running = 1;
+  while (running > 0 && !stopWarm) {
+    curl_multi_perform(multi, &running);
+
+    CURLMsg *msg;
+    int remaining = 0;
+    while ((msg = curl_multi_info_read(multi, &remaining))) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+      char *priv = nullptr;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+      Warm &warm = warms[(size_t)priv];
+      CURLcode result = msg->data.result;
+      noteTransfer("https://" + warm.host + "/", result, warm.easy);
+      if (result == CURLE_OK) {
+        warmed++;
+      } else if (warm.savedAddress) {
+        // The saved address may be what failed; resolve afresh.
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          dns.erase(warm.host);
+          dnsDirty = true;
+        }
+        add(warm.host, "-" + warm.host + ":443");
+        running++;
+      }
+    }
+
+    if (running > 0)
+      curl_multi_poll(multi, nullptr, 0, 100, nullptr);
+  }
+
+  for (auto &warm : warms) {
+    curl_multi_remove_handle(multi, warm.easy);
+    curl_easy_cleanup(warm.easy);
+    curl_slist_free_all(warm.resolve);
+  }
+  curl_multi_cleanup(multi);
+
+  if (!stopWarm) {
+    Logger::log("[Network] Warmed %d/%zu hosts in %llums, %d from saved DNS",
+                warmed, sizeof(WARM_HOSTS) / sizeof(WARM_HOSTS[0]),
+                (unsigned long long)(osGetTime() - startedAt), fromSaved);
+    saveDns();
+  }
+}
+
+void ConnectionManager::loadDns() {
+  std::lock_guard<std::mutex> lock(mutex);
+  dns.clear();
+
+  FILE *f = fopen(DNS_CACHE_PATH, "rb");
+  if (!f)
+    return;
+
+  DnsHeader header;
+  if (fread(&header, sizeof(header), 1, f) == 1 && header.magic == DNS_MAGIC &&
+      header.version == FORMAT_VERSION) {
+    u64 now = osGetTime();
+    DnsRecord record;
+    for (u16 i = 0; i < header.count; i++) {
+      if (fread(&record, sizeof(record), 1, f) != 1)
+        break;
+      record.host[sizeof(record.host) - 1] = '\0';
+      record.address[sizeof(record.address) - 1] = '\0';
+      if (record.expires > now && isWarmHost(record.host))
+        dns[record.host] = {record.address, record.expires};
+    }
+  }
+  fclose(f);
+}
+
+void ConnectionManager::saveDns() {
+  std::vector<DnsRecord> records;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!dnsDirty)
+      return;
+    for (const auto &pair : dns) {
+      DnsRecord record;
+      memset(&record, 0, sizeof(record));
+      strncpy(record.host, pair.first.c_str(), sizeof(record.host) - 1);
+      strncpy(record.address, pair.second.address.c_str(),
+              sizeof(record.address) - 1);
+      record.expires = pair.second.expires;
+      records.push_back(record);
+    }
+    dnsDirty = false;
+  }
+
+  mkdir(CONFIG_DIR_PATH "/cache", 0700);
+  FILE *f = fopen(DNS_CACHE_PATH, "wb");
+  if (!f)
+    return;
+  DnsHeader header;
+  header.magic = DNS_MAGIC;
+  header.version = FORMAT_VERSION;
+  header.count = (u16)records.size();
+  fwrite(&header, sizeof(header), 1, f);
+  fwrite(records.data(), sizeof(DnsRecord), records.size(), f);
+  fclose(f);
+}
+
+} // namespace Network
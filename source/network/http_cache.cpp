@@ -0,0 +1,538 @@
+#include "network/http_cache.h"
+#include "core/config.h"
+#include "log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <vector>
+
+#define HTTP_CACHE_DIR CONFIG_DIR_PATH "/cache/http"
+
+namespace Network {
+
+namespace {
+
+const u32 FILE_MAGIC = 0x45435448;  // "HTCE"
+const u32 INDEX_MAGIC = 0x58444948; // "HIDX"
+const u16 FORMAT_VERSION = 2;
+
+struct FileHeader {
+  u32 magic;
+  u16 version;
+  u16 reserved;
+  u64 keyCheck;
+  u32 bodySize;
+  u32 reserved2;
+};
+
+struct IndexHeader {
+  u32 magic;
+  u16 version;
+  u16 reserved;
+  u32 count;
+};
+
+struct IndexRecord {
+  u64 hash;
+  u32 size;
+  u16 etagSize;
+  u16 lastModifiedSize;
+  u64 lastAccess;
+  u64 freshUntil;
+};
+
+bool readString(FILE *f, std::string &out, size_t size) {
+  out.resize(size);
+  return size == 0 || fread(&out[0], 1, size, f) == size;
+}
+
+} // namespace
+
+HttpCache &HttpCache::getInstance() {
+  static HttpCache instance;
+  return instance;
+}
+
+HttpCache::~HttpCache() { shutdown(); }
+
+void HttpCache::init() {
+  if (worker.joinable())
+    return;
+
+  mkdir(CONFIG_DIR_PATH "/cache", 0700);
+  mkdir(HTTP_CACHE_DIR, 0700);
+  loadIndex();
+  lastIndexSave = osGetTime();
+
+  stopWorker = false;
+  ready = true;
+  worker = std::thread(&HttpCache::workerLoop, this);
+  Logger::log("[HttpCache] %zu responses, %llu KB", index.size(),
+              (unsigned long long)(totalBytes / 1024));
+}
+
+void HttpCache::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!ready)
+      return;
+    ready = false;
+    stopWorker = true;
+  }
+  jobCv.notify_all();
+  if (worker.joinable())
+    worker.join();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    writes.clear();
+    loads.clear();
+    queuedWriteBytes = 0;
+  }
+  saveIndex();
+}
+
+u64 HttpCache::hashKey(const std::string &key) {
+  u64 hash = 14695981039346656037ull;
+  for (unsigned char c : key) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// Stored in each file in place of the key, so a collision of hashKey() reads
+// as a miss without the token ever being written out. Unrelated to FNV, so
+// two keys colliding in both is as unlikely as a 128-bit collision.
+u64 HttpCache::checkKey(const std::string &key) {
+  u64 hash = 0x9e3779b97f4a7c15ull ^ key.size();
+  for (unsigned char c : key) {
+    hash = (hash ^ c) * 0xff51afd7ed558ccdull;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+std::string HttpCache::pathFor(u64 hash) {
+  char name[64];
+  snprintf(name, sizeof(name), HTTP_CACHE_DIR "/%016llx.bin",
+           (unsigned long long)hash);
+  return name;
+}
+
+// Fills entry's validators and freshness from a response's headers; false if
+// the response must not be stored or could never be reused. Expires and
+// heuristic freshness are not handled, so without max-age an entry is
+// revalidated on every use.
+bool HttpCache::policyOf(const std::map<std::string, std::string> &headers,
+                         u64 now, IndexEntry &entry) {
+  long long maxAge = 0;
+  bool noCache = false;
+  const std::string *control = findHeader(headers, "Cache-Control");
+  if (control) {
+    size_t pos = 0;
+    while (pos < control->size()) {
+      size_t end = control->find(',', pos);
+      if (end == std::string::npos)
+        end = control->size();
+      while (pos < end && (*control)[pos] == ' ')
+        pos++;
+      const char *token = control->c_str() + pos;
+      if (strncasecmp(token, "no-store", 8) == 0)
+        return false;
+      if (strncasecmp(token, "no-cache", 8) == 0)
+        noCache = true;
+      else if (strncasecmp(token, "max-age=", 8) == 0)
+        maxAge = atoll(token + 8);
+      pos = end + 1;
+    }
+  }
+
+  const std::string *age = findHeader(headers, "Age");
+  if (age)
+    maxAge -= atoll(age->c_str());
+  entry.freshUntil = now;
+  if (!noCache && maxAge > 0)
+    entry.freshUntil += (u64)maxAge * 1000;
+
+  const std::string *etag = findHeader(headers, "ETag");
+  const std::string *lastModified = findHeader(headers, "Last-Modified");
+  entry.etag = etag ? *etag : "";
+  entry.lastModified = lastModified ? *lastModified : "";
+  return entry.freshUntil > now || !entry.etag.empty() ||
+         !entry.lastModified.empty();
+}
+
+bool HttpCache::isFresh(const std::string &key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!ready)
+    return false;
+  auto it = index.find(hashKey(key));
+  return it != index.end() && it->second.freshUntil > osGetTime();
+}
+
+bool HttpCache::addValidators(const std::string &key,
+                              std::map<std::string, std::string> &headers) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!ready)
+    return false;
+  auto it = index.find(hashKey(key));
+  if (it == index.end())
+    return false;
+  const IndexEntry &entry = it->second;
+  if (!entry.etag.empty())
+    headers["If-None-Match"] = entry.etag;
+  if (!entry.lastModified.empty())
+    headers["If-Modified-Since"] = entry.lastModified;
+  return !entry.etag.empty() || !entry.lastModified.empty();
+}
+
+bool HttpCache::load(const std::string &key, LoadCallback done) {
+  Job job;
+  job.hash = hashKey(key);
+  job.check = checkKey(key);
+  job.done = std::move(done);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!ready)
+    return false;
+  loads.push_back(std::move(job));
+  jobCv.notify_one();
+  return true;
+}
+
+void HttpCache::store(const std::string &key, HttpResponse &response) {
+  if (response.statusCode != 200 || response.sink || response.body.empty() ||
+      response.body.size() > MAX_ENTRY_BYTES)
+    return;
+
+  Job job;
+  if (!policyOf(response.headers, osGetTime(), job.entry))
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    // The SD card is slow; shed writes rather than pile up copies in RAM.
+    if (!ready ||
+        queuedWriteBytes + response.body.size() > MAX_QUEUED_WRITE_BYTES)
+      return;
+    queuedWriteBytes += response.body.size();
+  }
+
+  job.hash = hashKey(key);
+  job.check = checkKey(key);
+  job.isWrite = true;
+  job.body = std::move(response.body);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  job.generation = generation;
+  writes.push_back(std::move(job));
+  jobCv.notify_one();
+}
+
+void HttpCache::refresh(const std::string &key,
+                        const std::map<std::string, std::string> &headers) {
+  IndexEntry update;
+  policyOf(headers, osGetTime(), update);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = index.find(hashKey(key));
+  if (it == index.end())
+    return;
+  it->second.freshUntil = update.freshUntil;
+  if (!update.etag.empty())
+    it->second.etag = update.etag;
+  if (!update.lastModified.empty())
+    it->second.lastModified = update.lastModified;
+  indexDirty = true;
+}
+
+void HttpCache::clear() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    generation++;
+    index.clear();
+    totalBytes = 0;
+    writes.clear();
+    queuedWriteBytes = 0;
+    indexDirty = true;
+  }
+  removeAllFiles();
+  Logger::log("[HttpCache] Cleared");
+}
+
+void HttpCache::workerLoop() {
+  removeOrphans();
+
+  while (true) {
+    Job job;
+    bool flushIndex = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      jobCv.wait_for(lock, std::chrono::seconds(1), [this] {
+        return stopWorker || !loads.empty() || !writes.empty();
+      });
+      if (stopWorker)
+        return;
+
+      // As in TextureDiskCache: a busy queue still gets the index saved.
+      bool idle = loads.empty() && writes.empty();
+      if (indexDirty &&
+          osGetTime() - lastIndexSave > (idle ? 5000 : 30000)) {
+        flushIndex = true;
+      } else if (!loads.empty()) {
+        job = std::move(loads.front());
+        loads.pop_front();
+      } else if (!writes.empty()) {
+        job = std::move(writes.front());
+        writes.pop_front();
+        queuedWriteBytes -= job.body.size();
+      }
+    }
+
+    if (flushIndex)
+      saveIndex();
+    else if (job.isWrite)
+      runWrite(job);
+    else if (job.done)
+      runLoad(job);
+  }
+}
+
+void HttpCache::runLoad(Job &job) {
+  std::string body;
+  bool known;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    known = index.find(job.hash) != index.end();
+  }
+
+  bool ok = false;
+  FILE *f = known ? fopen(pathFor(job.hash).c_str(), "rb") : nullptr;
+  if (f) {
+    FileHeader header;
+    ok = fread(&header, sizeof(header), 1, f) == 1 &&
+         header.magic == FILE_MAGIC && header.version == FORMAT_VERSION &&
+         header.keyCheck == job.check && header.bodySize <= MAX_ENTRY_BYTES &&
+         readString(f, body, header.bodySize);
+    fclose(f);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(job.hash);
+    if (it != index.end()) {
+      if (ok) {
+        it->second.lastAccess = osGetTime();
+      } else {
+        totalBytes -= it->second.size;
+        index.erase(it);
+      }
+      indexDirty = true;
+    }
+  }
+  if (known && !ok)
+    remove(pathFor(job.hash).c_str());
+  if (!ok)
+    body.clear();
+
+  job.done(ok, body);
+}
+
+void HttpCache::runWrite(Job &job) {
+  std::string path = pathFor(job.hash);
+
+  FileHeader header;
+  header.magic = FILE_MAGIC;
+  header.version = FORMAT_VERSION;
+  header.reserved = 0;
+  header.keyCheck = job.check;
+  header.bodySize = (u32)job.body.size();
+  header.reserved2 = 0;
+
+  bool ok = false;
+  FILE *f = fopen(path.c_str(), "wb");
+  if (f) {
+    ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+         fwrite(job.body.data(), 1, job.body.size(), f) == job.body.size();
+    fclose(f);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    // A clear() while this was being written must not leave the file behind.
+    ok = ok && job.generation == generation;
+    if (ok) {
+      IndexEntry &entry = index[job.hash];
+      totalBytes -= entry.size;
+      entry = std::move(job.entry);
+      entry.size = sizeof(header) + header.bodySize;
+      entry.lastAccess = osGetTime();
+      totalBytes += entry.size;
+    } else {
+      auto it = index.find(job.hash);
+      if (it != index.end()) {
+        totalBytes -= it->second.size;
+        index.erase(it);
+      }
+    }
+    indexDirty = true;
+  }
+  if (!ok) {
+    remove(path.c_str());
+    return;
+  }
+  evictIfNeeded();
+}
+
+void HttpCache::evictIfNeeded() {
+  std::vector<u64> victims;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (totalBytes <= MAX_DISK_BYTES)
+      return;
+
+    std::vector<std::pair<u64, u64>> byAge;
+    byAge.reserve(index.size());
+    for (const auto &pair : index)
+      byAge.push_back({pair.second.lastAccess, pair.first});
+    std::sort(byAge.begin(), byAge.end());
+
+    u64 target = MAX_DISK_BYTES - MAX_DISK_BYTES / 10;
+    for (const auto &age : byAge) {
+      if (totalBytes <= target)
+        break;
+      auto it = index.find(age.second);
+      totalBytes -= it->second.size;
+      index.erase(it);
+      victims.push_back(age.second);
+    }
+    indexDirty = true;
+  }
+
+  for (u64 hash : victims)
+    remove(pathFor(hash).c_str());
+}
+
+void HttpCache::loadIndex() {
+  index.clear();
+  totalBytes = 0;
+
+  FILE *f = fopen(HTTP_CACHE_DIR "/index.bin", "rb");
+  IndexHeader header;
+  if (!f || fread(&header, sizeof(header), 1, f) != 1 ||
+      header.magic != INDEX_MAGIC || header.version != FORMAT_VERSION) {
+    if (f)
+      fclose(f);
+    removeAllFiles();
+    return;
+  }
+
+  IndexRecord record;
+  for (u32 i = 0; i < header.count; i++) {
+    IndexEntry entry;
+    if (fread(&record, sizeof(record), 1, f) != 1 ||
+        !readString(f, entry.etag, record.etagSize) ||
+        !readString(f, entry.lastModified, record.lastModifiedSize))
+      break;
+    entry.size = record.size;
+    entry.lastAccess = record.lastAccess;
+    entry.freshUntil = record.freshUntil;
+    totalBytes += entry.size;
+    index[record.hash] = std::move(entry);
+  }
+  fclose(f);
+}
+
+void HttpCache::saveIndex() {
+  std::string data;
+  u32 count;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    lastIndexSave = osGetTime();
+    if (!indexDirty)
+      return;
+    count = index.size();
+    for (const auto &pair : index) {
+      const IndexEntry &entry = pair.second;
+      IndexRecord record;
+      record.hash = pair.first;
+      record.size = entry.size;
+      record.etagSize = (u16)entry.etag.size();
+      record.lastModifiedSize = (u16)entry.lastModified.size();
+      record.lastAccess = entry.lastAccess;
+      record.freshUntil = entry.freshUntil;
+      data.append((const char *)&record, sizeof(record));
+      data.append(entry.etag, 0, record.etagSize);
+      data.append(entry.lastModified, 0, record.lastModifiedSize);
+    }
+    indexDirty = false;
+  }
+
+  std::string tmpPath = HTTP_CACHE_DIR "/index.tmp";
+  FILE *f = fopen(tmpPath.c_str(), "wb");
+  if (!f)
+    return;
+
+  IndexHeader header;
+  header.magic = INDEX_MAGIC;
+  header.version = FORMAT_VERSION;
+  header.reserved = 0;
+  header.count = count;
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(data.data(), 1, data.size(), f) == data.size();
+  fclose(f);
+
+  if (ok) {
+    remove(HTTP_CACHE_DIR "/index.bin");
+    rename(tmpPath.c_str(), HTTP_CACHE_DIR "/index.bin");
+  } else {
+    remove(tmpPath.c_str());
+    std::lock_guard<std::mutex> lock(mutex);
+    indexDirty = true;
+  }
+}
+
+void HttpCache::removeAllFiles() {
+  DIR *dir = opendir(HTTP_CACHE_DIR);
+  if (!dir)
+    return;
+
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != nullptr) {
+    if (strstr(ent->d_name, ".bin"))
+      remove((std::string(HTTP_CACHE_DIR "/") + ent->d_name).c_str());
+  }
+  closedir(dir);
+}
+
+// Responses written after the last saveIndex() before a crash are not in the
+// index, so nothing would ever evict them.
+void HttpCache::removeOrphans() {
+  DIR *dir = opendir(HTTP_CACHE_DIR);
+  if (!dir)
+    return;
+
+  std::vector<std::string> orphans;
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != nullptr) {
+    const char *ext = strstr(ent->d_name, ".bin");
+    if (!ext || strcmp(ent->d_name, "index.bin") == 0)
+      continue;
+    u64 hash = strtoull(ent->d_name, nullptr, 16);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ext - ent->d_name != 16 || index.find(hash) == index.end())
+      orphans.push_back(ent->d_name);
+  }
+  closedir(dir);
+
+  for (const auto &name : orphans)
+    remove((std::string(HTTP_CACHE_DIR "/") + name).c_str());
+  if (!orphans.empty())
+    Logger::log("[HttpCache] Removed %zu orphaned responses", orphans.size());
+}
+
+} // namespace Network
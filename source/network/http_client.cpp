@@ -1,14 +1,26 @@
 #include "network/http_client.h"
 #include "config.h"
 #include "log.h"
+#include "network/trust_store.h"
+#include <cstring>
 #include <rapidjson/document.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
+#include <strings.h>
 #include <utils/base64_utils.h>
 #include <utils/message_utils.h>
 
 namespace Network {
 
+const std::string *findHeader(const std::map<std::string, std::string> &headers,
+                              const char *name) {
+  for (const auto &header : headers) {
+    if (strcasecmp(header.first.c_str(), name) == 0)
+      return &header.second;
+  }
+  return nullptr;
+}
+
 HttpClient::HttpClient()
     : curl(nullptr), share(nullptr), timeout(HTTP_TIMEOUT_SECONDS),
       verifySSL(true) {
@@ -25,6 +37,7 @@ HttpClient::HttpClient()
   curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
   curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 120L);
   curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 60L);
+  curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, (long)HTTP_MAX_IDLE_SECONDS);
 
   curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
 
@@ -32,8 +45,7 @@ HttpClient::HttpClient()
 
   curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
   curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
-  const char *caPath = "romfs:/cacert-2025-12-02.pem";
-  curl_easy_setopt(curl, CURLOPT_CAINFO, caPath);
+  TrustStore::getInstance().configure(curl);
 
   defaultHeaders["User-Agent"] =
       "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, "
@@ -169,6 +181,14 @@ void HttpClient::setShareHandle(CURLSH *handle) {
   }
 }
 
+CURL *HttpClient::duplicateHandle() const {
+  CURL *handle = curl ? curl_easy_duphandle(curl) : nullptr;
+  // curl_easy_duphandle() leaves the share handle out.
+  if (handle && share)
+    curl_easy_setopt(handle, CURLOPT_SHARE, share);
+  return handle;
+}
+
 void HttpClient::clearHeaders() {
   defaultHeaders.clear();
   defaultHeaders["User-Agent"] = APP_USER_AGENT;
@@ -176,20 +196,69 @@ void HttpClient::clearHeaders() {
   defaultHeaders["Accept"] = "application/json";
 }
 
+bool BufferSink::write(const char *data, size_t size) {
+  if (size > capacity - used)
+    return false;
+  memcpy(buffer + used, data, size);
+  used += size;
+  return true;
+}
+
+FileSink::FileSink(const std::string &path) : file(fopen(path.c_str(), "wb")) {
+  if (!file)
+    Logger::log("[HTTP] Can't open %s for download", path.c_str());
+}
+
+FileSink::~FileSink() { close(); }
+
+bool FileSink::write(const char *data, size_t size) {
+  if (!file || fwrite(data, 1, size, file) != size) {
+    failed = true;
+    return false;
+  }
+  return true;
+}
+
+bool FileSink::close() {
+  if (file) {
+    if (fclose(file) != 0)
+      failed = true;
+    file = nullptr;
+  }
+  return !failed;
+}
+
 size_t HttpClient::writeCallback(void *contents, size_t size, size_t nmemb,
                                  void *userp) {
   size_t realsize = size * nmemb;
-  std::string *str = static_cast<std::string *>(userp);
-  str->append(static_cast<char *>(contents), realsize);
+  HttpResponse *response = static_cast<HttpResponse *>(userp);
+  // Error pages go to body, so a sink only ever sees what was asked for.
+  if (response->sink && response->statusCode >= 200 &&
+      response->statusCode < 300) {
+    // Anything short of realsize makes curl fail the transfer.
+    return response->sink->write(static_cast<char *>(contents), realsize)
+               ? realsize
+               : 0;
+  }
+  response->body.append(static_cast<char *>(contents), realsize);
   return realsize;
 }
 
 size_t HttpClient::headerCallback(char *buffer, size_t size, size_t nitems,
                                   void *userdata) {
   size_t realsize = size * nitems;
-  auto *headers = static_cast<std::map<std::string, std::string> *>(userdata);
+  HttpResponse *response = static_cast<HttpResponse *>(userdata);
+  auto *headers = &response->headers;
 
   std::string header(buffer, realsize);
+  // The status line starts each response, including redirects.
+  if (header.compare(0, 5, "HTTP/") == 0) {
+    size_t space = header.find(' ');
+    if (space != std::string::npos)
+      response->statusCode = strtol(header.c_str() + space + 1, nullptr, 10);
+    return realsize;
+  }
+
   size_t colonPos = header.find(':');
   if (colonPos != std::string::npos) {
     std::string key = header.substr(0, colonPos);
@@ -202,6 +271,16 @@ size_t HttpClient::headerCallback(char *buffer, size_t size, size_t nitems,
       value.pop_back();
     }
 
+    // One allocation for the whole body instead of one per doubling.
+    if (strcasecmp(key.c_str(), "Content-Length") == 0) {
+      size_t length = strtoul(value.c_str(), nullptr, 10);
+      bool ok = response->statusCode >= 200 && response->statusCode < 300;
+      if (response->sink && ok)
+        response->sink->expect(length);
+      else if (length <= MAX_BODY_RESERVE)
+        response->body.reserve(length);
+    }
+
     (*headers)[key] = value;
   }
 
@@ -209,7 +288,7 @@ size_t HttpClient::headerCallback(char *buffer, size_t size, size_t nitems,
 }
 
 void HttpClient::setupHeaders(
-    struct curl_slist **headers,
+    CURL *handle, struct curl_slist **headers,
     const std::map<std::string, std::string> &extraHeaders) {
 
   *headers = nullptr;
@@ -226,7 +305,55 @@ void HttpClient::setupHeaders(
     *headers = curl_slist_append(*headers, headerStr.c_str());
   }
 
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, *headers);
+  curl_easy_setopt(handle, CURLOPT_HTTPHEADER, *headers);
+}
+
+struct curl_slist *
+HttpClient::prepare(CURL *handle, const std::string &url,
+                    const std::string &method, const std::string &body,
+                    const std::map<std::string, std::string> &extraHeaders,
+                    HttpResponse &response) {
+  curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+
+  curl_easy_setopt(handle, CURLOPT_HTTPGET, 0L);
+  curl_easy_setopt(handle, CURLOPT_POST, 0L);
+  curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, NULL);
+  curl_easy_setopt(handle, CURLOPT_POSTFIELDS, NULL);
+
+  if (method == "POST") {
+    curl_easy_setopt(handle, CURLOPT_POST, 1L);
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDS, body.c_str());
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)body.length());
+  } else if (method == "PATCH") {
+    curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "PATCH");
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDS, body.c_str());
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)body.length());
+  } else if (method == "DELETE") {
+    curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "DELETE");
+  } else {
+    curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+  }
+
+  struct curl_slist *headerList = nullptr;
+  setupHeaders(handle, &headerList, extraHeaders);
+
+  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, writeCallback);
+  curl_easy_setopt(handle, CURLOPT_WRITEDATA, &response);
+  curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, headerCallback);
+  curl_easy_setopt(handle, CURLOPT_HEADERDATA, &response);
+  return headerList;
+}
+
+void HttpClient::finish(CURL *handle, CURLcode result,
+                        HttpResponse &response) {
+  if (result != CURLE_OK) {
+    response.error = curl_easy_strerror(result);
+    response.statusCode = 0; // headerCallback's, for a transfer that failed
+    return;
+  }
+
+  curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response.statusCode);
+  response.success = (response.statusCode >= 200 && response.statusCode < 300);
 }
 
 HttpResponse HttpClient::performRequest(
@@ -241,34 +368,8 @@ HttpResponse HttpClient::performRequest(
     return response;
   }
 
-  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-
-  curl_easy_setopt(curl, CURLOPT_HTTPGET, 0L);
-  curl_easy_setopt(curl, CURLOPT_POST, 0L);
-  curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, NULL);
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
-
-  if (method == "POST") {
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)body.length());
-  } else if (method == "PATCH") {
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PATCH");
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)body.length());
-  } else if (method == "DELETE") {
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
-  } else {
-    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-  }
-
-  struct curl_slist *headerList = nullptr;
-  setupHeaders(&headerList, extraHeaders);
-
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.body);
-  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, headerCallback);
-  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response.headers);
+  struct curl_slist *headerList =
+      prepare(curl, url, method, body, extraHeaders, response);
 
   CURLcode res = curl_easy_perform(curl);
 
@@ -276,15 +377,7 @@ HttpResponse HttpClient::performRequest(
     curl_slist_free_all(headerList);
   }
 
-  if (res != CURLE_OK) {
-    response.error = curl_easy_strerror(res);
-
-    return response;
-  }
-
-  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.statusCode);
-  response.success = (response.statusCode >= 200 && response.statusCode < 300);
-
+  finish(curl, res, response);
   return response;
 }
 
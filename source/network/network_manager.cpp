@@ -1,7 +1,12 @@
 #include "network/network_manager.h"
+#include "core/frame_scheduler.h"
 #include "log.h"
+#include "network/http_cache.h"
 #include "network/http_client.h"
+#include "network/trust_store.h"
 #include "utils/message_utils.h"
+#include <3ds.h>
+#include <algorithm>
 
 namespace Network {
 
@@ -46,151 +51,768 @@ void NetworkManager::unlockCallback(CURL *handle, curl_lock_data data,
   }
 }
 
-void NetworkManager::init(int interactiveCount, int backgroundCount) {
+void NetworkManager::init(int interactiveLimit, int backgroundLimit) {
   std::lock_guard<std::mutex> lock(mutex);
-  if (!interactiveWorkers.empty() || !backgroundWorkers.empty())
+  if (loopThread.joinable())
     return;
 
-  stop = false;
-
-  for (int i = 0; i < interactiveCount; ++i) {
-    interactiveWorkers.emplace_back(&NetworkManager::workerThread, this,
-                                    RequestPriority::INTERACTIVE);
+  multi = curl_multi_init();
+  if (!multi) {
+    Logger::log("[Network] Failed to initialize curl multi");
+    return;
   }
 
-  for (int i = 0; i < backgroundCount; ++i) {
-    backgroundWorkers.emplace_back(&NetworkManager::workerThread, this,
-                                   RequestPriority::BACKGROUND);
-  }
+  // Without a working wakeup, new requests would wait out the whole poll.
+  pollTimeoutMs = curl_multi_wakeup(multi) == CURLM_OK ? 1000 : 10;
+
+  stop = false;
+  this->interactiveLimit = interactiveLimit;
+  this->backgroundLimit = backgroundLimit;
+  slots.setLimits(interactiveLimit, backgroundLimit);
+  client.reset(new HttpClient());
+  client->setVerifySSL(true);
+  client->setShareHandle(curlShare);
 
-  Logger::log(
-      "NetworkManager initialized: %d Interactive, %d Background threads",
-      interactiveCount, backgroundCount);
+  loopThread = std::thread(&NetworkManager::eventLoop, this);
+  callbackThread = std::thread(&NetworkManager::callbackLoop, this);
+  connections.start(curlShare);
+
+  Logger::log("NetworkManager initialized: %d interactive, %d background "
+              "transfers",
+              interactiveLimit, backgroundLimit);
 }
 
 void NetworkManager::shutdown() {
+  connections.stop();
   {
     std::lock_guard<std::mutex> lock(mutex);
     stop = true;
+    if (multi)
+      curl_multi_wakeup(multi);
+  }
+  {
+    std::lock_guard<std::mutex> lock(completionMutex);
+    completionReady.notify_all();
   }
-  condition.notify_all();
 
-  for (std::thread &worker : interactiveWorkers) {
-    if (worker.joinable())
-      worker.join();
+  if (loopThread.joinable())
+    loopThread.join();
+  if (callbackThread.joinable())
+    callbackThread.join();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &transfer : transfers) {
+    curl_multi_remove_handle(multi, transfer->easy);
+    curl_slist_free_all(transfer->headers);
+    curl_easy_cleanup(transfer->easy);
   }
-  for (std::thread &worker : backgroundWorkers) {
-    if (worker.joinable())
-      worker.join();
+  transfers.clear();
+  slots.reset();
+  for (CURL *easy : idleHandles)
+    curl_easy_cleanup(easy);
+  idleHandles.clear();
+  if (multi) {
+    curl_multi_cleanup(multi);
+    multi = nullptr;
   }
+  client.reset();
 
-  interactiveWorkers.clear();
-  backgroundWorkers.clear();
-
-  std::queue<AsyncRequest> empty0;
-  std::swap(realtimeQueue, empty0);
-  std::queue<AsyncRequest> empty1;
-  std::swap(interactiveQueue, empty1);
-  std::queue<AsyncRequest> empty2;
-  std::swap(backgroundQueue, empty2);
+  queue.clear();
+  cacheReads.clear();
+  pendingGets.clear();
+  completions.clear();
 
   Logger::log("NetworkManager shutdown");
 }
 
-void NetworkManager::enqueue(
+uint64_t NetworkManager::dueOf(const AsyncRequest &req) {
+  return TransferSlots::dueAt(req.priority, req.enqueuedAt, req.deadline);
+}
+
+void NetworkManager::schedule(AsyncRequest &&req) {
+  uint64_t due = dueOf(req);
+  auto it = std::upper_bound(queue.begin(), queue.end(), due,
+                             [](uint64_t due, const AsyncRequest &other) {
+                               return due < dueOf(other);
+                             });
+  queue.insert(it, std::move(req));
+}
+
+static std::string coalesceKeyOf(const AsyncRequest &req) {
+  if (req.method != "GET" || req.sink)
+    return "";
+  std::string key = req.url;
+  for (const auto &header : req.headers) {
+    key += '\n';
+    key += header.first;
+    key += ':';
+    key += header.second;
+  }
+  return key;
+}
+
+// Cancels id if it is one of several callers waiting on req, leaving the
+// request itself to the others.
+static bool dropWaiter(AsyncRequest &req, uint32_t id) {
+  if (req.id == id && !req.joined.empty()) {
+    req.id = req.joined.front().id;
+    req.callback = std::move(req.joined.front().callback);
+    req.joined.erase(req.joined.begin());
+    return true;
+  }
+  for (auto it = req.joined.begin(); it != req.joined.end(); ++it) {
+    if (it->id == id) {
+      req.joined.erase(it);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool NetworkManager::join(AsyncRequest &req) {
+  for (auto it = queue.begin(); it != queue.end(); ++it) {
+    if (it->coalesceKey != req.coalesceKey)
+      continue;
+    it->joined.push_back({req.id, std::move(req.callback)});
+    it->useCache = it->useCache || req.useCache;
+    // The shared request runs at the most urgent priority asked for.
+    if (req.priority < it->priority) {
+      AsyncRequest shared = std::move(*it);
+      queue.erase(it);
+      shared.priority = req.priority;
+      schedule(std::move(shared));
+    }
+    return true;
+  }
+  for (auto &transfer : transfers) {
+    if (!transfer->abort && transfer->req.coalesceKey == req.coalesceKey) {
+      transfer->req.joined.push_back({req.id, std::move(req.callback)});
+      return true;
+    }
+  }
+  for (auto &read : cacheReads) {
+    if (read.req.coalesceKey == req.coalesceKey) {
+      read.req.joined.push_back({req.id, std::move(req.callback)});
+      return true;
+    }
+  }
+  return false;
+}
+
+void NetworkManager::forgetGet(const std::string &coalesceKey) {
+  auto it = pendingGets.find(coalesceKey);
+  if (it != pendingGets.end() && --it->second <= 0)
+    pendingGets.erase(it);
+}
+
+NetworkManager::Completion
+NetworkManager::completionFor(AsyncRequest &req, HttpResponse &&response) {
+  Completion done;
+  done.waiters.reserve(1 + req.joined.size());
+  done.waiters.push_back({req.id, std::move(req.callback)});
+  for (auto &waiter : req.joined)
+    done.waiters.push_back(std::move(waiter));
+  done.response = std::move(response);
+  return done;
+}
+
+// Hands req over to be answered from HttpCache; false if the cache is not
+// running. Caller holds mutex, which the load's callback needs, so the
+// load cannot finish before req is in cacheReads.
+bool NetworkManager::readCache(AsyncRequest &req, HttpResponse &response) {
+  std::string key = req.coalesceKey;
+  auto done = [this, key](bool found, std::string &body) {
+    finishCacheRead(key, found, body);
+  };
+  if (!HttpCache::getInstance().load(key, done))
+    return false;
+
+  CacheRead read;
+  read.req = std::move(req);
+  read.response = std::move(response);
+  cacheReads.push_back(std::move(read));
+  return true;
+}
+
+void NetworkManager::finishCacheRead(const std::string &key, bool found,
+                                     std::string &body) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = std::find_if(
+      cacheReads.begin(), cacheReads.end(),
+      [&key](const CacheRead &read) { return read.req.coalesceKey == key; });
+  if (it == cacheReads.end())
+    return;
+  CacheRead read = std::move(*it);
+  cacheReads.erase(it);
+
+  // The entry has been dropped, so this time the request goes out without
+  // validators and fetches the whole body.
+  if (!found) {
+    schedule(std::move(read.req));
+    if (multi)
+      curl_multi_wakeup(multi);
+    return;
+  }
+
+  forgetGet(key);
+  if (read.response.statusCode == 304)
+    revalidatedCount++;
+  else
+    cacheHits++;
+  cacheBytesSaved += body.size();
+  read.response.statusCode = 200;
+  read.response.success = true;
+  read.response.body = std::move(body);
+
+  std::lock_guard<std::mutex> completionLock(completionMutex);
+  completions.push_back(completionFor(read.req, std::move(read.response)));
+  completionReady.notify_one();
+}
+
+RequestHandle NetworkManager::enqueue(
     const std::string &url, const std::string &method, const std::string &body,
-    RequestPriority priority,
-    std::function<void(const HttpResponse &)> callback,
+    RequestPriority priority, ResponseCallback callback,
+    const std::map<std::string, std::string> &extraHeaders,
+    std::shared_ptr<ResponseSink> sink) {
+  AsyncRequest req;
+  req.url = url;
+  req.method = method;
+  req.body = body;
+  req.priority = priority;
+  req.callback = std::move(callback);
+  req.headers = extraHeaders;
+  req.sink = std::move(sink);
+  return add(std::move(req));
+}
+
+RequestHandle NetworkManager::enqueueCached(
+    const std::string &url, RequestPriority priority,
+    ResponseCallback callback,
     const std::map<std::string, std::string> &extraHeaders) {
+  AsyncRequest req;
+  req.url = url;
+  req.method = "GET";
+  req.priority = priority;
+  req.callback = std::move(callback);
+  req.headers = extraHeaders;
+  req.useCache = true;
+  return add(std::move(req));
+}
+
+RequestHandle NetworkManager::add(AsyncRequest &&req) {
+  std::lock_guard<std::mutex> lock(mutex);
+  uint32_t id = nextRequestId++;
+  if (nextRequestId == 0)
+    nextRequestId = 1;
+
+  req.id = id;
+  req.enqueuedAt = osGetTime();
+  req.coalesceKey = coalesceKeyOf(req);
+
+  if (!req.coalesceKey.empty()) {
+    if (pendingGets.count(req.coalesceKey) && join(req)) {
+      coalescedCount++;
+      return RequestHandle(id);
+    }
+    pendingGets[req.coalesceKey]++;
+
+    HttpResponse cached;
+    cached.statusCode = 0;
+    cached.success = false;
+    if (req.useCache && HttpCache::getInstance().isFresh(req.coalesceKey) &&
+        readCache(req, cached))
+      return RequestHandle(id);
+  }
+  schedule(std::move(req));
+  if (multi)
+    curl_multi_wakeup(multi);
+  return RequestHandle(id);
+}
+
+static bool hasWaiter(const std::vector<RequestWaiter> &waiters,
+                      uint32_t id) {
+  return std::any_of(waiters.begin(), waiters.end(),
+                     [id](const RequestWaiter &w) { return w.id == id; });
+}
+
+bool NetworkManager::cancel(uint32_t id) {
+  if (id == 0)
+    return false;
 
   {
     std::lock_guard<std::mutex> lock(mutex);
-    AsyncRequest req;
-    req.url = url;
-    req.method = method;
-    req.body = body;
-    req.priority = priority;
-    req.callback = callback;
-    req.headers = extraHeaders;
+    for (auto it = queue.begin(); it != queue.end(); ++it) {
+      if (dropWaiter(*it, id))
+        return true;
+      if (it->id == id) {
+        forgetGet(it->coalesceKey);
+        queue.erase(it);
+        cancelStats.dequeued++;
+        return true;
+      }
+    }
+    for (auto &transfer : transfers) {
+      if (dropWaiter(transfer->req, id))
+        return true;
+      if (transfer->req.id == id) {
+        // Taken off the multi handle by the event loop, not here.
+        transfer->abort = true;
+        curl_multi_wakeup(multi);
+        return true;
+      }
+    }
+    for (auto it = cacheReads.begin(); it != cacheReads.end(); ++it) {
+      if (dropWaiter(it->req, id))
+        return true;
+      if (it->req.id == id) {
+        forgetGet(it->req.coalesceKey);
+        cacheReads.erase(it);
+        cancelStats.dequeued++;
+        return true;
+      }
+    }
+  }
 
-    if (priority == RequestPriority::REALTIME) {
-      realtimeQueue.push(req);
-    } else if (priority == RequestPriority::INTERACTIVE) {
-      interactiveQueue.push(req);
-    } else {
-      backgroundQueue.push(req);
+  // Not queued, in flight or being read from the cache, so its response is
+  // already on its way to the callback thread; complete() and
+  // finishCacheRead() hand it over under mutex, so it cannot be between the
+  // two.
+  std::unique_lock<std::mutex> lock(completionMutex);
+  for (auto &done : completions) {
+    for (auto it = done.waiters.begin(); it != done.waiters.end(); ++it) {
+      if (it->id == id) {
+        done.waiters.erase(it);
+        return true;
+      }
     }
   }
-  condition.notify_all();
+  if (std::this_thread::get_id() != callbackThread.get_id()) {
+    callbacksDone.wait(lock, [this, id] {
+      return std::find(runningIds.begin(), runningIds.end(), id) ==
+             runningIds.end();
+    });
+  }
+  return false;
 }
 
-void NetworkManager::workerThread(RequestPriority type) {
-  HttpClient client;
-  client.setVerifySSL(true);
-  client.setShareHandle(curlShare);
+bool NetworkManager::isPending(uint32_t id) {
+  if (id == 0)
+    return false;
 
-  while (true) {
-    AsyncRequest req;
-    bool hasRequest = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &req : queue) {
+      if (req.id == id || hasWaiter(req.joined, id))
+        return true;
+    }
+    for (const auto &transfer : transfers) {
+      if (transfer->req.id == id || hasWaiter(transfer->req.joined, id))
+        return !transfer->abort;
+    }
+    for (const auto &read : cacheReads) {
+      if (read.req.id == id || hasWaiter(read.req.joined, id))
+        return true;
+    }
+  }
 
-    {
-      std::unique_lock<std::mutex> lock(mutex);
-      condition.wait(lock, [this, type] {
-        if (stop)
-          return true;
-
-        bool hasHighPriority =
-            !realtimeQueue.empty() || !interactiveQueue.empty();
-        bool hasBackground = !backgroundQueue.empty();
-
-        if (type == RequestPriority::INTERACTIVE) {
-          return hasHighPriority;
-        } else {
-          return hasHighPriority || hasBackground;
-        }
-      });
+  std::lock_guard<std::mutex> lock(completionMutex);
+  for (const auto &done : completions) {
+    if (hasWaiter(done.waiters, id))
+      return true;
+  }
+  return std::find(runningIds.begin(), runningIds.end(), id) !=
+         runningIds.end();
+}
 
-      if (stop)
-        return;
+bool NetworkManager::setPriority(uint32_t id, RequestPriority priority) {
+  if (id == 0)
+    return false;
 
-      if (!realtimeQueue.empty()) {
-        req = std::move(realtimeQueue.front());
-        realtimeQueue.pop();
-        hasRequest = true;
-      } else if (!interactiveQueue.empty()) {
-        req = std::move(interactiveQueue.front());
-        interactiveQueue.pop();
-        hasRequest = true;
-      } else if (!backgroundQueue.empty() &&
-                 type != RequestPriority::INTERACTIVE) {
-        req = std::move(backgroundQueue.front());
-        backgroundQueue.pop();
-        hasRequest = true;
-      }
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto it = queue.begin(); it != queue.end(); ++it) {
+    bool owner = it->id == id;
+    if (!owner && !hasWaiter(it->joined, id))
+      continue;
+    // Only raise a request others are waiting on.
+    if (priority < it->priority ||
+        (priority > it->priority && owner && it->joined.empty())) {
+      AsyncRequest req = std::move(*it);
+      queue.erase(it);
+      req.priority = priority;
+      schedule(std::move(req));
+      if (multi)
+        curl_multi_wakeup(multi);
     }
+    return true;
+  }
+  return false;
+}
 
-    if (hasRequest) {
-      HttpResponse resp;
-      if (req.method == "GET") {
-        resp = client.get(req.url, req.headers);
-      } else if (req.method == "POST") {
-        resp = client.post(req.url, req.body, req.headers);
-      } else if (req.method == "PATCH") {
-        resp = client.patch(req.url, req.body, req.headers);
-      } else if (req.method == "DELETE") {
-        resp = client.del(req.url, req.headers);
-      }
+bool NetworkManager::setDeadline(uint32_t id, uint32_t withinMs) {
+  if (id == 0)
+    return false;
 
-      if (req.callback) {
-        req.callback(resp);
-      }
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto it = queue.begin(); it != queue.end(); ++it) {
+    if (it->id != id && !hasWaiter(it->joined, id))
+      continue;
+    uint64_t deadline = osGetTime() + withinMs;
+    if (it->deadline == 0 || deadline < it->deadline) {
+      AsyncRequest req = std::move(*it);
+      queue.erase(it);
+      req.deadline = deadline;
+      schedule(std::move(req));
+      if (multi)
+        curl_multi_wakeup(multi);
+    }
+    return true;
+  }
+  return false;
+}
+
+NetworkManager::CancelStats NetworkManager::getCancelStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return cancelStats;
+}
+
+NetworkManager::TransferStats NetworkManager::getTransferStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  TransferStats stats;
+  stats.active = (uint32_t)transfers.size();
+  stats.queued = (uint32_t)queue.size();
+  stats.coalesced = coalescedCount;
+  stats.rateLimited = limiter.getLimitedCount();
+  stats.staleRetries = staleRetries;
+  stats.cacheHits = cacheHits;
+  stats.revalidated = revalidatedCount;
+  stats.cacheBytesSaved = cacheBytesSaved;
+  return stats;
+}
+
+std::vector<RequestTiming> NetworkManager::getRecentTimings(size_t count) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return requestLog.recent(count);
+}
+
+std::vector<HostTiming> NetworkManager::getHostTimings() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return requestLog.hosts();
+}
+
+bool NetworkManager::dumpTimings(const std::string &path) {
+  std::vector<RequestTiming> timings = getRecentTimings(RequestLog::HISTORY);
+  return RequestLog::writeCsv(path, timings);
+}
+
+// Takes the transfer off the multi handle and keeps its easy handle for
+// reuse. Caller holds mutex.
+static void releaseTransfer(CURLM *multi, CURL *easy, curl_slist *headers,
+                            std::vector<CURL *> &idleHandles,
+                            size_t maxIdle) {
+  curl_multi_remove_handle(multi, easy);
+  curl_slist_free_all(headers);
+  if (idleHandles.size() < maxIdle)
+    idleHandles.push_back(easy);
+  else
+    curl_easy_cleanup(easy);
+}
+
+void NetworkManager::start(AsyncRequest &&req, const std::string &route,
+                           const std::string &bucketKey,
+                           TransferSlots::Share share) {
+  CURL *easy = nullptr;
+  if (!idleHandles.empty()) {
+    easy = idleHandles.back();
+    idleHandles.pop_back();
+  } else {
+    easy = client->duplicateHandle();
+  }
+
+  std::unique_ptr<Transfer> transfer(new Transfer());
+  transfer->req = std::move(req);
+  transfer->response.statusCode = 0;
+  transfer->response.success = false;
+  if (!easy) {
+    if (!route.empty())
+      limiter.release(bucketKey);
+    forgetGet(transfer->req.coalesceKey);
+    transfer->response.error = "CURL not initialized";
+    std::lock_guard<std::mutex> lock(completionMutex);
+    completions.push_back(
+        completionFor(transfer->req, std::move(transfer->response)));
+    completionReady.notify_one();
+    return;
+  }
 
-      auto it = resp.headers.find("Date");
-      if (it != resp.headers.end()) {
-        UI::MessageUtils::syncClock(it->second);
+  const AsyncRequest &r = transfer->req;
+  transfer->response.sink = r.sink.get();
+  transfer->easy = easy;
+  transfer->route = route;
+  transfer->bucketKey = bucketKey;
+  // A GET with a stale HttpCache entry asks only for changes.
+  std::map<std::string, std::string> conditional;
+  if (r.useCache && !r.coalesceKey.empty() &&
+      HttpCache::getInstance().addValidators(r.coalesceKey, conditional))
+    conditional.insert(r.headers.begin(), r.headers.end());
+  transfer->headers =
+      client->prepare(easy, r.url, r.method, r.body,
+                      conditional.empty() ? r.headers : conditional,
+                      transfer->response);
+  bool fresh = r.freshConnect || connections.needsFreshConnection(r.url);
+  curl_easy_setopt(easy, CURLOPT_FRESH_CONNECT, fresh ? 1L : 0L);
+  // A pooled socket that died without a FIN just goes quiet. For a GET
+  // someone is waiting on, give up after STALL_SECONDS instead of the full
+  // timeout; complete() then resends it on a new connection.
+  bool stallCheck = !fresh && r.priority == RequestPriority::INTERACTIVE &&
+                    r.method == "GET" && !r.sink;
+  curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, stallCheck ? 1L : 0L);
+  curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME,
+                   stallCheck ? STALL_SECONDS : 0L);
+  curl_easy_setopt(easy, CURLOPT_PRIVATE, transfer.get());
+  curl_multi_add_handle(multi, easy);
+  transfer->startedAt = osGetTime();
+
+  transfer->share = share;
+  slots.take(share);
+  transfers.push_back(std::move(transfer));
+}
+
+void NetworkManager::admit() {
+  std::lock_guard<std::mutex> lock(mutex);
+  uint64_t now = osGetTime();
+  admitWaitMs = -1;
+  auto noteWait = [this](uint64_t waitMs) {
+    if (admitWaitMs < 0 || (int64_t)waitMs < admitWaitMs)
+      admitWaitMs = (int64_t)waitMs;
+  };
+
+  // Earliest due first. A request whose class has no free slot, or that is
+  // held back by a retry delay or a full rate-limit bucket, doesn't block
+  // the ones behind it.
+  for (auto it = queue.begin(); it != queue.end();) {
+    uint64_t slotWaitMs = 0;
+    TransferSlots::Share share =
+        slots.shareFor(it->priority, dueOf(*it), now, slotWaitMs);
+    if (share == TransferSlots::Share::NONE) {
+      if (slotWaitMs > 0)
+        noteWait(slotWaitMs);
+      ++it;
+      continue;
+    }
+    bool background = it->priority == RequestPriority::BACKGROUND;
+    if (it->notBefore > now) {
+      noteWait(it->notBefore - now);
+      ++it;
+      continue;
+    }
+
+    std::string route = RateLimiter::routeOf(it->method, it->url);
+    std::string bucketKey;
+    if (!route.empty()) {
+      uint64_t waitMs = 0;
+      bucketKey = limiter.acquire(route, background, now, waitMs);
+      if (bucketKey.empty()) {
+        if (waitMs > 0)
+          noteWait(waitMs);
+        ++it;
+        continue;
       }
     }
+
+    AsyncRequest req = std::move(*it);
+    it = queue.erase(it);
+    start(std::move(req), route, bucketKey, share);
+  }
+}
+
+void NetworkManager::complete(Transfer *transfer, CURLcode result) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = transfers.begin();
+  while (it != transfers.end() && it->get() != transfer)
+    ++it;
+  if (it == transfers.end())
+    return;
+
+  std::unique_ptr<Transfer> done = std::move(*it);
+  transfers.erase(it);
+  slots.give(done->share);
+  HttpClient::finish(done->easy, result, done->response);
+  requestLog.record(done->easy, done->req.method, done->req.url,
+                    done->req.priority, done->response.statusCode, result,
+                    done->req.enqueuedAt, done->startedAt);
+  bool deadConnection =
+      connections.noteTransfer(done->req.url, result, done->easy);
+  releaseTransfer(multi, done->easy, done->headers, idleHandles,
+                  interactiveLimit + backgroundLimit);
+
+  uint64_t retryMs = 0;
+  if (!done->route.empty()) {
+    if (result == CURLE_OK)
+      retryMs = limiter.release(done->bucketKey, done->route,
+                                done->response.statusCode,
+                                done->response.headers, osGetTime());
+    else
+      limiter.release(done->bucketKey);
+  }
+
+  if (done->abort) {
+    forgetGet(done->req.coalesceKey);
+    cancelStats.aborted++;
+    cancelStats.abortedBytes += done->response.body.size();
+    return;
+  }
+
+  // The certificate chains to a root outside the trimmed set. Nothing was
+  // sent before the handshake failed, so any request can go again.
+  if (result == CURLE_PEER_FAILED_VERIFICATION &&
+      TrustStore::getInstance().widen()) {
+    schedule(std::move(done->req));
+    return;
+  }
+
+  // A pooled connection that had died under it; a GET can safely go again
+  // on a new one.
+  if (deadConnection && done->req.method == "GET" && !done->req.sink &&
+      !done->req.freshConnect) {
+    done->req.freshConnect = true;
+    staleRetries++;
+    schedule(std::move(done->req));
+    return;
+  }
+
+  // A 429 is queued again, keeping its age, to run once the limit allows;
+  // the caller only sees it if the retries run out.
+  if (retryMs > 0 && done->req.attempts < MAX_RATE_LIMIT_RETRIES) {
+    done->req.attempts++;
+    done->req.notBefore = osGetTime() + retryMs;
+    schedule(std::move(done->req));
+    return;
+  }
+
+  // Not modified: the waiters get the stored body once it has been read.
+  if (done->response.statusCode == 304 && done->req.useCache &&
+      !done->req.coalesceKey.empty()) {
+    HttpCache::getInstance().refresh(done->req.coalesceKey,
+                                     done->response.headers);
+    if (readCache(done->req, done->response))
+      return;
+  }
+  forgetGet(done->req.coalesceKey);
+
+  Completion completion =
+      completionFor(done->req, std::move(done->response));
+  if (done->req.useCache && completion.response.statusCode == 200)
+    completion.cacheKey = done->req.coalesceKey;
+  std::lock_guard<std::mutex> completionLock(completionMutex);
+  completions.push_back(std::move(completion));
+  completionReady.notify_one();
+}
+
+void NetworkManager::reapAborted() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto it = transfers.begin(); it != transfers.end();) {
+    Transfer &transfer = **it;
+    if (!transfer.abort) {
+      ++it;
+      continue;
+    }
+    forgetGet(transfer.req.coalesceKey);
+    cancelStats.aborted++;
+    cancelStats.abortedBytes += transfer.response.body.size();
+    if (!transfer.route.empty())
+      limiter.release(transfer.bucketKey);
+    slots.give(transfer.share);
+    releaseTransfer(multi, transfer.easy, transfer.headers, idleHandles,
+                    interactiveLimit + backgroundLimit);
+    it = transfers.erase(it);
   }
 }
 
+void NetworkManager::eventLoop() {
+  while (!stop) {
+    admit();
+
+    int running = 0;
+    curl_multi_perform(multi, &running);
+
+    CURLMsg *msg;
+    int remaining = 0;
+    while ((msg = curl_multi_info_read(multi, &remaining))) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+      char *priv = nullptr;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+      complete((Transfer *)priv, msg->data.result);
+    }
+
+    reapAborted();
+    admit();
+
+    // Woken early by enqueue(), cancel() and shutdown().
+    int timeoutMs = pollTimeoutMs;
+    if (admitWaitMs >= 0)
+      timeoutMs = (int)std::min<int64_t>(timeoutMs, admitWaitMs);
+    curl_multi_poll(multi, nullptr, 0, timeoutMs, nullptr);
+  }
+}
+
+void NetworkManager::callbackLoop() {
+  while (true) {
+    Completion done;
+    {
+      std::unique_lock<std::mutex> lock(completionMutex);
+      completionReady.wait(lock,
+                           [this] { return stop || !completions.empty(); });
+      if (stop)
+        return;
+      done = std::move(completions.front());
+      completions.pop_front();
+      for (const auto &waiter : done.waiters)
+        runningIds.push_back(waiter.id);
+    }
+
+    // Coalesced callers all read the one response; only the last may take
+    // its body.
+    for (size_t i = 0; i < done.waiters.size(); i++) {
+      done.response.shared = i + 1 < done.waiters.size();
+      if (done.waiters[i].callback)
+        done.waiters[i].callback(done.response);
+    }
+    {
+      std::lock_guard<std::mutex> lock(completionMutex);
+      runningIds.clear();
+    }
+    callbacksDone.notify_all();
+    Core::FrameScheduler::getInstance().requestRedraw();
+
+    // After the callbacks, so the body is moved to the cache rather than
+    // copied; one a callback has taken is not stored.
+    if (!done.cacheKey.empty())
+      HttpCache::getInstance().store(done.cacheKey, done.response);
+
+    auto it = done.response.headers.find("Date");
+    if (it != done.response.headers.end()) {
+      UI::MessageUtils::syncClock(it->second);
+    }
+  }
+}
+
+bool RequestHandle::cancel() {
+  uint32_t id = requestId;
+  requestId = 0;
+  return NetworkManager::getInstance().cancel(id);
+}
+
+bool RequestHandle::setPriority(RequestPriority priority) {
+  return NetworkManager::getInstance().setPriority(requestId, priority);
+}
+
+bool RequestHandle::setDeadline(uint32_t withinMs) {
+  return NetworkManager::getInstance().setDeadline(requestId, withinMs);
+}
+
+bool RequestHandle::isPending() const {
+  return NetworkManager::getInstance().isPending(requestId);
+}
+
 } // namespace Network
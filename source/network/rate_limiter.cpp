@@ -0,0 +1,192 @@
+#include "network/rate_limiter.h"
+#include "log.h"
+#include "network/http_client.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace Network {
+
+namespace {
+
+const char *API_HOST = "discord.com/api";
+const size_t MAX_BUCKETS = 128;
+
+bool isSnowflake(const std::string &segment) {
+  if (segment.size() < 15)
+    return false;
+  for (char c : segment) {
+    if (c < '0' || c > '9')
+      return false;
+  }
+  return true;
+}
+
+// The part of a route that splits a shared bucket: the first channel, guild
+// or webhook id.
+std::string majorOf(const std::string &route) {
+  for (const char *major : {"/channels/", "/guilds/", "/webhooks/"}) {
+    size_t pos = route.find(major);
+    if (pos == std::string::npos)
+      continue;
+    size_t end = route.find('/', pos + strlen(major));
+    return route.substr(pos, end == std::string::npos ? end : end - pos);
+  }
+  return "";
+}
+
+} // namespace
+
+std::string RateLimiter::routeOf(const std::string &method,
+                                 const std::string &url) {
+  size_t api = url.find(API_HOST);
+  if (api == std::string::npos)
+    return "";
+
+  std::string path = url.substr(api + strlen(API_HOST));
+  size_t query = path.find('?');
+  if (query != std::string::npos)
+    path.resize(query);
+
+  std::string route = method + " ";
+  std::string prev;
+  size_t pos = 0;
+  while (pos < path.size()) {
+    size_t end = path.find('/', pos + 1);
+    if (end == std::string::npos)
+      end = path.size();
+    std::string segment = path.substr(pos + 1, end - pos - 1);
+    pos = end;
+
+    bool version = prev.empty() && segment.size() > 1 && segment[0] == 'v' &&
+                   segment[1] >= '0' && segment[1] <= '9';
+    if (segment.empty() || version)
+      continue;
+    if (isSnowflake(segment) && prev != "channels" && prev != "guilds" &&
+        prev != "webhooks")
+      route += "/:id";
+    else
+      route += "/" + segment;
+    // Every emoji and user under a message's reactions shares one bucket.
+    if (segment == "reactions")
+      break;
+    prev = segment;
+  }
+  return route;
+}
+
+std::string RateLimiter::bucketKeyFor(const std::string &route) const {
+  auto it = routeBuckets.find(route);
+  if (it == routeBuckets.end())
+    return route;
+  return it->second + majorOf(route);
+}
+
+std::string RateLimiter::acquire(const std::string &route, bool background,
+                                 uint64_t now, uint64_t &waitMs) {
+  waitMs = 0;
+  if (now < globalUntil) {
+    waitMs = globalUntil - now;
+    return "";
+  }
+
+  globalTokens = std::min(GLOBAL_PER_SECOND,
+                          globalTokens + (now - globalRefilledAt) *
+                                             GLOBAL_PER_SECOND / 1000.0);
+  globalRefilledAt = now;
+  if (globalTokens < 1.0) {
+    waitMs = (uint64_t)((1.0 - globalTokens) * 1000.0 / GLOBAL_PER_SECOND) + 1;
+    return "";
+  }
+
+  std::string key = bucketKeyFor(route);
+  Bucket &bucket = buckets[key];
+  if (bucket.resetAt != 0 && now >= bucket.resetAt) {
+    bucket.remaining = bucket.limit;
+    bucket.resetAt = 0;
+  }
+
+  int reserve = (background && bucket.limit > 1) ? 1 : 0;
+  if (bucket.remaining - bucket.inFlight <= reserve) {
+    if (bucket.resetAt > now)
+      waitMs = bucket.resetAt - now;
+    return "";
+  }
+
+  bucket.inFlight++;
+  globalTokens -= 1.0;
+  return key;
+}
+
+void RateLimiter::release(const std::string &bucketKey) {
+  auto it = buckets.find(bucketKey);
+  if (it != buckets.end() && it->second.inFlight > 0)
+    it->second.inFlight--;
+}
+
+uint64_t RateLimiter::release(const std::string &bucketKey,
+                              const std::string &route, long statusCode,
+                              const std::map<std::string, std::string> &headers,
+                              uint64_t now) {
+  release(bucketKey);
+
+  std::string key = bucketKey;
+  const std::string *hash = findHeader(headers, "X-RateLimit-Bucket");
+  if (hash && !hash->empty()) {
+    routeBuckets[route] = *hash;
+    key = bucketKeyFor(route);
+  }
+
+  Bucket &bucket = buckets[key];
+  const std::string *limit = findHeader(headers, "X-RateLimit-Limit");
+  const std::string *remaining = findHeader(headers, "X-RateLimit-Remaining");
+  const std::string *resetAfter =
+      findHeader(headers, "X-RateLimit-Reset-After");
+  if (limit)
+    bucket.limit = std::max(1, atoi(limit->c_str()));
+  // Responses from one window can arrive out of order, so within it the
+  // count only goes down; a later one may carry an older, higher count.
+  if (remaining) {
+    int value = atoi(remaining->c_str());
+    bucket.remaining =
+        bucket.resetAt > now ? std::min(bucket.remaining, value) : value;
+  }
+  if (resetAfter)
+    bucket.resetAt = now + (uint64_t)(atof(resetAfter->c_str()) * 1000.0);
+
+  uint64_t retryMs = 0;
+  if (statusCode == 429) {
+    limitedCount++;
+    const std::string *retryAfter = findHeader(headers, "Retry-After");
+    double seconds = retryAfter    ? atof(retryAfter->c_str())
+                     : resetAfter ? atof(resetAfter->c_str())
+                                  : 1.0;
+    retryMs = std::max<uint64_t>(1, (uint64_t)(seconds * 1000.0));
+
+    const std::string *global = findHeader(headers, "X-RateLimit-Global");
+    const std::string *scope = findHeader(headers, "X-RateLimit-Scope");
+    if ((global && *global == "true") || (scope && *scope == "global")) {
+      globalUntil = now + retryMs;
+    } else {
+      bucket.remaining = 0;
+      bucket.resetAt = now + retryMs;
+    }
+    Logger::log("[Network] Rate limited on %s, retry in %llums", route.c_str(),
+                (unsigned long long)retryMs);
+  }
+
+  if (buckets.size() > MAX_BUCKETS)
+    prune(now);
+  return retryMs;
+}
+
+void RateLimiter::prune(uint64_t now) {
+  for (auto it = buckets.begin(); it != buckets.end();) {
+    if (it->second.inFlight == 0 && it->second.resetAt <= now)
+      it = buckets.erase(it);
+    else
+      ++it;
+  }
+}
+
+} // namespace Network
@@ -0,0 +1,146 @@
+#include "network/request_log.h"
+#include "log.h"
+#include "network/connection_manager.h"
+#include "network/network_manager.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace Network {
+
+namespace {
+
+uint32_t infoUs(CURL *easy, CURLINFO info) {
+  curl_off_t us = 0;
+  if (curl_easy_getinfo(easy, info, &us) != CURLE_OK || us < 0)
+    return 0;
+  return (uint32_t)std::min<curl_off_t>(us, UINT32_MAX);
+}
+
+const char *priorityName(RequestPriority priority) {
+  switch (priority) {
+  case RequestPriority::REALTIME:
+    return "realtime";
+  case RequestPriority::INTERACTIVE:
+    return "interactive";
+  case RequestPriority::BACKGROUND:
+    return "background";
+  }
+  return "";
+}
+
+double ms(uint32_t us) { return us / 1000.0; }
+
+} // namespace
+
+void RequestLog::record(CURL *easy, const std::string &method,
+                        const std::string &url, RequestPriority priority,
+                        long status, CURLcode result, uint64_t enqueuedAt,
+                        uint64_t startedAt) {
+  RequestTiming timing;
+  timing.method = method;
+  timing.url = url;
+  timing.priority = priority;
+  timing.status = status;
+  timing.result = result;
+  timing.enqueuedAt = enqueuedAt;
+  timing.startedAt = startedAt;
+
+  long connects = 0;
+  curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+  timing.newConnection = connects > 0;
+
+  // curl leaves a phase at 0 when it was skipped or never reached, so each
+  // end is clamped to the one before to keep the phases in order.
+  timing.dnsEndUs = infoUs(easy, CURLINFO_NAMELOOKUP_TIME_T);
+  timing.connectEndUs =
+      std::max(timing.dnsEndUs, infoUs(easy, CURLINFO_CONNECT_TIME_T));
+  timing.tlsEndUs =
+      std::max(timing.connectEndUs, infoUs(easy, CURLINFO_APPCONNECT_TIME_T));
+  timing.totalUs =
+      std::max(timing.tlsEndUs, infoUs(easy, CURLINFO_TOTAL_TIME_T));
+  uint32_t firstByteUs = infoUs(easy, CURLINFO_STARTTRANSFER_TIME_T);
+  timing.firstByteUs =
+      firstByteUs ? std::min(std::max(timing.tlsEndUs, firstByteUs),
+                             timing.totalUs)
+                  : timing.totalUs;
+
+  curl_off_t bytes = 0;
+  curl_easy_getinfo(easy, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+  timing.bytes = bytes > 0 ? (uint64_t)bytes : 0;
+
+  HostTiming &host = hostTotals[ConnectionManager::hostOf(url)];
+  host.requests++;
+  if (status == 0 || status >= 500)
+    host.failures++;
+  if (timing.newConnection)
+    host.newConnections++;
+  host.queueMs += timing.queueMs();
+  host.firstByteUs += timing.firstByteUs;
+  host.totalUs += timing.totalUs;
+  host.maxTotalUs = std::max(host.maxTotalUs, timing.totalUs);
+  host.bytes += timing.bytes;
+
+  if (ring.size() < HISTORY) {
+    ring.push_back(std::move(timing));
+  } else {
+    ring[next] = std::move(timing);
+    next = (next + 1) % HISTORY;
+  }
+}
+
+std::vector<RequestTiming> RequestLog::recent(size_t count) const {
+  count = std::min(count, ring.size());
+  std::vector<RequestTiming> timings;
+  timings.reserve(count);
+  // Until the ring fills, next stays 0 and the oldest entry is the first.
+  size_t start = next + ring.size() - count;
+  for (size_t i = 0; i < count; i++)
+    timings.push_back(ring[(start + i) % ring.size()]);
+  return timings;
+}
+
+std::vector<HostTiming> RequestLog::hosts() const {
+  std::vector<HostTiming> hosts;
+  hosts.reserve(hostTotals.size());
+  for (const auto &pair : hostTotals) {
+    hosts.push_back(pair.second);
+    hosts.back().host = pair.first;
+  }
+  std::sort(hosts.begin(), hosts.end(),
+            [](const HostTiming &a, const HostTiming &b) {
+              return a.requests > b.requests;
+            });
+  return hosts;
+}
+
+bool RequestLog::writeCsv(const std::string &path,
+                          const std::vector<RequestTiming> &timings) {
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f) {
+    Logger::log("[Network] Could not open %s", path.c_str());
+    return false;
+  }
+
+  // One row per transfer, oldest first; the phases are durations in ms.
+  fprintf(f, "started_ms,method,url,priority,status,curl_result,"
+             "new_connection,queue_ms,dns_ms,connect_ms,tls_ms,wait_ms,"
+             "receive_ms,total_ms,bytes\n");
+  for (const auto &t : timings) {
+    fprintf(f, "%llu,%s,\"%s\",%s,%ld,%d,%d,%lu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,"
+               "%llu\n",
+            (unsigned long long)t.startedAt, t.method.c_str(), t.url.c_str(),
+            priorityName(t.priority), t.status, (int)t.result,
+            t.newConnection ? 1 : 0, (unsigned long)t.queueMs(),
+            ms(t.dnsEndUs), ms(t.connectEndUs - t.dnsEndUs),
+            ms(t.tlsEndUs - t.connectEndUs), ms(t.firstByteUs - t.tlsEndUs),
+            ms(t.totalUs - t.firstByteUs), ms(t.totalUs),
+            (unsigned long long)t.bytes);
+  }
+
+  fclose(f);
+  Logger::log("[Network] Dumped %zu request timings to %s", timings.size(),
+              path.c_str());
+  return true;
+}
+
+} // namespace Network
@@ -0,0 +1,67 @@
+#include "network/transfer_slots.h"
+
+namespace Network {
+
+uint64_t TransferSlots::dueAt(RequestPriority priority, uint64_t enqueuedAt,
+                              uint64_t deadline) {
+  uint64_t due = enqueuedAt;
+  if (priority == RequestPriority::INTERACTIVE)
+    due += INTERACTIVE_SLACK_MS;
+  else if (priority == RequestPriority::BACKGROUND)
+    due += BACKGROUND_SLACK_MS;
+  if (deadline != 0 && deadline < due)
+    due = deadline;
+  return due;
+}
+
+void TransferSlots::setLimits(int interactiveLimit, int backgroundLimit) {
+  this->interactiveLimit = interactiveLimit;
+  this->backgroundLimit = backgroundLimit;
+}
+
+TransferSlots::Share TransferSlots::shareFor(RequestPriority priority,
+                                             uint64_t due, uint64_t now,
+                                             uint64_t &waitMs) const {
+  waitMs = 0;
+  bool urgentFree = urgent + borrowed < interactiveLimit;
+  if (priority == RequestPriority::REALTIME)
+    return Share::URGENT;
+  if (priority == RequestPriority::INTERACTIVE)
+    return urgentFree ? Share::URGENT : Share::NONE;
+
+  if (background < backgroundLimit)
+    return Share::BACKGROUND;
+  if (!urgentFree || borrowed >= interactiveLimit / 2)
+    return Share::NONE;
+  if (due > now) {
+    waitMs = due - now;
+    return Share::NONE;
+  }
+  return Share::BORROWED;
+}
+
+void TransferSlots::take(Share share) {
+  if (share == Share::URGENT)
+    urgent++;
+  else if (share == Share::BACKGROUND)
+    background++;
+  else if (share == Share::BORROWED)
+    borrowed++;
+}
+
+void TransferSlots::give(Share share) {
+  if (share == Share::URGENT)
+    urgent--;
+  else if (share == Share::BACKGROUND)
+    background--;
+  else if (share == Share::BORROWED)
+    borrowed--;
+}
+
+void TransferSlots::reset() {
+  urgent = 0;
+  background = 0;
+  borrowed = 0;
+}
+
+} // namespace Network
@@ -0,0 +1,104 @@
+#include "network/trust_store.h"
+#include "log.h"
+#include <3ds.h>
+#include <cstring>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+
+namespace Network {
+
+namespace {
+
+// Built from the full bundle by the Makefile; see tools/trusted-roots.txt.
+const char *TRUSTED_ROOTS_PATH = "romfs:/trusted-roots.pem";
+const char *FULL_BUNDLE_PATH = "romfs:/cacert-2025-12-02.pem";
+
+} // namespace
+
+TrustStore &TrustStore::getInstance() {
+  static TrustStore instance;
+  return instance;
+}
+
+mbedtls_x509_crt *TrustStore::load(const char *path) {
+  u64 startedAt = osGetTime();
+  mbedtls_x509_crt *chain = new mbedtls_x509_crt;
+  mbedtls_x509_crt_init(chain);
+  // A positive result counts certificates that failed to parse; the rest
+  // are still usable.
+  int ret = mbedtls_x509_crt_parse_file(chain, path);
+  if (ret < 0 || chain->version == 0) {
+    Logger::log("[TLS] Can't load roots from %s: %d", path, ret);
+    mbedtls_x509_crt_free(chain);
+    delete chain;
+    return nullptr;
+  }
+
+  int count = 0;
+  for (mbedtls_x509_crt *crt = chain; crt; crt = crt->next)
+    count++;
+  Logger::log("[TLS] %d roots from %s in %llums", count, path,
+              (unsigned long long)(osGetTime() - startedAt));
+  return chain;
+}
+
+mbedtls_x509_crt *TrustStore::roots() {
+  mbedtls_x509_crt *current = active.load();
+  if (current)
+    return current;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!loaded) {
+    loaded = true;
+    current = load(TRUSTED_ROOTS_PATH);
+    if (!current) {
+      widened = true;
+      current = load(FULL_BUNDLE_PATH);
+    }
+    active = current;
+  }
+  return active.load();
+}
+
+bool TrustStore::widen() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (widened)
+    return false;
+  widened = true;
+
+  mbedtls_x509_crt *full = load(FULL_BUNDLE_PATH);
+  if (!full)
+    return false;
+  // The trimmed chain stays allocated: handshakes under way still use it.
+  active = full;
+  Logger::log("[TLS] Verification failed against the trimmed roots; using "
+              "the full bundle");
+  return true;
+}
+
+CURLcode TrustStore::sslContextCallback(CURL *curl, void *sslContext,
+                                        void *userptr) {
+  mbedtls_x509_crt *chain = getInstance().roots();
+  if (!chain)
+    return CURLE_SSL_CACERT_BADFILE;
+  mbedtls_ssl_conf_ca_chain((mbedtls_ssl_config *)sslContext, chain, nullptr);
+  return CURLE_OK;
+}
+
+void TrustStore::configure(CURL *handle) {
+  // The callback is handed the backend's own config type, so it only works
+  // with mbedTLS.
+  const curl_version_info_data *info = curl_version_info(CURLVERSION_NOW);
+  bool mbedtls =
+      info->ssl_version && strncmp(info->ssl_version, "mbedTLS", 7) == 0;
+  if (mbedtls && roots() &&
+      curl_easy_setopt(handle, CURLOPT_SSL_CTX_FUNCTION, sslContextCallback) ==
+          CURLE_OK) {
+    curl_easy_setopt(handle, CURLOPT_CAINFO, nullptr);
+    curl_easy_setopt(handle, CURLOPT_CAPATH, nullptr);
+    return;
+  }
+  curl_easy_setopt(handle, CURLOPT_CAINFO, FULL_BUNDLE_PATH);
+}
+
+} // namespace Network
@@ -1,6 +1,7 @@
 #include "network/websocket_client.h"
 #include "config.h"
 #include "log.h"
+#include "network/trust_store.h"
 #include "utils/base64_utils.h"
 
 #include <cstdio>
@@ -16,6 +17,7 @@
 #include <mbedtls/net_sockets.h>
 #include <mbedtls/sha1.h>
 #include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
 
 namespace Network {
 
@@ -237,8 +239,16 @@ bool WebSocketClient::connect(const std::string &url) {
     return false;
   }
 
-  mbedtls_ssl_conf_authmode((mbedtls_ssl_config *)sslConfig,
-                            MBEDTLS_SSL_VERIFY_NONE);
+  mbedtls_x509_crt *roots = TrustStore::getInstance().roots();
+  if (roots) {
+    mbedtls_ssl_conf_authmode((mbedtls_ssl_config *)sslConfig,
+                              MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain((mbedtls_ssl_config *)sslConfig, roots, nullptr);
+  } else {
+    Logger::log("[WS] No CA roots, connecting without verification");
+    mbedtls_ssl_conf_authmode((mbedtls_ssl_config *)sslConfig,
+                              MBEDTLS_SSL_VERIFY_NONE);
+  }
   mbedtls_ssl_conf_rng((mbedtls_ssl_config *)sslConfig, mbedtls_ctr_drbg_random,
                        ctrDrbg);
 
@@ -270,6 +280,9 @@ bool WebSocketClient::connect(const std::string &url) {
       Logger::log("[WS] TLS handshake failed: %d", ret);
       state = WebSocketState::DISCONNECTED;
       cleanupTLS();
+      if (ret == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED &&
+          TrustStore::getInstance().widen())
+        return connect(url);
       return false;
     }
   }
@@ -1,6 +1,8 @@
 #include "ui/about_screen.h"
 #include "core/config.h"
+#include "core/frame_scheduler.h"
 #include "core/i18n.h"
+#include "core/profiler.h"
 #include "ui/image_manager.h"
 #include "ui/screen_manager.h"
 #include "utils/message_utils.h"
@@ -21,6 +23,7 @@ void AboutScreen::onEnter() {
 void AboutScreen::update() {
   animTimer += 0.02f;
   logoBounce = std::sin(animTimer) * 5.0f;
+  Core::FrameScheduler::getInstance().requestAnimationFrame(Core::REDRAW_TOP);
 
   u32 kDown = hidKeysDown();
   u32 kHeld = hidKeysHeld();
@@ -66,6 +69,7 @@ void AboutScreen::update() {
 }
 
 void AboutScreen::renderTop(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("AboutScreen::renderTop");
   C2D_SceneBegin(target);
   C2D_TargetClear(target, ScreenManager::colorBackground());
 
@@ -107,6 +111,7 @@ void AboutScreen::renderTop(C3D_RenderTarget *target) {
 }
 
 void AboutScreen::renderBottom(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("AboutScreen::renderBottom");
   C2D_SceneBegin(target);
   C2D_TargetClear(target, ScreenManager::colorBackgroundDark());
 
@@ -0,0 +1,205 @@
+#include "ui/asset_pack.h"
+#include "log.h"
+#include "ui/decode_pool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+
+namespace UI {
+
+namespace {
+
+const u32 FILE_MAGIC = 0x4B504354; // "TCPK"
+const u16 FORMAT_VERSION = 1;
+
+struct FileHeader {
+  u32 magic;
+  u16 version;
+  u16 sheetCount;
+  u32 entryCount;
+  u32 keyBytes;
+};
+
+struct SheetRecord {
+  u16 w, h;
+  u8 format;
+  u8 reserved[3];
+  u32 offset;
+  u32 packedSize;
+  u32 rawSize;
+};
+
+struct EntryRecord {
+  u32 keyOffset;
+  u16 keyLength;
+  u16 sheet;
+  u16 x, y;
+  u16 w, h;
+};
+
+static_assert(sizeof(FileHeader) == 16, "pack header layout");
+static_assert(sizeof(SheetRecord) == 20, "pack sheet layout");
+static_assert(sizeof(EntryRecord) == 16, "pack entry layout");
+
+template <typename T> bool readArray(FILE *f, std::vector<T> &out, u32 n) {
+  out.resize(n);
+  return n == 0 || fread(out.data(), sizeof(T), n, f) == n;
+}
+
+} // namespace
+
+bool AssetPack::open(const std::string &packPath) {
+  close();
+
+  FILE *f = fopen(packPath.c_str(), "rb");
+  if (!f) {
+    Logger::log("[Pack] Missing %s", packPath.c_str());
+    return false;
+  }
+
+  FileHeader header;
+  std::vector<SheetRecord> sheetRecords;
+  std::vector<EntryRecord> entryRecords;
+  bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+            header.magic == FILE_MAGIC && header.version == FORMAT_VERSION &&
+            readArray(f, sheetRecords, header.sheetCount) &&
+            readArray(f, entryRecords, header.entryCount);
+  if (ok) {
+    keys.resize(header.keyBytes);
+    ok = header.keyBytes == 0 ||
+         fread(&keys[0], 1, header.keyBytes, f) == header.keyBytes;
+  }
+  fclose(f);
+  if (!ok) {
+    Logger::log("[Pack] Bad pack %s", packPath.c_str());
+    keys.clear();
+    return false;
+  }
+
+  for (const auto &rec : sheetRecords) {
+    Sheet sheet;
+    sheet.w = rec.w;
+    sheet.h = rec.h;
+    sheet.format = (GPU_TEXCOLOR)rec.format;
+    sheet.offset = rec.offset;
+    sheet.packedSize = rec.packedSize;
+    sheet.rawSize = rec.rawSize;
+    sheets.push_back(sheet);
+  }
+
+  entries.reserve(entryRecords.size());
+  subtextures.reserve(entryRecords.size());
+  for (const auto &rec : entryRecords) {
+    if (rec.sheet >= sheets.size() ||
+        rec.keyOffset + rec.keyLength > keys.size())
+      continue;
+    entries.push_back({rec.keyOffset, rec.keyLength, rec.sheet});
+
+    // Inset by half a texel so filtering never reaches the next cell.
+    const Sheet &sheet = sheets[rec.sheet];
+    Tex3DS_SubTexture subtex;
+    subtex.width = rec.w;
+    subtex.height = rec.h;
+    subtex.left = (rec.x + 0.5f) / sheet.w;
+    subtex.right = (rec.x + rec.w - 0.5f) / sheet.w;
+    subtex.top = 1.0f - (rec.y + 0.5f) / sheet.h;
+    subtex.bottom = 1.0f - (rec.y + rec.h - 0.5f) / sheet.h;
+    subtextures.push_back(subtex);
+  }
+
+  path = packPath;
+  Logger::log("[Pack] %s: %zu images in %zu sheets", name.c_str(),
+              entries.size(), sheets.size());
+  return true;
+}
+
+void AssetPack::close() {
+  DecodePool::getInstance().cancel(this);
+  sheets.clear();
+  entries.clear();
+  subtextures.clear();
+  keys.clear();
+  path.clear();
+}
+
+int AssetPack::find(const std::string &key) const {
+  auto less = [this](const Entry &e, const std::string &k) {
+    int c = memcmp(keys.data() + e.keyOffset, k.data(),
+                   std::min<size_t>(e.keyLength, k.size()));
+    return c != 0 ? c < 0 : e.keyLength < k.size();
+  };
+  auto it = std::lower_bound(entries.begin(), entries.end(), key, less);
+  if (it == entries.end() || it->keyLength != key.size() ||
+      memcmp(keys.data() + it->keyOffset, key.data(), key.size()) != 0)
+    return -1;
+  return (int)(it - entries.begin());
+}
+
+std::string AssetPack::sheetKey(int sheet) const {
+  return name + ":" + std::to_string(sheet);
+}
+
+Utils::Image::TiledData AssetPack::loadSheet(const std::string &path,
+                                             const Sheet &sheet) {
+  Utils::Image::TiledData tiled;
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return tiled;
+
+  std::vector<u8> packed(sheet.packedSize);
+  bool ok = fseek(f, sheet.offset, SEEK_SET) == 0 &&
+            fread(packed.data(), 1, packed.size(), f) == packed.size();
+  fclose(f);
+  if (!ok || !Utils::Image::allocTiled(tiled, sheet.rawSize))
+    return tiled;
+
+  uLongf rawSize = sheet.rawSize;
+  if (uncompress((Bytef *)tiled.pixels, &rawSize, packed.data(),
+                 packed.size()) != Z_OK ||
+      rawSize != sheet.rawSize) {
+    Utils::Image::freeTiled(tiled);
+    return tiled;
+  }
+
+  tiled.w = tiled.p2w = sheet.w;
+  tiled.h = tiled.p2h = sheet.h;
+  tiled.format = sheet.format;
+  tiled.vramSize = sheet.rawSize;
+  Utils::Image::flushTiled(tiled);
+  return tiled;
+}
+
+C2D_Image AssetPack::getImage(int index) {
+  if (index < 0 || index >= (int)entries.size())
+    return {};
+
+  int sheetIndex = entries[index].sheet;
+  std::string key = sheetKey(sheetIndex);
+  TextureCache::TextureInfo info;
+  if (TextureCache::getInstance().find(key, cls, &info))
+    return {info.tex, info.tex ? &subtextures[index] : nullptr};
+
+  DecodePool &pool = DecodePool::getInstance();
+  pool.markVisible(key);
+  Sheet &sheet = sheets[sheetIndex];
+  if (sheet.loading)
+    return {};
+  sheet.loading = true;
+
+  DecodePool::Job job;
+  job.key = key;
+  std::string packPath = path;
+  Sheet copy = sheet;
+  job.produce = [packPath, copy]() { return loadSheet(packPath, copy); };
+  job.priority = Network::RequestPriority::INTERACTIVE;
+  job.owner = this;
+  job.done = [this, sheetIndex, key](Utils::Image::TiledData &tiled) {
+    sheets[sheetIndex].loading = false;
+    TextureCache::getInstance().insertTiled(key, cls, tiled);
+  };
+  pool.submit(std::move(job));
+  return {};
+}
+
+} // namespace UI
@@ -0,0 +1,243 @@
+#include "ui/decode_pool.h"
+#include "core/frame_scheduler.h"
+#include "core/profiler.h"
+#include "log.h"
+#include "ui/texture_disk_cache.h"
+#include <malloc.h>
+
+namespace UI {
+
+DecodePool &DecodePool::getInstance() {
+  static DecodePool instance;
+  return instance;
+}
+
+DecodePool::~DecodePool() { shutdown(); }
+
+void DecodePool::init() {
+  if (!workers.empty())
+    return;
+
+  bool isNew3DS = false;
+  APT_CheckNew3DS(&isNew3DS);
+
+  s32 mainPriority = 0x30;
+  svcGetThreadPriority(&mainPriority, CUR_THREAD_HANDLE);
+  s32 workerPriority = mainPriority + 1;
+
+  // -2 is the application's default core; core 2 only exists on New 3DS.
+  std::vector<int> cores = {-2};
+  if (isNew3DS)
+    cores.insert(cores.begin(), 2);
+
+  stopWorkers = false;
+  for (int core : cores) {
+    Thread t = threadCreate(workerEntry, this, WORKER_STACK_SIZE,
+                            workerPriority, core, false);
+    if (!t && core != -2)
+      t = threadCreate(workerEntry, this, WORKER_STACK_SIZE, workerPriority,
+                       -2, false);
+    if (t)
+      workers.push_back(t);
+  }
+
+  Logger::log("[Decode] %d worker(s) (%s)", (int)workers.size(),
+              isNew3DS ? "New 3DS" : "Old 3DS");
+}
+
+void DecodePool::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopWorkers = true;
+  }
+  jobCv.notify_all();
+  for (Thread t : workers) {
+    threadJoin(t, U64_MAX);
+    threadFree(t);
+  }
+  workers.clear();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  jobs.clear();
+  for (auto &r : results)
+    Utils::Image::freeTiled(r.tiled);
+  results.clear();
+}
+
+void DecodePool::submit(Job job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopWorkers || workers.empty())
+      return;
+    jobs.push_back(std::move(job));
+  }
+  jobCv.notify_one();
+}
+
+void DecodePool::deliver(const std::string &key, const void *owner,
+                         Utils::Image::TiledData &tiled, DoneCallback done) {
+  Result r;
+  r.key = key;
+  r.owner = owner;
+  r.tiled = tiled;
+  r.done = std::move(done);
+  tiled.pixels = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    results.push_back(std::move(r));
+  }
+  Core::FrameScheduler::getInstance().requestRedraw();
+}
+
+void DecodePool::markVisible(const std::string &key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  frameVisible.insert(key);
+}
+
+void DecodePool::cancel(const void *owner) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto it = jobs.begin(); it != jobs.end();) {
+    if (it->owner == owner)
+      it = jobs.erase(it);
+    else
+      ++it;
+  }
+  for (auto it = results.begin(); it != results.end();) {
+    if (it->owner == owner) {
+      Utils::Image::freeTiled(it->tiled);
+      it = results.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+size_t DecodePool::getQueuedCount() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return jobs.size();
+}
+
+bool DecodePool::popBest(Job &out) {
+  if (jobs.empty())
+    return false;
+
+  auto best = jobs.begin();
+  bool bestVisible = visibleKeys.count(best->key) > 0;
+  for (auto it = std::next(jobs.begin()); it != jobs.end(); ++it) {
+    bool visible = visibleKeys.count(it->key) > 0;
+    if (visible != bestVisible) {
+      if (visible) {
+        best = it;
+        bestVisible = true;
+      }
+      continue;
+    }
+    if (it->priority < best->priority)
+      best = it;
+  }
+
+  out = std::move(*best);
+  jobs.erase(best);
+  return true;
+}
+
+void DecodePool::workerEntry(void *arg) {
+  static_cast<DecodePool *>(arg)->workerLoop();
+}
+
+void DecodePool::workerLoop() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      jobCv.wait(lock, [this] { return stopWorkers || !jobs.empty(); });
+      if (stopWorkers)
+        return;
+      popBest(job);
+    }
+
+    Utils::Image::TiledData tiled =
+        job.produce ? job.produce()
+                    : Utils::Image::decodeToTiled(
+                          (const unsigned char *)job.data.data(),
+                          job.data.size());
+    std::string().swap(job.data);
+    if (!job.diskKey.empty())
+      TextureDiskCache::getInstance().store(job.diskKey, tiled);
+
+    deliver(job.key, job.owner, tiled, std::move(job.done));
+  }
+}
+
+bool DecodePool::popUpload(size_t bytesUsed, bool first, Result &out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (results.empty())
+    return false;
+
+  auto pick = results.begin();
+  for (auto it = results.begin(); it != results.end(); ++it) {
+    if (visibleKeys.count(it->key)) {
+      pick = it;
+      break;
+    }
+  }
+  if (!first && bytesUsed + pick->tiled.vramSize > UPLOAD_BUDGET_BYTES)
+    return false;
+
+  out = std::move(*pick);
+  results.erase(pick);
+  return true;
+}
+
+void DecodePool::update() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    visibleKeys.swap(frameVisible);
+    frameVisible.clear();
+  }
+
+  PROFILE_SCOPE("Texture upload");
+  u64 start = svcGetSystemTick();
+  u64 budgetTicks = (u64)(UPLOAD_BUDGET_US * CPU_TICKS_PER_USEC);
+  size_t bytesUsed = 0;
+  u32 uploaded = 0;
+  Result r;
+  // Always take one, so a single oversized texture cannot stall the queue.
+  while (popUpload(bytesUsed, uploaded == 0, r)) {
+    bytesUsed += r.tiled.vramSize;
+    uploaded++;
+    if (r.done)
+      r.done(r.tiled);
+    else
+      Utils::Image::freeTiled(r.tiled);
+    r = Result();
+    if (svcGetSystemTick() - start >= budgetTicks)
+      break;
+  }
+  if (uploaded == 0)
+    return;
+
+  u64 elapsed = svcGetSystemTick() - start;
+  bool more;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.textures += uploaded;
+    stats.bytes += bytesUsed;
+    stats.ticks += elapsed;
+    u32 us = (u32)(elapsed / CPU_TICKS_PER_USEC);
+    if (us > stats.worstFrameUs)
+      stats.worstFrameUs = us;
+    more = !results.empty();
+  }
+
+  // More finished work is waiting; make sure the next frame comes.
+  if (more)
+    Core::FrameScheduler::getInstance().requestRedraw();
+}
+
+DecodePool::UploadStats DecodePool::getUploadStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return stats;
+}
+
+} // namespace UI
@@ -1,6 +1,7 @@
 #include "ui/disclaimer_screen.h"
 #include "core/config.h"
 #include "core/i18n.h"
+#include "core/profiler.h"
 #include "discord/discord_client.h"
 #include "ui/image_manager.h"
 #include "ui/screen_manager.h"
@@ -37,6 +38,7 @@ void DisclaimerScreen::update() {
 }
 
 void DisclaimerScreen::renderTop(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("DisclaimerScreen::renderTop");
   C2D_SceneBegin(target);
   C2D_TargetClear(target, ScreenManager::colorBackground());
 
@@ -60,6 +62,7 @@ void DisclaimerScreen::renderTop(C3D_RenderTarget *target) {
 }
 
 void DisclaimerScreen::renderBottom(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("DisclaimerScreen::renderBottom");
   C2D_SceneBegin(target);
   C2D_TargetClear(target, ScreenManager::colorBackgroundDark());
 
@@ -1,5 +1,6 @@
 #include "ui/dm_screen.h"
 #include "core/i18n.h"
+#include "core/profiler.h"
 #include "discord/avatar_cache.h"
 #include "discord/discord_client.h"
 #include "log.h"
@@ -99,6 +100,7 @@ void DmScreen::update() {
 }
 
 void DmScreen::renderTop(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("DmScreen::renderTop");
   C2D_TargetClear(target, ScreenManager::colorBackground());
   C2D_SceneBegin(target);
 
@@ -126,6 +128,7 @@ void DmScreen::renderTop(C3D_RenderTarget *target) {
 }
 
 void DmScreen::renderBottom(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("DmScreen::renderBottom");
   C2D_SceneBegin(target);
   C2D_TargetClear(target, ScreenManager::colorBackgroundDark());
 
@@ -184,33 +187,27 @@ void DmScreen::drawDmItem(int index, const Discord::Channel &dm, float y) {
   u32 textColor =
       isSelected ? ScreenManager::colorText() : ScreenManager::colorTextMuted();
 
-  C3D_Tex *avatarTex = nullptr;
+  C2D_Image avatar = {};
   if (dm.type == 1 && !dm.recipients.empty()) {
     const auto &r = dm.recipients[0];
-    avatarTex = Discord::AvatarCache::getInstance().getAvatar(r.id, r.avatar,
-                                                              r.discriminator);
+    avatar = Discord::AvatarCache::getInstance().getAvatar(r.id, r.avatar,
+                                                           r.discriminator);
   } else if (dm.type == 3 && !dm.icon.empty()) {
-    avatarTex =
-        Discord::AvatarCache::getInstance().getGuildIcon(dm.id, dm.icon);
+    avatar = Discord::AvatarCache::getInstance().getGuildIcon(dm.id, dm.icon);
   }
 
-  if (avatarTex) {
-    Tex3DS_SubTexture subtex = {
-        (u16)avatarTex->width, (u16)avatarTex->height, 0.0f, 1.0f, 1.0f, 0.0f};
-    C2D_Image img = {avatarTex, &subtex};
-    C2D_DrawImageAt(img, 18.0f, y + 8.0f, 0.5f, nullptr,
-                    32.0f / avatarTex->width, 32.0f / avatarTex->height);
+  if (avatar.tex) {
+    C2D_DrawImageAt(avatar, 18.0f, y + 8.0f, 0.5f, nullptr,
+                    32.0f / avatar.subtex->width,
+                    32.0f / avatar.subtex->height);
   } else {
     std::string iconPath = "romfs:/discord-icons/chat.png";
-    C3D_Tex *tex = UI::ImageManager::getInstance().getLocalImage(iconPath);
-    if (tex) {
-      Tex3DS_SubTexture subtex = {
-          (u16)tex->width, (u16)tex->height, 0.0f, 1.0f, 1.0f, 0.0f};
-      C2D_Image img = {tex, &subtex};
+    C2D_Image img = UI::ImageManager::getInstance().getLocalIcon(iconPath);
+    if (img.tex) {
       C2D_ImageTint tint;
       C2D_PlainImageTint(&tint, textColor, 1.0f);
-      C2D_DrawImageAt(img, 20.0f, y + 12.0f, 0.5f, &tint, 24.0f / tex->width,
-                      24.0f / tex->height);
+      C2D_DrawImageAt(img, 20.0f, y + 12.0f, 0.5f, &tint,
+                      24.0f / img.subtex->width, 24.0f / img.subtex->height);
     }
   }
 
@@ -1,9 +1,11 @@
 #include "ui/emoji_manager.h"
 #include "log.h"
 #include "network/network_manager.h"
+#include "ui/decode_pool.h"
+#include "ui/texture_cache.h"
+#include "ui/texture_disk_cache.h"
 #include "utils/image_utils.h"
-#include <cstdio>
-#include <malloc.h>
+#include <cstdlib>
 
 namespace UI {
 
@@ -12,38 +14,42 @@ EmojiManager &EmojiManager::getInstance() {
   return instance;
 }
 
-void EmojiManager::init() {}
+void EmojiManager::init() { twemoji.open("romfs:/packs/twemoji.pack"); }
 
 void EmojiManager::shutdown() {
-  std::unique_lock<std::shared_mutex> lock(cacheMutex);
-  for (auto &pair : emojiCache) {
-    if (pair.second.tex) {
-      C3D_TexDelete(pair.second.tex);
-      free(pair.second.tex);
-    }
-  }
-  for (auto &pair : twemojiCache) {
-    if (pair.second.tex) {
-      C3D_TexDelete(pair.second.tex);
-      free(pair.second.tex);
-    }
-  }
-  emojiCache.clear();
-  twemojiCache.clear();
+  DecodePool::getInstance().cancel(this);
+  twemoji.close();
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  requestedEmoji.clear();
 }
 
 EmojiManager::~EmojiManager() { shutdown(); }
 
 void EmojiManager::update() {}
 
-EmojiManager::EmojiInfo EmojiManager::getEmojiInfo(const std::string &emojiId) {
-  std::shared_lock<std::shared_mutex> lock(cacheMutex);
-  auto it = emojiCache.find(emojiId);
-  if (it != emojiCache.end()) {
-    return it->second;
+EmojiManager::EmojiInfo EmojiManager::lookup(const std::string &key) {
+  EmojiInfo info;
+  TextureCache::TextureInfo cached;
+  if (TextureCache::getInstance().find(key, TextureClass::EMOJI, &cached)) {
+    info.tex = cached.tex;
+    info.image = cached.image;
+    info.originalW = cached.originalW;
+    info.originalH = cached.originalH;
   }
+  return info;
+}
 
-  return EmojiInfo();
+EmojiManager::EmojiInfo EmojiManager::getEmojiInfo(const std::string &emojiId) {
+  EmojiInfo info = lookup("emoji:" + emojiId);
+  if (!info.tex) {
+    DecodePool::getInstance().markVisible("emoji:" + emojiId);
+    // Re-request custom emoji that were evicted after loading.
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (requestedEmoji.count(emojiId) &&
+        !TextureCache::getInstance().contains("emoji:" + emojiId))
+      requestedEmoji.erase(emojiId);
+  }
+  return info;
 }
 
 void EmojiManager::prefetchEmoji(const std::string &emojiId) {
@@ -51,37 +57,51 @@ void EmojiManager::prefetchEmoji(const std::string &emojiId) {
     return;
 
   {
-    std::unique_lock<std::shared_mutex> lock(cacheMutex);
-    if (emojiCache.count(emojiId))
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (!requestedEmoji.insert(emojiId).second)
       return;
-
-    EmojiInfo placeholder;
-    placeholder.tex = nullptr;
-    placeholder.originalW = 0;
-    placeholder.originalH = 0;
-    emojiCache[emojiId] = placeholder;
   }
 
   std::string url =
       "https://media.discordapp.net/emojis/" + emojiId + ".png?size=32";
 
-  Network::NetworkManager::getInstance().enqueue(
-      url, "GET", "", Network::RequestPriority::INTERACTIVE,
-      [this, emojiId](const Network::HttpResponse &resp) {
-        if (resp.statusCode == 200 && !resp.body.empty()) {
-          int w, h;
-          C3D_Tex *tex = Utils::Image::loadTextureFromMemory(
-              (const unsigned char *)resp.body.data(), resp.body.size(), w, h);
-          if (tex) {
-            std::unique_lock<std::shared_mutex> lock(cacheMutex);
-            EmojiInfo info;
-            info.tex = tex;
-            info.originalW = w;
-            info.originalH = h;
-            emojiCache[emojiId] = info;
+  std::string key = "emoji:" + emojiId;
+  auto insertTiled = [key](Utils::Image::TiledData &tiled) {
+    TextureCache::getInstance().insertTiled(key, TextureClass::EMOJI, tiled);
+  };
+
+  auto fetch = [this, url, key, insertTiled]() {
+    Network::NetworkManager::getInstance().enqueue(
+        url, "GET", "", Network::RequestPriority::INTERACTIVE,
+        [this, url, key, insertTiled](Network::HttpResponse &resp) {
+          if (resp.statusCode != 200 || resp.body.empty()) {
+            Utils::Image::TiledData empty;
+            DecodePool::getInstance().deliver(key, this, empty, insertTiled);
+            return;
           }
-        }
-      });
+          DecodePool::Job job;
+          job.key = key;
+          job.data = resp.takeBody();
+          job.diskKey = url;
+          job.priority = Network::RequestPriority::INTERACTIVE;
+          job.owner = this;
+          job.done = insertTiled;
+          DecodePool::getInstance().submit(std::move(job));
+        });
+  };
+
+  TextureDiskCache &disk = TextureDiskCache::getInstance();
+  if (disk.contains(url)) {
+    disk.load(url, [this, key, fetch,
+                    insertTiled](Utils::Image::TiledData &tiled) {
+      if (tiled.pixels)
+        DecodePool::getInstance().deliver(key, this, tiled, insertTiled);
+      else
+        fetch();
+    });
+    return;
+  }
+  fetch();
 }
 
 void EmojiManager::prefetchEmojisFromText(const std::string &text) {
@@ -114,64 +134,51 @@ void EmojiManager::prefetchEmojisFromText(const std::string &text) {
   }
 }
 
-EmojiManager::EmojiInfo
-EmojiManager::getTwemojiInfo(const std::string &codepointHex) {
-  {
-    std::shared_lock<std::shared_mutex> lock(cacheMutex);
-    auto it = twemojiCache.find(codepointHex);
-    if (it != twemojiCache.end()) {
-      return it->second;
+int EmojiManager::findTwemoji(const std::string &codepointHex) const {
+  // Pack keys are the codepoints as big-endian u32s.
+  auto toKey = [](const std::string &hex, bool skipFe0f) {
+    std::string key;
+    const char *p = hex.c_str();
+    while (*p) {
+      char *end;
+      unsigned long cp = strtoul(p, &end, 16);
+      if (end == p)
+        return std::string();
+      if (!(skipFe0f && cp == 0xFE0F)) {
+        key += (char)(cp >> 24);
+        key += (char)(cp >> 16);
+        key += (char)(cp >> 8);
+        key += (char)cp;
+      }
+      p = (*end == '-') ? end + 1 : end;
     }
-  }
-
-  auto getPath = [](const std::string &h) {
-    return "romfs:/twemoji17/" + h + ".png";
+    return key;
   };
 
-  std::string hex = codepointHex;
-  std::string path = getPath(hex);
-  FILE *f = fopen(path.c_str(), "rb");
+  int index = twemoji.find(toKey(codepointHex, false));
+  if (index < 0 && codepointHex.find("fe0f") != std::string::npos)
+    index = twemoji.find(toKey(codepointHex, true));
+  return index;
+}
 
-  if (!f) {
-    std::string strippedHex = hex;
-    size_t pos = 0;
-    while ((pos = strippedHex.find("-fe0f")) != std::string::npos) {
-      strippedHex.erase(pos, 5);
-    }
-    if (strippedHex != hex) {
-      hex = strippedHex;
-      path = getPath(hex);
-      f = fopen(path.c_str(), "rb");
-    }
-  }
+bool EmojiManager::hasTwemoji(const std::string &codepointHex) const {
+  return findTwemoji(codepointHex) >= 0;
+}
 
-  if (f) {
-    fseek(f, 0, SEEK_END);
-    size_t size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    std::vector<unsigned char> buffer(size);
-    fread(buffer.data(), 1, size, f);
-    fclose(f);
-
-    int w, h;
-    C3D_Tex *tex =
-        Utils::Image::loadTextureFromMemory(buffer.data(), size, w, h);
-    if (tex) {
-      EmojiInfo info;
-      info.tex = tex;
-      info.originalW = w;
-      info.originalH = h;
-
-      {
-        std::unique_lock<std::shared_mutex> lock(cacheMutex);
-        twemojiCache[codepointHex] = info;
-      }
-      return info;
-    }
+EmojiManager::EmojiInfo
+EmojiManager::getTwemojiInfo(const std::string &codepointHex) {
+  EmojiInfo info;
+  int index = findTwemoji(codepointHex);
+  if (index < 0)
+    return info;
+
+  info.image = twemoji.getImage(index);
+  if (info.image.tex) {
+    info.tex = info.image.tex;
+    info.originalW = info.image.subtex->width;
+    info.originalH = info.image.subtex->height;
   }
-
-  return EmojiInfo();
+  return info;
 }
 
 } // namespace UI
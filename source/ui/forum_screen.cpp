@@ -1,5 +1,6 @@
 #include "ui/forum_screen.h"
 #include "core/i18n.h"
+#include "core/profiler.h"
 #include "log.h"
 #include "ui/image_manager.h"
 #include "ui/screen_manager.h"
@@ -23,7 +24,10 @@ ForumScreen::ForumScreen(const std::string &channelId,
       getTruncatedRichText(channelName, 380.0f, 0.52f, 0.52f);
 }
 
-ForumScreen::~ForumScreen() {}
+ForumScreen::~ForumScreen() {
+  for (auto &request : requests)
+    request.cancel();
+}
 
 void ForumScreen::onEnter() {
   Logger::log("Entered Forum Screen: %s", channelName.c_str());
@@ -44,7 +48,9 @@ void ForumScreen::onExit() {}
 
 void ForumScreen::fetchThreads() {
   isLoading = true;
-  Discord::DiscordClient::getInstance().fetchForumThreads(
+  for (auto &request : requests)
+    request.cancel();
+  requests = Discord::DiscordClient::getInstance().fetchForumThreads(
       channelId, [this](const std::vector<Discord::Channel> &fetchedThreads) {
         std::vector<Discord::Channel> active;
         std::vector<Discord::Channel> archived;
@@ -166,6 +172,7 @@ void ForumScreen::update() {
 }
 
 void ForumScreen::renderTop(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("ForumScreen::renderTop");
   C2D_SceneBegin(target);
   C2D_TargetClear(target, ScreenManager::colorBackground());
 
@@ -214,24 +221,22 @@ void ForumScreen::renderTop(C3D_RenderTarget *target) {
 }
 
 void ForumScreen::renderBottom(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("ForumScreen::renderBottom");
   C2D_SceneBegin(target);
   C2D_TargetClear(target, ScreenManager::colorBackgroundDark());
 
   float headerX = 35.0f;
 
   std::string iconPath = "romfs:/discord-icons/forum.png";
-  C3D_Tex *icon = UI::ImageManager::getInstance().getLocalImage(iconPath);
-  if (icon) {
+  C2D_Image img = UI::ImageManager::getInstance().getLocalIcon(iconPath);
+  if (img.tex) {
     float iconSize = 18.0f;
-    Tex3DS_SubTexture subtex = {
-        (u16)icon->width, (u16)icon->height, 0.0f, 1.0f, 1.0f, 0.0f};
-    C2D_Image img = {icon, &subtex};
-
     C2D_ImageTint tint;
     C2D_PlainImageTint(&tint, ScreenManager::colorText(), 1.0f);
 
-    C2D_DrawImageAt(img, 35.0f, 9.0f, 0.5f, &tint, iconSize / icon->width,
-                    iconSize / icon->height);
+    C2D_DrawImageAt(img, 35.0f, 9.0f, 0.5f, &tint,
+                    iconSize / img.subtex->width,
+                    iconSize / img.subtex->height);
     headerX = 35.0f + iconSize + 5.0f;
   } else {
     drawText(35.0f, 10.0f, 0.5f, 0.6f, 0.6f, ScreenManager::colorTextMuted(),
@@ -299,18 +304,15 @@ void ForumScreen::renderThreadCard(int index, float y) {
   bool isPinned = (thread.flags & 2);
   if (isPinned) {
     std::string pinPath = "romfs:/discord-icons/pin.png";
-    C3D_Tex *pinIcon = UI::ImageManager::getInstance().getLocalImage(pinPath);
-    if (pinIcon) {
+    C2D_Image pinIcon = UI::ImageManager::getInstance().getLocalIcon(pinPath);
+    if (pinIcon.tex) {
       float pinSize = 16.0f;
-      Tex3DS_SubTexture subtex = {
-          (u16)pinIcon->width, (u16)pinIcon->height, 0.0f, 1.0f, 1.0f, 0.0f};
-      C2D_Image img = {pinIcon, &subtex};
-
       C2D_ImageTint tint;
       C2D_PlainImageTint(&tint, ScreenManager::colorText(), 1.0f);
 
-      C2D_DrawImageAt(img, textX, currentY + 2.0f, 0.6f, &tint,
-                      pinSize / pinIcon->width, pinSize / pinIcon->height);
+      C2D_DrawImageAt(pinIcon, textX, currentY + 2.0f, 0.6f, &tint,
+                      pinSize / pinIcon.subtex->width,
+                      pinSize / pinIcon.subtex->height);
 
       textX += pinSize + 5.0f;
     }
@@ -381,15 +383,13 @@ void ForumScreen::renderThreadCard(int index, float y) {
 
   textX = x + 12.0f;
 
-  C3D_Tex *chatIcon = UI::ImageManager::getInstance().getLocalImage(
+  C2D_Image chatIcon = UI::ImageManager::getInstance().getLocalIcon(
       "romfs:/discord-icons/chat.png");
-  if (chatIcon) {
+  if (chatIcon.tex) {
     float iconSize = 12.0f;
-    Tex3DS_SubTexture subtex = {
-        (u16)chatIcon->width, (u16)chatIcon->height, 0.0f, 1.0f, 1.0f, 0.0f};
-    C2D_Image img = {chatIcon, &subtex};
-    C2D_DrawImageAt(img, textX, currentY + 1.0f, 0.6f, nullptr,
-                    iconSize / chatIcon->width, iconSize / chatIcon->height);
+    C2D_DrawImageAt(chatIcon, textX, currentY + 1.0f, 0.6f, nullptr,
+                    iconSize / chatIcon.subtex->width,
+                    iconSize / chatIcon.subtex->height);
     textX += iconSize + 4.0f;
   }
 
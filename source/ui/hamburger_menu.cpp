@@ -1,9 +1,11 @@
 #include "ui/hamburger_menu.h"
 #include "core/config.h"
+#include "core/frame_scheduler.h"
 #include "core/i18n.h"
 #include "core/log.h"
 #include "discord/avatar_cache.h"
 #include "discord/discord_client.h"
+#include "network/http_cache.h"
 #include "ui/image_manager.h"
 #include "ui/screen_manager.h"
 #include "ui/server_list_screen.h"
@@ -18,7 +20,8 @@ const float HamburgerMenu::ANIMATION_SPEED = 0.2f;
 
 HamburgerMenu::HamburgerMenu()
     : state(State::CLOSED), slideProgress(0.0f), selectedIndex(0),
-      accountSelectionIndex(0), accountScrollOffset(0) {
+      accountSelectionIndex(0), accountScrollOffset(0),
+      panelLayer((u16)MENU_WIDTH, BOTTOM_SCREEN_HEIGHT) {
   refreshStrings();
 }
 
@@ -66,6 +69,10 @@ void HamburgerMenu::reset() {
 }
 
 void HamburgerMenu::update() {
+  if (state == State::OPENING || state == State::CLOSING) {
+    Core::FrameScheduler::getInstance().requestAnimationFrame();
+  }
+
   if (state == State::OPENING) {
     slideProgress += ANIMATION_SPEED;
     if (slideProgress >= 1.0f) {
@@ -224,6 +231,7 @@ void HamburgerMenu::update() {
         Logger::log("[HamburgerMenu] Deleting account %d",
                     accountSelectionIndex);
         Config::getInstance().removeAccount(accountSelectionIndex);
+        Network::HttpCache::getInstance().clear();
 
         // Adjust selection
         const auto &newAccounts = Config::getInstance().getAccounts();
@@ -275,7 +283,7 @@ void HamburgerMenu::update() {
   }
 }
 
-void HamburgerMenu::render() {
+void HamburgerMenu::render(C3D_RenderTarget *target) {
   if (state == State::CLOSED)
     return;
 
@@ -290,12 +298,48 @@ void HamburgerMenu::render() {
   u8 b = (menuBg >> 16) & 0xFF;
   u32 glassBg = C2D_Color32(r, g, b, 240);
 
+  if (state == State::OPEN) {
+    // Fully open, the panel only changes with the selection or the account,
+    // so it is composited from a layer. The layer is drawn opaque and faded
+    // as a whole to keep text edges clean.
+    Discord::User self = Discord::DiscordClient::getInstance().getCurrentUser();
+    u32 layerKey = RenderLayer::hashKey(0, (u32)selectedIndex);
+    layerKey = RenderLayer::hashKey(layerKey, accountCardSelected ? 1u : 0u);
+    layerKey = RenderLayer::hashKey(layerKey, menuBg);
+    layerKey = RenderLayer::hashKey(layerKey, ScreenManager::colorText());
+    layerKey = RenderLayer::hashLoadedImages(layerKey);
+    for (const auto &item : items)
+      layerKey = RenderLayer::hashKey(layerKey, item.label);
+    layerKey = RenderLayer::hashKey(layerKey, self.username);
+    layerKey = RenderLayer::hashKey(layerKey, (u32)self.status);
+    layerKey = RenderLayer::hashKey(
+        layerKey, Discord::AvatarCache::getInstance()
+                              .getAvatar(self.id, self.avatar,
+                                         self.discriminator)
+                              .tex
+                      ? 1u
+                      : 0u);
+
+    auto drawPanel = [&]() {
+      C2D_DrawRectSolid(MENU_WIDTH - 1, 0, 0.975f, 1, 240,
+                        C2D_Color32(255, 255, 255, 30));
+      float y = 10.0f;
+      for (size_t i = 0; i < items.size(); i++) {
+        drawMenuItem(i, y, 1.0f);
+        y += 40.0f;
+      }
+      drawAccountCard(0.0f, 240.0f - 50.0f, 1.0f);
+    };
+    panelLayer.draw(target, layerKey, menuBg | 0xFF000000, x, 0.0f, 0.97f,
+                    drawPanel, 240.0f / 255.0f);
+    return;
+  }
+
   C2D_DrawRectSolid(x, 0, 0.97f, MENU_WIDTH, 240, glassBg);
   C2D_DrawRectSolid(x + MENU_WIDTH - 1, 0, 0.975f, 1, 240,
                     C2D_Color32(255, 255, 255, 30));
 
-  if (state == State::OPEN || state == State::OPENING ||
-      state == State::CLOSING) {
+  if (state == State::OPENING || state == State::CLOSING) {
     float y = 10.0f;
     for (size_t i = 0; i < items.size(); i++) {
       drawMenuItem(i, y, alpha);
@@ -435,15 +479,12 @@ void HamburgerMenu::render() {
         break;
       }
 
-      C3D_Tex *statTex = ImageManager::getInstance().getLocalImage(iconPath);
-      if (statTex) {
+      C2D_Image img = ImageManager::getInstance().getLocalIcon(iconPath);
+      if (img.tex) {
         float sSize = 12.0f;
-        Tex3DS_SubTexture subtex = {
-            (u16)statTex->width, (u16)statTex->height, 0.0f, 1.0f, 1.0f, 0.0f};
-        C2D_Image img = {statTex, &subtex};
         C2D_DrawImageAt(img, popupX + 12, itemY + 11 - (sSize / 2), 0.99f,
-                        nullptr, sSize / statTex->width,
-                        sSize / statTex->height);
+                        nullptr, sSize / img.subtex->width,
+                        sSize / img.subtex->height);
       }
       drawText(popupX + 30, itemY + 3, 0.99f, 0.45f, 0.45f, color, label);
     }
@@ -488,15 +529,12 @@ void HamburgerMenu::drawAccountCard(float x, float y, float alpha) {
   float avatarY = y + 10.0f;
   float avatarSize = 30.0f;
 
-  C3D_Tex *avatarTex = Discord::AvatarCache::getInstance().getAvatar(
+  C2D_Image avatar = Discord::AvatarCache::getInstance().getAvatar(
       self.id, self.avatar, self.discriminator);
-  if (avatarTex) {
-    Tex3DS_SubTexture subtex = {
-        (u16)avatarTex->width, (u16)avatarTex->height, 0.0f, 1.0f, 1.0f, 0.0f};
-    C2D_Image img = {avatarTex, &subtex};
-    C2D_DrawImageAt(img, avatarX, avatarY, 0.98f, nullptr,
-                    avatarSize / avatarTex->width,
-                    avatarSize / avatarTex->height);
+  if (avatar.tex) {
+    C2D_DrawImageAt(avatar, avatarX, avatarY, 0.98f, nullptr,
+                    avatarSize / avatar.subtex->width,
+                    avatarSize / avatar.subtex->height);
   } else {
     Discord::AvatarCache::getInstance().prefetchAvatar(self.id, self.avatar,
                                                        self.discriminator);
@@ -546,12 +584,9 @@ void HamburgerMenu::drawAccountCard(float x, float y, float alpha) {
   }
 
   // Status Icon
-  C3D_Tex *statTex = ImageManager::getInstance().getLocalImage(iconPath);
-  if (statTex) {
+  C2D_Image img = ImageManager::getInstance().getLocalIcon(iconPath);
+  if (img.tex) {
     float sSize = 10.0f;
-    Tex3DS_SubTexture subtex = {
-        (u16)statTex->width, (u16)statTex->height, 0.0f, 1.0f, 1.0f, 0.0f};
-    C2D_Image img = {statTex, &subtex};
 
     // Draw background circle for the icon to stand out
     C2D_DrawCircleSolid(avatarX + avatarSize - 2, avatarY + avatarSize - 2,
@@ -559,7 +594,7 @@ void HamburgerMenu::drawAccountCard(float x, float y, float alpha) {
 
     C2D_DrawImageAt(img, avatarX + avatarSize - 2 - (sSize / 2),
                     avatarY + avatarSize - 2 - (sSize / 2), 0.99f, nullptr,
-                    sSize / statTex->width, sSize / statTex->height);
+                    sSize / img.subtex->width, sSize / img.subtex->height);
   }
 
   drawText(avatarX + avatarSize + 10.0f, y + 28.0f, 0.98f, 0.35f, 0.35f,
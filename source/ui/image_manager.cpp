@@ -1,6 +1,10 @@
 #include "ui/image_manager.h"
+#include "core/frame_scheduler.h"
+#include "core/profiler.h"
 #include "log.h"
 #include "network/network_manager.h"
+#include "ui/decode_pool.h"
+#include "ui/texture_disk_cache.h"
 #include "utils/image_utils.h"
 
 #include <cstring>
@@ -12,145 +16,157 @@ ImageManager &ImageManager::getInstance() {
   return instance;
 }
 
-ImageManager::~ImageManager() {
-  shutdown();
-  clear();
-}
+ImageManager::~ImageManager() { shutdown(); }
 
 void ImageManager::init() {
-  if (!decoderThread.joinable()) {
-    stopDecoder = false;
-    decoderThread = std::thread(&ImageManager::decoderWorker, this);
-  }
+  // One small sheet; start loading it now so the first screen has icons.
+  if (icons.open("romfs:/packs/icons.pack"))
+    icons.getImage(0);
 }
 
 void ImageManager::shutdown() {
-  {
-    std::lock_guard<std::mutex> lock(decodeMutex);
-    stopDecoder = true;
-  }
-  decodeCv.notify_all();
-  if (decoderThread.joinable())
-    decoderThread.join();
-
   clear();
+  icons.close();
 }
 
 void ImageManager::clear() {
+  dropPending();
+  TextureCache::getInstance().clear();
   std::lock_guard<std::mutex> lock(cacheMutex);
-  for (auto &pair : textureCache) {
-    if (pair.second.tex) {
-      C3D_TexDelete(pair.second.tex);
-      free(pair.second.tex);
+  for (const auto &pair : undisplayedBytes)
+    prefetchStats.unseenBytes += pair.second;
+  undisplayedBytes.clear();
+}
+
+void ImageManager::cancelPending() { dropPending(); }
+
+void ImageManager::dropPending() {
+  std::vector<Network::RequestHandle> requests;
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for (const auto &fetch : fetchingUrls) {
+      if (fetch.second)
+        requests.push_back(fetch.second);
     }
   }
-  textureCache.clear();
-  lruList.clear();
-  fetchingUrls.clear();
-  pendingTextures.clear();
-  currentCacheBytes = 0;
-  {
-    std::lock_guard<std::mutex> lock(decodeMutex);
-    decodeQueue.clear();
+
+  // Not under cacheMutex: cancel() waits for a callback that is already
+  // running, and ours take it. Afterwards none of them will run.
+  uint32_t cancelled = 0;
+  for (auto &request : requests) {
+    if (request.cancel())
+      cancelled++;
   }
+  // Only now, so a response callback that was already running can't queue
+  // a decode after the pool was cleared.
+  DecodePool::getInstance().cancel(this);
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  prefetchStats.cancelled += cancelled;
+  fetchingUrls.clear();
+  // Disk reads and decodes cannot be cancelled once started.
   currentSessionId++;
+
+  // Anything downloaded that didn't make it into the cache won't be drawn
+  // now; neither will what was evicted before it was.
+  TextureCache &cache = TextureCache::getInstance();
+  for (auto it = undisplayedBytes.begin(); it != undisplayedBytes.end();) {
+    if (cache.contains(it->first)) {
+      ++it;
+      continue;
+    }
+    prefetchStats.unseenBytes += it->second;
+    it = undisplayedBytes.erase(it);
+  }
 }
 
-void ImageManager::touchImage(const std::string &url) {
+TextureClass ImageManager::classifyUrl(const std::string &url) {
   if (url.find("http") != 0)
-    return; // Don't LRU local images
-
-  lruList.remove(url);
-  lruList.push_front(url);
+    return TextureClass::LOCAL;
+  if (url.find("/avatars/") != std::string::npos ||
+      url.find("/icons/") != std::string::npos ||
+      url.find("/app-icons/") != std::string::npos)
+    return TextureClass::AVATAR;
+  if (url.find("/emojis/") != std::string::npos ||
+      url.find("/stickers/") != std::string::npos)
+    return TextureClass::EMOJI;
+  return TextureClass::ATTACHMENT;
 }
 
-void ImageManager::evictOldest() {
-  if (lruList.empty())
-    return;
-
-  std::string url = lruList.back();
-  lruList.pop_back();
-
-  auto it = textureCache.find(url);
-  if (it != textureCache.end()) {
-    currentCacheBytes -= it->second.vramSize;
-    if (it->second.tex) {
-      C3D_TexDelete(it->second.tex);
-      free(it->second.tex);
-    }
-    textureCache.erase(it);
-  }
+ImageManager::ImageInfo
+ImageManager::toImageInfo(const TextureCache::TextureInfo &info) {
+  ImageInfo out;
+  out.tex = info.tex;
+  out.originalW = info.originalW;
+  out.originalH = info.originalH;
+  out.vramSize = info.bytes;
+  out.failed = info.failed;
+  return out;
 }
 
 void ImageManager::clearFailed(const std::string &url) {
+  TextureCache::getInstance().eraseFailed(url);
   std::lock_guard<std::mutex> lock(cacheMutex);
-  auto it = textureCache.find(url);
-  if (it != textureCache.end() && it->second.failed) {
-    textureCache.erase(it);
-    lruList.remove(url);
-  }
   fetchingUrls.erase(url);
 }
 
-void ImageManager::clearRemote() {
+void ImageManager::markDisplayed(const std::string &url) {
   std::lock_guard<std::mutex> lock(cacheMutex);
-  for (auto it = textureCache.begin(); it != textureCache.end();) {
-    if (it->first.find("http") == 0) {
-      currentCacheBytes -= it->second.vramSize;
-      if (it->second.tex) {
-        C3D_TexDelete(it->second.tex);
-        free(it->second.tex);
-      }
-      it = textureCache.erase(it);
-    } else {
-      ++it;
-    }
+  if (undisplayedBytes.empty())
+    return;
+  auto it = undisplayedBytes.find(url);
+  if (it != undisplayedBytes.end()) {
+    prefetchStats.displayedBytes += it->second;
+    undisplayedBytes.erase(it);
   }
-  lruList.clear();
-  fetchingUrls.clear();
-  pendingTextures.clear();
-  {
-    std::lock_guard<std::mutex> lock2(decodeMutex);
-    decodeQueue.clear();
+}
+
+// Caller holds cacheMutex.
+void ImageManager::markUnseen(const std::string &url) {
+  auto it = undisplayedBytes.find(url);
+  if (it != undisplayedBytes.end()) {
+    prefetchStats.unseenBytes += it->second;
+    undisplayedBytes.erase(it);
   }
-  currentSessionId++;
 }
 
 C3D_Tex *ImageManager::getImage(const std::string &url) {
   if (url.empty())
     return nullptr;
 
-  {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    if (textureCache.find(url) != textureCache.end()) {
-      touchImage(url);
-      return textureCache[url].tex;
-    }
+  TextureCache::TextureInfo info;
+  if (TextureCache::getInstance().find(url, classifyUrl(url), &info)) {
+    markDisplayed(url);
+    return info.tex;
   }
 
+  DecodePool::getInstance().markVisible(url);
   prefetch(url);
   return nullptr;
 }
 
 ImageManager::ImageInfo ImageManager::getImageInfo(const std::string &url) {
-  std::lock_guard<std::mutex> lock(cacheMutex);
-  if (textureCache.find(url) != textureCache.end()) {
-    touchImage(url);
-    return textureCache[url];
+  TextureCache::TextureInfo info;
+  if (TextureCache::getInstance().find(url, classifyUrl(url), &info)) {
+    markDisplayed(url);
+    return toImageInfo(info);
   }
+  // Asked for while drawing but not ready yet: decode it ahead of the rest.
+  DecodePool::getInstance().markVisible(url);
   return ImageInfo();
 }
 
+TextureHandle ImageManager::pin(const std::string &url) {
+  return TextureCache::getInstance().acquire(url);
+}
+
 C3D_Tex *ImageManager::getLocalImage(const std::string &path, bool noResize) {
   if (path.empty())
     return nullptr;
 
-  {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    if (textureCache.find(path) != textureCache.end()) {
-      return textureCache[path].tex;
-    }
-  }
+  TextureCache::TextureInfo cached;
+  if (TextureCache::getInstance().find(path, TextureClass::LOCAL, &cached))
+    return cached.tex;
 
   Logger::log("[Image] Loading local: %s", path.c_str());
 
@@ -178,34 +194,48 @@ C3D_Tex *ImageManager::getLocalImage(const std::string &path, bool noResize) {
   C3D_Tex *tex = Utils::Image::loadTextureFromMemory(
       (const unsigned char *)data.data(), size, outW, outH, noResize);
   if (tex) {
-    ImageInfo info;
-    info.tex = tex;
-    info.originalW = outW;
-    info.originalH = outH;
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    textureCache[path] = info;
+    TextureCache::getInstance().insert(path, TextureClass::LOCAL, tex, outW,
+                                       outH);
     return tex;
   }
 
   return nullptr;
 }
 
+C2D_Image ImageManager::getLocalIcon(const std::string &path) {
+  static const std::string prefix = "romfs:/discord-icons/";
+  if (path.compare(0, prefix.size(), prefix) == 0) {
+    int index = icons.find(path.substr(prefix.size()));
+    if (index >= 0)
+      return icons.getImage(index);
+  }
+
+  TextureCache::TextureInfo cached;
+  if (getLocalImage(path, true) &&
+      TextureCache::getInstance().find(path, TextureClass::LOCAL, &cached))
+    return cached.image;
+  return {};
+}
+
 void ImageManager::prefetch(const std::string &url, int origW, int origH,
                             Network::RequestPriority priority) {
   if (url.empty())
     return;
   {
-    std::lock_guard<std::mutex> lock(cacheMutex);
-    auto it = textureCache.find(url);
-    if (it != textureCache.end()) {
-      if (!it->second.failed)
+    TextureCache &cache = TextureCache::getInstance();
+    if (cache.contains(url)) {
+      TextureCache::TextureInfo info;
+      cache.find(url, classifyUrl(url), &info);
+      if (!info.failed)
         return;
-      textureCache.erase(it);
+      cache.eraseFailed(url);
     }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
     if (fetchingUrls.find(url) != fetchingUrls.end())
       return;
 
-    fetchingUrls.insert(url);
+    fetchingUrls[url] = Network::RequestHandle();
   }
 
   std::string optimizedUrl = url;
@@ -266,119 +296,151 @@ void ImageManager::prefetch(const std::string &url, int origW, int origH,
   }
 
   int sessionId = currentSessionId;
-  Network::NetworkManager::getInstance().enqueue(
-      optimizedUrl, "GET", "", priority,
-      [this, url, sessionId, priority](const Network::HttpResponse &resp) {
-        if (currentSessionId != sessionId)
-          return;
+  TextureDiskCache &disk = TextureDiskCache::getInstance();
+  if (disk.contains(optimizedUrl)) {
+    disk.load(optimizedUrl, [this, url, optimizedUrl, sessionId, priority](
+                                Utils::Image::TiledData &tiled) {
+      if (currentSessionId != sessionId) {
+        Utils::Image::freeTiled(tiled);
+        return;
+      }
+      if (!tiled.pixels) {
+        fetchFromNetwork(url, optimizedUrl, sessionId, priority);
+        return;
+      }
+      DecodePool::getInstance().deliver(
+          url, this, tiled, [this, url, sessionId](Utils::Image::TiledData &t) {
+            onDecoded(url, sessionId, t);
+          });
+    });
+    return;
+  }
+
+  fetchFromNetwork(url, optimizedUrl, sessionId, priority);
+}
+
+void ImageManager::fetchFromNetwork(const std::string &url,
+                                    const std::string &requestUrl,
+                                    int sessionId,
+                                    Network::RequestPriority priority) {
+  auto request = Network::NetworkManager::getInstance().enqueue(
+      requestUrl, "GET", "", priority,
+      [this, url, requestUrl, sessionId,
+       priority](Network::HttpResponse &resp) {
+        {
+          std::lock_guard<std::mutex> lock(cacheMutex);
+          auto it = fetchingUrls.find(url);
+          if (it != fetchingUrls.end())
+            it->second = Network::RequestHandle();
+          prefetchStats.fetchedBytes += resp.body.size();
+          // Left over from an earlier download that was evicted undrawn.
+          markUnseen(url);
+          undisplayedBytes[url] = resp.body.size();
+        }
 
         if (resp.success && resp.statusCode == 200 && !resp.body.empty()) {
-          DecodeRequest req;
-          req.url = url;
-          req.body = std::move(resp.body);
-          req.sessionId = sessionId;
-          req.priority = priority;
-
-          std::lock_guard<std::mutex> lock(decodeMutex);
-          decodeQueue.push_back(std::move(req));
-          decodeCv.notify_one();
+          DecodePool::Job job;
+          job.key = url;
+          job.data = resp.takeBody();
+          job.diskKey = requestUrl;
+          job.priority = priority;
+          job.owner = this;
+          job.done = [this, url, sessionId](Utils::Image::TiledData &tiled) {
+            onDecoded(url, sessionId, tiled);
+          };
+          DecodePool::getInstance().submit(std::move(job));
         } else {
           Logger::log("[Image] Fetch failed for %s. Status: %d, Body size: %zu",
                       url.c_str(), resp.statusCode, resp.body.size());
+          TextureCache::getInstance().insert(url, classifyUrl(url), nullptr, 0,
+                                             0);
           std::lock_guard<std::mutex> lock(cacheMutex);
-          ImageInfo info;
-          info.failed = true;
-          textureCache[url] = info;
           fetchingUrls.erase(url);
+          markUnseen(url);
         }
       });
-}
 
-void ImageManager::decoderWorker() {
-  while (true) {
-    DecodeRequest req;
-    {
-      std::unique_lock<std::mutex> lock(decodeMutex);
-      decodeCv.wait(lock,
-                    [this] { return stopDecoder || !decodeQueue.empty(); });
-      if (stopDecoder)
-        return;
-      req = std::move(decodeQueue.front());
-      decodeQueue.pop_front();
+  // The request may already have failed and been forgotten; a stale
+  // handle left behind by one that succeeded just makes cancel() a no-op.
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (currentSessionId == sessionId) {
+      auto it = fetchingUrls.find(url);
+      if (it != fetchingUrls.end())
+        it->second = request;
+      return;
     }
+  }
+  // Dropped by dropPending() while the disk thread was queueing it.
+  request.cancel();
+}
 
-    if (currentSessionId != req.sessionId)
-      continue;
-
-    Utils::Image::TiledData tiled = Utils::Image::decodeToTiled(
-        (const unsigned char *)req.body.data(), req.body.size());
-
-    PendingTexture pending;
-    pending.url = req.url;
-    pending.tiled = tiled;
-    pending.success = (tiled.pixels != nullptr);
-    pending.width = tiled.w;
-    pending.height = tiled.h;
-
+void ImageManager::cancel(const std::string &url) {
+  Network::RequestHandle request;
+  {
     std::lock_guard<std::mutex> lock(cacheMutex);
-    pendingTextures.push_back(pending);
+    auto it = fetchingUrls.find(url);
+    if (it == fetchingUrls.end() || !it->second)
+      return;
+    request = it->second;
   }
+
+  uint32_t id = request.id();
+  if (!request.cancel())
+    return;
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  auto it = fetchingUrls.find(url);
+  if (it != fetchingUrls.end() && it->second.id() == id)
+    fetchingUrls.erase(it);
+  markUnseen(url);
+  prefetchStats.cancelled++;
 }
 
-void ImageManager::update() {
-  PendingTexture p;
+void ImageManager::reprioritize(const std::string &url,
+                                Network::RequestPriority priority) {
+  Network::RequestHandle request;
   {
     std::lock_guard<std::mutex> lock(cacheMutex);
-    if (pendingTextures.empty())
+    auto it = fetchingUrls.find(url);
+    if (it == fetchingUrls.end())
       return;
-    p = std::move(pendingTextures.front());
-    pendingTextures.pop_front();
+    request = it->second;
   }
+  request.setPriority(priority);
+}
+
+bool ImageManager::isFetching(const std::string &url) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  return fetchingUrls.find(url) != fetchingUrls.end();
+}
 
-  fetchingUrls.erase(p.url);
+ImageManager::PrefetchStats ImageManager::getPrefetchStats() {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  return prefetchStats;
+}
 
-  if (p.success) {
-    if (p.tiled.pixels) {
-      while (currentCacheBytes + p.tiled.vramSize > MAX_CACHE_BYTES &&
-             lruList.size() > MIN_CACHE_ENTRIES) {
-        evictOldest();
-      }
+void ImageManager::onDecoded(const std::string &url, int sessionId,
+                             Utils::Image::TiledData &tiled) {
+  if (currentSessionId != sessionId) {
+    Utils::Image::freeTiled(tiled);
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    markUnseen(url);
+    return;
+  }
 
-      C3D_Tex *tex = (C3D_Tex *)malloc(sizeof(C3D_Tex));
-      if (C3D_TexInit(tex, p.tiled.p2w, p.tiled.p2h, GPU_RGBA8)) {
-        C3D_TexSetFilter(tex, GPU_LINEAR, GPU_LINEAR);
-        memcpy(tex->data, p.tiled.pixels, p.tiled.vramSize);
-        GSPGPU_FlushDataCache(tex->data, p.tiled.vramSize);
-
-        ImageInfo info;
-        info.tex = tex;
-        info.originalW = p.width;
-        info.originalH = p.height;
-        info.vramSize = p.tiled.vramSize;
-        info.failed = false;
-
-        std::lock_guard<std::mutex> lock(cacheMutex);
-        textureCache[p.url] = info;
-        currentCacheBytes += p.tiled.vramSize;
-        touchImage(p.url);
-        generation++;
-      } else {
-        free(tex);
-        std::lock_guard<std::mutex> lock(cacheMutex);
-        ImageInfo info;
-        info.failed = true;
-        textureCache[p.url] = info;
-        generation++;
-      }
-      free(p.tiled.pixels);
-    }
-  } else {
+  PROFILE_SCOPE("ImageManager texture upload");
+  int w = tiled.w, h = tiled.h;
+  C3D_Tex *tex = Utils::Image::createTexture(tiled);
+  TextureCache::getInstance().insert(url, classifyUrl(url), tex, w, h);
+  {
     std::lock_guard<std::mutex> lock(cacheMutex);
-    ImageInfo info;
-    info.failed = true;
-    textureCache[p.url] = info;
-    generation++;
+    fetchingUrls.erase(url);
+    // A failed decode is cached as a failure and never drawn.
+    if (!tex)
+      markUnseen(url);
   }
+  generation++;
+  Core::FrameScheduler::getInstance().requestRedraw();
 }
 
 } // namespace UI
@@ -1,6 +1,8 @@
 #include "ui/login_screen.h"
 #include "config.h"
+#include "core/frame_scheduler.h"
 #include "core/i18n.h"
+#include "core/profiler.h"
 #include "discord/discord_client.h"
 #include "log.h"
 #include "qrcodegen.h"
@@ -95,6 +97,7 @@ void LoginScreen::update() {
     }
 
     loadingAngle = 360.0f * t;
+    Core::FrameScheduler::getInstance().requestAnimationFrame();
   }
 
   bool shouldAutoConnect = !Config::getInstance().getToken().empty() &&
@@ -254,6 +257,7 @@ void LoginScreen::drawLoadingSpinner(float centerX, float centerY,
 }
 
 void LoginScreen::renderTop(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("LoginScreen::renderTop");
   C2D_TargetClear(target, ScreenManager::colorBackgroundDark());
   C2D_SceneBegin(target);
 
@@ -345,6 +349,7 @@ void LoginScreen::renderTop(C3D_RenderTarget *target) {
 }
 
 void LoginScreen::renderBottom(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("LoginScreen::renderBottom");
   C2D_TargetClear(target, ScreenManager::colorBackgroundDark());
   C2D_SceneBegin(target);
 
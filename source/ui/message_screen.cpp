@@ -1,6 +1,8 @@
 #include "ui/message_screen.h"
 #include "core/config.h"
+#include "core/frame_scheduler.h"
 #include "core/i18n.h"
+#include "core/profiler.h"
 #include "discord/avatar_cache.h"
 #include "discord/discord_client.h"
 #include "log.h"
@@ -11,6 +13,7 @@
 #include <3ds.h>
 #include <algorithm>
 #include <citro2d.h>
+#include <cmath>
 #include <ctime>
 
 #include <mutex>
@@ -18,6 +21,95 @@
 
 namespace UI {
 
+static bool isSnowflakeOlder(const std::string &a, const std::string &b) {
+  if (a.size() != b.size())
+    return a.size() < b.size();
+  return a < b;
+}
+
+static bool isPendingId(const std::string &id) {
+  return id.compare(0, 8, "pending_") == 0;
+}
+
+static void pinMessageImages(const Discord::Message &msg,
+                             std::vector<TextureHandle> &pins) {
+  ImageManager &images = ImageManager::getInstance();
+  auto pinUrl = [&](const std::string &url) {
+    if (url.empty())
+      return;
+    TextureHandle handle = images.pin(url);
+    if (handle)
+      pins.push_back(std::move(handle));
+  };
+
+  for (const auto &attach : msg.attachments)
+    pinUrl(attach.proxy_url.empty() ? attach.url : attach.proxy_url);
+  for (const auto &sticker : msg.stickers) {
+    std::string ext = (sticker.format_type == 4) ? ".gif" : ".png";
+    pinUrl("https://cdn.discordapp.com/stickers/" + sticker.id + ext);
+  }
+  for (const auto &embed : msg.embeds) {
+    pinUrl(embed.image_proxy_url.empty() ? embed.image_url
+                                         : embed.image_proxy_url);
+    pinUrl(embed.thumbnail_url);
+    pinUrl(embed.thumbnail_proxy_url);
+  }
+}
+
+// Mirrors the URL choices of drawAttachments, drawStickers and renderEmbed.
+// Every image is given the message's extent; close enough for prefetching.
+static void collectMessageImages(const Discord::Message &msg, float top,
+                                 float bottom,
+                                 std::vector<PrefetchPlanner::Item> &out) {
+  auto add = [&](const std::string &url, int w, int h) {
+    PrefetchPlanner::Item item;
+    item.url = url;
+    item.width = w;
+    item.height = h;
+    item.top = top;
+    item.bottom = bottom;
+    out.push_back(std::move(item));
+  };
+
+  for (const auto &attach : msg.attachments) {
+    if (attach.content_type.find("image/") != std::string::npos ||
+        attach.filename.find(".png") != std::string::npos ||
+        attach.filename.find(".jpg") != std::string::npos ||
+        attach.filename.find(".jpeg") != std::string::npos)
+      add(attach.proxy_url.empty() ? attach.url : attach.proxy_url,
+          attach.width, attach.height);
+  }
+  for (const auto &sticker : msg.stickers) {
+    std::string ext = (sticker.format_type == 4) ? ".gif" : ".png";
+    add("https://cdn.discordapp.com/stickers/" + sticker.id + ext, 160, 160);
+  }
+  for (const auto &embed : msg.embeds) {
+    bool hasImage = !embed.image_url.empty();
+    bool hasThumbnail = !embed.thumbnail_url.empty();
+    bool isLargeThumbnail =
+        (hasThumbnail && embed.thumbnail_width >= 160 &&
+         (float)embed.thumbnail_width > (float)embed.thumbnail_height * 1.2f);
+    bool isMedia = (embed.type == "image" || embed.type == "gifv" ||
+                    embed.type == "video" || embed.type == "article" ||
+                    isLargeThumbnail);
+    bool isSimpleMedia = isMedia && embed.title.empty() &&
+                         embed.description.empty() && embed.fields.empty() &&
+                         embed.author_name.empty() &&
+                         (hasImage || hasThumbnail);
+
+    if (!isSimpleMedia && hasThumbnail && !isMedia)
+      add(embed.thumbnail_url, embed.thumbnail_width, embed.thumbnail_height);
+    if (hasImage)
+      add(embed.image_proxy_url.empty() ? embed.image_url
+                                        : embed.image_proxy_url,
+          embed.image_width, embed.image_height);
+    else if (isMedia && hasThumbnail)
+      add(embed.thumbnail_proxy_url.empty() ? embed.thumbnail_url
+                                            : embed.thumbnail_proxy_url,
+          embed.thumbnail_width, embed.thumbnail_height);
+  }
+}
+
 MessageScreen::MessageScreen(const std::string &channelId,
                              const std::string &channelName)
     : channelId(channelId), channelName(channelName), channelType(0),
@@ -26,21 +118,37 @@ MessageScreen::MessageScreen(const std::string &channelId,
       scrollInitialized(false), showNewMessageIndicator(false),
       newMessageCount(0), isForumView(false), hasMoreHistory(true),
       lastImageGeneration(0), keyRepeatTimer(0), targetScrollY(0.0f),
-      currentScrollY(0.0f), totalContentHeight(0.0f), isMenuOpen(false),
-      menuIndex(0) {
-  aliveToken = std::make_shared<bool>(true);
+      currentScrollY(0.0f), totalContentHeight(0.0f), olderStubsHeight(0.0f),
+      newerStubsHeight(0.0f), isFetchingNewer(false), olderRetryAt(0),
+      newerRetryAt(0), isMenuOpen(false), menuIndex(0),
+      bottomLayer(BOTTOM_SCREEN_WIDTH, BOTTOM_SCREEN_HEIGHT),
+      scrollVelocity(0.0f), lastPlannedScrollY(0.0f), planIdleUpdates(0) {
   Logger::log("MessageScreen initialized for channel: %s", channelName.c_str());
 }
 
 MessageScreen::~MessageScreen() {
-  *aliveToken = false;
+  // Their callbacks capture this; once cancelled none can still be running.
+  // Not done in onExit(), which can run inside update() with the locks
+  // those callbacks wait on held.
+  std::vector<Network::RequestHandle> pending;
+  {
+    std::lock_guard<std::mutex> lock(requestMutex);
+    pending.swap(requests);
+  }
+  for (auto &request : pending)
+    request.cancel();
+}
+
+void MessageScreen::onExit() {
   Discord::DiscordClient::getInstance().setMessageCallback(nullptr);
   Discord::DiscordClient::getInstance().setMessageUpdateCallback(nullptr);
   Discord::DiscordClient::getInstance().setMessageDeleteCallback(nullptr);
   Discord::DiscordClient::getInstance().setConnectionCallback(nullptr);
 
   embedHeightCache.clear();
-  ImageManager::getInstance().clearRemote();
+  // Textures stay cached (and evictable) so coming back is instant; only
+  // stop the downloads this channel queued.
+  ImageManager::getInstance().cancelPending();
 }
 
 void MessageScreen::onEnter() {
@@ -92,7 +200,22 @@ void MessageScreen::onEnter() {
       }
     }
 
-    if (!found) {
+    if (!found && !newerStubs.empty()) {
+      MessageStub stub;
+      stub.id = msg.id;
+      stub.authorId = msg.author.id;
+      stub.epoch = msg.epoch;
+      stub.height = calculateMessageHeight(msg, true);
+      if (msg.epoch != 0 &&
+          MessageUtils::getLocalDay(msg.epoch) !=
+              MessageUtils::getLocalDay(newerStubs.back().epoch))
+        stub.height += 28.0f;
+      newerStubs.push_back(stub);
+      newerStubsHeight += stub.height;
+      rebuildLayoutCache();
+      showNewMessageIndicator = true;
+      newMessageCount++;
+    } else if (!found) {
 
       const float SCREEN_HEIGHT = 240.0f;
       float maxScroll = std::max(0.0f, totalContentHeight - SCREEN_HEIGHT);
@@ -143,6 +266,21 @@ void MessageScreen::onEnter() {
 
   client.setMessageDeleteCallback([this](const std::string &msgId) {
     std::lock_guard<std::recursive_mutex> lock(messageMutex);
+    for (auto *stubs : {&olderStubs, &newerStubs}) {
+      for (auto it = stubs->begin(); it != stubs->end(); ++it) {
+        if (it->id == msgId) {
+          if (stubs == &olderStubs) {
+            olderStubsHeight -= it->height;
+            currentScrollY = std::max(0.0f, currentScrollY - it->height);
+            targetScrollY = std::max(0.0f, targetScrollY - it->height);
+          } else {
+            newerStubsHeight -= it->height;
+          }
+          stubs->erase(it);
+          break;
+        }
+      }
+    }
     for (size_t i = 0; i < this->messages.size(); i++) {
       if (this->messages[i].id == msgId) {
         this->messages.erase(this->messages.begin() + i);
@@ -252,11 +390,8 @@ void MessageScreen::onEnter() {
   isForumView = (channel.type == 15);
 
   if (isForumView) {
-    client.fetchForumThreads(
-        channelId, [this, token = aliveToken](
-                       const std::vector<Discord::Channel> &threads) {
-          if (!*token)
-            return;
+    auto requests = client.fetchForumThreads(
+        channelId, [this](const std::vector<Discord::Channel> &threads) {
           std::vector<Discord::Message> threadMsgs;
           for (const auto &t : threads) {
             Discord::Message m;
@@ -278,14 +413,13 @@ void MessageScreen::onEnter() {
           }
           isLoading = false;
         });
+    for (auto &request : requests)
+      track(request);
     return;
   }
 
-  client.fetchMessagesAsync(
-      channelId, 25,
-      [this, token = aliveToken](const std::vector<Discord::Message> &fetched) {
-        if (!*token)
-          return;
+  track(client.fetchMessagesAsync(
+      channelId, 25, [this](const std::vector<Discord::Message> &fetched) {
         if (fetched.empty()) {
           isLoading = false;
           return;
@@ -318,7 +452,7 @@ void MessageScreen::onEnter() {
         isLoading = false;
         Logger::log("MessageScreen loaded %d messages async via NetworkManager",
                     reversed.size());
-      });
+      }));
 }
 
 void MessageScreen::update() {
@@ -447,6 +581,8 @@ void MessageScreen::update() {
                                                 ? msg.author.username
                                                 : msg.author.global_name;
 
+            if (!newerStubs.empty())
+              jumpToLatest();
             this->messages.push_back(replyMsg);
             rebuildLayoutCache();
             scrollToBottom();
@@ -630,7 +766,15 @@ void MessageScreen::update() {
   }
 
   float scrollSpeed = 0.5f;
-  currentScrollY += (targetScrollY - currentScrollY) * scrollSpeed;
+  if (std::fabs(targetScrollY - currentScrollY) > 0.5f) {
+    currentScrollY += (targetScrollY - currentScrollY) * scrollSpeed;
+    Core::FrameScheduler::getInstance().requestAnimationFrame();
+  } else if (currentScrollY != targetScrollY) {
+    currentScrollY = targetScrollY;
+    Core::FrameScheduler::getInstance().requestAnimationFrame();
+  }
+
+  planPrefetch();
 
   if (showNewMessageIndicator) {
     const float SCREEN_HEIGHT = 240.0f;
@@ -640,12 +784,24 @@ void MessageScreen::update() {
     }
   }
 
-  if (currentScrollY < 40.0f && !isFetchingHistory && hasMoreHistory &&
-      !this->messages.empty()) {
+  float historyEdge =
+      olderStubsHeight + (olderStubs.empty() ? 40.0f : 240.0f);
+  if (currentScrollY < historyEdge && !isFetchingHistory &&
+      (hasMoreHistory || !olderStubs.empty()) && !this->messages.empty() &&
+      osGetTime() >= olderRetryAt) {
     isFetchingHistory = true;
     fetchOlderMessages();
   }
 
+  if (!newerStubs.empty() && !isFetchingNewer && !this->messages.empty() &&
+      currentScrollY + 480.0f > totalContentHeight - newerStubsHeight &&
+      osGetTime() >= newerRetryAt) {
+    isFetchingNewer = true;
+    fetchNewerMessages();
+  }
+
+  trimMessageWindow();
+
   if (!isManualScrolling && shouldMoveDown) {
     bool visible = false;
     if (selectedIndex >= 0 && selectedIndex < (int)messagePositions.size()) {
@@ -958,17 +1114,15 @@ float MessageScreen::drawSystemMessage(const Discord::Message &msg, float y,
     else
       iconPath = "romfs:/discord-icons/boostgem.png";
 
-    C3D_Tex *tex = ImageManager::getInstance().getLocalImage(iconPath, true);
-    if (tex) {
+    C2D_Image img = ImageManager::getInstance().getLocalIcon(iconPath);
+    if (img.tex) {
       float iconSize = 14.0f;
-      Tex3DS_SubTexture subtex = {
-          (u16)tex->width, (u16)tex->height, 0.0f, 1.0f, 1.0f, 0.0f};
-      C2D_Image img = {tex, &subtex};
       C2D_ImageTint tint;
       C2D_PlainImageTint(&tint, iconColor, 1.0f);
 
-      C2D_DrawImageAt(img, 17.0f, drawY, 0.5f, &tint, iconSize / tex->width,
-                      iconSize / tex->height);
+      C2D_DrawImageAt(img, 17.0f, drawY, 0.5f, &tint,
+                      iconSize / img.subtex->width,
+                      iconSize / img.subtex->height);
     } else {
       drawText(12.0f, drawY, 0.55f, 0.35f, 0.35f, iconColor, icon);
     }
@@ -992,11 +1146,7 @@ float MessageScreen::drawReplyPreview(const Discord::Message &msg, float x,
   }
 
   std::string arrowPath = "romfs:/discord-icons/curve.png";
-  auto arrowInfo = ImageManager::getInstance().getImageInfo(arrowPath);
-  if (!arrowInfo.tex || arrowInfo.failed) {
-    ImageManager::getInstance().getLocalImage(arrowPath, true);
-    arrowInfo = ImageManager::getInstance().getImageInfo(arrowPath);
-  }
+  C2D_Image arrow = ImageManager::getInstance().getLocalIcon(arrowPath);
 
   std::string author = !msg.referencedAuthorNickname.empty()
                            ? msg.referencedAuthorNickname
@@ -1023,20 +1173,11 @@ float MessageScreen::drawReplyPreview(const Discord::Message &msg, float x,
 
   float curX = x;
 
-  if (arrowInfo.tex) {
+  if (arrow.tex) {
     float iconSize = 8.0f;
-    float uMax = (float)arrowInfo.originalW / arrowInfo.tex->width;
-    float vMax = (float)arrowInfo.originalH / arrowInfo.tex->height;
-    Tex3DS_SubTexture subtex = {(u16)arrowInfo.originalW,
-                                (u16)arrowInfo.originalH,
-                                0.0f,
-                                1.0f,
-                                uMax,
-                                1.0f - vMax};
-    C2D_Image img = {arrowInfo.tex, &subtex};
-    C2D_DrawImageAt(img, curX + 1.0f, y + 2.0f, 0.5f, nullptr,
-                    iconSize / arrowInfo.originalW,
-                    iconSize / arrowInfo.originalH);
+    C2D_DrawImageAt(arrow, curX + 1.0f, y + 2.0f, 0.5f, nullptr,
+                    iconSize / arrow.subtex->width,
+                    iconSize / arrow.subtex->height);
   } else {
     drawText(curX, y, 0.5f, 0.35f, 0.35f, ScreenManager::colorTextMuted(),
              "↳ ");
@@ -1067,18 +1208,15 @@ float MessageScreen::drawForwardHeader(const Discord::Message &msg, float x,
     return y;
 
   std::string iconPath = "romfs:/discord-icons/arrow-angle-right-up.png";
-  C3D_Tex *icon = UI::ImageManager::getInstance().getLocalImage(iconPath, true);
-  if (icon) {
+  C2D_Image img = UI::ImageManager::getInstance().getLocalIcon(iconPath);
+  if (img.tex) {
     float iconSize = 10.0f;
-    Tex3DS_SubTexture subtex = {
-        (u16)icon->width, (u16)icon->height, 0.0f, 1.0f, 1.0f, 0.0f};
-    C2D_Image img = {icon, &subtex};
-
     C2D_ImageTint tint;
     C2D_PlainImageTint(&tint, ScreenManager::colorTextMuted(), 1.0f);
 
     C2D_DrawImageAt(img, x + 2.0f, y + 2.0f, 0.5f, &tint,
-                    iconSize / icon->width, iconSize / icon->height);
+                    iconSize / img.subtex->width,
+                    iconSize / img.subtex->height);
 
     drawText(x + iconSize + 6.0f, y, 0.5f, 0.38f, 0.38f,
              ScreenManager::colorTextMuted(), TR("message.forwarded"));
@@ -1125,16 +1263,13 @@ float MessageScreen::drawAuthorHeader(const Discord::Message &msg, float x,
                                pendingMemberFetches.end()) {
           pendingMemberFetches.insert(msg.author.id);
           std::string uid = msg.author.id;
-          client.fetchMember(
-              guildId, uid,
-              [this, uid, token = aliveToken](const Discord::Member &m) {
-                if (!*token)
-                  return;
+          track(client.fetchMember(
+              guildId, uid, [this, uid](const Discord::Member &m) {
                 if (m.user_id.empty()) {
                   this->failedMemberFetches[uid] = osGetTime() + (30 * 1000);
                 }
                 this->pendingMemberFetches.erase(uid);
-              });
+              }));
         }
       }
     }
@@ -1150,15 +1285,12 @@ float MessageScreen::drawAuthorHeader(const Discord::Message &msg, float x,
   float avatarX = 10.0f;
   float avatarSize = 28.0f;
 
-  C3D_Tex *avatarTex = Discord::AvatarCache::getInstance().getAvatar(
+  C2D_Image avatar = Discord::AvatarCache::getInstance().getAvatar(
       msg.author.id, msg.author.avatar, msg.author.discriminator);
-  if (avatarTex) {
-    Tex3DS_SubTexture subtex = {
-        (u16)avatarTex->width, (u16)avatarTex->height, 0.0f, 1.0f, 1.0f, 0.0f};
-    C2D_Image img = {avatarTex, &subtex};
-    C2D_DrawImageAt(img, avatarX, y, 0.5f, nullptr,
-                    avatarSize / avatarTex->width,
-                    avatarSize / avatarTex->height);
+  if (avatar.tex) {
+    C2D_DrawImageAt(avatar, avatarX, y, 0.5f, nullptr,
+                    avatarSize / avatar.subtex->width,
+                    avatarSize / avatar.subtex->height);
   } else {
     Discord::AvatarCache::getInstance().prefetchAvatar(
         msg.author.id, msg.author.avatar, msg.author.discriminator);
@@ -1173,7 +1305,7 @@ float MessageScreen::drawAuthorHeader(const Discord::Message &msg, float x,
   drawRichText(x, y - 2.0f, 0.5f, 0.45f, 0.45f, nameColor, displayName);
   float nameWidth = UI::measureRichText(displayName, 0.45f, 0.45f);
   float timeX = x + nameWidth + 8.0f;
-  std::string time = MessageUtils::formatTimestamp(msg.timestamp);
+  std::string time = MessageUtils::formatTimestamp(msg);
 
   drawText(timeX, y, 0.5f, 0.35f, 0.35f, ScreenManager::colorTextMuted(), time);
   return y + 14.0f;
@@ -1431,23 +1563,14 @@ float MessageScreen::drawReactions(const Discord::Message &msg, float x,
       EmojiManager::EmojiInfo emojiInfo =
           UI::EmojiManager::getInstance().getEmojiInfo(info.react->emoji.id);
       if (emojiInfo.tex) {
-        float uMax = (float)emojiInfo.originalW / emojiInfo.tex->width;
-        float vMax = (float)emojiInfo.originalH / emojiInfo.tex->height;
-        Tex3DS_SubTexture subtex = {(u16)emojiInfo.originalW,
-                                    (u16)emojiInfo.originalH,
-                                    0.0f,
-                                    1.0f,
-                                    uMax,
-                                    1.0f - vMax};
         float scale =
             std::min(16.0f / emojiInfo.originalW, 16.0f / emojiInfo.originalH);
         float drawEmojiX =
             emojiX + (16.0f - emojiInfo.originalW * scale) / 2.0f;
         float drawEmojiY =
             emojiY + (16.0f - emojiInfo.originalH * scale) / 2.0f;
-        C2D_Image img = {emojiInfo.tex, &subtex};
-        C2D_DrawImageAt(img, drawEmojiX, drawEmojiY, 0.47f, nullptr, scale,
-                        scale);
+        C2D_DrawImageAt(emojiInfo.image, drawEmojiX, drawEmojiY, 0.47f, nullptr,
+                        scale, scale);
       } else {
         UI::EmojiManager::getInstance().prefetchEmoji(info.react->emoji.id);
         drawText(emojiX, emojiY + 2.0f, 0.47f, 0.4f, 0.4f,
@@ -1459,24 +1582,15 @@ float MessageScreen::drawReactions(const Discord::Message &msg, float x,
           UI::EmojiManager::getInstance().getTwemojiInfo(hex);
 
       if (emojiInfo.tex) {
-        float uMax = (float)emojiInfo.originalW / emojiInfo.tex->width;
-        float vMax = (float)emojiInfo.originalH / emojiInfo.tex->height;
-        Tex3DS_SubTexture subtex = {(u16)emojiInfo.originalW,
-                                    (u16)emojiInfo.originalH,
-                                    0.0f,
-                                    1.0f,
-                                    uMax,
-                                    1.0f - vMax};
         float scale =
             std::min(16.0f / emojiInfo.originalW, 16.0f / emojiInfo.originalH);
         float drawEmojiX =
             emojiX + (16.0f - emojiInfo.originalW * scale) / 2.0f;
         float drawEmojiY =
             emojiY + (16.0f - emojiInfo.originalH * scale) / 2.0f;
-        C2D_Image img = {emojiInfo.tex, &subtex};
-        C2D_DrawImageAt(img, drawEmojiX, drawEmojiY, 0.47f, nullptr, scale,
-                        scale);
-      } else {
+        C2D_DrawImageAt(emojiInfo.image, drawEmojiX, drawEmojiY, 0.47f, nullptr,
+                        scale, scale);
+      } else if (!UI::EmojiManager::getInstance().hasTwemoji(hex)) {
         drawText(emojiX, emojiY + 2.0f, 0.47f, 0.5f, 0.5f,
                  ScreenManager::colorText(), info.react->emoji.name);
       }
@@ -1524,7 +1638,7 @@ float MessageScreen::drawMessage(const Discord::Message &msg, float y,
   contentY = drawForwardHeader(msg, textOffsetX, contentY);
 
   if (!showHeader && isSelected) {
-    std::string time = MessageUtils::formatTimeOnly(msg.timestamp);
+    std::string time = MessageUtils::formatTimeOnly(msg);
     drawText(10.0f, contentY + 2.0f, 0.5f, 0.35f, 0.35f,
              ScreenManager::colorTextMuted(), time);
   }
@@ -1562,6 +1676,7 @@ float MessageScreen::drawMessage(const Discord::Message &msg, float y,
 }
 
 void MessageScreen::renderTop(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("MessageScreen::renderTop");
   C2D_TargetClear(target, ScreenManager::colorBackground());
   C2D_SceneBegin(target);
 
@@ -1599,31 +1714,32 @@ void MessageScreen::renderTop(C3D_RenderTarget *target) {
   const float MARGIN = 10.0f;
   const float TOP_MARGIN = 30.0f;
 
-  for (size_t i = 0; i < messages.size(); i++) {
+  // Only rows from the last one starting above the viewport onward can be
+  // visible, so skip straight to it.
+  auto firstIt =
+      std::upper_bound(messagePositions.begin(), messagePositions.end(),
+                       -yStart - TOP_MARGIN);
+  size_t firstVisible =
+      (firstIt == messagePositions.begin())
+          ? 0
+          : (size_t)std::distance(messagePositions.begin(), firstIt) - 1;
+
+  std::vector<TextureHandle> pins;
+
+  for (size_t i = firstVisible; i < messages.size(); i++) {
     if (i >= messagePositions.size() || i >= messageHeights.size())
       break;
 
     float msgY = yStart + messagePositions[i];
     float msgH = messageHeights[i];
 
-    if (msgY + msgH < -TOP_MARGIN || msgY > SCREEN_HEIGHT + MARGIN)
+    if (msgY - 20.0f > SCREEN_HEIGHT + MARGIN)
+      break;
+    if (msgY + msgH < -TOP_MARGIN)
       continue;
 
-    bool showDateSeparator = false;
-    std::string currDate = "";
-
-    if (i == 0) {
-      showDateSeparator = true;
-      currDate = MessageUtils::getLocalDateString(this->messages[i].timestamp);
-    } else if (this->messages[i].timestamp != "Sending...") {
-      currDate = MessageUtils::getLocalDateString(this->messages[i].timestamp);
-      std::string prevDate =
-          MessageUtils::getLocalDateString(this->messages[i - 1].timestamp);
-      if (currDate != prevDate) {
-        showDateSeparator = true;
-      }
-    }
-
+    bool showDateSeparator = i < messageHasDateSeparator.size() &&
+                             messageHasDateSeparator[i];
     float dateY = msgY - 20.0f;
 
     float renderTopY = showDateSeparator ? dateY : msgY;
@@ -1643,6 +1759,8 @@ void MessageScreen::renderTop(C3D_RenderTarget *target) {
         C2D_DrawRectSolid(10.0f, lineY, 0.7f, 130.0f, 1.0f, lineColor);
         C2D_DrawRectSolid(260.0f, lineY, 0.7f, 130.0f, 1.0f, lineColor);
 
+        std::string currDate =
+            MessageUtils::getLocalDateString(this->messages[i]);
         float dateW = UI::measureText(currDate, 0.4f, 0.4f);
         float dateX = (400.0f - dateW) / 2.0f;
         drawText(dateX, dateY, 0.7f, 0.4f, 0.4f,
@@ -1651,14 +1769,12 @@ void MessageScreen::renderTop(C3D_RenderTarget *target) {
     }
 
     bool isSelected = (i == (size_t)selectedIndex);
-    bool showHeader = (i == 0) || !MessageUtils::canGroupWithPrevious(
-                                      messages[i], messages[i - 1]);
-
-    if (showDateSeparator)
-      showHeader = true;
+    bool showHeader = i >= messageShowsHeader.size() || messageShowsHeader[i];
 
     drawMessage(this->messages[i], msgY, 400.0f, isSelected, showHeader);
+    pinMessageImages(this->messages[i], pins);
   }
+  visiblePins.swap(pins);
 
   if (showNewMessageIndicator) {
     float indicatorY = 205.0f;
@@ -1683,87 +1799,103 @@ void MessageScreen::renderTop(C3D_RenderTarget *target) {
 }
 
 void MessageScreen::renderBottom(C3D_RenderTarget *target) {
-  C2D_DrawRectSolid(0, 0, 0.0f, 320, 240, ScreenManager::colorBackgroundDark());
-
-  float headerX = 35.0f;
-
-  std::string iconPath;
-  if (!rulesChannelId.empty() && channelId == rulesChannelId) {
-    iconPath = "romfs:/discord-icons/bookcheck.png";
-  } else if (channelType == 5) {
-    iconPath = "romfs:/discord-icons/announcement.png";
-  } else if (channelType == 10 || channelType == 11 || channelType == 12 ||
-             channelType == 1 || channelType == 3) {
-    iconPath = "romfs:/discord-icons/chat.png";
-  } else {
-    iconPath = "romfs:/discord-icons/text.png";
-  }
+  PROFILE_SCOPE("MessageScreen::renderBottom");
+  bool canSend =
+      Discord::DiscordClient::getInstance().canSendMessage(channelId);
 
-  C3D_Tex *icon = UI::ImageManager::getInstance().getLocalImage(iconPath);
-  if (icon) {
-    float iconSize = 16.0f;
-    Tex3DS_SubTexture subtex = {
-        (u16)icon->width, (u16)icon->height, 0.0f, 1.0f, 1.0f, 0.0f};
-    C2D_Image img = {icon, &subtex};
+  // Header, topic and hints only change on navigation; keep them in a layer
+  // and redraw only the typing indicator and scroll button on top.
+  u32 layerKey = RenderLayer::hashKey(0, channelId);
+  layerKey = RenderLayer::hashKey(layerKey, truncatedChannelName);
+  layerKey = RenderLayer::hashKey(layerKey, channelTopic);
+  layerKey = RenderLayer::hashKey(layerKey, (u32)channelType);
+  layerKey = RenderLayer::hashKey(
+      layerKey, (isMenuOpen ? 1u : 0u) | (isForumView ? 2u : 0u) |
+                    (canSend ? 4u : 0u));
+  layerKey = RenderLayer::hashKey(layerKey, ScreenManager::colorText());
+  layerKey = RenderLayer::hashLoadedImages(layerKey);
 
-    C2D_ImageTint tint;
-    C2D_PlainImageTint(&tint, ScreenManager::colorText(), 1.0f);
+  u32 background = ScreenManager::colorBackgroundDark();
+  bottomLayer.draw(target, layerKey, background, 0.0f, 0.0f, 0.0f, [&]() {
+    C2D_DrawRectSolid(0, 0, 0.0f, 320, 240, background);
 
-    C2D_DrawImageAt(img, 35.0f, 10.0f, 0.51f, &tint, iconSize / icon->width,
-                    iconSize / icon->height);
-    headerX = 35.0f + iconSize + 5.0f;
-  } else {
-    drawText(35.0f, 10.0f, 0.5f, 0.5f, 0.5f, ScreenManager::colorTextMuted(),
-             "#");
-    headerX = 50.0f;
-  }
+    float headerX = 35.0f;
+
+    std::string iconPath;
+    if (!rulesChannelId.empty() && channelId == rulesChannelId) {
+      iconPath = "romfs:/discord-icons/bookcheck.png";
+    } else if (channelType == 5) {
+      iconPath = "romfs:/discord-icons/announcement.png";
+    } else if (channelType == 10 || channelType == 11 || channelType == 12 ||
+               channelType == 1 || channelType == 3) {
+      iconPath = "romfs:/discord-icons/chat.png";
+    } else {
+      iconPath = "romfs:/discord-icons/text.png";
+    }
+
+    C2D_Image img = UI::ImageManager::getInstance().getLocalIcon(iconPath);
+    if (img.tex) {
+      float iconSize = 16.0f;
+      C2D_ImageTint tint;
+      C2D_PlainImageTint(&tint, ScreenManager::colorText(), 1.0f);
 
-  drawRichText(headerX, 10.0f, 0.5f, 0.55f, 0.55f, ScreenManager::colorText(),
-               truncatedChannelName);
+      C2D_DrawImageAt(img, 35.0f, 10.0f, 0.51f, &tint,
+                      iconSize / img.subtex->width,
+                      iconSize / img.subtex->height);
+      headerX = 35.0f + iconSize + 5.0f;
+    } else {
+      drawText(35.0f, 10.0f, 0.5f, 0.5f, 0.5f, ScreenManager::colorTextMuted(),
+               "#");
+      headerX = 50.0f;
+    }
 
-  C2D_DrawRectSolid(10, 32, 0.5f, 320 - 20, 1, ScreenManager::colorSeparator());
+    drawRichText(headerX, 10.0f, 0.5f, 0.55f, 0.55f, ScreenManager::colorText(),
+                 truncatedChannelName);
 
-  std::string displayTopic =
-      channelTopic.empty() ? Core::I18n::getInstance().get("common.no_topic")
-                           : channelTopic;
+    C2D_DrawRectSolid(10, 32, 0.5f, 320 - 20, 1,
+                      ScreenManager::colorSeparator());
 
-  float topicY = 40.0f;
+    std::string displayTopic =
+        channelTopic.empty() ? Core::I18n::getInstance().get("common.no_topic")
+                             : channelTopic;
 
-  drawText(10.0f, topicY, 0.5f, 0.45f, 0.45f, ScreenManager::colorSelection(),
-           Core::I18n::getInstance().get("message.topic"));
-  topicY += 15.0f;
+    float topicY = 40.0f;
 
-  auto lines = MessageUtils::wrapText(displayTopic, 300.0f, 0.4f);
-  int lineCount = 0;
+    drawText(10.0f, topicY, 0.5f, 0.45f, 0.45f, ScreenManager::colorSelection(),
+             Core::I18n::getInstance().get("message.topic"));
+    topicY += 15.0f;
 
-  for (const auto &line : lines) {
-    if (lineCount >= 10)
-      break;
+    auto lines = MessageUtils::wrapText(displayTopic, 300.0f, 0.4f);
+    int lineCount = 0;
 
-    drawRichText(10.0f, topicY, 0.5f, 0.4f, 0.4f, ScreenManager::colorText(),
-                 line);
-    topicY += 13.0f;
-    lineCount++;
-  }
+    for (const auto &line : lines) {
+      if (lineCount >= 10)
+        break;
 
-  bool canSend =
-      Discord::DiscordClient::getInstance().canSendMessage(channelId);
+      drawRichText(10.0f, topicY, 0.5f, 0.4f, 0.4f, ScreenManager::colorText(),
+                   line);
+      topicY += 13.0f;
+      lineCount++;
+    }
 
-  std::string hints = "\uE079\uE07A: " + TR("common.navigate") + "  ";
-  if (isMenuOpen) {
-    hints +=
-        "\uE000: " + TR("common.select") + "  \uE001: " + TR("common.close");
-  } else if (isForumView) {
-    hints += "\uE000: " + TR("common.open") + "  \uE001: " + TR("common.back");
-  } else {
-    if (canSend) {
-      hints += "\uE003: " + TR("common.type") + "  ";
+    std::string hints = "\uE079\uE07A: " + TR("common.navigate") + "  ";
+    if (isMenuOpen) {
+      hints +=
+          "\uE000: " + TR("common.select") + "  \uE001: " + TR("common.close");
+    } else if (isForumView) {
+      hints +=
+          "\uE000: " + TR("common.open") + "  \uE001: " + TR("common.back");
+    } else {
+      if (canSend) {
+        hints += "\uE003: " + TR("common.type") + "  ";
+      }
+      hints +=
+          "\uE002: " + TR("common.menu") + "  \uE001: " + TR("common.back");
     }
-    hints += "\uE002: " + TR("common.menu") + "  \uE001: " + TR("common.back");
-  }
 
-  drawText(10.0f, BOTTOM_SCREEN_HEIGHT - 25.0f, 0.5f, 0.4f, 0.4f,
-           ScreenManager::colorTextMuted(), hints);
+    drawText(10.0f, BOTTOM_SCREEN_HEIGHT - 25.0f, 0.5f, 0.4f, 0.4f,
+             ScreenManager::colorTextMuted(), hints);
+  });
 
   auto typingUsers =
       Discord::DiscordClient::getInstance().getTypingUsers(channelId);
@@ -1827,15 +1959,20 @@ void MessageScreen::fetchOlderMessages() {
   }
 
   std::string beforeId = this->messages.front().id;
+  if (isPendingId(beforeId)) {
+    isFetchingHistory = false;
+    return;
+  }
   Discord::DiscordClient &client = Discord::DiscordClient::getInstance();
 
-  client.fetchMessagesBeforeAsync(
+  track(client.fetchMessagesBeforeAsync(
       channelId, beforeId, 25,
-      [this,
-       token = aliveToken](const std::vector<Discord::Message> &olderMessages) {
-        if (!*token)
-          return;
-        if (!olderMessages.empty()) {
+      [this](const std::vector<Discord::Message> &olderMessages,
+             bool success) {
+        if (!success) {
+          // Keep any stubs; the page is asked for again shortly.
+          olderRetryAt = osGetTime() + PAGE_RETRY_MS;
+        } else if (!olderMessages.empty()) {
           std::vector<Discord::Message> reversed = olderMessages;
           std::reverse(reversed.begin(), reversed.end());
 
@@ -1844,6 +1981,15 @@ void MessageScreen::fetchOlderMessages() {
 
           {
             std::lock_guard<std::recursive_mutex> lock(messageMutex);
+            const std::string &oldestId = reversed.front().id;
+            while (!olderStubs.empty() &&
+                   !isSnowflakeOlder(olderStubs.back().id, oldestId)) {
+              olderStubsHeight -= olderStubs.back().height;
+              olderStubs.pop_back();
+            }
+            if (olderStubs.empty())
+              olderStubsHeight = 0.0f;
+
             this->messages.insert(this->messages.begin(), reversed.begin(),
                                   reversed.end());
             selectedIndex += reversed.size();
@@ -1859,14 +2005,230 @@ void MessageScreen::fetchOlderMessages() {
           Logger::log("Loaded %d older messages async, adjusted scroll by %.2f",
                       addedCount, heightDiff);
         } else {
-
+          std::lock_guard<std::recursive_mutex> lock(messageMutex);
           hasMoreHistory = false;
+          if (!olderStubs.empty()) {
+            // The server says nothing is older, so the stubbed history was
+            // deleted; collapse the gap.
+            currentScrollY = std::max(0.0f, currentScrollY - olderStubsHeight);
+            targetScrollY = std::max(0.0f, targetScrollY - olderStubsHeight);
+            olderStubs.clear();
+            olderStubsHeight = 0.0f;
+            rebuildLayoutCache();
+          }
           Logger::log("End of history reached for channel %s",
                       channelId.c_str());
         }
 
         isFetchingHistory = false;
-      });
+      }));
+}
+
+void MessageScreen::fetchNewerMessages() {
+  std::string afterId;
+  for (auto it = this->messages.rbegin(); it != this->messages.rend(); ++it) {
+    if (!isPendingId(it->id)) {
+      afterId = it->id;
+      break;
+    }
+  }
+
+  if (afterId.empty() || newerStubs.empty()) {
+    isFetchingNewer = false;
+    return;
+  }
+
+  track(Discord::DiscordClient::getInstance().fetchMessagesAfterAsync(
+      channelId, afterId, 25,
+      [this](const std::vector<Discord::Message> &newerMessages,
+             bool success) {
+        if (!success) {
+          newerRetryAt = osGetTime() + PAGE_RETRY_MS;
+          isFetchingNewer = false;
+          return;
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(messageMutex);
+        std::vector<Discord::Message> sorted = newerMessages;
+        std::sort(sorted.begin(), sorted.end(),
+                  [](const Discord::Message &a, const Discord::Message &b) {
+                    return isSnowflakeOlder(a.id, b.id);
+                  });
+
+        if (sorted.empty()) {
+          newerStubs.clear();
+        } else {
+          const std::string &newestId = sorted.back().id;
+          while (!newerStubs.empty() &&
+                 !isSnowflakeOlder(newestId, newerStubs.front().id)) {
+            newerStubsHeight -= newerStubs.front().height;
+            newerStubs.pop_front();
+          }
+        }
+        if (newerStubs.empty())
+          newerStubsHeight = 0.0f;
+
+        this->messages.insert(this->messages.end(), sorted.begin(),
+                              sorted.end());
+        rebuildLayoutCache();
+
+        Logger::log("Reloaded %d newer messages, %d still stubbed",
+                    (int)sorted.size(), (int)newerStubs.size());
+        isFetchingNewer = false;
+      }));
+}
+
+void MessageScreen::jumpToLatest() {
+  std::lock_guard<std::recursive_mutex> lock(messageMutex);
+
+  std::vector<Discord::Message> pending;
+  for (const auto &m : this->messages) {
+    if (isPendingId(m.id))
+      pending.push_back(m);
+  }
+
+  this->messages = pending;
+  olderStubs.clear();
+  newerStubs.clear();
+  olderStubsHeight = 0.0f;
+  newerStubsHeight = 0.0f;
+  hasMoreHistory = true;
+  showNewMessageIndicator = false;
+  newMessageCount = 0;
+  isLoading = true;
+  rebuildLayoutCache();
+
+  track(Discord::DiscordClient::getInstance().fetchMessagesAsync(
+      channelId, 25, [this](const std::vector<Discord::Message> &fetched) {
+
+        {
+          std::lock_guard<std::recursive_mutex> lock(messageMutex);
+          std::vector<Discord::Message> latest(fetched.rbegin(),
+                                               fetched.rend());
+          for (const auto &m : this->messages) {
+            if (isPendingId(m.id))
+              latest.push_back(m);
+          }
+          this->messages = std::move(latest);
+          rebuildLayoutCache();
+          scrollToBottom();
+        }
+
+        isLoading = false;
+      }));
+}
+
+MessageScreen::MessageStub MessageScreen::makeStub(size_t index) const {
+  const Discord::Message &msg = this->messages[index];
+  MessageStub stub;
+  stub.id = msg.id;
+  stub.authorId = msg.author.id;
+  stub.epoch = msg.epoch;
+  stub.height = messageHeights[index];
+  if (messageHasDateSeparator[index])
+    stub.height += 28.0f;
+  return stub;
+}
+
+void MessageScreen::planPrefetch() {
+  const float SCREEN_HEIGHT = 240.0f;
+  float delta = currentScrollY - lastPlannedScrollY;
+  lastPlannedScrollY = currentScrollY;
+  // A jump (history prepended, jump to latest) is not scrolling.
+  if (std::fabs(delta) > SCREEN_HEIGHT)
+    delta = 0.0f;
+  scrollVelocity = scrollVelocity * 0.7f + delta * 0.3f;
+
+  // While at rest the window only changes when messages do.
+  if (std::fabs(scrollVelocity) < 0.05f && ++planIdleUpdates < 30)
+    return;
+  planIdleUpdates = 0;
+
+  float viewTop =
+      currentScrollY - std::max(0.0f, SCREEN_HEIGHT - totalContentHeight);
+  float rangeTop = viewTop - SCREEN_HEIGHT * 4.0f;
+  float rangeBottom = viewTop + SCREEN_HEIGHT * 5.0f;
+
+  std::vector<PrefetchPlanner::Item> items;
+  auto it = std::lower_bound(messagePositions.begin(), messagePositions.end(),
+                             rangeTop);
+  for (size_t i = std::distance(messagePositions.begin(), it);
+       i < messages.size() && i < messagePositions.size() &&
+       i < messageHeights.size() && messagePositions[i] < rangeBottom;
+       i++) {
+    collectMessageImages(messages[i], messagePositions[i],
+                         messagePositions[i] + messageHeights[i], items);
+  }
+  prefetchPlanner.plan(items, viewTop, SCREEN_HEIGHT, scrollVelocity);
+}
+
+void MessageScreen::trimMessageWindow() {
+  if (isForumView || isFetchingHistory || isFetchingNewer ||
+      this->messages.size() <= WINDOW_MAX_MESSAGES ||
+      messagePositions.size() != this->messages.size())
+    return;
+
+  // Keep the rows around the middle of the viewport and stub out whichever
+  // end is farther from it until the window is back under budget.
+  auto centerIt =
+      std::upper_bound(messagePositions.begin(), messagePositions.end(),
+                       currentScrollY + 120.0f);
+  size_t center =
+      (centerIt == messagePositions.begin())
+          ? 0
+          : (size_t)std::distance(messagePositions.begin(), centerIt) - 1;
+
+  size_t keep = WINDOW_MAX_MESSAGES - WINDOW_TRIM_BATCH;
+  size_t lo = 0;
+  size_t hi = this->messages.size();
+  while (hi - lo > keep) {
+    bool canDropBack = hi - 1 > center && !isPendingId(messages[hi - 1].id);
+    if (canDropBack && (hi - 1 - center) >= (center - lo)) {
+      hi--;
+    } else if (center > lo) {
+      lo++;
+    } else if (canDropBack) {
+      hi--;
+    } else {
+      break;
+    }
+  }
+
+  if (lo == 0 && hi == this->messages.size())
+    return;
+
+  std::string anchorId = this->messages[center].id;
+  float anchorY = messagePositions[center];
+
+  for (size_t i = 0; i < lo; i++) {
+    olderStubs.push_back(makeStub(i));
+    olderStubsHeight += olderStubs.back().height;
+  }
+  for (size_t i = this->messages.size(); i > hi; i--) {
+    newerStubs.push_front(makeStub(i - 1));
+    newerStubsHeight += newerStubs.front().height;
+  }
+
+  this->messages.erase(this->messages.begin() + hi, this->messages.end());
+  this->messages.erase(this->messages.begin(), this->messages.begin() + lo);
+  selectedIndex = std::clamp(selectedIndex - (int)lo, 0,
+                             (int)this->messages.size() - 1);
+
+  rebuildLayoutCache();
+
+  // Stub heights match the rows they replace, but keep the anchor pinned in
+  // case a header or separator changed at the new window edge.
+  size_t newCenter = center - lo;
+  if (newCenter < this->messages.size() &&
+      this->messages[newCenter].id == anchorId) {
+    float delta = messagePositions[newCenter] - anchorY;
+    currentScrollY += delta;
+    targetScrollY += delta;
+  }
+
+  Logger::log("Message window trimmed: %d loaded, %d older / %d newer stubs",
+              (int)this->messages.size(), (int)olderStubs.size(),
+              (int)newerStubs.size());
 }
 
 void MessageScreen::openKeyboard() {
@@ -1919,6 +2281,8 @@ void MessageScreen::openKeyboard() {
       optimisticMsg.author = client.getCurrentUser();
       optimisticMsg.timestamp = TR("message.status.sending");
 
+      if (!newerStubs.empty())
+        jumpToLatest();
       this->messages.push_back(optimisticMsg);
       rebuildLayoutCache();
       scrollToBottom();
@@ -2038,6 +2402,11 @@ void MessageScreen::showMessageOptions() {
 }
 
 void MessageScreen::scrollToBottom() {
+  if (!newerStubs.empty()) {
+    jumpToLatest();
+    return;
+  }
+
   if (this->messages.empty())
     return;
 
@@ -2052,30 +2421,56 @@ void MessageScreen::scrollToBottom() {
 }
 
 void MessageScreen::rebuildLayoutCache() {
+  PROFILE_SCOPE("MessageScreen::rebuildLayoutCache");
   messagePositions.clear();
   messageHeights.clear();
+  messageShowsHeader.clear();
+  messageHasDateSeparator.clear();
 
   if (messages.empty()) {
     totalContentHeight = 0.0f;
     return;
   }
 
-  float y = 10.0f;
-  std::string lastDate = "";
+  float y = 10.0f + olderStubsHeight;
+  bool hasLastDay = false;
+  int32_t lastDay = 0;
 
-  for (size_t i = 0; i < this->messages.size(); i++) {
-    bool showHeader = (i == 0) || !MessageUtils::canGroupWithPrevious(
-                                      this->messages[i], this->messages[i - 1]);
-
-    if (this->messages[i].timestamp != "Sending...") {
-      std::string currDate =
-          MessageUtils::getLocalDateString(this->messages[i].timestamp);
+  // The first loaded row groups against the nearest stub, as if it were still
+  // loaded, so trimming the window doesn't reflow the rows that remain.
+  Discord::Message boundary;
+  if (!olderStubs.empty()) {
+    const MessageStub &stub = olderStubs.back();
+    boundary.author.id = stub.authorId;
+    boundary.epoch = stub.epoch;
+    if (stub.epoch != 0) {
+      hasLastDay = true;
+      lastDay = MessageUtils::getLocalDay(stub.epoch);
+    }
+  }
 
-      if (currDate != lastDate) {
-        y += 28.0f;
-        lastDate = currDate;
-        showHeader = true;
-      }
+  for (size_t i = 0; i < this->messages.size(); i++) {
+    const Discord::Message &msg = this->messages[i];
+    bool showHeader;
+    if (i == 0) {
+      showHeader = olderStubs.empty() ||
+                   !MessageUtils::canGroupWithPrevious(msg, boundary);
+    } else {
+      showHeader =
+          !MessageUtils::canGroupWithPrevious(msg, this->messages[i - 1]);
+    }
+    bool dateSeparator = false;
+
+    // epoch == 0 marks pending sends and forum rows: no date to separate on.
+    // The day is worked out here, not at parse time, so a timezone change
+    // applies to messages already loaded.
+    int32_t day = MessageUtils::getLocalDay(msg.epoch);
+    if (msg.epoch != 0 && (!hasLastDay || day != lastDay)) {
+      y += 28.0f;
+      hasLastDay = true;
+      lastDay = day;
+      showHeader = true;
+      dateSeparator = true;
     }
 
     for (const auto &react : this->messages[i].reactions) {
@@ -2089,11 +2484,13 @@ void MessageScreen::rebuildLayoutCache() {
     messagePositions.push_back(y);
     float h = calculateMessageHeight(this->messages[i], showHeader);
     messageHeights.push_back(h);
+    messageShowsHeader.push_back(showHeader);
+    messageHasDateSeparator.push_back(dateSeparator);
 
     y += h;
   }
 
-  totalContentHeight = y + 2.0f;
+  totalContentHeight = y + newerStubsHeight + 2.0f;
 
   const float SCREEN_HEIGHT = 240.0f;
   float maxScroll = std::max(0.0f, totalContentHeight - SCREEN_HEIGHT);
@@ -2454,13 +2851,17 @@ void MessageScreen::catchUpMessages() {
   if (channelId.empty())
     return;
 
-  Discord::DiscordClient::getInstance().fetchMessagesAsync(
+  track(Discord::DiscordClient::getInstance().fetchMessagesAsync(
       channelId, 50, [this](const std::vector<Discord::Message> &fetched) {
         if (fetched.empty())
           return;
 
         std::lock_guard<std::recursive_mutex> lock(messageMutex);
 
+        // Newer history is stubbed out; it is refetched on scroll instead.
+        if (!newerStubs.empty())
+          return;
+
         std::string latestRealId;
         for (auto it = this->messages.rbegin(); it != this->messages.rend();
              ++it) {
@@ -2520,7 +2921,18 @@ void MessageScreen::catchUpMessages() {
             newMessageCount += addedAny;
           }
         }
-      });
+      }));
+}
+
+void MessageScreen::track(Network::RequestHandle request) {
+  std::lock_guard<std::mutex> lock(requestMutex);
+  requests.erase(std::remove_if(requests.begin(), requests.end(),
+                                [](const Network::RequestHandle &r) {
+                                  return !r.isPending();
+                                }),
+                 requests.end());
+  if (request)
+    requests.push_back(request);
 }
 
 } // namespace UI
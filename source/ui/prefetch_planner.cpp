@@ -0,0 +1,104 @@
+#include "ui/prefetch_planner.h"
+#include "ui/image_manager.h"
+#include "ui/texture_cache.h"
+#include <algorithm>
+#include <cmath>
+
+namespace UI {
+
+namespace {
+
+// Below this many pixels per update the list counts as at rest.
+const float IDLE_SPEED = 0.5f;
+// How many updates of travel at the current speed to look ahead.
+const float LOOKAHEAD_UPDATES = 30.0f;
+
+} // namespace
+
+void PrefetchPlanner::plan(const std::vector<Item> &items, float viewTop,
+                           float viewHeight, float velocity) {
+  float viewBottom = viewTop + viewHeight;
+  float speed = std::fabs(velocity);
+
+  // [lo, hi] is everything worth downloading; [nearLo, nearHi] is what the
+  // user will see within about a screen and so goes first.
+  float lo, hi, nearLo, nearHi;
+  if (speed < IDLE_SPEED) {
+    lo = viewTop - viewHeight;
+    hi = viewBottom + viewHeight;
+    nearLo = viewTop - viewHeight * 0.5f;
+    nearHi = viewBottom + viewHeight * 0.5f;
+  } else {
+    float ahead = viewHeight + std::min(speed * LOOKAHEAD_UPDATES,
+                                        viewHeight * 3.0f);
+    float behind = viewHeight * 0.25f;
+    if (velocity > 0) {
+      lo = viewTop - behind;
+      hi = viewBottom + ahead;
+      nearLo = viewTop;
+      nearHi = viewBottom + viewHeight;
+    } else {
+      lo = viewTop - ahead;
+      hi = viewBottom + behind;
+      nearLo = viewTop - viewHeight;
+      nearHi = viewBottom;
+    }
+  }
+
+  std::map<std::string, const Item *> wanted;
+  std::map<std::string, Network::RequestPriority> priorities;
+  for (const auto &item : items) {
+    if (item.url.empty() || item.bottom < lo || item.top > hi)
+      continue;
+    bool near = item.bottom >= nearLo && item.top <= nearHi;
+    auto priority = near ? Network::RequestPriority::INTERACTIVE
+                         : Network::RequestPriority::BACKGROUND;
+    auto it = priorities.find(item.url);
+    if (it == priorities.end()) {
+      priorities[item.url] = priority;
+      wanted[item.url] = &item;
+    } else if (near) {
+      it->second = priority;
+    }
+  }
+
+  ImageManager &images = ImageManager::getInstance();
+  TextureCache &cache = TextureCache::getInstance();
+  for (auto it = tracked.begin(); it != tracked.end();) {
+    if (priorities.find(it->first) == priorities.end()) {
+      images.cancel(it->first);
+      it = tracked.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  for (const auto &want : priorities) {
+    const std::string &url = want.first;
+    auto it = tracked.find(url);
+    if (it == tracked.end()) {
+      // Loaded or failed; failures are retried by hand, not by scrolling.
+      if (cache.contains(url))
+        continue;
+      const Item *item = wanted[url];
+      images.prefetch(url, item->width, item->height, want.second);
+    } else if (it->second != want.second) {
+      images.reprioritize(url, want.second);
+    }
+
+    // Only downloads still under way are ours to move or cancel later.
+    if (images.isFetching(url))
+      tracked[url] = want.second;
+    else if (it != tracked.end())
+      tracked.erase(it);
+  }
+}
+
+void PrefetchPlanner::reset() {
+  ImageManager &images = ImageManager::getInstance();
+  for (const auto &entry : tracked)
+    images.cancel(entry.first);
+  tracked.clear();
+}
+
+} // namespace UI
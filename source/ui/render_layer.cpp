@@ -0,0 +1,128 @@
+#include "ui/render_layer.h"
+#include "log.h"
+#include "ui/texture_cache.h"
+
+namespace UI {
+
+size_t RenderLayer::rebuildCount = 0;
+
+static u16 nextPow2(u16 v) {
+  u16 p = 8;
+  while (p < v)
+    p <<= 1;
+  return p;
+}
+
+RenderLayer::RenderLayer(u16 width, u16 height)
+    : width(width), height(height), layerTarget(nullptr), subtex(),
+      allocated(false), allocationFailed(false), valid(false),
+      contentKey(0) {}
+
+RenderLayer::~RenderLayer() { release(); }
+
+void RenderLayer::release() {
+  if (layerTarget) {
+    C3D_RenderTargetDelete(layerTarget);
+    layerTarget = nullptr;
+  }
+  if (allocated) {
+    C3D_TexDelete(&tex);
+    allocated = false;
+  }
+  valid = false;
+}
+
+bool RenderLayer::allocate() {
+  if (allocated)
+    return true;
+  if (allocationFailed)
+    return false;
+
+  u16 texW = nextPow2(width);
+  u16 texH = nextPow2(height);
+  if (!C3D_TexInitVRAM(&tex, texW, texH, GPU_RGBA8)) {
+    Logger::log("[Layer] No VRAM for %dx%d layer, drawing directly", texW,
+                texH);
+    allocationFailed = true;
+    return false;
+  }
+
+  layerTarget = C3D_RenderTargetCreateFromTex(&tex, GPU_TEXFACE_2D, 0, -1);
+  if (!layerTarget) {
+    C3D_TexDelete(&tex);
+    allocationFailed = true;
+    return false;
+  }
+
+  C3D_TexSetFilter(&tex, GPU_NEAREST, GPU_NEAREST);
+
+  // Render targets come out with row 0 at the top of the texture.
+  subtex.width = width;
+  subtex.height = height;
+  subtex.left = 0.0f;
+  subtex.top = 1.0f;
+  subtex.right = (float)width / texW;
+  subtex.bottom = 1.0f - (float)height / texH;
+
+  allocated = true;
+  return true;
+}
+
+void RenderLayer::draw(C3D_RenderTarget *target, u32 key, u32 clearColor,
+                       float x, float y, float z,
+                       const std::function<void()> &drawContent,
+                       float alpha) {
+  if (!allocate()) {
+    drawContent();
+    return;
+  }
+
+  if (!valid || key != contentKey) {
+    C2D_TargetClear(layerTarget, clearColor);
+    C2D_SceneBegin(layerTarget);
+    drawContent();
+    C2D_SceneBegin(target);
+
+    contentKey = key;
+    valid = true;
+    rebuildCount++;
+  }
+
+  C2D_Image img = {&tex, &subtex};
+  if (alpha < 1.0f) {
+    C2D_ImageTint tint;
+    C2D_AlphaImageTint(&tint, alpha);
+    C2D_DrawImageAt(img, x, y, z, &tint, 1.0f, 1.0f);
+  } else {
+    C2D_DrawImageAt(img, x, y, z, nullptr, 1.0f, 1.0f);
+  }
+}
+
+u32 RenderLayer::hashKey(u32 seed, const std::string &value) {
+  u32 h = seed ^ 2166136261u;
+  for (unsigned char c : value) {
+    h ^= c;
+    h *= 16777619u;
+  }
+  // Separator so ("ab","c") and ("a","bc") hash differently.
+  h ^= 0xFF;
+  h *= 16777619u;
+  return h;
+}
+
+u32 RenderLayer::hashKey(u32 seed, u32 value) {
+  u32 h = seed ^ 2166136261u;
+  for (int i = 0; i < 4; i++) {
+    h ^= (value >> (i * 8)) & 0xFF;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+u32 RenderLayer::hashLoadedImages(u32 seed) {
+  TextureCache &textures = TextureCache::getInstance();
+  u32 h = hashKey(seed, textures.getGeneration(TextureClass::LOCAL));
+  return hashKey(h, textures.getGeneration(TextureClass::SHEET));
+}
+
+} // namespace UI
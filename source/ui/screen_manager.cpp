@@ -1,10 +1,13 @@
 #include "ui/screen_manager.h"
 #include "core/config.h"
+#include "core/frame_scheduler.h"
 #include "core/i18n.h"
+#include "core/profiler.h"
 #include "discord/avatar_cache.h"
 #include "discord/discord_client.h"
 #include "log.h"
 #include "ui/about_screen.h"
+#include "ui/decode_pool.h"
 #include "ui/disclaimer_screen.h"
 #include "ui/dm_screen.h"
 #include "ui/emoji_manager.h"
@@ -12,9 +15,12 @@
 #include "ui/image_manager.h"
 #include "ui/login_screen.h"
 #include "ui/message_screen.h"
+#include "ui/render_layer.h"
 #include "ui/server_list_screen.h"
 #include "ui/settings_screen.h"
 #include "ui/text_measure_cache.h"
+#include "ui/texture_atlas.h"
+#include "ui/texture_cache.h"
 #include "utils/message_utils.h"
 #include "utils/utf8_utils.h"
 
@@ -65,6 +71,9 @@ void ScreenManager::shutdown() {
     currentScreen->onExit();
     currentScreen.reset();
   }
+  retiredScreen.reset();
+
+  hamburgerMenu.shutdown();
 
   if (textBuf) {
     C2D_TextBufDelete(textBuf);
@@ -83,8 +92,11 @@ void ScreenManager::shutdown() {
 }
 
 void ScreenManager::setScreen(ScreenType type) {
+  Core::FrameScheduler::getInstance().requestRedraw();
+
   if (currentScreen) {
     currentScreen->onExit();
+    retiredScreen = std::move(currentScreen);
   }
 
   if (type == ScreenType::LOGIN || type == ScreenType::GUILD_LIST ||
@@ -197,9 +209,10 @@ void ScreenManager::returnToPreviousScreen() {
 }
 
 void ScreenManager::update() {
-  ImageManager::getInstance().update();
+  PROFILE_SCOPE("ScreenManager::update");
+  DecodePool::getInstance().update();
   EmojiManager::getInstance().update();
-  Discord::AvatarCache::getInstance().update();
+  TextureCache::getInstance().trim();
 
   hamburgerMenu.update();
 
@@ -210,6 +223,13 @@ void ScreenManager::update() {
   u32 kDown = hidKeysDown();
   u32 kHeld = hidKeysHeld();
 
+  circlePosition circle;
+  hidCircleRead(&circle);
+  if (kDown || kHeld || hidKeysUp() || abs(circle.dx) > 15 ||
+      abs(circle.dy) > 15) {
+    Core::FrameScheduler::getInstance().requestRedraw();
+  }
+
   if (kDown & KEY_START) {
     appExitRequested = true;
     return;
@@ -217,6 +237,17 @@ void ScreenManager::update() {
 
   bool shouldBlockScreen = !hamburgerMenu.isClosed();
 
+  // L+SELECT on the profiler or network page dumps it instead of opening
+  // the menu.
+  if ((profilerOverlayEnabled || networkOverlayEnabled) && (kHeld & KEY_L) &&
+      (kDown & KEY_SELECT)) {
+    if (profilerOverlayEnabled)
+      dumpProfile();
+    else
+      dumpNetworkTimings();
+    kDown &= ~KEY_SELECT;
+  }
+
   if (!isMenuHidden()) {
     if (kDown & KEY_SELECT) {
       hamburgerMenu.toggle();
@@ -238,19 +269,31 @@ void ScreenManager::update() {
       currentScreen->update();
     }
   }
+  retiredScreen.reset();
 
   if ((kHeld & KEY_L) && (kDown & KEY_R)) {
     toggleDebugOverlay();
-    Logger::log("Debug overlay toggled: %s",
-                debugOverlayEnabled ? "ON" : "OFF");
+    const char *mode = profilerOverlayEnabled ? "PROFILER"
+                       : networkOverlayEnabled ? "NETWORK"
+                       : debugOverlayEnabled   ? "ON"
+                                               : "OFF";
+    Logger::log("Debug overlay toggled: %s", mode);
   }
 
   if (toastTimer > 0) {
     toastTimer--;
+    Core::FrameScheduler::getInstance().requestAnimationFrame(
+        Core::REDRAW_BOTTOM);
+  }
+
+  if (debugOverlayEnabled) {
+    Core::FrameScheduler::getInstance().requestAnimationFrame(
+        Core::REDRAW_TOP);
   }
 }
 
-void ScreenManager::render() {
+void ScreenManager::render(u32 targets) {
+  PROFILE_SCOPE("ScreenManager::render");
   C3D_FrameBegin(C3D_FRAME_SYNCDRAW);
 
   if (textBuf) {
@@ -260,41 +303,68 @@ void ScreenManager::render() {
     C2D_TextBufClear(debugTextBuf);
   }
 
-  C2D_TargetClear(topTarget, colorBackground());
-  C2D_SceneBegin(topTarget);
+  // A target that is not drawn this frame keeps showing its last image.
+  if (targets & Core::REDRAW_TOP) {
+    C2D_TargetClear(topTarget, colorBackground());
+    C2D_SceneBegin(topTarget);
 
-  if (currentScreen) {
-    currentScreen->renderTop(topTarget);
-  }
+    if (currentScreen) {
+      currentScreen->renderTop(topTarget);
+    }
 
-  if (!isMenuHidden()) {
-    hamburgerMenu.render();
-  }
+    if (!isMenuHidden()) {
+      hamburgerMenu.render(topTarget);
+    }
 
-  if (debugOverlayEnabled) {
-    renderDebugOverlay();
+    if (profilerOverlayEnabled) {
+      renderProfilerOverlay();
+    } else if (networkOverlayEnabled) {
+      renderNetworkOverlay();
+    } else if (debugOverlayEnabled) {
+      renderDebugOverlay();
+    }
   }
 
-  C2D_TargetClear(bottomTarget, colorBackground());
-  C2D_SceneBegin(bottomTarget);
+  if (targets & Core::REDRAW_BOTTOM) {
+    C2D_TargetClear(bottomTarget, colorBackground());
+    C2D_SceneBegin(bottomTarget);
 
-  if (currentScreen) {
-    currentScreen->renderBottom(bottomTarget);
-  }
+    if (currentScreen) {
+      currentScreen->renderBottom(bottomTarget);
+    }
 
-  if (!isMenuHidden()) {
-    drawHamburgerButton();
-  }
+    if (!isMenuHidden()) {
+      drawHamburgerButton();
+    }
 
-  if (toastTimer > 0) {
-    drawToast();
+    if (toastTimer > 0) {
+      drawToast();
+    }
   }
 
   C3D_FrameEnd(0);
 }
 
 void ScreenManager::toggleDebugOverlay() {
-  debugOverlayEnabled = !debugOverlayEnabled;
+  // Cycles off -> logs -> profiler -> network -> off (no profiler page in
+  // release).
+  if (!debugOverlayEnabled) {
+    debugOverlayEnabled = true;
+#ifdef TRICORD_PROFILER
+  } else if (!profilerOverlayEnabled && !networkOverlayEnabled) {
+    profilerOverlayEnabled = true;
+  } else if (profilerOverlayEnabled) {
+    profilerOverlayEnabled = false;
+    networkOverlayEnabled = true;
+#else
+  } else if (!networkOverlayEnabled) {
+    networkOverlayEnabled = true;
+#endif
+  } else {
+    debugOverlayEnabled = false;
+    networkOverlayEnabled = false;
+  }
+  Core::FrameScheduler::getInstance().requestRedraw(Core::REDRAW_TOP);
 }
 
 void ScreenManager::renderDebugOverlay() {
@@ -302,18 +372,272 @@ void ScreenManager::renderDebugOverlay() {
   float y = 5.0f;
   float lineHeight = 10.0f;
 
+  char stats[96];
+  Core::FrameScheduler &scheduler = Core::FrameScheduler::getInstance();
+  snprintf(stats, sizeof(stats),
+           "%lu fps, main loop busy %lu%%, layer rebuilds %lu",
+           (unsigned long)scheduler.getFramesPerSecond(),
+           (unsigned long)scheduler.getBusyPercent(),
+           (unsigned long)RenderLayer::getRebuildCount());
+  logs.insert(logs.begin(), stats);
+
+  TextureCache &textures = TextureCache::getInstance();
+  TextureCache::Stats avatars = textures.getStats(TextureClass::AVATAR);
+  TextureCache::Stats emoji = textures.getStats(TextureClass::EMOJI);
+  TextureCache::Stats media = textures.getStats(TextureClass::ATTACHMENT);
+  TextureCache::Stats sheets = textures.getStats(TextureClass::SHEET);
+  char texStats[128];
+  snprintf(texStats, sizeof(texStats),
+           "tex %zu/%zuKB hit %d%% | av %zuKB em %zuKB media %zuKB "
+           "sheet %zuKB evict %lu",
+           textures.getTotalBytes() / 1024, textures.getBudget() / 1024,
+           (int)(textures.getHitRate() * 100.0f), avatars.bytes / 1024,
+           emoji.bytes / 1024, media.bytes / 1024, sheets.bytes / 1024,
+           (unsigned long)(avatars.evictions + emoji.evictions +
+                           media.evictions + sheets.evictions));
+  logs.insert(logs.begin() + 1, texStats);
+
+  DecodePool::UploadStats uploads = DecodePool::getInstance().getUploadStats();
+  double uploadMs = uploads.ticks / CPU_TICKS_PER_MSEC;
+  char uploadStats[96];
+  snprintf(uploadStats, sizeof(uploadStats),
+           "upload %lu tex %lluKB %.0fKB/s worst %lu.%02lums | decode q %zu",
+           (unsigned long)uploads.textures,
+           (unsigned long long)(uploads.bytes / 1024),
+           uploadMs > 0 ? (uploads.bytes / 1024.0) / (uploadMs / 1000.0) : 0.0,
+           (unsigned long)(uploads.worstFrameUs / 1000),
+           (unsigned long)(uploads.worstFrameUs % 1000 / 10),
+           DecodePool::getInstance().getQueuedCount());
+  logs.insert(logs.begin() + 2, uploadStats);
+
+  TextureAtlas::Stats atlas = TextureAtlas::getInstance().getStats();
+  char atlasStats[80];
+  snprintf(atlasStats, sizeof(atlasStats),
+           "atlas %lu pages %lu slots %zu/%zuKB repacks %lu",
+           (unsigned long)atlas.pages, (unsigned long)atlas.slots,
+           atlas.liveBytes / 1024, atlas.pageBytes / 1024,
+           (unsigned long)atlas.repacks);
+  logs.insert(logs.begin() + 3, atlasStats);
+
+  // Bytes downloaded but never drawn, plus the partial bodies of aborted
+  // transfers, is the prefetch waste.
+  ImageManager::PrefetchStats prefetch =
+      ImageManager::getInstance().getPrefetchStats();
+  Network::NetworkManager::CancelStats cancels =
+      Network::NetworkManager::getInstance().getCancelStats();
+  char prefetchStats[112];
+  snprintf(prefetchStats, sizeof(prefetchStats),
+           "img dl %lluKB unseen %lluKB | cancel %lu q %lu abort %lu %lluKB",
+           (unsigned long long)(prefetch.fetchedBytes / 1024),
+           (unsigned long long)(prefetch.unseenBytes / 1024),
+           (unsigned long)prefetch.cancelled, (unsigned long)cancels.dequeued,
+           (unsigned long)cancels.aborted,
+           (unsigned long long)(cancels.abortedBytes / 1024));
+  logs.insert(logs.begin() + 4, prefetchStats);
+
+  Network::NetworkManager::TransferStats net =
+      Network::NetworkManager::getInstance().getTransferStats();
+  char netStats[80];
+  snprintf(netStats, sizeof(netStats),
+           "net active %lu queued %lu | coalesced %lu | 429 %lu | stale %lu",
+           (unsigned long)net.active, (unsigned long)net.queued,
+           (unsigned long)net.coalesced, (unsigned long)net.rateLimited,
+           (unsigned long)net.staleRetries);
+  logs.insert(logs.begin() + 5, netStats);
+
+  char cacheStats[80];
+  snprintf(cacheStats, sizeof(cacheStats),
+           "http cache hit %lu 304 %lu | saved %llu KB",
+           (unsigned long)net.cacheHits, (unsigned long)net.revalidated,
+           (unsigned long long)(net.cacheBytesSaved / 1024));
+  logs.insert(logs.begin() + 6, cacheStats);
+
   for (const auto &line : logs) {
     if (y + lineHeight > 240)
       break;
 
-    C2D_Text text;
-    C2D_TextParse(&text, debugTextBuf, line.c_str());
-    C2D_TextOptimize(&text);
-    C2D_DrawText(&text, C2D_WithColor, 5.0f, y, 1.0f, 0.4f, 0.4f,
-                 C2D_Color32(0, 255, 0, 255));
+    drawDebugLine(5.0f, y, line, C2D_Color32(0, 255, 0, 255));
+
+    y += lineHeight;
+  }
+}
+
+void ScreenManager::renderProfilerOverlay() {
+#ifdef TRICORD_PROFILER
+  const float z = 0.95f;
+  const float labelWidth = 150.0f;
+  const float barScale = 200.0f / 16.7f; // one 60 fps frame = 200px
+  const float lineHeight = 11.0f;
+
+  std::vector<Core::Profiler::ProbeStats> stats =
+      Core::Profiler::getInstance().getStats();
+
+  C2D_DrawRectSolid(0, 0, z, 400, 240, C2D_Color32(0, 0, 0, 200));
+
+  char header[96];
+  snprintf(header, sizeof(header),
+           "Profiler: %d frames, avg/p95/max ms  (L+SELECT: dump to SD)",
+           Core::Profiler::getInstance().getFrameCount());
+  drawDebugLine(5.0f, 3.0f, header, C2D_Color32(255, 255, 255, 255));
+
+  // Frame budget marker.
+  C2D_DrawRectSolid(labelWidth + 200.0f, 14.0f, z, 1, 226,
+                    C2D_Color32(255, 80, 80, 160));
+
+  float y = 16.0f;
+  for (const auto &s : stats) {
+    if (y + lineHeight > 240)
+      break;
+
+    float avgW = std::min(s.avgMs * barScale, 245.0f);
+    float p95X = labelWidth + std::min(s.p95Ms * barScale, 245.0f);
+    C2D_DrawRectSolid(labelWidth, y + 2, z, avgW, lineHeight - 4,
+                      C2D_Color32(80, 160, 255, 220));
+    C2D_DrawRectSolid(p95X, y + 1, z, 2, lineHeight - 2,
+                      C2D_Color32(255, 200, 0, 255));
+
+    char line[128];
+    snprintf(line, sizeof(line), "%.22s %.2f/%.2f/%.2f", s.name.c_str(),
+             s.avgMs, s.p95Ms, s.maxMs);
+    drawDebugLine(5.0f, y, line, C2D_Color32(0, 255, 0, 255));
 
     y += lineHeight;
   }
+#endif
+}
+
+void ScreenManager::dumpProfile() {
+#ifdef TRICORD_PROFILER
+  std::string path = std::string(CONFIG_DIR_PATH) + "/profile.csv";
+  if (Core::Profiler::getInstance().dumpToFile(path))
+    showToast("Profile saved to " + path);
+  else
+    showToast("Profile dump failed");
+#endif
+}
+
+void ScreenManager::renderNetworkOverlay() {
+  const float z = 0.95f;
+  const float barX = 125.0f;
+  const float barWidth = 272.0f;
+  const float rowHeight = 6.0f;
+  const size_t rows = 30;
+  // Older requests are clipped so a quiet spell doesn't squash the rest.
+  const uint64_t maxWindowMs = 10000;
+
+  Network::NetworkManager &network = Network::NetworkManager::getInstance();
+  std::vector<Network::RequestTiming> timings =
+      network.getRecentTimings(rows);
+  std::vector<Network::HostTiming> hosts = network.getHostTimings();
+
+  C2D_DrawRectSolid(0, 0, z, 400, 240, C2D_Color32(0, 0, 0, 200));
+
+  uint64_t windowStart = UINT64_MAX;
+  uint64_t windowEnd = 0;
+  for (const auto &t : timings) {
+    windowStart = std::min(windowStart, t.enqueuedAt);
+    windowEnd = std::max(windowEnd, t.startedAt + t.totalUs / 1000 + 1);
+  }
+  if (timings.empty())
+    windowStart = windowEnd;
+  windowStart = std::max(windowStart, windowEnd - std::min(windowEnd,
+                                                           maxWindowMs));
+  float pxPerMs = barWidth / std::max<uint64_t>(windowEnd - windowStart, 1);
+
+  char header[96];
+  snprintf(header, sizeof(header), "Net: last %zu over %.1fs (L+SELECT: dump)",
+           timings.size(), (windowEnd - windowStart) / 1000.0f);
+  drawDebugLine(5.0f, 2.0f, header, C2D_Color32(255, 255, 255, 255), 0.35f);
+
+  const u32 phaseColors[] = {
+      C2D_Color32(120, 120, 120, 255), // queued
+      C2D_Color32(0, 200, 200, 255),   // DNS
+      C2D_Color32(255, 160, 0, 255),   // connect
+      C2D_Color32(200, 80, 255, 255),  // TLS
+      C2D_Color32(80, 220, 80, 255),   // waiting for the first byte
+      C2D_Color32(80, 160, 255, 255),  // receiving
+  };
+  const char *phaseNames[] = {"queue", "dns", "conn", "tls", "wait", "recv"};
+  for (int i = 0; i < 6; i++)
+    drawDebugLine(235.0f + i * 27.0f, 2.0f, phaseNames[i], phaseColors[i],
+                  0.35f);
+
+  // ms from windowStart, which may be negative for a clipped request.
+  auto xAt = [&](float ms) {
+    return barX + std::min(std::max(ms, 0.0f) * pxPerMs, barWidth);
+  };
+
+  float y = 13.0f;
+  for (const auto &t : timings) {
+    static const char priorities[] = {'R', 'I', 'B'};
+    bool failed = t.status == 0 || t.status >= 400;
+    char label[64];
+    snprintf(label, sizeof(label), "%c %3ld %5lums %.18s",
+             priorities[(int)t.priority], t.status,
+             (unsigned long)(t.queueMs() + t.totalUs / 1000),
+             Network::ConnectionManager::hostOf(t.url).c_str());
+    drawDebugLine(3.0f, y - 1.0f, label,
+                  failed ? C2D_Color32(255, 90, 90, 255)
+                         : C2D_Color32(0, 255, 0, 255),
+                  0.25f);
+
+    float started = (float)((int64_t)t.startedAt - (int64_t)windowStart);
+    float ends[] = {started,
+                    started + t.dnsEndUs / 1000.0f,
+                    started + t.connectEndUs / 1000.0f,
+                    started + t.tlsEndUs / 1000.0f,
+                    started + t.firstByteUs / 1000.0f,
+                    started + t.totalUs / 1000.0f};
+    float from = xAt((float)((int64_t)t.enqueuedAt - (int64_t)windowStart));
+    for (int i = 0; i < 6; i++) {
+      float to = xAt(ends[i]);
+      // The last phase gets a pixel so even the quickest request shows.
+      if (i == 5 && to - from < 1.0f)
+        to = from + 1.0f;
+      if (to > from)
+        C2D_DrawRectSolid(from, y + 1.0f, z, to - from, rowHeight - 2.0f,
+                          phaseColors[i]);
+      from = std::max(from, to);
+    }
+    y += rowHeight;
+  }
+
+  // Per-host totals since startup; averages in ms.
+  y = 196.0f;
+  for (const auto &h : hosts) {
+    if (y + 9.0f > 240)
+      break;
+    uint32_t n = std::max<uint32_t>(h.requests, 1);
+    char line[128];
+    snprintf(line, sizeof(line),
+             "%.20s %lu req %lu fail %lu conn | q %lu ttfb %lu avg %lu max "
+             "%lu | %lluKB",
+             h.host.c_str(), (unsigned long)h.requests,
+             (unsigned long)h.failures, (unsigned long)h.newConnections,
+             (unsigned long)(h.queueMs / n),
+             (unsigned long)(h.firstByteUs / n / 1000),
+             (unsigned long)(h.totalUs / n / 1000),
+             (unsigned long)(h.maxTotalUs / 1000),
+             (unsigned long long)(h.bytes / 1024));
+    drawDebugLine(5.0f, y, line, C2D_Color32(0, 255, 0, 255), 0.35f);
+    y += 9.0f;
+  }
+}
+
+void ScreenManager::dumpNetworkTimings() {
+  std::string path = std::string(CONFIG_DIR_PATH) + "/network.csv";
+  if (Network::NetworkManager::getInstance().dumpTimings(path))
+    showToast("Network timings saved to " + path);
+  else
+    showToast("Network timings dump failed");
+}
+
+void ScreenManager::drawDebugLine(float x, float y, const std::string &line,
+                                  u32 color, float scale) {
+  C2D_Text text;
+  C2D_TextParse(&text, debugTextBuf, line.c_str());
+  C2D_TextOptimize(&text);
+  C2D_DrawText(&text, C2D_WithColor, x, y, 1.0f, scale, scale, color);
 }
 
 void ScreenManager::drawHamburgerButton() {
@@ -334,6 +658,7 @@ void ScreenManager::drawHamburgerButton() {
 void ScreenManager::showToast(const std::string &message) {
   toastMessage = message;
   toastTimer = 90;
+  Core::FrameScheduler::getInstance().requestRedraw(Core::REDRAW_BOTTOM);
 }
 
 bool ScreenManager::isMenuHidden() const {
@@ -366,14 +691,16 @@ void ScreenManager::drawToast() {
 
 void drawText(float x, float y, float z, float scaleX, float scaleY, u32 color,
               const std::string &rawText) {
-  std::string text = Utils::Utf8::sanitizeText(rawText);
-
   if (!textBuf)
     return;
 
   C2D_Text c2dText;
-  C2D_TextParse(&c2dText, textBuf, text.c_str());
-  C2D_TextOptimize(&c2dText);
+  {
+    PROFILE_SCOPE("Text parsing");
+    std::string text = Utils::Utf8::sanitizeText(rawText);
+    C2D_TextParse(&c2dText, textBuf, text.c_str());
+    C2D_TextOptimize(&c2dText);
+  }
   C2D_DrawText(&c2dText, C2D_WithColor, x, y, z, scaleX, scaleY, color);
 }
 
@@ -447,6 +774,7 @@ void drawRichText(float x, float y, float z, float scaleX, float scaleY,
                   u32 color, const std::string &text) {
   if (!textBuf || text.empty())
     return;
+  PROFILE_SCOPE("drawRichText");
 
   size_t cursor = 0;
   float currentX = x;
@@ -468,15 +796,7 @@ void drawRichText(float x, float y, float z, float scaleX, float scaleY,
               float emojiSize = 28.0f * scaleY;
 
               if (info.tex) {
-                float uMax = (float)info.originalW / info.tex->width;
-                float vMax = (float)info.originalH / info.tex->height;
-
-                Tex3DS_SubTexture subtex = {
-                    (u16)info.originalW, (u16)info.originalH, 0.0f, 1.0f, uMax,
-                    1.0f - vMax};
-
-                const C2D_Image img = {info.tex, &subtex};
-                C2D_DrawImageAt(img, currentX, y + 1.0f, z, nullptr,
+                C2D_DrawImageAt(info.image, currentX, y + 1.0f, z, nullptr,
                                 emojiSize / info.originalW,
                                 emojiSize / info.originalH);
               } else {
@@ -513,17 +833,16 @@ void drawRichText(float x, float y, float z, float scaleX, float scaleY,
       float emojiSize = 28.0f * scaleY;
 
       if (info.tex) {
-        float uMax = (float)info.originalW / info.tex->width;
-        float vMax = (float)info.originalH / info.tex->height;
-        Tex3DS_SubTexture subtex = {
-            (u16)info.originalW, (u16)info.originalH, 0.0f, 1.0f, uMax,
-            1.0f - vMax};
-        const C2D_Image img = {info.tex, &subtex};
-        C2D_DrawImageAt(img, currentX, y + 1.0f, z, nullptr,
+        C2D_DrawImageAt(info.image, currentX, y + 1.0f, z, nullptr,
                         emojiSize / info.originalW, emojiSize / info.originalH);
         currentX += emojiSize + (2.0f * scaleX);
         cursor = seqCursor;
         continue;
+      } else if (EmojiManager::getInstance().hasTwemoji(hex)) {
+        // Its sheet is still loading; keep the space measured for it.
+        currentX += emojiSize + (2.0f * scaleX);
+        cursor = seqCursor;
+        continue;
       } else {
         drawText(currentX, y, z, scaleX, scaleY, color, sequence);
         currentX += measureText(sequence, scaleX, scaleY);
@@ -615,10 +934,8 @@ float measureRichTextImpl(const std::string &text, float scaleX, float scaleY,
       size_t seqCursor = cursor;
       std::string sequence = Utils::Utf8::getEmojiSequence(text, seqCursor);
       std::string hex = MessageUtils::getEmojiFilename(sequence);
-      EmojiManager::EmojiInfo info =
-          EmojiManager::getInstance().getTwemojiInfo(hex);
       float emojiSize = 28.0f * scaleY;
-      if (info.tex) {
+      if (EmojiManager::getInstance().hasTwemoji(hex)) {
         currentX += emojiSize + (2.0f * scaleX);
       } else {
         currentX += measureText(sequence, scaleX, scaleY);
@@ -772,18 +1089,11 @@ void drawRichTextUnicodeOnly(float x, float y, float z, float scaleX,
       float emojiSize = 28.0f * scaleY;
 
       if (info.tex) {
-        Tex3DS_SubTexture subtex;
-        subtex.width = (u16)info.originalW;
-        subtex.height = (u16)info.originalH;
-        subtex.left = 0.0f;
-        subtex.top = 0.0f;
-        subtex.right = (float)info.originalW / info.tex->width;
-        subtex.bottom = (float)info.originalH / info.tex->height;
-
-        const C2D_Image img = {info.tex, &subtex};
-        C2D_DrawImageAt(img, currentX, y + 1.0f, z, nullptr,
+        C2D_DrawImageAt(info.image, currentX, y + 1.0f, z, nullptr,
                         emojiSize / info.originalW, emojiSize / info.originalH);
         currentX += emojiSize + (0.0f * scaleX);
+      } else if (EmojiManager::getInstance().hasTwemoji(hex)) {
+        currentX += emojiSize + (0.0f * scaleX);
       } else {
         std::string clean = Utils::Utf8::sanitizeText(sequence);
         drawText(currentX, y, z, scaleX, scaleY, color, clean);
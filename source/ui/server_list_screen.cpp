@@ -1,6 +1,8 @@
 #include "ui/server_list_screen.h"
 #include "core/config.h"
+#include "core/frame_scheduler.h"
 #include "core/i18n.h"
+#include "core/profiler.h"
 #include "discord/avatar_cache.h"
 #include "log.h"
 #include "ui/image_manager.h"
@@ -14,7 +16,7 @@ namespace UI {
 
 ServerListScreen::ServerListScreen()
     : repeatTimer(0), lastKey(0), animationProgress(0.0f), loadingAngle(0.0f),
-      animTimer(0.0f) {
+      animTimer(0.0f), bottomLayer(BOTTOM_SCREEN_WIDTH, BOTTOM_SCREEN_HEIGHT) {
   Logger::log("ServerListScreen initialized");
 
   auto &sm = ScreenManager::getInstance();
@@ -267,6 +269,7 @@ void ServerListScreen::update() {
         t = 1.0f;
       }
       loadingAngle = 360.0f * t;
+      Core::FrameScheduler::getInstance().requestAnimationFrame();
       return;
     }
   }
@@ -277,6 +280,11 @@ void ServerListScreen::update() {
   u32 kDown = hidKeysDown();
   u32 kHeld = hidKeysHeld();
 
+  if (state == State::TRANSITION_TO_CHANNEL ||
+      state == State::TRANSITION_TO_SERVER) {
+    Core::FrameScheduler::getInstance().requestAnimationFrame();
+  }
+
   if (state == State::TRANSITION_TO_CHANNEL) {
     animationProgress += 0.1f;
     if (animationProgress >= 1.0f) {
@@ -437,6 +445,7 @@ void ServerListScreen::update() {
 }
 
 void ServerListScreen::renderTop(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("ServerListScreen::renderTop");
   C2D_SceneBegin(target);
   C2D_TargetClear(target, ScreenManager::colorBackground());
 
@@ -579,19 +588,16 @@ void ServerListScreen::drawChannelList(float x, float y, float alpha) {
         iconPath = "romfs:/discord-icons/chat.png";
 
       float iconOffset = 0.0f;
-      C3D_Tex *tex = UI::ImageManager::getInstance().getLocalImage(iconPath);
-      if (tex) {
-        Tex3DS_SubTexture subtex = {
-            (u16)tex->width, (u16)tex->height, 0.0f, 1.0f, 1.0f, 0.0f};
-        C2D_Image img = {tex, &subtex};
-
+      C2D_Image img = UI::ImageManager::getInstance().getLocalIcon(iconPath);
+      if (img.tex) {
         float iconSize = 12.0f;
         float iconY = currentY + (rowHeight - iconSize) / 2.0f;
 
         C2D_ImageTint tint;
         C2D_PlainImageTint(&tint, color, 1.0f);
         C2D_DrawImageAt(img, currentX, iconY, 0.5f, &tint,
-                        iconSize / tex->width, iconSize / tex->height);
+                        iconSize / img.subtex->width,
+                        iconSize / img.subtex->height);
         iconOffset = iconSize + 4.0f;
       }
 
@@ -663,21 +669,14 @@ void ServerListScreen::drawListItem(int index, const ListItem &item, float x,
       float smallIconX = x + (width - smallIconSize) / 2.0f;
       float smallIconY = y + (48.0f - smallIconSize) / 2.0f;
 
-      C3D_Tex *folderTex = UI::ImageManager::getInstance().getLocalImage(
+      C2D_Image img = UI::ImageManager::getInstance().getLocalIcon(
           "romfs:/discord-icons/folder.png");
-      if (folderTex) {
-        Tex3DS_SubTexture subtex = {(u16)folderTex->width,
-                                    (u16)folderTex->height,
-                                    0.0f,
-                                    1.0f,
-                                    1.0f,
-                                    0.0f};
-        C2D_Image img = {folderTex, &subtex};
+      if (img.tex) {
         C2D_ImageTint tint;
         C2D_PlainImageTint(&tint, ScreenManager::colorText(), 1.0f);
         C2D_DrawImageAt(img, smallIconX, smallIconY, 0.5f, &tint,
-                        smallIconSize / folderTex->width,
-                        smallIconSize / folderTex->height);
+                        smallIconSize / img.subtex->width,
+                        smallIconSize / img.subtex->height);
       } else {
 
         C2D_DrawRectSolid(smallIconX, smallIconY, 0.5f, smallIconSize,
@@ -701,17 +700,19 @@ void ServerListScreen::drawListItem(int index, const ListItem &item, float x,
         float mX = iconX + 2.0f + (i % 2) * (miniSize + 2.0f);
         float mY = iconY + 2.0f + (i / 2) * (miniSize + 2.0f);
 
-        C3D_Tex *tex = nullptr;
+        C2D_Image img = {};
         if (!g->icon.empty()) {
           std::string iconKey = g->id + "_" + g->icon;
           auto it = iconCache.find(iconKey);
           if (it != iconCache.end()) {
-            tex = it->second;
+            img = it->second.getImage();
           } else {
-            tex = Discord::AvatarCache::getInstance().getGuildIcon(g->id,
-                                                                   g->icon);
-            if (tex) {
-              iconCache[iconKey] = tex;
+            TextureHandle icon =
+                Discord::AvatarCache::getInstance().acquireGuildIcon(g->id,
+                                                                     g->icon);
+            img = icon.getImage();
+            if (img.tex) {
+              iconCache[iconKey] = std::move(icon);
             } else {
               Discord::AvatarCache::getInstance().prefetchGuildIcon(g->id,
                                                                     g->icon);
@@ -719,12 +720,10 @@ void ServerListScreen::drawListItem(int index, const ListItem &item, float x,
           }
         }
 
-        if (tex) {
-          Tex3DS_SubTexture subtex = {
-              (u16)tex->width, (u16)tex->height, 0.0f, 1.0f, 1.0f, 0.0f};
-          C2D_Image img = {tex, &subtex};
-          C2D_DrawImageAt(img, mX, mY, 0.51f, nullptr, miniSize / tex->width,
-                          miniSize / tex->height);
+        if (img.tex) {
+          C2D_DrawImageAt(img, mX, mY, 0.51f, nullptr,
+                          miniSize / img.subtex->width,
+                          miniSize / img.subtex->height);
         } else {
           C2D_DrawRectSolid(mX, mY, 0.51f, miniSize, miniSize,
                             ScreenManager::colorBackgroundLight());
@@ -733,17 +732,19 @@ void ServerListScreen::drawListItem(int index, const ListItem &item, float x,
     }
   } else {
     std::string iconKey = item.id + "_" + item.icon;
-    C3D_Tex *tex = nullptr;
+    C2D_Image img = {};
 
     if (!item.icon.empty()) {
       auto it = iconCache.find(iconKey);
       if (it != iconCache.end()) {
-        tex = it->second;
+        img = it->second.getImage();
       } else {
-        tex = Discord::AvatarCache::getInstance().getGuildIcon(item.id,
-                                                               item.icon);
-        if (tex) {
-          iconCache[iconKey] = tex;
+        TextureHandle icon =
+            Discord::AvatarCache::getInstance().acquireGuildIcon(item.id,
+                                                                 item.icon);
+        img = icon.getImage();
+        if (img.tex) {
+          iconCache[iconKey] = std::move(icon);
         } else {
           Discord::AvatarCache::getInstance().prefetchGuildIcon(item.id,
                                                                 item.icon);
@@ -751,12 +752,9 @@ void ServerListScreen::drawListItem(int index, const ListItem &item, float x,
       }
     }
 
-    if (tex) {
-      Tex3DS_SubTexture subtex = {
-          (u16)tex->width, (u16)tex->height, 0.0f, 1.0f, 1.0f, 0.0f};
-      C2D_Image img = {tex, &subtex};
-      float sX = iconSize / tex->width;
-      float sY = iconSize / tex->height;
+    if (img.tex) {
+      float sX = iconSize / img.subtex->width;
+      float sY = iconSize / img.subtex->height;
       C2D_DrawImageAt(img, iconX, iconY, 0.5f, nullptr, sX, sY);
     } else {
       C2D_DrawRectSolid(iconX, iconY, 0.5f, iconSize, iconSize,
@@ -770,144 +768,176 @@ void ServerListScreen::drawListItem(int index, const ListItem &item, float x,
 }
 
 void ServerListScreen::renderBottom(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("ServerListScreen::renderBottom");
   C2D_SceneBegin(target);
   C2D_TargetClear(target, ScreenManager::colorBackgroundDark());
 
   Discord::DiscordClient &client = Discord::DiscordClient::getInstance();
   std::lock_guard<std::recursive_mutex> lock(client.getMutex());
 
-  bool infoDrawn = false;
-
+  // Everything here depends only on the selection, so it is kept in a layer
+  // and re-rendered when the selected server or folder changes.
+  u32 layerKey = RenderLayer::hashKey(0, (u32)state);
+  layerKey = RenderLayer::hashKey(layerKey, (u32)selectedIndex);
+  layerKey = RenderLayer::hashKey(layerKey, ScreenManager::colorText());
+  layerKey = RenderLayer::hashLoadedImages(layerKey);
   if (selectedIndex >= 0 && selectedIndex < (int)listItems.size()) {
     const auto &item = listItems[selectedIndex];
+    layerKey = RenderLayer::hashKey(layerKey, item.id);
+    layerKey = RenderLayer::hashKey(layerKey, item.name);
+    const Discord::Guild *guild = item.isFolder ? nullptr : getGuild(item.id);
+    if (guild) {
+      layerKey = RenderLayer::hashKey(layerKey, guild->name);
+      layerKey = RenderLayer::hashKey(layerKey, guild->description);
+      layerKey =
+          RenderLayer::hashKey(layerKey, (u32)guild->approximateMemberCount);
+      layerKey =
+          RenderLayer::hashKey(layerKey, (u32)guild->approximatePresenceCount);
+      auto it = iconCache.find(guild->id + "_" + guild->icon);
+      layerKey = RenderLayer::hashKey(
+          layerKey, (it != iconCache.end() && it->second.get()) ? 1u : 0u);
+    }
+    for (const auto &guildId : item.folderGuildIds) {
+      const Discord::Guild *g = getGuild(guildId);
+      if (g)
+        layerKey = RenderLayer::hashKey(layerKey, g->name);
+    }
+  }
 
-    if (!item.isFolder) {
-      const Discord::Guild *guild = getGuild(item.id);
-      if (guild) {
-        float headerX = 35.0f;
-        std::string iconKey = guild->id + "_" + guild->icon;
-        C3D_Tex *tex = nullptr;
-        auto it = iconCache.find(iconKey);
-        if (it != iconCache.end())
-          tex = it->second;
-
-        if (tex) {
-          float iconSize = 18.0f;
-          Tex3DS_SubTexture subtex = {
-              (u16)tex->width, (u16)tex->height, 0.0f, 1.0f, 1.0f, 0.0f};
-          C2D_Image img = {tex, &subtex};
-          C2D_DrawImageAt(img, headerX, 8.0f, 0.5f, nullptr,
-                          iconSize / tex->width, iconSize / tex->height);
-          headerX += iconSize + 6.0f;
-        }
+  u32 background = ScreenManager::colorBackgroundDark();
+  bottomLayer.draw(target, layerKey, background, 0.0f, 0.0f, 0.0f, [&]() {
+    bool infoDrawn = false;
 
-        drawRichText(
-            headerX, 8.5f, 0.5f, 0.55f, 0.55f, ScreenManager::colorPrimary(),
-            getTruncatedRichText(guild->name, 305.0f - headerX, 0.55f, 0.55f));
+    if (selectedIndex >= 0 && selectedIndex < (int)listItems.size()) {
+      const auto &item = listItems[selectedIndex];
 
+      if (!item.isFolder) {
+        const Discord::Guild *guild = getGuild(item.id);
+        if (guild) {
+          float headerX = 35.0f;
+          std::string iconKey = guild->id + "_" + guild->icon;
+          C2D_Image img = {};
+          auto it = iconCache.find(iconKey);
+          if (it != iconCache.end())
+            img = it->second.getImage();
+
+          if (img.tex) {
+            float iconSize = 18.0f;
+            C2D_DrawImageAt(img, headerX, 8.0f, 0.5f, nullptr,
+                            iconSize / img.subtex->width,
+                            iconSize / img.subtex->height);
+            headerX += iconSize + 6.0f;
+          }
+
+          drawRichText(headerX, 8.5f, 0.5f, 0.55f, 0.55f,
+                       ScreenManager::colorPrimary(),
+                       getTruncatedRichText(guild->name, 305.0f - headerX,
+                                            0.55f, 0.55f));
+
+          C2D_DrawRectSolid(10, 32, 0.5f, 320 - 20, 1,
+                            ScreenManager::colorSeparator());
+
+          float statsY = 40.0f;
+
+          drawText(10.0f, statsY, 0.5f, 0.45f, 0.45f,
+                   ScreenManager::colorTextMuted(),
+                   TR("server.member_count") + ":");
+          drawText(10.0f, statsY + 12.0f, 0.5f, 0.5f, 0.5f,
+                   ScreenManager::colorText(),
+                   std::to_string(guild->approximateMemberCount));
+
+          drawText(100.0f, statsY, 0.5f, 0.45f, 0.45f,
+                   ScreenManager::colorTextMuted(),
+                   TR("server.online_count") + ":");
+          drawText(100.0f, statsY + 12.0f, 0.5f, 0.5f, 0.5f,
+                   ScreenManager::colorSuccess(),
+                   std::to_string(guild->approximatePresenceCount));
+
+          float overviewY = statsY + 35.0f;
+          drawText(10.0f, overviewY, 0.5f, 0.45f, 0.45f,
+                   ScreenManager::colorSelection(), TR("server.description"));
+          overviewY += 15.0f;
+
+          std::string desc = guild->description;
+          if (desc.empty())
+            desc = TR("common.no_topic");
+
+          auto lines = MessageUtils::wrapText(desc, 300.0f, 0.4f);
+          int lineCount = 0;
+          for (const auto &line : lines) {
+            if (lineCount >= 10)
+              break;
+            drawRichText(10.0f, overviewY, 0.5f, 0.4f, 0.4f,
+                         ScreenManager::colorText(), line);
+            overviewY += 13.0f;
+            lineCount++;
+          }
+          infoDrawn = true;
+        }
+      } else {
+        drawRichText(
+            35.0f, 8.5f, 0.5f, 0.55f, 0.55f, ScreenManager::colorPrimary(),
+            getTruncatedRichText(item.name, 305.0f - 35.0f, 0.55f, 0.55f));
         C2D_DrawRectSolid(10, 32, 0.5f, 320 - 20, 1,
                           ScreenManager::colorSeparator());
 
-        float statsY = 40.0f;
-
-        drawText(10.0f, statsY, 0.5f, 0.45f, 0.45f,
-                 ScreenManager::colorTextMuted(),
-                 TR("server.member_count") + ":");
-        drawText(10.0f, statsY + 12.0f, 0.5f, 0.5f, 0.5f,
-                 ScreenManager::colorText(),
-                 std::to_string(guild->approximateMemberCount));
-
-        drawText(100.0f, statsY, 0.5f, 0.45f, 0.45f,
-                 ScreenManager::colorTextMuted(),
-                 TR("server.online_count") + ":");
-        drawText(100.0f, statsY + 12.0f, 0.5f, 0.5f, 0.5f,
-                 ScreenManager::colorSuccess(),
-                 std::to_string(guild->approximatePresenceCount));
-
-        float overviewY = statsY + 35.0f;
-        drawText(10.0f, overviewY, 0.5f, 0.45f, 0.45f,
-                 ScreenManager::colorSelection(), TR("server.description"));
-        overviewY += 15.0f;
-
-        std::string desc = guild->description;
-        if (desc.empty())
-          desc = TR("common.no_topic");
-
-        auto lines = MessageUtils::wrapText(desc, 300.0f, 0.4f);
-        int lineCount = 0;
-        for (const auto &line : lines) {
-          if (lineCount >= 10)
+        float infoY = 40.0f;
+        std::string countStr = Core::I18n::format(
+            TR("server.count"), std::to_string(item.folderGuildIds.size()));
+        drawText(10.0f, infoY, 0.5f, 0.45f, 0.45f, ScreenManager::colorText(),
+                 countStr);
+
+        infoY += 18.0f;
+        drawText(10.0f, infoY, 0.5f, 0.45f, 0.45f,
+                 ScreenManager::colorSelection(), TR("server.list") + ":");
+        infoY += 14.0f;
+
+        int displayCount = 0;
+        for (const auto &guildId : item.folderGuildIds) {
+          if (displayCount >= 9)
             break;
-          drawRichText(10.0f, overviewY, 0.5f, 0.4f, 0.4f,
-                       ScreenManager::colorText(), line);
-          overviewY += 13.0f;
-          lineCount++;
+          const Discord::Guild *g = getGuild(guildId);
+          if (g) {
+            std::string guildName =
+                getTruncatedRichText(g->name, 300.0f, 0.4f, 0.4f);
+            drawRichText(15.0f, infoY, 0.5f, 0.4f, 0.4f,
+                         ScreenManager::colorText(), guildName);
+            infoY += 13.0f;
+            displayCount++;
+          }
         }
-        infoDrawn = true;
-      }
-    } else {
-      drawRichText(
-          35.0f, 8.5f, 0.5f, 0.55f, 0.55f, ScreenManager::colorPrimary(),
-          getTruncatedRichText(item.name, 305.0f - 35.0f, 0.55f, 0.55f));
-      C2D_DrawRectSolid(10, 32, 0.5f, 320 - 20, 1,
-                        ScreenManager::colorSeparator());
-
-      float infoY = 40.0f;
-      std::string countStr = Core::I18n::format(
-          TR("server.count"), std::to_string(item.folderGuildIds.size()));
-      drawText(10.0f, infoY, 0.5f, 0.45f, 0.45f, ScreenManager::colorText(),
-               countStr);
-
-      infoY += 18.0f;
-      drawText(10.0f, infoY, 0.5f, 0.45f, 0.45f,
-               ScreenManager::colorSelection(), TR("server.list") + ":");
-      infoY += 14.0f;
-
-      int displayCount = 0;
-      for (const auto &guildId : item.folderGuildIds) {
-        if (displayCount >= 9)
-          break;
-        const Discord::Guild *g = getGuild(guildId);
-        if (g) {
-          std::string guildName =
-              getTruncatedRichText(g->name, 300.0f, 0.4f, 0.4f);
+
+        if (item.folderGuildIds.size() > 9) {
+          int remaining = item.folderGuildIds.size() - 9;
           drawRichText(15.0f, infoY, 0.5f, 0.4f, 0.4f,
-                       ScreenManager::colorText(), guildName);
-          infoY += 13.0f;
-          displayCount++;
+                       ScreenManager::colorTextMuted(),
+                       "+" + std::to_string(remaining) + " more");
         }
-      }
 
-      if (item.folderGuildIds.size() > 9) {
-        int remaining = item.folderGuildIds.size() - 9;
-        drawRichText(15.0f, infoY, 0.5f, 0.4f, 0.4f,
-                     ScreenManager::colorTextMuted(),
-                     "+" + std::to_string(remaining) + " more");
+        infoDrawn = true;
       }
-
-      infoDrawn = true;
     }
-  }
 
-  if (!infoDrawn) {
-    std::string title = (state == State::SELECTING_SERVER)
-                            ? TR("server.select")
-                            : TR("channel.select");
-    drawText(35.0f, 8.5f, 0.5f, 0.55f, 0.55f, ScreenManager::colorText(),
-             title);
-  }
+    if (!infoDrawn) {
+      std::string title = (state == State::SELECTING_SERVER)
+                              ? TR("server.select")
+                              : TR("channel.select");
+      drawText(35.0f, 8.5f, 0.5f, 0.55f, 0.55f, ScreenManager::colorText(),
+               title);
+    }
 
-  if (state == State::SELECTING_SERVER) {
-    drawText(10.0f, BOTTOM_SCREEN_HEIGHT - 25.0f, 0.5f, 0.4f, 0.4f,
-             ScreenManager::colorTextMuted(),
-             "\uE079\uE07A: " + TR("common.navigate") + "  \uE000: " +
-                 TR("common.enter") + "  START: " + TR("common.exit"));
-  } else {
-    drawText(10.0f, BOTTOM_SCREEN_HEIGHT - 25.0f, 0.5f, 0.4f, 0.4f,
-             ScreenManager::colorTextMuted(),
-             "\uE079\uE07A: " + TR("common.navigate") + "  \uE001: " +
-                 TR("common.back") + "  \uE000: " + TR("common.enter"));
-  }
+    if (state == State::SELECTING_SERVER) {
+      drawText(10.0f, BOTTOM_SCREEN_HEIGHT - 25.0f, 0.5f, 0.4f, 0.4f,
+               ScreenManager::colorTextMuted(),
+               "\uE079\uE07A: " + TR("common.navigate") + "  \uE000: " +
+                   TR("common.enter") + "  START: " + TR("common.exit"));
+    } else {
+      drawText(10.0f, BOTTOM_SCREEN_HEIGHT - 25.0f, 0.5f, 0.4f, 0.4f,
+               ScreenManager::colorTextMuted(),
+               "\uE079\uE07A: " + TR("common.navigate") + "  \uE001: " +
+                   TR("common.back") + "  \uE000: " + TR("common.enter"));
+    }
+  });
 }
 
 } // namespace UI
@@ -1,6 +1,7 @@
 #include "ui/settings_screen.h"
 #include "core/config.h"
 #include "core/i18n.h"
+#include "core/profiler.h"
 #include "log.h"
 #include "ui/screen_manager.h"
 #include "utils/message_utils.h"
@@ -213,6 +214,7 @@ void SettingsScreen::update() {
 }
 
 void SettingsScreen::renderTop(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("SettingsScreen::renderTop");
   C2D_TargetClear(target, ScreenManager::colorBackground());
   C2D_SceneBegin(target);
 
@@ -272,6 +274,7 @@ void SettingsScreen::renderTop(C3D_RenderTarget *target) {
 }
 
 void SettingsScreen::renderBottom(C3D_RenderTarget *target) {
+  PROFILE_SCOPE("SettingsScreen::renderBottom");
   C2D_TargetClear(target, ScreenManager::colorBackgroundDark());
   C2D_SceneBegin(target);
 
@@ -0,0 +1,314 @@
+#include "ui/texture_atlas.h"
+#include "log.h"
+#include <algorithm>
+#include <cstring>
+#include <malloc.h>
+
+namespace UI {
+
+namespace {
+
+const int TILES_PER_ROW = TextureAtlas::PAGE_SIZE / 8;
+
+// Copies a block of whole 8x8 tiles between two tiled buffers. A row of
+// tiles is contiguous in both, so each tile row is one memcpy.
+void copyTiles(const u8 *src, int srcTilesPerRow, int srcTx, int srcTy,
+               u8 *dst, int dstTilesPerRow, int dstTx, int dstTy, int tilesW,
+               int tilesH, size_t tileBytes) {
+  for (int row = 0; row < tilesH; row++) {
+    const u8 *s =
+        src + ((size_t)(srcTy + row) * srcTilesPerRow + srcTx) * tileBytes;
+    u8 *d = dst + ((size_t)(dstTy + row) * dstTilesPerRow + dstTx) * tileBytes;
+    memcpy(d, s, tilesW * tileBytes);
+  }
+}
+
+void setSubtex(AtlasSlot &slot, int w, int h) {
+  // Inset by half a texel so filtering never reaches the next cell.
+  const float size = (float)TextureAtlas::PAGE_SIZE;
+  slot.subtex.width = (u16)w;
+  slot.subtex.height = (u16)h;
+  slot.subtex.left = (slot.x + 0.5f) / size;
+  slot.subtex.right = (slot.x + w - 0.5f) / size;
+  slot.subtex.top = 1.0f - (slot.y + 0.5f) / size;
+  slot.subtex.bottom = 1.0f - (slot.y + h - 0.5f) / size;
+}
+
+} // namespace
+
+TextureAtlas &TextureAtlas::getInstance() {
+  static TextureAtlas instance;
+  return instance;
+}
+
+TextureAtlas::~TextureAtlas() {
+  for (auto &page : pages)
+    C3D_TexDelete(&page->tex);
+}
+
+size_t TextureAtlas::bytesOf(const AtlasSlot *slot) {
+  return (size_t)slot->cellW * slot->cellH *
+         Utils::Image::bytesPerTexel(slot->page->fmt);
+}
+
+int TextureAtlas::shelfArea(const Page &page) {
+  int area = 0;
+  for (const auto &shelf : page.shelves)
+    area += shelf.cursor * shelf.height;
+  return area;
+}
+
+bool TextureAtlas::place(Page &page, int cellW, int cellH, int &outX,
+                         int &outY) {
+  // Best fit on height: the lowest shelf that is tall enough and has room,
+  // preferring a gap left by a freed cell over the shelf's open end.
+  Shelf *best = nullptr;
+  Span *bestSpan = nullptr;
+  for (auto &shelf : page.shelves) {
+    if (shelf.height < cellH || (best && shelf.height >= best->height))
+      continue;
+    // Don't bury small images in much taller shelves.
+    if (shelf.height > cellH * 2)
+      continue;
+    Span *fit = nullptr;
+    for (auto &span : shelf.freeSpans) {
+      if (span.w >= cellW) {
+        fit = &span;
+        break;
+      }
+    }
+    if (fit || shelf.cursor + cellW <= PAGE_SIZE) {
+      best = &shelf;
+      bestSpan = fit;
+    }
+  }
+
+  if (!best) {
+    if (page.nextShelfY + cellH > PAGE_SIZE)
+      return false;
+    Shelf shelf;
+    shelf.y = page.nextShelfY;
+    shelf.height = cellH;
+    page.nextShelfY += cellH;
+    page.shelves.push_back(shelf);
+    best = &page.shelves.back();
+  }
+
+  outY = best->y;
+  if (bestSpan) {
+    outX = bestSpan->x;
+    bestSpan->x += cellW;
+    bestSpan->w -= cellW;
+    if (bestSpan->w == 0)
+      best->freeSpans.erase(best->freeSpans.begin() +
+                            (bestSpan - best->freeSpans.data()));
+  } else {
+    outX = best->cursor;
+    best->cursor += cellW;
+  }
+  return true;
+}
+
+void TextureAtlas::freeCell(Page &page, const AtlasSlot &slot) {
+  for (auto &shelf : page.shelves) {
+    if (shelf.y != slot.y)
+      continue;
+
+    Span freed = {slot.x, slot.cellW};
+    auto &spans = shelf.freeSpans;
+    auto pos = std::lower_bound(
+        spans.begin(), spans.end(), freed,
+        [](const Span &a, const Span &b) { return a.x < b.x; });
+    pos = spans.insert(pos, freed);
+    // Merge with the neighbours on either side.
+    if (pos + 1 != spans.end() && pos->x + pos->w == (pos + 1)->x) {
+      pos->w += (pos + 1)->w;
+      spans.erase(pos + 1);
+    }
+    if (pos != spans.begin() && (pos - 1)->x + (pos - 1)->w == pos->x) {
+      (pos - 1)->w += pos->w;
+      pos = spans.erase(pos) - 1;
+    }
+    // A gap that reaches the open end just moves the end back.
+    if (pos->x + pos->w == shelf.cursor) {
+      shelf.cursor = pos->x;
+      spans.erase(pos);
+    }
+    // An emptied top shelf can be re-cut at a different height.
+    if (shelf.cursor == 0 && &shelf == &page.shelves.back()) {
+      page.nextShelfY = shelf.y;
+      page.shelves.pop_back();
+    }
+    return;
+  }
+}
+
+TextureAtlas::Page *TextureAtlas::newPage(GPU_TEXCOLOR format) {
+  if ((int)pages.size() >= MAX_PAGES)
+    return nullptr;
+
+  std::unique_ptr<Page> page(new Page());
+  if (!C3D_TexInit(&page->tex, PAGE_SIZE, PAGE_SIZE, format))
+    return nullptr;
+  C3D_TexSetFilter(&page->tex, GPU_LINEAR, GPU_LINEAR);
+  memset(page->tex.data, 0, page->tex.size);
+  GSPGPU_FlushDataCache(page->tex.data, page->tex.size);
+  page->format = format;
+
+  pages.push_back(std::move(page));
+  Logger::log("[Atlas] New page %d (format %d)", (int)pages.size(),
+              (int)format);
+  return pages.back().get();
+}
+
+bool TextureAtlas::repack(Page &page) {
+  // Lay the live cells out again, tallest first, on a scratch copy so a
+  // failure leaves the page untouched.
+  std::vector<AtlasSlot *> order;
+  for (auto &slot : page.slots)
+    order.push_back(&slot);
+  std::sort(order.begin(), order.end(),
+            [](const AtlasSlot *a, const AtlasSlot *b) {
+              return a->cellH != b->cellH ? a->cellH > b->cellH
+                                          : a->cellW > b->cellW;
+            });
+
+  Page layout;
+  layout.format = page.format;
+  std::vector<std::pair<int, int>> positions;
+  for (AtlasSlot *slot : order) {
+    int x, y;
+    if (!place(layout, slot->cellW, slot->cellH, x, y))
+      return false;
+    positions.push_back({x, y});
+  }
+
+  size_t tileBytes = 64 * Utils::Image::bytesPerTexel(page.format);
+  u8 *scratch = (u8 *)malloc(page.tex.size);
+  if (!scratch)
+    return false;
+  memset(scratch, 0, page.tex.size);
+
+  for (size_t i = 0; i < order.size(); i++) {
+    AtlasSlot *slot = order[i];
+    copyTiles((const u8 *)page.tex.data, TILES_PER_ROW, slot->x / 8,
+              slot->y / 8, scratch, TILES_PER_ROW, positions[i].first / 8,
+              positions[i].second / 8, slot->cellW / 8, slot->cellH / 8,
+              tileBytes);
+    slot->x = (u16)positions[i].first;
+    slot->y = (u16)positions[i].second;
+    setSubtex(*slot, slot->subtex.width, slot->subtex.height);
+  }
+
+  memcpy(page.tex.data, scratch, page.tex.size);
+  GSPGPU_FlushDataCache(page.tex.data, page.tex.size);
+  free(scratch);
+
+  page.shelves = std::move(layout.shelves);
+  page.nextShelfY = layout.nextShelfY;
+  repackCount++;
+  return true;
+}
+
+AtlasSlot *TextureAtlas::insert(Utils::Image::TiledData &tiled) {
+  if (!tiled.pixels || tiled.w > MAX_ITEM_SIZE || tiled.h > MAX_ITEM_SIZE)
+    return nullptr;
+
+  int cellW = (tiled.w + 7) & ~7;
+  int cellH = (tiled.h + 7) & ~7;
+
+  Page *target = nullptr;
+  int x = 0, y = 0;
+  for (auto &page : pages) {
+    if (page->format == tiled.format && place(*page, cellW, cellH, x, y)) {
+      target = page.get();
+      break;
+    }
+  }
+
+  if (!target) {
+    for (auto &page : pages) {
+      if (page->format != tiled.format ||
+          page->liveArea * 2 >= shelfArea(*page))
+        continue;
+      if (repack(*page) && place(*page, cellW, cellH, x, y)) {
+        target = page.get();
+        break;
+      }
+    }
+  }
+
+  if (!target) {
+    target = newPage(tiled.format);
+    if (!target || !place(*target, cellW, cellH, x, y))
+      return nullptr;
+  }
+
+  size_t tileBytes = 64 * Utils::Image::bytesPerTexel(tiled.format);
+  copyTiles((const u8 *)tiled.pixels, tiled.p2w / 8, 0, 0,
+            (u8 *)target->tex.data, TILES_PER_ROW, x / 8, y / 8, cellW / 8,
+            cellH / 8, tileBytes);
+  // The cell's tile rows are one contiguous run of the page.
+  size_t rowBytes = TILES_PER_ROW * tileBytes;
+  GSPGPU_FlushDataCache((u8 *)target->tex.data + (y / 8) * rowBytes,
+                        (cellH / 8) * rowBytes);
+  Utils::Image::freeTiled(tiled);
+
+  target->slots.emplace_back();
+  AtlasSlot &slot = target->slots.back();
+  slot.page = &target->tex;
+  slot.x = (u16)x;
+  slot.y = (u16)y;
+  slot.cellW = (u16)cellW;
+  slot.cellH = (u16)cellH;
+  slot.refCount = 1;
+  setSubtex(slot, tiled.w, tiled.h);
+  target->liveArea += cellW * cellH;
+  return &slot;
+}
+
+void TextureAtlas::retain(AtlasSlot *slot) {
+  if (slot)
+    slot->refCount++;
+}
+
+void TextureAtlas::release(AtlasSlot *slot) {
+  if (!slot || --slot->refCount > 0)
+    return;
+
+  for (auto it = pages.begin(); it != pages.end(); ++it) {
+    Page &page = **it;
+    if (&page.tex != slot->page)
+      continue;
+
+    freeCell(page, *slot);
+    page.liveArea -= slot->cellW * slot->cellH;
+    for (auto s = page.slots.begin(); s != page.slots.end(); ++s) {
+      if (&*s == slot) {
+        page.slots.erase(s);
+        break;
+      }
+    }
+
+    if (page.slots.empty()) {
+      C3D_TexDelete(&page.tex);
+      pages.erase(it);
+    }
+    return;
+  }
+}
+
+TextureAtlas::Stats TextureAtlas::getStats() const {
+  Stats stats;
+  stats.pages = (u32)pages.size();
+  stats.repacks = repackCount;
+  for (const auto &page : pages) {
+    stats.slots += (u32)page->slots.size();
+    stats.pageBytes += page->tex.size;
+    stats.liveBytes +=
+        (size_t)page->liveArea * Utils::Image::bytesPerTexel(page->format);
+  }
+  return stats;
+}
+
+} // namespace UI
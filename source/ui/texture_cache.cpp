@@ -0,0 +1,377 @@
+#include "ui/texture_cache.h"
+#include "core/config.h"
+#include "log.h"
+#include "ui/texture_atlas.h"
+#include <malloc.h>
+
+namespace UI {
+
+namespace {
+
+// Atlas pages cost their full size however few live cells they hold, but
+// entries are only charged for their own cells; the rest counts against
+// the budget here.
+size_t atlasOverhead() {
+  TextureAtlas::Stats atlas = TextureAtlas::getInstance().getStats();
+  return atlas.pageBytes > atlas.liveBytes ? atlas.pageBytes - atlas.liveBytes
+                                           : 0;
+}
+
+} // namespace
+
+TextureCache &TextureCache::getInstance() {
+  static TextureCache instance;
+  return instance;
+}
+
+TextureCache::TextureCache() : budgetBytes(12 * 1024 * 1024) {
+  classes[(int)TextureClass::AVATAR].quota = 3 * 1024 * 1024;
+  classes[(int)TextureClass::EMOJI].quota = 1 * 1024 * 1024;
+  // Six 512x512 RGBA4 twemoji sheets; the everyday reactions alone span
+  // five of them.
+  classes[(int)TextureClass::SHEET].quota = 3 * 1024 * 1024;
+  // Half the budget, so a channel full of media can't push avatars and
+  // emoji out; init() rescales it to the configured budget.
+  classes[(int)TextureClass::ATTACHMENT].quota = 6 * 1024 * 1024;
+}
+
+TextureCache::~TextureCache() { shutdown(); }
+
+void TextureCache::init() {
+  int budgetMB = Config::getInstance().getTextureCacheMB();
+  setBudget((size_t)budgetMB * 1024 * 1024);
+  setQuota(TextureClass::ATTACHMENT, (size_t)budgetMB * 1024 * 1024 / 2);
+  Logger::log("[TexCache] Budget %d MB", budgetMB);
+}
+
+void TextureCache::shutdown() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &pair : entries)
+    freeEntry(pair.second);
+  entries.clear();
+  pinned.clear();
+  for (auto &state : classes) {
+    state.lru.clear();
+    state.stats.bytes = 0;
+    state.stats.entries = 0;
+  }
+  totalBytes = 0;
+}
+
+void TextureCache::freeEntry(Entry &entry) {
+  if (entry.slot) {
+    TextureAtlas::getInstance().release(entry.slot);
+    entry.slot = nullptr;
+    entry.info.tex = nullptr;
+  } else if (entry.info.tex) {
+    C3D_TexDelete(entry.info.tex);
+    free(entry.info.tex);
+    entry.info.tex = nullptr;
+  }
+}
+
+bool TextureCache::find(const std::string &key, TextureClass cls,
+                        TextureInfo *out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    classes[(int)cls].stats.misses++;
+    return false;
+  }
+
+  Entry &entry = it->second;
+  ClassState &state = classes[(int)entry.cls];
+  state.stats.hits++;
+  entry.usedFrame = frame;
+  lookedUp = true;
+  if (entry.refCount == 0)
+    state.lru.splice(state.lru.begin(), state.lru, entry.lruPos);
+  if (out)
+    *out = entry.info;
+  return true;
+}
+
+bool TextureCache::contains(const std::string &key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return entries.find(key) != entries.end();
+}
+
+bool TextureCache::makeRoomFor(const std::string &key) {
+  auto it = entries.find(key);
+  if (it == entries.end())
+    return true;
+  Entry &existing = it->second;
+  if (existing.info.tex)
+    return false;
+
+  // Replace a failed placeholder in place.
+  ClassState &state = classes[(int)existing.cls];
+  if (existing.refCount == 0)
+    state.lru.erase(existing.lruPos);
+  else
+    pinned.erase(existing.lruPos);
+  state.stats.entries--;
+  entries.erase(it);
+  return true;
+}
+
+void TextureCache::insert(const std::string &key, TextureClass cls,
+                          C3D_Tex *tex, int originalW, int originalH) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!makeRoomFor(key)) {
+    if (tex) {
+      C3D_TexDelete(tex);
+      free(tex);
+    }
+    return;
+  }
+
+  Entry entry;
+  entry.info.tex = tex;
+  entry.info.originalW = originalW;
+  entry.info.originalH = originalH;
+  entry.info.bytes = tex ? tex->size : 0;
+  entry.info.failed = (tex == nullptr);
+  if (tex) {
+    entry.subtex = {(u16)originalW, (u16)originalH, 0.0f, 1.0f,
+                    (float)originalW / tex->width,
+                    1.0f - (float)originalH / tex->height};
+  }
+  addEntry(key, cls, entry);
+}
+
+void TextureCache::addEntry(const std::string &key, TextureClass cls,
+                            Entry &entry) {
+  entry.cls = cls;
+  ClassState &state = classes[(int)cls];
+  state.lru.push_front(key);
+  entry.lruPos = state.lru.begin();
+  state.stats.entries++;
+  state.stats.bytes += entry.info.bytes;
+  state.generation++;
+  totalBytes += entry.info.bytes;
+
+  // The image points at subtex storage that must not move with the copy.
+  Entry &stored = entries.emplace(key, entry).first->second;
+  stored.info.image.tex = stored.info.tex;
+  stored.info.image.subtex =
+      stored.slot ? &stored.slot->subtex : &stored.subtex;
+}
+
+void TextureCache::insertTiled(const std::string &key, TextureClass cls,
+                               Utils::Image::TiledData &tiled) {
+  int w = tiled.w, h = tiled.h;
+  AtlasSlot *slot = TextureAtlas::getInstance().insert(tiled);
+  if (!slot) {
+    insert(key, cls, Utils::Image::createTexture(tiled), w, h);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!makeRoomFor(key)) {
+    TextureAtlas::getInstance().release(slot);
+    return;
+  }
+
+  Entry entry;
+  entry.slot = slot;
+  entry.info.tex = slot->page;
+  entry.info.originalW = w;
+  entry.info.originalH = h;
+  entry.info.bytes = TextureAtlas::bytesOf(slot);
+  addEntry(key, cls, entry);
+}
+
+void TextureCache::eraseFailed(const std::string &key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = entries.find(key);
+  if (it == entries.end() || !it->second.info.failed ||
+      it->second.refCount > 0)
+    return;
+
+  ClassState &state = classes[(int)it->second.cls];
+  state.lru.erase(it->second.lruPos);
+  state.stats.entries--;
+  entries.erase(it);
+}
+
+TextureHandle TextureCache::acquire(const std::string &key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = entries.find(key);
+  if (it == entries.end() || !it->second.info.tex)
+    return TextureHandle();
+
+  Entry &entry = it->second;
+  if (entry.refCount++ == 0)
+    pinned.splice(pinned.begin(), classes[(int)entry.cls].lru, entry.lruPos);
+  return TextureHandle(key, entry.info.image);
+}
+
+void TextureCache::retain(const std::string &key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = entries.find(key);
+  if (it != entries.end())
+    it->second.refCount++;
+}
+
+void TextureCache::release(const std::string &key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = entries.find(key);
+  if (it == entries.end() || it->second.refCount == 0)
+    return;
+
+  Entry &entry = it->second;
+  if (--entry.refCount == 0) {
+    ClassState &state = classes[(int)entry.cls];
+    state.lru.splice(state.lru.begin(), pinned, entry.lruPos);
+  }
+}
+
+bool TextureCache::canEvict(TextureClass cls) {
+  ClassState &state = classes[(int)cls];
+  if (state.lru.empty())
+    return false;
+  auto it = entries.find(state.lru.back());
+  return it == entries.end() || it->second.usedFrame + 1 < frame;
+}
+
+bool TextureCache::evictOne(TextureClass cls) {
+  ClassState &state = classes[(int)cls];
+  if (!canEvict(cls))
+    return false;
+
+  auto it = entries.find(state.lru.back());
+  state.lru.pop_back();
+  if (it == entries.end())
+    return true;
+
+  state.stats.bytes -= it->second.info.bytes;
+  state.stats.entries--;
+  if (it->second.info.tex)
+    state.stats.evictions++;
+  state.generation++;
+  totalBytes -= it->second.info.bytes;
+  freeEntry(it->second);
+  entries.erase(it);
+  return true;
+}
+
+void TextureCache::trim() {
+  std::lock_guard<std::mutex> lock(mutex);
+  // Frames that drew nothing don't count, so an idle screen keeps what it
+  // last drew.
+  if (lookedUp) {
+    frame++;
+    lookedUp = false;
+  }
+
+  for (int c = 0; c < (int)TextureClass::COUNT; c++) {
+    if (c == (int)TextureClass::LOCAL || classes[c].quota == 0)
+      continue;
+    while (classes[c].stats.bytes > classes[c].quota &&
+           evictOne((TextureClass)c)) {
+    }
+  }
+
+  // Over the global budget (or short on linear heap), take from whichever
+  // evictable class is furthest into its share. Evicting from a fragmented
+  // page lowers that class's share until another class is the furthest in.
+  while (totalBytes + atlasOverhead() > budgetBytes ||
+         linearSpaceFree() < LINEAR_RESERVE_BYTES) {
+    int victim = -1;
+    float worst = -1.0f;
+    for (int c = 0; c < (int)TextureClass::COUNT; c++) {
+      if (c == (int)TextureClass::LOCAL || !canEvict((TextureClass)c))
+        continue;
+      size_t share = classes[c].quota ? classes[c].quota : budgetBytes;
+      float usage = (float)classes[c].stats.bytes / (float)share;
+      if (usage > worst) {
+        worst = usage;
+        victim = c;
+      }
+    }
+    if (victim < 0 || !evictOne((TextureClass)victim))
+      break;
+  }
+}
+
+void TextureCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &state : classes) {
+    for (const auto &key : state.lru) {
+      auto it = entries.find(key);
+      if (it == entries.end())
+        continue;
+      state.stats.bytes -= it->second.info.bytes;
+      state.stats.entries--;
+      totalBytes -= it->second.info.bytes;
+      freeEntry(it->second);
+      entries.erase(it);
+    }
+    state.lru.clear();
+    state.generation++;
+  }
+}
+
+void TextureCache::setBudget(size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  budgetBytes = bytes;
+}
+
+void TextureCache::setQuota(TextureClass cls, size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  classes[(int)cls].quota = bytes;
+}
+
+TextureCache::Stats TextureCache::getStats(TextureClass cls) {
+  std::lock_guard<std::mutex> lock(mutex);
+  Stats stats = classes[(int)cls].stats;
+  stats.quota = classes[(int)cls].quota;
+  return stats;
+}
+
+size_t TextureCache::getTotalBytes() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return totalBytes + atlasOverhead();
+}
+
+u32 TextureCache::getGeneration(TextureClass cls) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return classes[(int)cls].generation;
+}
+
+float TextureCache::getHitRate() {
+  std::lock_guard<std::mutex> lock(mutex);
+  u32 hits = 0, lookups = 0;
+  for (const auto &state : classes) {
+    hits += state.stats.hits;
+    lookups += state.stats.hits + state.stats.misses;
+  }
+  return lookups ? (float)hits / (float)lookups : 0.0f;
+}
+
+TextureHandle::TextureHandle(const TextureHandle &other)
+    : key(other.key), image(other.image) {
+  if (image.tex)
+    TextureCache::getInstance().retain(key);
+}
+
+TextureHandle::TextureHandle(TextureHandle &&other) noexcept
+    : key(std::move(other.key)), image(other.image) {
+  other.image = {};
+}
+
+TextureHandle &TextureHandle::operator=(TextureHandle other) {
+  std::swap(key, other.key);
+  std::swap(image, other.image);
+  return *this;
+}
+
+void TextureHandle::reset() {
+  if (image.tex)
+    TextureCache::getInstance().release(key);
+  image = {};
+  key.clear();
+}
+
+} // namespace UI
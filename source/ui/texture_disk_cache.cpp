@@ -0,0 +1,428 @@
+#include "ui/texture_disk_cache.h"
+#include "core/config.h"
+#include "log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#include <vector>
+
+#define TEXTURE_CACHE_DIR CONFIG_DIR_PATH "/cache/textures"
+
+namespace UI {
+
+namespace {
+
+const u32 FILE_MAGIC = 0x58544354; // "TCTX"
+const u32 INDEX_MAGIC = 0x58444954; // "TIDX"
+// 2: soft-alpha images above emoji size are stored as RGBA8, not RGBA4.
+const u16 FORMAT_VERSION = 2;
+
+struct FileHeader {
+  u32 magic;
+  u16 version;
+  u16 format;
+  u16 w, h;
+  u16 p2w, p2h;
+  u32 dataSize;
+};
+
+struct IndexHeader {
+  u32 magic;
+  u16 version;
+  u16 reserved;
+  u32 count;
+};
+
+struct IndexRecord {
+  u64 key;
+  u32 size;
+  u32 reserved;
+  u64 lastAccess;
+};
+
+} // namespace
+
+TextureDiskCache &TextureDiskCache::getInstance() {
+  static TextureDiskCache instance;
+  return instance;
+}
+
+TextureDiskCache::~TextureDiskCache() { shutdown(); }
+
+void TextureDiskCache::init() {
+  if (worker.joinable())
+    return;
+
+  mkdir(CONFIG_DIR_PATH "/cache", 0700);
+  mkdir(TEXTURE_CACHE_DIR, 0700);
+  loadIndex();
+  lastIndexSave = osGetTime();
+
+  stopWorker = false;
+  ready = true;
+  worker = std::thread(&TextureDiskCache::workerLoop, this);
+  Logger::log("[DiskCache] %zu textures, %llu KB", index.size(),
+              (unsigned long long)(totalBytes / 1024));
+}
+
+void TextureDiskCache::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!ready)
+      return;
+    ready = false;
+    stopWorker = true;
+  }
+  jobCv.notify_all();
+  if (worker.joinable())
+    worker.join();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &job : writes)
+      Utils::Image::freeTiled(job.tiled);
+    writes.clear();
+    loads.clear();
+    queuedWriteBytes = 0;
+  }
+  saveIndex();
+}
+
+u64 TextureDiskCache::hashUrl(const std::string &url) {
+  u64 hash = 14695981039346656037ull;
+  for (unsigned char c : url) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+std::string TextureDiskCache::pathFor(u64 key) {
+  char name[64];
+  snprintf(name, sizeof(name), TEXTURE_CACHE_DIR "/%016llx.tex",
+           (unsigned long long)key);
+  return name;
+}
+
+bool TextureDiskCache::contains(const std::string &url) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return ready && index.find(hashUrl(url)) != index.end();
+}
+
+void TextureDiskCache::load(const std::string &url, LoadCallback done) {
+  Job job;
+  job.key = hashUrl(url);
+  job.done = std::move(done);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ready) {
+      loads.push_back(std::move(job));
+      jobCv.notify_one();
+      return;
+    }
+  }
+  Utils::Image::TiledData empty;
+  job.done(empty);
+}
+
+void TextureDiskCache::store(const std::string &url,
+                             const Utils::Image::TiledData &tiled) {
+  if (!tiled.pixels || tiled.vramSize == 0)
+    return;
+
+  u64 key = hashUrl(url);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!ready || index.find(key) != index.end())
+      return;
+    // The SD card is slow; shed writes rather than pile up copies in RAM.
+    if (queuedWriteBytes + tiled.vramSize > MAX_QUEUED_WRITE_BYTES)
+      return;
+    queuedWriteBytes += tiled.vramSize;
+  }
+
+  Job job;
+  job.key = key;
+  job.isWrite = true;
+  job.tiled = tiled;
+  job.tiled.linear = false;
+  job.tiled.pixels = malloc(tiled.vramSize);
+  if (!job.tiled.pixels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    queuedWriteBytes -= tiled.vramSize;
+    return;
+  }
+  memcpy(job.tiled.pixels, tiled.pixels, tiled.vramSize);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  writes.push_back(std::move(job));
+  jobCv.notify_one();
+}
+
+void TextureDiskCache::workerLoop() {
+  removeOrphans();
+
+  while (true) {
+    Job job;
+    bool flushIndex = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      jobCv.wait_for(lock, std::chrono::seconds(1), [this] {
+        return stopWorker || !loads.empty() || !writes.empty();
+      });
+      if (stopWorker)
+        return;
+
+      // Flush at most every few seconds when idle, and every half minute
+      // under a steady stream of jobs so a crash can't orphan all of them.
+      bool idle = loads.empty() && writes.empty();
+      if (indexDirty &&
+          osGetTime() - lastIndexSave > (idle ? 5000 : 30000)) {
+        flushIndex = true;
+      } else if (!loads.empty()) {
+        job = std::move(loads.front());
+        loads.pop_front();
+      } else if (!writes.empty()) {
+        job = std::move(writes.front());
+        writes.pop_front();
+        queuedWriteBytes -= job.tiled.vramSize;
+      }
+    }
+
+    if (flushIndex)
+      saveIndex();
+    else if (job.isWrite)
+      runWrite(job);
+    else if (job.done)
+      runLoad(job);
+  }
+}
+
+void TextureDiskCache::runLoad(Job &job) {
+  Utils::Image::TiledData tiled;
+  bool known;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    known = index.find(job.key) != index.end();
+  }
+
+  FILE *f = known ? fopen(pathFor(job.key).c_str(), "rb") : nullptr;
+  if (f) {
+    FileHeader header;
+    if (fread(&header, sizeof(header), 1, f) == 1 &&
+        header.magic == FILE_MAGIC && header.version == FORMAT_VERSION &&
+        header.dataSize > 0) {
+      Utils::Image::TiledData data;
+      if (Utils::Image::allocTiled(data, header.dataSize) &&
+          fread(data.pixels, 1, header.dataSize, f) == header.dataSize) {
+        tiled = data;
+        tiled.w = header.w;
+        tiled.h = header.h;
+        tiled.p2w = header.p2w;
+        tiled.p2h = header.p2h;
+        tiled.vramSize = header.dataSize;
+        tiled.format = (GPU_TEXCOLOR)header.format;
+        Utils::Image::flushTiled(tiled);
+      } else {
+        Utils::Image::freeTiled(data);
+      }
+    }
+    fclose(f);
+  }
+
+  bool corrupt = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(job.key);
+    if (it != index.end()) {
+      if (tiled.pixels) {
+        it->second.lastAccess = osGetTime();
+      } else {
+        totalBytes -= it->second.size;
+        index.erase(it);
+        corrupt = true;
+      }
+      indexDirty = true;
+    }
+  }
+  if (corrupt)
+    remove(pathFor(job.key).c_str());
+
+  job.done(tiled);
+}
+
+void TextureDiskCache::runWrite(Job &job) {
+  Utils::Image::TiledData &tiled = job.tiled;
+  std::string path = pathFor(job.key);
+
+  FileHeader header;
+  header.magic = FILE_MAGIC;
+  header.version = FORMAT_VERSION;
+  header.format = (u16)tiled.format;
+  header.w = (u16)tiled.w;
+  header.h = (u16)tiled.h;
+  header.p2w = (u16)tiled.p2w;
+  header.p2h = (u16)tiled.p2h;
+  header.dataSize = (u32)tiled.vramSize;
+
+  bool ok = false;
+  FILE *f = fopen(path.c_str(), "wb");
+  if (f) {
+    ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+         fwrite(tiled.pixels, 1, tiled.vramSize, f) == tiled.vramSize;
+    fclose(f);
+  }
+  Utils::Image::freeTiled(tiled);
+
+  if (!ok) {
+    remove(path.c_str());
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    IndexEntry &entry = index[job.key];
+    totalBytes -= entry.size;
+    entry.size = sizeof(header) + header.dataSize;
+    entry.lastAccess = osGetTime();
+    totalBytes += entry.size;
+    indexDirty = true;
+  }
+  evictIfNeeded();
+}
+
+void TextureDiskCache::evictIfNeeded() {
+  std::vector<u64> victims;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (totalBytes <= MAX_DISK_BYTES)
+      return;
+
+    // Drop the least recently used files until 10% under the cap, so this
+    // sort runs once per batch rather than once per write.
+    std::vector<std::pair<u64, u64>> byAge;
+    byAge.reserve(index.size());
+    for (const auto &pair : index)
+      byAge.push_back({pair.second.lastAccess, pair.first});
+    std::sort(byAge.begin(), byAge.end());
+
+    u64 target = MAX_DISK_BYTES - MAX_DISK_BYTES / 10;
+    for (const auto &age : byAge) {
+      if (totalBytes <= target)
+        break;
+      auto it = index.find(age.second);
+      totalBytes -= it->second.size;
+      index.erase(it);
+      victims.push_back(age.second);
+    }
+    indexDirty = true;
+  }
+
+  for (u64 key : victims)
+    remove(pathFor(key).c_str());
+}
+
+void TextureDiskCache::loadIndex() {
+  index.clear();
+  totalBytes = 0;
+
+  FILE *f = fopen(TEXTURE_CACHE_DIR "/index.bin", "rb");
+  IndexHeader header;
+  if (!f || fread(&header, sizeof(header), 1, f) != 1 ||
+      header.magic != INDEX_MAGIC || header.version != FORMAT_VERSION) {
+    if (f)
+      fclose(f);
+    // Without a usable index the files on disk can't be accounted for;
+    // removeOrphans() deletes them all.
+    return;
+  }
+
+  IndexRecord record;
+  for (u32 i = 0; i < header.count; i++) {
+    if (fread(&record, sizeof(record), 1, f) != 1)
+      break;
+    IndexEntry entry;
+    entry.size = record.size;
+    entry.lastAccess = record.lastAccess;
+    index[record.key] = entry;
+    totalBytes += entry.size;
+  }
+  fclose(f);
+}
+
+void TextureDiskCache::saveIndex() {
+  // Snapshot under the lock, write without it.
+  std::vector<IndexRecord> records;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    lastIndexSave = osGetTime();
+    if (!indexDirty)
+      return;
+    records.reserve(index.size());
+    for (const auto &pair : index) {
+      IndexRecord record;
+      record.key = pair.first;
+      record.size = pair.second.size;
+      record.reserved = 0;
+      record.lastAccess = pair.second.lastAccess;
+      records.push_back(record);
+    }
+    indexDirty = false;
+  }
+
+  std::string tmpPath = TEXTURE_CACHE_DIR "/index.tmp";
+  FILE *f = fopen(tmpPath.c_str(), "wb");
+  if (!f)
+    return;
+
+  IndexHeader header;
+  header.magic = INDEX_MAGIC;
+  header.version = FORMAT_VERSION;
+  header.reserved = 0;
+  header.count = records.size();
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(records.data(), sizeof(IndexRecord), records.size(), f) ==
+                records.size();
+  fclose(f);
+
+  if (ok) {
+    remove(TEXTURE_CACHE_DIR "/index.bin");
+    rename(tmpPath.c_str(), TEXTURE_CACHE_DIR "/index.bin");
+  } else {
+    remove(tmpPath.c_str());
+    std::lock_guard<std::mutex> lock(mutex);
+    indexDirty = true;
+  }
+}
+
+// Files written after the last saveIndex() before a crash or power-off are
+// not in the index, so nothing would ever evict them.
+void TextureDiskCache::removeOrphans() {
+  DIR *dir = opendir(TEXTURE_CACHE_DIR);
+  if (!dir)
+    return;
+
+  std::vector<std::string> orphans;
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != nullptr) {
+    const char *ext = strstr(ent->d_name, ".tex");
+    if (!ext)
+      continue;
+    u64 key = strtoull(ent->d_name, nullptr, 16);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ext - ent->d_name != 16 || index.find(key) == index.end())
+      orphans.push_back(ent->d_name);
+  }
+  closedir(dir);
+
+  for (const auto &name : orphans)
+    remove((std::string(TEXTURE_CACHE_DIR "/") + name).c_str());
+  if (!orphans.empty())
+    Logger::log("[DiskCache] Removed %zu orphaned textures", orphans.size());
+}
+
+} // namespace UI
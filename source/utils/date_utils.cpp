@@ -0,0 +1,76 @@
+#include "utils/date_utils.h"
+
+namespace Utils {
+namespace Date {
+
+namespace {
+
+int parseDigits(const char *p, int count) {
+  int value = 0;
+  for (int i = 0; i < count; i++) {
+    if (p[i] < '0' || p[i] > '9')
+      return -1;
+    value = value * 10 + (p[i] - '0');
+  }
+  return value;
+}
+
+int64_t floorDiv(int64_t a, int64_t b) {
+  int64_t q = a / b;
+  if ((a % b != 0) && ((a < 0) != (b < 0)))
+    q--;
+  return q;
+}
+
+} // namespace
+
+time_t parseISO8601(const std::string &timestamp) {
+  if (timestamp.size() < 19)
+    return 0;
+
+  const char *p = timestamp.c_str();
+  if (p[4] != '-' || p[7] != '-' || (p[10] != 'T' && p[10] != ' ') ||
+      p[13] != ':' || p[16] != ':')
+    return 0;
+
+  int year = parseDigits(p, 4);
+  int month = parseDigits(p + 5, 2);
+  int day = parseDigits(p + 8, 2);
+  int hour = parseDigits(p + 11, 2);
+  int min = parseDigits(p + 14, 2);
+  int sec = parseDigits(p + 17, 2);
+  if (year < 0 || month < 1 || month > 12 || day < 1 || day > 31 ||
+      hour < 0 || min < 0 || sec < 0)
+    return 0;
+
+  return (time_t)daysFromCivil(year, month, day) * 86400 + hour * 3600 +
+         min * 60 + sec;
+}
+
+int64_t daysFromCivil(int year, int month, int day) {
+  year -= month <= 2;
+  const int64_t era = (year >= 0 ? year : year - 399) / 400;
+  const unsigned yoe = (unsigned)(year - era * 400);
+  const unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t)doe - 719468;
+}
+
+void civilFromDays(int64_t days, int &year, int &month, int &day) {
+  days += 719468;
+  const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  const unsigned doe = (unsigned)(days - era * 146097);
+  const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const unsigned mp = (5 * doy + 2) / 153;
+  day = (int)(doy - (153 * mp + 2) / 5 + 1);
+  month = (int)(mp < 10 ? mp + 3 : mp - 9);
+  year = (int)(yoe + era * 400) + (month <= 2);
+}
+
+int32_t localDay(time_t utcEpoch, int64_t offsetSeconds) {
+  return (int32_t)floorDiv((int64_t)utcEpoch + offsetSeconds, 86400);
+}
+
+} // namespace Date
+} // namespace Utils
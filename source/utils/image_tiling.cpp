@@ -0,0 +1,95 @@
+#include "utils/image_tiling.h"
+#include <algorithm>
+#include <vector>
+
+namespace Utils {
+namespace Image {
+
+namespace {
+
+// The RGB of a box weighted by alpha, so that the colour of transparent
+// texels (often black) doesn't bleed into the edges. alphaSum is the box's
+// total alpha and not 0.
+uint32_t weightedRGB(const uint32_t *src, int w, int x0, int x1, int y0,
+                     int y1, uint32_t alphaSum) {
+  uint64_t r = 0, g = 0, b = 0;
+  for (int y = y0; y < y1; y++) {
+    const uint32_t *row = src + (size_t)y * w;
+    for (int x = x0; x < x1; x++) {
+      uint32_t v = row[x];
+      uint32_t a = v >> 24;
+      r += (v & 0xFF) * a;
+      g += ((v >> 8) & 0xFF) * a;
+      b += ((v >> 16) & 0xFF) * a;
+    }
+  }
+  uint64_t half = alphaSum / 2;
+  return (uint32_t)((r + half) / alphaSum) |
+         (uint32_t)((g + half) / alphaSum) << 8 |
+         (uint32_t)((b + half) / alphaSum) << 16;
+}
+
+} // namespace
+
+void boxDownscale(const uint32_t *src, int w, int h, uint32_t *dst, int dw,
+                  int dh) {
+  std::vector<int> colStart(dw + 1);
+  for (int x = 0; x <= dw; x++)
+    colStart[x] = (int)(((long long)x * w) / dw);
+  std::vector<uint32_t> acc((size_t)dw * 4);
+
+  for (int y = 0; y < dh; y++) {
+    int sy0 = (int)(((long long)y * h) / dh);
+    int sy1 = std::max(sy0 + 1, (int)(((long long)(y + 1) * h) / dh));
+    std::fill(acc.begin(), acc.end(), 0);
+
+    for (int sy = sy0; sy < sy1; sy++) {
+      const uint32_t *row = src + (size_t)sy * w;
+      uint32_t *a = acc.data();
+      for (int x = 0; x < dw; x++, a += 4) {
+        int sx1 = std::max(colStart[x] + 1, colStart[x + 1]);
+        for (int sx = colStart[x]; sx < sx1;) {
+          // Two channels per word in 16-bit lanes; 256 texels can't
+          // overflow a lane.
+          int end = std::min(sx1, sx + 256);
+          uint32_t rb = 0, ga = 0;
+          for (; sx < end; sx++) {
+            uint32_t v = row[sx];
+            rb += v & 0x00FF00FF;
+            ga += (v >> 8) & 0x00FF00FF;
+          }
+          a[0] += rb & 0xFFFF;
+          a[1] += ga & 0xFFFF;
+          a[2] += rb >> 16;
+          a[3] += ga >> 16;
+        }
+      }
+    }
+
+    uint32_t *out = dst + (size_t)y * dw;
+    const uint32_t *a = acc.data();
+    int rows = sy1 - sy0;
+    for (int x = 0; x < dw; x++, a += 4) {
+      int cols = std::max(1, colStart[x + 1] - colStart[x]);
+      uint32_t count = (uint32_t)(rows * cols);
+      // Fixed-point reciprocal instead of four divides per texel.
+      uint32_t inv = (65536u + count / 2) / count;
+      uint32_t al = std::min(255u, (a[3] * inv + 32768) >> 16);
+      // Boxes that are opaque throughout, or fully transparent, need no
+      // alpha weighting; only the ones on an edge are summed again.
+      if (a[3] != 0 && a[3] != count * 255) {
+        out[x] = weightedRGB(src, w, colStart[x], colStart[x] + cols, sy0, sy1,
+                             a[3]) |
+                 (al << 24);
+        continue;
+      }
+      uint32_t r = std::min(255u, (a[0] * inv + 32768) >> 16);
+      uint32_t g = std::min(255u, (a[1] * inv + 32768) >> 16);
+      uint32_t b = std::min(255u, (a[2] * inv + 32768) >> 16);
+      out[x] = r | (g << 8) | (b << 16) | (al << 24);
+    }
+  }
+}
+
+} // namespace Image
+} // namespace Utils
@@ -2,42 +2,70 @@
 #include "stb_image.h"
 
 #include "utils/image_utils.h"
+#include "utils/image_tiling.h"
+#include <algorithm>
 #include <cmath>
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
 #include <malloc.h>
 #include <string.h>
 
 namespace Utils {
 namespace Image {
 
-static const int mortonTable[] = {
-    0,  1,  4,  5,  16, 17, 20, 21, 2,  3,  6,  7,  18, 19, 22, 23,
-    8,  9,  12, 13, 24, 25, 28, 29, 10, 11, 14, 15, 26, 27, 30, 31,
-    32, 33, 36, 37, 48, 49, 52, 53, 34, 35, 38, 39, 50, 51, 54, 55,
-    40, 41, 44, 45, 56, 57, 60, 61, 42, 43, 46, 47, 58, 59, 62, 63};
+// Tiled buffers at least this big are staged in linear memory for a DMA
+// upload; below it a memcpy is cheaper than setting up the transfer.
+static const size_t DMA_MIN_BYTES = 32 * 1024;
+static const size_t DMA_LINEAR_RESERVE_BYTES = 4 * 1024 * 1024;
 
-TiledData decodeToTiled(const unsigned char *data, size_t size, int maxWidth,
-                        int maxHeight, bool noResize) {
-  TiledData result;
-  int w, h, c;
+// Largest decoded bitmap we'll hold (36 MB of RGBA).
+static const long long MAX_DECODED_PIXELS = 3000LL * 3000;
+// A progressive JPEG keeps all DCT coefficients (~3 bytes/pixel at 4:2:0),
+// so a 12 MP phone photo peaks about where a 9 MP RGBA bitmap did.
+static const long long MAX_PROGRESSIVE_JPEG_PIXELS = 4096LL * 3072;
+// Soft alpha only gets RGBA4, with its 4-bit colour, up to emoji and
+// avatar size; a banded gradient is easy to see on anything bigger.
+static const int RGBA4_MAX_SIDE = 64;
 
-  if (!stbi_info_from_memory(data, size, &w, &h, &c)) {
-    return result;
+size_t bytesPerTexel(GPU_TEXCOLOR format) {
+  switch (format) {
+  case GPU_RGB565:
+  case GPU_RGBA5551:
+  case GPU_RGBA4:
+    return 2;
+  default:
+    return 4;
   }
+}
 
-  if (w > 8192 || h > 8192)
-    return result;
-  if (w * h > 3000 * 3000)
-    return result;
-
-  stbi_set_flip_vertically_on_load(false);
-  unsigned char *img = stbi_load_from_memory(data, size, &w, &h, &c, 4);
-
-  if (!img) {
-    return result;
+GPU_TEXCOLOR chooseFormat(const unsigned char *rgba, int w, int h,
+                          bool small) {
+  bool opaque = true;
+  bool binaryAlpha = true;
+  size_t count = (size_t)w * h;
+  for (size_t i = 0; i < count; i++) {
+    u8 a = rgba[i * 4 + 3];
+    if (a != 255) {
+      opaque = false;
+      if (a != 0) {
+        binaryAlpha = false;
+        break;
+      }
+    }
   }
 
-  int targetW = w;
-  int targetH = h;
+  if (opaque)
+    return GPU_RGB565;
+  if (binaryAlpha)
+    return GPU_RGBA5551;
+  return small ? GPU_RGBA4 : GPU_RGBA8;
+}
+
+static void fitTarget(int w, int h, int maxWidth, int maxHeight,
+                      bool noResize, int &targetW, int &targetH) {
+  targetW = w;
+  targetH = h;
   if (!noResize && (targetW > maxWidth || targetH > maxHeight)) {
     float ratio = (float)w / h;
     if (w > h) {
@@ -47,78 +75,255 @@ TiledData decodeToTiled(const unsigned char *data, size_t size, int maxWidth,
       targetH = maxHeight;
       targetW = maxHeight * ratio;
     }
+    targetW = std::max(1, targetW);
+    targetH = std::max(1, targetH);
+  }
+}
+
+struct JpegErrorManager {
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr cinfo) {
+  longjmp(((JpegErrorManager *)cinfo->err)->jump, 1);
+}
+
+static void jpegOutputMessage(j_common_ptr) {}
+
+// Decodes a JPEG with libjpeg's scaled IDCT, picking the largest 1/2, 1/4
+// or 1/8 reduction that still covers the target size, so a phone photo
+// never exists in memory at full resolution. Returns a malloc'd RGBA
+// buffer, or nullptr to fall back to stb_image.
+static unsigned char *decodeJpegScaled(const unsigned char *data, size_t size,
+                                       int maxWidth, int maxHeight,
+                                       bool noResize, int &outW, int &outH) {
+  jpeg_decompress_struct cinfo;
+  JpegErrorManager jerr;
+  unsigned char *volatile pixels = nullptr;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = jpegErrorExit;
+  jerr.pub.output_message = jpegOutputMessage;
+  if (setjmp(jerr.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    free(pixels);
+    return nullptr;
+  }
+
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, data, size);
+  jpeg_read_header(&cinfo, TRUE);
+
+  int w = cinfo.image_width;
+  int h = cinfo.image_height;
+  // Baseline JPEGs stream through a few MCU rows, so only the output size
+  // matters. Progressive ones keep every coefficient (~3 bytes/pixel for
+  // 4:2:0), so they keep a pixel cap.
+  bool tooLarge = w > 16384 || h > 16384 ||
+                  (cinfo.progressive_mode &&
+                   (long long)w * h > MAX_PROGRESSIVE_JPEG_PIXELS);
+  if (tooLarge || w == 0 || h == 0) {
+    jpeg_destroy_decompress(&cinfo);
+    return nullptr;
+  }
+
+  int targetW, targetH;
+  fitTarget(w, h, maxWidth, maxHeight, noResize, targetW, targetH);
+  int denom = 1;
+  while (denom < 8 && w / (denom * 2) >= targetW &&
+         h / (denom * 2) >= targetH)
+    denom *= 2;
+
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = denom;
+  cinfo.out_color_space = JCS_EXT_RGBA;
+  cinfo.dct_method = JDCT_IFAST;
+  jpeg_start_decompress(&cinfo);
+
+  outW = cinfo.output_width;
+  outH = cinfo.output_height;
+  if ((long long)outW * outH > MAX_DECODED_PIXELS) {
+    jpeg_destroy_decompress(&cinfo);
+    return nullptr;
+  }
+
+  pixels = (unsigned char *)malloc((size_t)outW * outH * 4);
+  if (!pixels) {
+    jpeg_destroy_decompress(&cinfo);
+    return nullptr;
+  }
+
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = pixels + (size_t)cinfo.output_scanline * outW * 4;
+    jpeg_read_scanlines(&cinfo, &row, 1);
   }
 
-  int p2_w = 1, p2_h = 1;
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return pixels;
+}
+
+static bool isJpeg(const unsigned char *data, size_t size) {
+  return size > 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+TiledData decodeToTiled(const unsigned char *data, size_t size, int maxWidth,
+                        int maxHeight, bool noResize, bool compact) {
+  TiledData result;
+  int w = 0, h = 0, c;
+
+  // Both decoders hand back malloc'd memory (stb_image's default STBI_FREE
+  // is free), so img is released with free() either way.
+  unsigned char *img = nullptr;
+  if (isJpeg(data, size))
+    img = decodeJpegScaled(data, size, maxWidth, maxHeight, noResize, w, h);
+
+  if (!img) {
+    if (!stbi_info_from_memory(data, size, &w, &h, &c))
+      return result;
+    if (w > 8192 || h > 8192)
+      return result;
+    if ((long long)w * h > MAX_DECODED_PIXELS)
+      return result;
+
+    stbi_set_flip_vertically_on_load(false);
+    img = stbi_load_from_memory(data, size, &w, &h, &c, 4);
+    if (!img)
+      return result;
+  }
+
+  int targetW, targetH;
+  fitTarget(w, h, maxWidth, maxHeight, noResize, targetW, targetH);
+
+  // The GPU's smallest texture is 8x8, which is also one tile.
+  int p2_w = 8, p2_h = 8;
   while (p2_w < targetW)
     p2_w *= 2;
   while (p2_h < targetH)
     p2_h *= 2;
 
-  size_t vramSize = p2_w * p2_h * 4;
-  u32 *tiledBuf = (u32 *)malloc(vramSize);
-  if (!tiledBuf) {
-    stbi_image_free(img);
+  bool small = std::max(targetW, targetH) <= RGBA4_MAX_SIDE;
+  GPU_TEXCOLOR format = compact ? chooseFormat(img, w, h, small) : GPU_RGBA8;
+  size_t bpp = bytesPerTexel(format);
+  size_t vramSize = (size_t)p2_w * p2_h * bpp;
+  if (!allocTiled(result, vramSize)) {
+    free(img);
     return result;
   }
+  void *tiledBuf = result.pixels;
   memset(tiledBuf, 0, vramSize);
 
-  for (int y = 0; y < targetH; y++) {
-    for (int x = 0; x < targetW; x++) {
-      int sx = (x * w) / targetW;
-      int sy = (y * h) / targetH;
-
-      int srcIdx = (sy * w + sx) * 4;
-      u8 r = img[srcIdx + 0];
-      u8 g = img[srcIdx + 1];
-      u8 b = img[srcIdx + 2];
-      u8 a = img[srcIdx + 3];
-
-      u32 color = (r << 24) | (g << 16) | (b << 8) | a;
-
-      int tileX = x & 7;
-      int tileY = y & 7;
-      int tileIdx = ((y >> 3) * (p2_w >> 3) + (x >> 3)) * 64;
-      int dstIdx = tileIdx + mortonTable[tileY * 8 + tileX];
-
-      if (dstIdx < (int)(vramSize / 4)) {
-        tiledBuf[dstIdx] = color;
-      }
+  // stb_image returns a malloc'd, word-aligned RGBA buffer.
+  const u32 *linear = (const u32 *)img;
+  u32 *scaled = nullptr;
+  if (targetW != w || targetH != h) {
+    scaled = (u32 *)malloc((size_t)targetW * targetH * 4);
+    if (!scaled) {
+      freeTiled(result);
+      free(img);
+      return result;
     }
+    boxDownscale(linear, w, h, scaled, targetW, targetH);
+    linear = scaled;
   }
 
-  stbi_image_free(img);
+  switch (format) {
+  case GPU_RGB565:
+    swizzleTiles<u16, toRGB565>(linear, targetW, targetH, p2_w,
+                                (u16 *)tiledBuf);
+    break;
+  case GPU_RGBA5551:
+    swizzleTiles<u16, toRGBA5551>(linear, targetW, targetH, p2_w,
+                                  (u16 *)tiledBuf);
+    break;
+  case GPU_RGBA4:
+    swizzleTiles<u16, toRGBA4>(linear, targetW, targetH, p2_w,
+                               (u16 *)tiledBuf);
+    break;
+  default:
+    swizzleTiles<u32, toRGBA8>(linear, targetW, targetH, p2_w,
+                               (u32 *)tiledBuf);
+    break;
+  }
+
+  free(scaled);
+  free(img);
 
-  result.pixels = tiledBuf;
   result.w = targetW;
   result.h = targetH;
   result.p2w = p2_w;
   result.p2h = p2_h;
   result.vramSize = vramSize;
+  result.format = format;
+  flushTiled(result);
   return result;
 }
 
-C3D_Tex *loadTextureFromMemory(const unsigned char *data, size_t size,
-                               int &outW, int &outH, bool noResize) {
-  TiledData tiled = decodeToTiled(data, size, 512, 512, noResize);
+bool allocTiled(TiledData &tiled, size_t size) {
+  tiled.pixels = nullptr;
+  tiled.linear = false;
+  if (size >= DMA_MIN_BYTES &&
+      linearSpaceFree() > size + DMA_LINEAR_RESERVE_BYTES) {
+    tiled.pixels = linearAlloc(size);
+    tiled.linear = (tiled.pixels != nullptr);
+  }
+  if (!tiled.pixels)
+    tiled.pixels = malloc(size);
+  return tiled.pixels != nullptr;
+}
+
+void freeTiled(TiledData &tiled) {
+  if (tiled.linear)
+    linearFree(tiled.pixels);
+  else
+    free(tiled.pixels);
+  tiled.pixels = nullptr;
+  tiled.linear = false;
+}
+
+void flushTiled(const TiledData &tiled) {
+  if (tiled.linear && tiled.pixels)
+    GSPGPU_FlushDataCache(tiled.pixels, tiled.vramSize);
+}
+
+C3D_Tex *createTexture(TiledData &tiled) {
   if (!tiled.pixels)
     return nullptr;
 
   C3D_Tex *tex = (C3D_Tex *)malloc(sizeof(C3D_Tex));
-  if (!C3D_TexInit(tex, tiled.p2w, tiled.p2h, GPU_RGBA8)) {
-    free(tiled.pixels);
+  if (!tex || !C3D_TexInit(tex, tiled.p2w, tiled.p2h, tiled.format)) {
+    freeTiled(tiled);
     free(tex);
     return nullptr;
   }
 
   C3D_TexSetFilter(tex, GPU_LINEAR, GPU_LINEAR);
-  memcpy(tex->data, tiled.pixels, tiled.vramSize);
-  GSPGPU_FlushDataCache(tex->data, tex->size);
-  free(tiled.pixels);
+  size_t copySize = std::min(tiled.vramSize, (size_t)tex->size);
+  if (tiled.linear) {
+    // Already flushed by the decoder; the copy engine moves it while the
+    // CPU only waits. Drop any stale lines over the destination first so
+    // they cannot be written back on top of the copy.
+    u32 rowBytes = (u32)(tiled.p2w * 8 * bytesPerTexel(tiled.format));
+    GSPGPU_InvalidateDataCache(tex->data, tex->size);
+    C3D_SyncTextureCopy((u32 *)tiled.pixels, GX_BUFFER_DIM(rowBytes >> 4, 0),
+                        (u32 *)tex->data, GX_BUFFER_DIM(rowBytes >> 4, 0),
+                        copySize, 8);
+  } else {
+    memcpy(tex->data, tiled.pixels, copySize);
+    GSPGPU_FlushDataCache(tex->data, tex->size);
+  }
+  freeTiled(tiled);
+  return tex;
+}
 
+C3D_Tex *loadTextureFromMemory(const unsigned char *data, size_t size,
+                               int &outW, int &outH, bool noResize,
+                               bool compact) {
+  TiledData tiled = decodeToTiled(data, size, 512, 512, noResize, compact);
   outW = tiled.w;
   outH = tiled.h;
-  return tex;
+  return createTexture(tiled);
 }
 
 C3D_Tex *loadTextureFromMemory(const unsigned char *data, size_t size) {
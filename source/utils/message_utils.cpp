@@ -3,6 +3,7 @@
 #include "core/i18n.h"
 #include "log.h"
 #include "ui/screen_manager.h"
+#include "utils/date_utils.h"
 #include "utils/utf8_utils.h"
 #include <3ds.h>
 #include <cmath>
@@ -52,29 +53,12 @@ void syncClock(const std::string &dateStr) {
 
 time_t getUtcNow() { return time(NULL) + clockSkew; }
 
-time_t parseISO8601(const std::string &timestamp) {
-  int year, month, day, hour, min, sec;
-  if (sscanf(timestamp.c_str(), "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour,
-             &min, &sec) != 6) {
-    return 0;
-  }
-
-  static const int days_in_month[] = {31, 28, 31, 30, 31, 30,
-                                      31, 31, 30, 31, 30, 31};
-  time_t epoch = 0;
-  for (int y = 1970; y < year; ++y) {
-    epoch += (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) ? 366 : 365;
-  }
-  for (int m = 0; m < month - 1; ++m) {
-    epoch += days_in_month[m];
-    if (m == 1 && (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))) {
-      epoch += 1;
-    }
-  }
-  epoch += day - 1;
-  epoch = epoch * 86400 + hour * 3600 + min * 60 + sec;
+static time_t getLocalOffsetSeconds() {
+  return (time_t)Config::getInstance().getTimezoneOffset() * 3600;
+}
 
-  return epoch;
+int32_t getLocalDay(time_t utcEpoch) {
+  return Utils::Date::localDay(utcEpoch, getLocalOffsetSeconds());
 }
 
 time_t snowflakeToTimestamp(const std::string &snowflake) {
@@ -95,7 +79,7 @@ std::string formatTimestamp(const std::string &timestamp) {
     return TR("message.sending");
   if (timestamp == "Failed")
     return TR("message.status.failed");
-  time_t msg_utc = parseISO8601(timestamp);
+  time_t msg_utc = Utils::Date::parseISO8601(timestamp);
   if (msg_utc == 0)
     return timestamp;
 
@@ -148,7 +132,7 @@ std::string formatTimestamp(const std::string &timestamp) {
 std::string formatTimeOnly(const std::string &timestamp) {
   if (timestamp == "Sending...")
     return "";
-  time_t utc_epoch = parseISO8601(timestamp);
+  time_t utc_epoch = Utils::Date::parseISO8601(timestamp);
   if (utc_epoch == 0)
     return timestamp.substr(11, 5);
 
@@ -376,35 +360,14 @@ bool canGroupWithPrevious(const Discord::Message &current,
   if (!current.referencedMessageId.empty())
     return false;
 
-  time_t t1 = parseISO8601(current.timestamp);
-  time_t t2 = parseISO8601(previous.timestamp);
-  if (t1 == 0 || t2 == 0)
-    return false;
-
-  double diff = difftime(t1, t2);
-  if (std::abs(diff) > 300)
-    return false;
-
-  s64 offset_s = (s64)Config::getInstance().getTimezoneOffset() * 3600LL;
-  time_t local_t1 = t1 + offset_s;
-  time_t local_t2 = t2 + offset_s;
-
-  struct tm *lt1 = gmtime(&local_t1);
-  if (!lt1)
-    return false;
-  int day1 = lt1->tm_yday;
-  int year1 = lt1->tm_year;
-
-  struct tm *lt2 = gmtime(&local_t2);
-  if (!lt2)
+  if (current.epoch == 0 || previous.epoch == 0)
     return false;
-  int day2 = lt2->tm_yday;
-  int year2 = lt2->tm_year;
 
-  if (day1 != day2 || year1 != year2)
+  time_t diff = current.epoch - previous.epoch;
+  if (diff > 300 || diff < -300)
     return false;
 
-  return true;
+  return getLocalDay(current.epoch) == getLocalDay(previous.epoch);
 }
 
 std::string getRelativeTime(time_t targetEpoch) {
@@ -447,7 +410,7 @@ std::string getRelativeTime(time_t targetEpoch) {
 }
 
 std::string getLocalDateString(const std::string &timestamp) {
-  time_t utc = parseISO8601(timestamp);
+  time_t utc = Utils::Date::parseISO8601(timestamp);
   if (utc == 0)
     return timestamp.substr(0, 10);
 
@@ -464,6 +427,72 @@ std::string getLocalDateString(const std::string &timestamp) {
   return std::string(buffer);
 }
 
+void stampMessage(Discord::Message &msg) {
+  msg.epoch = Utils::Date::parseISO8601(msg.timestamp);
+  if (msg.epoch == 0)
+    msg.epoch = snowflakeToTimestamp(msg.id);
+}
+
+std::string formatTimestamp(const Discord::Message &msg) {
+  if (msg.epoch == 0)
+    return formatTimestamp(msg.timestamp);
+
+  int32_t today = getLocalDay(getUtcNow());
+  int64_t localSecs = (int64_t)msg.epoch + getLocalOffsetSeconds();
+  int32_t localDay = getLocalDay(msg.epoch);
+  int secOfDay = (int)(localSecs - (int64_t)localDay * 86400);
+  int hour = secOfDay / 3600;
+  int minute = (secOfDay / 60) % 60;
+
+  char buffer[64];
+  if (localDay == today) {
+    snprintf(buffer, sizeof(buffer), "%02d:%02d", hour, minute);
+    return std::string(buffer);
+  }
+
+  if (localDay == today - 1) {
+    std::string yesterday_at =
+        Core::I18n::getInstance().get("time.yesterday_at");
+    snprintf(buffer, sizeof(buffer), "%02d:%02d", hour, minute);
+    size_t pos = yesterday_at.find("{0}");
+    if (pos != std::string::npos) {
+      yesterday_at.replace(pos, 3, buffer);
+    }
+    return yesterday_at;
+  }
+
+  int year, month, day;
+  Utils::Date::civilFromDays(localDay, year, month, day);
+  snprintf(buffer, sizeof(buffer), "%04d/%02d/%02d %02d:%02d", year, month,
+           day, hour, minute);
+  return std::string(buffer);
+}
+
+std::string formatTimeOnly(const Discord::Message &msg) {
+  if (msg.epoch == 0)
+    return formatTimeOnly(msg.timestamp);
+
+  int64_t localSecs = (int64_t)msg.epoch + getLocalOffsetSeconds();
+  int secOfDay = (int)(localSecs - (int64_t)getLocalDay(msg.epoch) * 86400);
+
+  char buffer[16];
+  snprintf(buffer, sizeof(buffer), "%02d:%02d", secOfDay / 3600,
+           (secOfDay / 60) % 60);
+  return std::string(buffer);
+}
+
+std::string getLocalDateString(const Discord::Message &msg) {
+  if (msg.epoch == 0)
+    return getLocalDateString(msg.timestamp);
+
+  int year, month, day;
+  Utils::Date::civilFromDays(getLocalDay(msg.epoch), year, month, day);
+
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d", year, month, day);
+  return std::string(buffer);
+}
+
 std::string getISOTimestamp(time_t epoch) {
   struct tm *gt = gmtime(&epoch);
   if (!gt)
@@ -0,0 +1,343 @@
+// Host-side build step: packs a directory of PNGs into pre-tiled texture
+// sheets plus an index sorted by key, in the format read by UI::AssetPack
+// (include/ui/asset_pack.h).
+//
+//   assetpack [-k codepoints|path] [-c cell] [-s sheet] [-f rgba8|rgba4]
+//             <source dir> <output.pack>
+//
+// -k codepoints: files are named like twemoji ("1f468-200d-1f469.png") and
+//                keyed by their codepoint sequence, big-endian u32 each, so
+//                byte order is codepoint-sequence order.
+// -k path:       keyed by the path below the source dir ("status/idle.png").
+// -c cell:       box-filter anything larger down to fit cell x cell.
+// -s sheet:      sheet width and height, a power of two up to 1024.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+#include <zlib.h>
+
+namespace {
+
+// Must match GPU_TEXCOLOR.
+const uint8_t FORMAT_RGBA8 = 0;
+const uint8_t FORMAT_RGBA4 = 4;
+
+const uint16_t PACK_VERSION = 1;
+
+struct Image {
+  std::string key;
+  std::string file;
+  int w = 0, h = 0;
+  std::vector<uint32_t> rgba; // 0xAABBGGRR
+  int sheet = 0, x = 0, y = 0;
+};
+
+void listPngs(const std::string &root, const std::string &rel,
+              std::vector<std::string> &out) {
+  std::string dirPath = rel.empty() ? root : root + "/" + rel;
+  DIR *dir = opendir(dirPath.c_str());
+  if (!dir)
+    return;
+  while (dirent *ent = readdir(dir)) {
+    std::string name = ent->d_name;
+    if (name == "." || name == "..")
+      continue;
+    std::string child = rel.empty() ? name : rel + "/" + name;
+    struct stat st;
+    if (stat((root + "/" + child).c_str(), &st) != 0)
+      continue;
+    if (S_ISDIR(st.st_mode))
+      listPngs(root, child, out);
+    else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".png") == 0)
+      out.push_back(child);
+  }
+  closedir(dir);
+}
+
+bool codepointKey(const std::string &rel, std::string &key) {
+  std::string stem = rel.substr(0, rel.size() - 4);
+  size_t pos = 0;
+  while (pos <= stem.size()) {
+    size_t dash = stem.find('-', pos);
+    if (dash == std::string::npos)
+      dash = stem.size();
+    std::string part = stem.substr(pos, dash - pos);
+    char *end = nullptr;
+    unsigned long cp = strtoul(part.c_str(), &end, 16);
+    if (part.empty() || *end || cp > 0x10FFFF)
+      return false;
+    key += (char)(cp >> 24);
+    key += (char)(cp >> 16);
+    key += (char)(cp >> 8);
+    key += (char)cp;
+    pos = dash + 1;
+  }
+  return true;
+}
+
+// Area-average downscale with premultiplied alpha, so transparent texels
+// don't darken the edges.
+void downscale(Image &img, int dw, int dh) {
+  std::vector<uint32_t> out((size_t)dw * dh);
+  for (int y = 0; y < dh; y++) {
+    double sy0 = (double)y * img.h / dh, sy1 = (double)(y + 1) * img.h / dh;
+    for (int x = 0; x < dw; x++) {
+      double sx0 = (double)x * img.w / dw, sx1 = (double)(x + 1) * img.w / dw;
+      double acc[4] = {0, 0, 0, 0}, area = 0;
+      for (int sy = (int)sy0; sy < sy1 && sy < img.h; sy++) {
+        double wy = std::min(sy1, sy + 1.0) - std::max(sy0, (double)sy);
+        for (int sx = (int)sx0; sx < sx1 && sx < img.w; sx++) {
+          double wx = std::min(sx1, sx + 1.0) - std::max(sx0, (double)sx);
+          uint32_t v = img.rgba[(size_t)sy * img.w + sx];
+          double a = (v >> 24) / 255.0;
+          double wgt = wx * wy;
+          acc[0] += (v & 0xFF) * a * wgt;
+          acc[1] += ((v >> 8) & 0xFF) * a * wgt;
+          acc[2] += ((v >> 16) & 0xFF) * a * wgt;
+          acc[3] += a * wgt;
+          area += wgt;
+        }
+      }
+      uint32_t px = 0;
+      if (acc[3] > 0) {
+        uint32_t r = (uint32_t)std::min(255.0, acc[0] / acc[3] + 0.5);
+        uint32_t g = (uint32_t)std::min(255.0, acc[1] / acc[3] + 0.5);
+        uint32_t b = (uint32_t)std::min(255.0, acc[2] / acc[3] + 0.5);
+        uint32_t a = (uint32_t)std::min(255.0, acc[3] / area * 255.0 + 0.5);
+        px = r | (g << 8) | (b << 16) | (a << 24);
+      }
+      out[(size_t)y * dw + x] = px;
+    }
+  }
+  img.rgba.swap(out);
+  img.w = dw;
+  img.h = dh;
+}
+
+// Same conversions and tile order as Utils::Image on the console.
+uint32_t toRGBA8(uint32_t v) {
+  return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+}
+
+uint16_t toRGBA4(uint32_t v) {
+  return ((v << 8) & 0xF000) | ((v >> 4) & 0x0F00) | ((v >> 16) & 0x00F0) |
+         (v >> 28);
+}
+
+size_t tiledOffset(int x, int y, int sheetSize) {
+  static const uint8_t morton[8] = {0, 1, 4, 5, 16, 17, 20, 21};
+  size_t tile = (size_t)(y >> 3) * (sheetSize >> 3) + (x >> 3);
+  return tile * 64 + morton[x & 7] + 2 * morton[y & 7];
+}
+
+void put16(std::string &out, uint16_t v) {
+  out += (char)(v & 0xFF);
+  out += (char)(v >> 8);
+}
+
+void put32(std::string &out, uint32_t v) {
+  put16(out, (uint16_t)(v & 0xFFFF));
+  put16(out, (uint16_t)(v >> 16));
+}
+
+int usage() {
+  fprintf(stderr, "usage: assetpack [-k codepoints|path] [-c cell] "
+                  "[-s sheet] [-f rgba8|rgba4] <dir> <out.pack>\n");
+  return 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  bool codepoints = false;
+  int cell = 0;
+  int sheetSize = 512;
+  uint8_t format = FORMAT_RGBA8;
+
+  int arg = 1;
+  for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+    std::string opt = argv[arg], val = argv[arg + 1];
+    if (opt == "-k")
+      codepoints = (val == "codepoints");
+    else if (opt == "-c")
+      cell = atoi(val.c_str());
+    else if (opt == "-s")
+      sheetSize = atoi(val.c_str());
+    else if (opt == "-f")
+      format = (val == "rgba4") ? FORMAT_RGBA4 : FORMAT_RGBA8;
+    else
+      return usage();
+  }
+  if (argc - arg != 2 || sheetSize < 8 || sheetSize > 1024 ||
+      (sheetSize & (sheetSize - 1)))
+    return usage();
+  std::string srcDir = argv[arg], outPath = argv[arg + 1];
+
+  std::vector<std::string> files;
+  listPngs(srcDir, "", files);
+  if (files.empty()) {
+    fprintf(stderr, "assetpack: no PNGs in %s\n", srcDir.c_str());
+    return 1;
+  }
+
+  std::vector<Image> images;
+  for (const auto &rel : files) {
+    Image img;
+    img.file = rel;
+    if (codepoints ? !codepointKey(rel, img.key) : (img.key = rel, false)) {
+      fprintf(stderr, "assetpack: skipping %s (not a codepoint name)\n",
+              rel.c_str());
+      continue;
+    }
+    int n;
+    stbi_uc *px =
+        stbi_load((srcDir + "/" + rel).c_str(), &img.w, &img.h, &n, 4);
+    if (!px) {
+      fprintf(stderr, "assetpack: %s: %s\n", rel.c_str(),
+              stbi_failure_reason());
+      return 1;
+    }
+    img.rgba.resize((size_t)img.w * img.h);
+    for (size_t i = 0; i < img.rgba.size(); i++)
+      img.rgba[i] = px[i * 4] | (px[i * 4 + 1] << 8) |
+                    (px[i * 4 + 2] << 16) | ((uint32_t)px[i * 4 + 3] << 24);
+    stbi_image_free(px);
+
+    if (cell > 0 && (img.w > cell || img.h > cell)) {
+      float s = std::min((float)cell / img.w, (float)cell / img.h);
+      downscale(img, std::max(1, (int)(img.w * s + 0.5f)),
+                std::max(1, (int)(img.h * s + 0.5f)));
+    }
+    if (img.w > sheetSize || img.h > sheetSize) {
+      fprintf(stderr, "assetpack: %s is larger than a sheet\n", rel.c_str());
+      return 1;
+    }
+    images.push_back(std::move(img));
+  }
+
+  std::sort(images.begin(), images.end(),
+            [](const Image &a, const Image &b) { return a.key < b.key; });
+  for (size_t i = 1; i < images.size(); i++) {
+    if (images[i].key == images[i - 1].key) {
+      fprintf(stderr, "assetpack: duplicate key for %s\n",
+              images[i].file.c_str());
+      return 1;
+    }
+  }
+
+  // Shelves in key order, cells rounded up to whole tiles, so neighbours in
+  // the index (skin tones of one emoji, say) tend to share a sheet.
+  int sheets = 1, shelfX = 0, shelfY = 0, shelfH = 0;
+  for (auto &img : images) {
+    int cw = (img.w + 7) & ~7, ch = (img.h + 7) & ~7;
+    if (shelfX + cw > sheetSize) {
+      shelfY += shelfH;
+      shelfX = shelfH = 0;
+    }
+    if (shelfY + ch > sheetSize) {
+      sheets++;
+      shelfX = shelfY = shelfH = 0;
+    }
+    img.sheet = sheets - 1;
+    img.x = shelfX;
+    img.y = shelfY;
+    shelfX += cw;
+    shelfH = std::max(shelfH, ch);
+  }
+
+  size_t texelBytes = (format == FORMAT_RGBA4) ? 2 : 4;
+  size_t rawSize = (size_t)sheetSize * sheetSize * texelBytes;
+  std::vector<std::string> packed(sheets);
+  for (int s = 0; s < sheets; s++) {
+    std::vector<uint8_t> raw(rawSize, 0);
+    for (const auto &img : images) {
+      if (img.sheet != s)
+        continue;
+      for (int y = 0; y < img.h; y++) {
+        for (int x = 0; x < img.w; x++) {
+          uint32_t v = img.rgba[(size_t)y * img.w + x];
+          size_t at = tiledOffset(img.x + x, img.y + y, sheetSize);
+          if (format == FORMAT_RGBA4) {
+            uint16_t t = toRGBA4(v);
+            memcpy(&raw[at * 2], &t, 2);
+          } else {
+            uint32_t t = toRGBA8(v);
+            memcpy(&raw[at * 4], &t, 4);
+          }
+        }
+      }
+    }
+    uLongf size = compressBound(raw.size());
+    packed[s].resize(size);
+    if (compress2((Bytef *)&packed[s][0], &size, raw.data(), raw.size(),
+                  Z_BEST_COMPRESSION) != Z_OK) {
+      fprintf(stderr, "assetpack: compression failed\n");
+      return 1;
+    }
+    packed[s].resize(size);
+  }
+
+  std::string keys;
+  for (const auto &img : images)
+    keys += img.key;
+
+  const size_t headerSize = 16, sheetRecordSize = 20, entrySize = 16;
+  size_t dataOffset = headerSize + sheets * sheetRecordSize +
+                      images.size() * entrySize + keys.size();
+
+  std::string out = "TCPK";
+  put16(out, PACK_VERSION);
+  put16(out, (uint16_t)sheets);
+  put32(out, (uint32_t)images.size());
+  put32(out, (uint32_t)keys.size());
+
+  size_t offset = dataOffset;
+  for (int s = 0; s < sheets; s++) {
+    put16(out, (uint16_t)sheetSize);
+    put16(out, (uint16_t)sheetSize);
+    out += (char)format;
+    out.append(3, '\0');
+    put32(out, (uint32_t)offset);
+    put32(out, (uint32_t)packed[s].size());
+    put32(out, (uint32_t)rawSize);
+    offset += packed[s].size();
+  }
+
+  uint32_t keyOffset = 0;
+  for (const auto &img : images) {
+    put32(out, keyOffset);
+    put16(out, (uint16_t)img.key.size());
+    put16(out, (uint16_t)img.sheet);
+    put16(out, (uint16_t)img.x);
+    put16(out, (uint16_t)img.y);
+    put16(out, (uint16_t)img.w);
+    put16(out, (uint16_t)img.h);
+    keyOffset += (uint32_t)img.key.size();
+  }
+  out += keys;
+  for (const auto &p : packed)
+    out += p;
+
+  FILE *f = fopen(outPath.c_str(), "wb");
+  if (!f || fwrite(out.data(), 1, out.size(), f) != out.size()) {
+    fprintf(stderr, "assetpack: cannot write %s\n", outPath.c_str());
+    if (f)
+      fclose(f);
+    return 1;
+  }
+  fclose(f);
+
+  printf("%s: %d image(s), %d sheet(s), %zu bytes\n", outPath.c_str(),
+         (int)images.size(), sheets, out.size());
+  return 0;
+}
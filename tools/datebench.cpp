@@ -0,0 +1,216 @@
+// Host-side benchmark of the message date math in source/utils/date_utils.cpp
+// against the code it replaced: sscanf plus a loop over every year since
+// 1970, and a grouping check that re-parsed both timestamps and called
+// gmtime() twice per message pair on every layout.
+//
+//   datebench [messages] [rounds]
+//
+// Checks that the old and new paths agree on every generated timestamp
+// before timing them, and exits non-zero if they don't.
+
+#include "utils/date_utils.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int64_t OFFSET_SECONDS = 9 * 3600;
+
+time_t oldParseISO8601(const std::string &timestamp) {
+  int year, month, day, hour, min, sec;
+  if (sscanf(timestamp.c_str(), "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour,
+             &min, &sec) != 6) {
+    return 0;
+  }
+
+  static const int days_in_month[] = {31, 28, 31, 30, 31, 30,
+                                      31, 31, 30, 31, 30, 31};
+  time_t epoch = 0;
+  for (int y = 1970; y < year; ++y) {
+    epoch += (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) ? 366 : 365;
+  }
+  for (int m = 0; m < month - 1; ++m) {
+    epoch += days_in_month[m];
+    if (m == 1 && (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))) {
+      epoch += 1;
+    }
+  }
+  epoch += day - 1;
+  epoch = epoch * 86400 + hour * 3600 + min * 60 + sec;
+
+  return epoch;
+}
+
+// The time half of the old MessageUtils::canGroupWithPrevious; the author
+// and reply checks in front of it are unchanged.
+bool oldSameGroup(const std::string &current, const std::string &previous) {
+  time_t t1 = oldParseISO8601(current);
+  time_t t2 = oldParseISO8601(previous);
+  if (t1 == 0 || t2 == 0)
+    return false;
+  if (std::abs(difftime(t1, t2)) > 300)
+    return false;
+
+  time_t local_t1 = t1 + OFFSET_SECONDS;
+  time_t local_t2 = t2 + OFFSET_SECONDS;
+  struct tm lt1, lt2;
+  if (!gmtime_r(&local_t1, &lt1) || !gmtime_r(&local_t2, &lt2))
+    return false;
+  return lt1.tm_yday == lt2.tm_yday && lt1.tm_year == lt2.tm_year;
+}
+
+// The same check as it is now, on epochs stamped once at parse time.
+bool newSameGroup(time_t current, time_t previous) {
+  if (current == 0 || previous == 0)
+    return false;
+  time_t diff = current - previous;
+  if (diff > 300 || diff < -300)
+    return false;
+  return Utils::Date::localDay(current, OFFSET_SECONDS) ==
+         Utils::Date::localDay(previous, OFFSET_SECONDS);
+}
+
+// Days since 1970 the way the old parser counted them, without the sscanf.
+int64_t oldDaysFromCivil(int year, int month, int day) {
+  static const int days_in_month[] = {31, 28, 31, 30, 31, 30,
+                                      31, 31, 30, 31, 30, 31};
+  bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+  int64_t days = 0;
+  for (int y = 1970; y < year; ++y)
+    days += (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) ? 366 : 365;
+  for (int m = 0; m < month - 1; ++m)
+    days += days_in_month[m] + (m == 1 && leap);
+  return days + day - 1;
+}
+
+// A channel's history as Discord sends it: bursts of messages a few
+// seconds to minutes apart, with longer gaps between them.
+std::vector<std::string> makeTimestamps(size_t count) {
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<int> burst(1, 120);
+  std::uniform_int_distribution<int> gap(600, 3 * 86400);
+  std::uniform_int_distribution<int> micros(0, 999999);
+
+  std::vector<std::string> out;
+  out.reserve(count);
+  time_t t = 1546300800; // 2019-01-01
+  for (size_t i = 0; i < count; i++) {
+    t += (i % 8 == 0) ? gap(rng) : burst(rng);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buffer[96];
+    snprintf(buffer, sizeof(buffer),
+             "%04d-%02d-%02dT%02d:%02d:%02d.%06d+00:00", tm.tm_year + 1900,
+             tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+             micros(rng));
+    out.push_back(buffer);
+  }
+  return out;
+}
+
+template <typename F> double nsPerOp(size_t ops, int rounds, F body) {
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++)
+    body();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         ((double)ops * rounds);
+}
+
+void report(const char *name, double oldNs, double newNs) {
+  printf("%-16s %10.1f ns %10.1f ns %8.1fx\n", name, oldNs, newNs,
+         oldNs / newNs);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 20;
+  if (count < 2 || rounds < 1) {
+    fprintf(stderr, "usage: datebench [messages] [rounds]\n");
+    return 1;
+  }
+
+  std::vector<std::string> timestamps = makeTimestamps(count);
+  std::vector<time_t> epochs(count);
+  size_t groupedCount = 0;
+  for (size_t i = 0; i < count; i++) {
+    epochs[i] = Utils::Date::parseISO8601(timestamps[i]);
+    if (epochs[i] != oldParseISO8601(timestamps[i])) {
+      fprintf(stderr, "datebench: parse mismatch on %s\n",
+              timestamps[i].c_str());
+      return 1;
+    }
+    if (i > 0) {
+      bool grouped = newSameGroup(epochs[i], epochs[i - 1]);
+      if (grouped != oldSameGroup(timestamps[i], timestamps[i - 1])) {
+        fprintf(stderr, "datebench: grouping mismatch at %s\n",
+                timestamps[i].c_str());
+        return 1;
+      }
+      groupedCount += grouped;
+    }
+  }
+  for (int64_t days = 0; days < 50000; days++) {
+    int y, m, d;
+    Utils::Date::civilFromDays(days, y, m, d);
+    if (Utils::Date::daysFromCivil(y, m, d) != days ||
+        oldDaysFromCivil(y, m, d) != days) {
+      fprintf(stderr, "datebench: civil date mismatch at day %lld\n",
+              (long long)days);
+      return 1;
+    }
+  }
+
+  volatile int64_t sink = 0;
+  printf("%zu messages, %zu grouped with the one before, %d rounds\n", count,
+         groupedCount, rounds);
+  printf("%-16s %13s %13s %9s\n", "", "old", "new", "speedup");
+
+  report("parseISO8601",
+         nsPerOp(count, rounds,
+                 [&] {
+                   for (const auto &ts : timestamps)
+                     sink = sink + oldParseISO8601(ts);
+                 }),
+         nsPerOp(count, rounds, [&] {
+           for (const auto &ts : timestamps)
+             sink = sink + Utils::Date::parseISO8601(ts);
+         }));
+
+  std::vector<int> ys(count), ms(count), ds(count);
+  for (size_t i = 0; i < count; i++)
+    Utils::Date::civilFromDays(epochs[i] / 86400, ys[i], ms[i], ds[i]);
+  report("daysFromCivil",
+         nsPerOp(count, rounds,
+                 [&] {
+                   for (size_t i = 0; i < count; i++)
+                     sink = sink + oldDaysFromCivil(ys[i], ms[i], ds[i]);
+                 }),
+         nsPerOp(count, rounds, [&] {
+           for (size_t i = 0; i < count; i++)
+             sink = sink + Utils::Date::daysFromCivil(ys[i], ms[i], ds[i]);
+         }));
+
+  report("grouping",
+         nsPerOp(count - 1, rounds,
+                 [&] {
+                   for (size_t i = 1; i < count; i++)
+                     sink = sink +
+                            oldSameGroup(timestamps[i], timestamps[i - 1]);
+                 }),
+         nsPerOp(count - 1, rounds, [&] {
+           for (size_t i = 1; i < count; i++)
+             sink = sink + newSameGroup(epochs[i], epochs[i - 1]);
+         }));
+  return 0;
+}
@@ -0,0 +1,52 @@
+// Just enough of libctru for the network code to build on the host, for
+// tools/nettest.cpp.
+#ifndef HOST_3DS_H
+#define HOST_3DS_H
+
+#include <cstdint>
+#include <ctime>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+
+typedef struct {
+  s32 state;
+} LightEvent;
+
+typedef enum {
+  APTHOOK_ONSUSPEND = 0,
+  APTHOOK_ONRESTORE,
+  APTHOOK_ONSLEEP,
+  APTHOOK_ONWAKEUP,
+  APTHOOK_ONEXIT,
+  APTHOOK_COUNT,
+} APT_HookType;
+
+typedef void (*aptHookFn)(APT_HookType hook, void *param);
+
+typedef struct tag_aptHookCookie {
+  struct tag_aptHookCookie *next;
+  aptHookFn callback;
+  void *param;
+} aptHookCookie;
+
+// There is no sleep mode on the host, so hooks are never called.
+inline void aptHook(aptHookCookie *cookie, aptHookFn callback, void *param) {
+  cookie->next = nullptr;
+  cookie->callback = callback;
+  cookie->param = param;
+}
+inline void aptUnhook(aptHookCookie *cookie) { cookie->callback = nullptr; }
+
+// Milliseconds of wall-clock time, as on the console.
+inline u64 osGetTime() {
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (u64)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+#endif // HOST_3DS_H
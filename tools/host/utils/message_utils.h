@@ -0,0 +1,13 @@
+// Host stand-in for include/utils/message_utils.h, whose real header pulls in
+// the Discord client; the network code only calls syncClock().
+#pragma once
+
+#include <string>
+
+namespace UI {
+namespace MessageUtils {
+
+void syncClock(const std::string &dateStr);
+
+} // namespace MessageUtils
+} // namespace UI
@@ -0,0 +1,1268 @@
+// Host-side checks of the request path in source/network, on real libcurl,
+// against StandIn: a keep-alive HTTP/1.1 server on the loopback interface
+// whose routes play whatever part of Discord's API or CDN a check needs.
+//
+//   nettest [-v] [check...]
+//
+// Runs every check, or the ones named, each in a child process of its own so
+// it starts from fresh NetworkManager and HttpCache singletons, and exits
+// non-zero if any of them fails. "throughput" checks nothing: it times 100
+// GETs through the event loop and through the worker pool it replaced. -v
+// shows the Logger output. The nettest rule in the Makefile builds it under
+// ASan or TSan with SANITIZE=address or SANITIZE=thread.
+//
+// The checks run in a scratch directory under /tmp standing in for the SD
+// card. ConnectionManager's warm-up still sends its HEADs to Discord's hosts;
+// without a network they just fail.
+
+#include "core/config.h"
+#include "core/frame_scheduler.h"
+#include "log.h"
+#include "network/http_cache.h"
+#include "network/network_manager.h"
+#include "network/trust_store.h"
+#include "utils/base64_utils.h"
+#include "utils/message_utils.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <ftw.h>
+#include <functional>
+#include <future>
+#include <malloc.h>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <new>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace Network;
+
+// What the network code needs from the rest of the app.
+
+namespace {
+bool verbose = false;
+} // namespace
+
+void Logger::log(const char *fmt, ...) {
+  if (!verbose)
+    return;
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fputc('\n', stderr);
+}
+
+Config::Config()
+    : currentAccountIndex(-1), timezoneOffset(0), language("en"),
+      themeType(0), typingIndicatorEnabled(true), fileLoggingEnabled(false),
+      disclaimerAccepted(true), textureCacheMB(12) {}
+
+void Core::FrameScheduler::requestRedraw(u32) {}
+
+void UI::MessageUtils::syncClock(const std::string &) {}
+
+// Only for the X-Super-Properties header, which nothing here looks at.
+std::string Utils::Base64::encode(const unsigned char *, size_t) {
+  return "";
+}
+
+// Every request is plain HTTP, so curl's own CA handling is left alone.
+TrustStore &TrustStore::getInstance() {
+  static TrustStore instance;
+  return instance;
+}
+void TrustStore::configure(CURL *) {}
+bool TrustStore::widen() { return false; }
+
+// Allocations of LARGE_ALLOC bytes or more outside StandIn, for the sinks
+// check: a body should cost exactly one.
+namespace {
+const size_t LARGE_ALLOC = 32 * 1024;
+std::atomic<long> largeAllocs{0};
+std::atomic<long> largeAllocBytes{0};
+thread_local bool onStandIn = false;
+} // namespace
+
+void *operator new(size_t size) {
+  if (size >= LARGE_ALLOC && !onStandIn) {
+    largeAllocs++;
+    largeAllocBytes += size;
+  }
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "nettest: %s:%d: %s\n", __FILE__, __LINE__, #cond);   \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+struct Request {
+  std::string method;
+  std::string path;
+  std::string query;
+  std::map<std::string, std::string> headers; // lower-case names
+  std::string body;
+  int onConnection = 0; // 1 for the first request on its connection
+};
+
+struct Reply {
+  int status = 200;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+  int delayMs = 0;
+  size_t chunk = 0;  // written in pieces this big; 0 for one write
+  bool hang = false; // never answered, like a keep-alive socket gone dead
+};
+
+using Route = std::function<Reply(const Request &)>;
+
+std::string queryValue(const Request &req, const char *name) {
+  std::string key = std::string(name) + "=";
+  size_t pos = 0;
+  while (pos < req.query.size()) {
+    size_t end = req.query.find('&', pos);
+    if (end == std::string::npos)
+      end = req.query.size();
+    if (req.query.compare(pos, key.size(), key) == 0)
+      return req.query.substr(pos + key.size(), end - pos - key.size());
+    pos = end + 1;
+  }
+  return "";
+}
+
+const char *reasonFor(int status) {
+  switch (status) {
+  case 200:
+    return "OK";
+  case 304:
+    return "Not Modified";
+  case 404:
+    return "Not Found";
+  case 429:
+    return "Too Many Requests";
+  default:
+    return "Status";
+  }
+}
+
+bool sendAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+// One thread per connection, each serving requests on it until the client
+// closes it. Route runs on those threads, so it must be thread-safe.
+class StandIn {
+public:
+  explicit StandIn(Route route) : route(std::move(route)) {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listenFd, (sockaddr *)&addr, len) != 0 ||
+        listen(listenFd, 64) != 0 ||
+        getsockname(listenFd, (sockaddr *)&addr, &len) != 0) {
+      perror("nettest: stand-in");
+      exit(1);
+    }
+    port = ntohs(addr.sin_port);
+    acceptThread = std::thread(&StandIn::acceptLoop, this);
+  }
+
+  ~StandIn() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+      for (int fd : fds)
+        shutdown(fd, SHUT_RDWR);
+    }
+    shutdown(listenFd, SHUT_RDWR);
+    wake.notify_all();
+    acceptThread.join();
+    for (std::thread &worker : workers)
+      worker.join();
+    for (int fd : fds)
+      close(fd);
+    close(listenFd);
+  }
+
+  std::string url(const std::string &path, const char *host = "127.0.0.1") {
+    return "http://" + std::string(host) + ":" + std::to_string(port) + path;
+  }
+
+  int hits(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = hitCounts.find(path);
+    return it == hitCounts.end() ? 0 : it->second;
+  }
+
+  int connections() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int)fds.size();
+  }
+
+  // Threads still serving a connection.
+  int threads() const { return serving; }
+
+private:
+  void acceptLoop() {
+    while (true) {
+      int fd = accept(listenFd, nullptr, nullptr);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (stopping) {
+        if (fd >= 0)
+          close(fd);
+        return;
+      }
+      if (fd < 0)
+        continue;
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      fds.push_back(fd);
+      workers.emplace_back(&StandIn::serve, this, fd);
+    }
+  }
+
+  // False if the server is stopping.
+  bool sleepFor(int ms) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return !wake.wait_for(lock, std::chrono::milliseconds(ms),
+                          [this] { return stopping; });
+  }
+
+  bool readRequest(int fd, std::string &in, Request &req) {
+    char buffer[16384];
+    size_t end;
+    while ((end = in.find("\r\n\r\n")) == std::string::npos) {
+      ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+      if (n <= 0)
+        return false;
+      in.append(buffer, n);
+    }
+
+    size_t lineEnd = in.find("\r\n");
+    std::string line = in.substr(0, lineEnd);
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.find(' ', sp1 + 1);
+    if (sp1 == std::string::npos || sp2 == std::string::npos)
+      return false;
+    req.method = line.substr(0, sp1);
+    std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    size_t q = target.find('?');
+    req.path = target.substr(0, q);
+    req.query = q == std::string::npos ? "" : target.substr(q + 1);
+
+    size_t pos = lineEnd + 2;
+    while (pos < end) {
+      size_t next = in.find("\r\n", pos);
+      size_t colon = in.find(':', pos);
+      if (colon != std::string::npos && colon < next) {
+        std::string name = in.substr(pos, colon - pos);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        size_t value = in.find_first_not_of(' ', colon + 1);
+        req.headers[name] = in.substr(value, next - value);
+      }
+      pos = next + 2;
+    }
+
+    size_t length = 0;
+    auto it = req.headers.find("content-length");
+    if (it != req.headers.end())
+      length = strtoul(it->second.c_str(), nullptr, 10);
+    while (in.size() < end + 4 + length) {
+      ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+      if (n <= 0)
+        return false;
+      in.append(buffer, n);
+    }
+    req.body = in.substr(end + 4, length);
+    in.erase(0, end + 4 + length);
+    return true;
+  }
+
+  void serve(int fd) {
+    onStandIn = true;
+    serving++;
+    serveConnection(fd);
+    serving--;
+  }
+
+  void serveConnection(int fd) {
+    std::string in;
+    int served = 0;
+    while (true) {
+      Request req;
+      if (!readRequest(fd, in, req))
+        return;
+      req.onConnection = ++served;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        hitCounts[req.path]++;
+      }
+
+      Reply reply = route(req);
+      if (reply.hang) {
+        sleepFor(60000);
+        return;
+      }
+      if (reply.delayMs > 0 && !sleepFor(reply.delayMs))
+        return;
+
+      std::string head = "HTTP/1.1 " + std::to_string(reply.status) + " " +
+                         reasonFor(reply.status) + "\r\n";
+      for (const auto &header : reply.headers)
+        head += header.first + ": " + header.second + "\r\n";
+      head += "Content-Length: " + std::to_string(reply.body.size()) +
+              "\r\n\r\n";
+      if (!sendAll(fd, head.data(), head.size()))
+        return;
+      if (req.method == "HEAD")
+        continue;
+      size_t chunk = reply.chunk ? reply.chunk : reply.body.size();
+      for (size_t i = 0; i < reply.body.size(); i += chunk) {
+        size_t n = std::min(chunk, reply.body.size() - i);
+        if (!sendAll(fd, reply.body.data() + i, n))
+          return;
+      }
+    }
+  }
+
+  Route route;
+  int listenFd = -1;
+  int port = 0;
+  std::thread acceptThread;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+  std::vector<int> fds; // closed once every worker has finished
+  std::vector<std::thread> workers;
+  std::atomic<int> serving{0};
+  std::map<std::string, int> hitCounts;
+};
+
+// A body of size bytes after delayMs, like an avatar off the CDN.
+Route delayed(int delayMs, size_t size = 4096) {
+  return [=](const Request &) {
+    Reply reply;
+    reply.delayMs = delayMs;
+    reply.body.assign(size, 'x');
+    return reply;
+  };
+}
+
+void pause(int ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+bool waitFor(const std::atomic<int> &count, int target,
+             int timeoutMs = 10000) {
+  for (int waited = 0; count < target; waited += 2) {
+    if (waited >= timeoutMs)
+      return false;
+    pause(2);
+  }
+  return true;
+}
+
+struct Result {
+  long status = 0;
+  std::string body;
+  std::string error;
+};
+
+Result fetch(const std::string &url, bool cached = false) {
+  NetworkManager &nm = NetworkManager::getInstance();
+  std::promise<Result> done;
+  std::future<Result> result = done.get_future();
+  // HttpCache only stores a body no callback has taken.
+  auto callback = [&done, cached](HttpResponse &response) {
+    done.set_value({response.statusCode,
+                    cached ? response.body : response.takeBody(),
+                    response.error});
+  };
+  if (cached)
+    nm.enqueueCached(url, RequestPriority::INTERACTIVE, callback);
+  else
+    nm.enqueue(url, "GET", "", RequestPriority::INTERACTIVE, callback);
+  return result.get();
+}
+
+uint64_t elapsedMs(uint64_t since) { return osGetTime() - since; }
+
+// [user-041] Cancelling queued and running transfers on the event loop.
+void checkCancel() {
+  StandIn server(delayed(50));
+  NetworkManager &nm = NetworkManager::getInstance();
+  nm.init();
+
+  std::atomic<int> done{0};
+  std::vector<RequestHandle> handles;
+  for (int i = 0; i < 20; i++)
+    handles.push_back(nm.enqueue(server.url("/x" + std::to_string(i)), "GET",
+                                 "", RequestPriority::INTERACTIVE,
+                                 [&](HttpResponse &) { done++; }));
+  pause(20);
+  int cancelled = 0;
+  for (int i = 0; i < 20; i += 2)
+    cancelled += handles[i].cancel();
+  CHECK(handles[19].setPriority(RequestPriority::REALTIME));
+
+  CHECK(waitFor(done, 10));
+  pause(200);
+  NetworkManager::CancelStats stats = nm.getCancelStats();
+  CHECK(cancelled == 10);
+  CHECK(done == 10);
+  CHECK(stats.aborted > 0);
+  CHECK(stats.dequeued + stats.aborted == 10);
+  for (int i = 0; i < 20; i += 2)
+    CHECK(server.hits("/x" + std::to_string(i)) <= 1);
+  nm.shutdown();
+}
+
+// [user-042] Discord's per-route limits: a stand-in bucket of 5 requests a
+// second, 20 background GETs on it and then 3 interactive POSTs.
+void checkRateLimit() {
+  const int LIMIT = 5;
+  std::mutex mutex;
+  uint64_t windowStart = 0;
+  int used = 0;
+  std::atomic<int> limited{0};
+  StandIn server([&](const Request &) {
+    Reply reply;
+    reply.delayMs = 30;
+    reply.body = "{}";
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t now = osGetTime();
+    if (now - windowStart >= 1000) {
+      windowStart = now;
+      used = 0;
+    }
+    char reset[16];
+    snprintf(reset, sizeof(reset), "%.3f",
+             (1000 - (now - windowStart)) / 1000.0);
+    reply.headers = {{"X-RateLimit-Bucket", "abc"},
+                     {"X-RateLimit-Limit", std::to_string(LIMIT)},
+                     {"X-RateLimit-Reset-After", reset}};
+    if (used >= LIMIT) {
+      limited++;
+      reply.status = 429;
+      reply.headers.push_back({"Retry-After", reset});
+      reply.headers.push_back({"X-RateLimit-Remaining", "0"});
+      return reply;
+    }
+    used++;
+    reply.headers.push_back(
+        {"X-RateLimit-Remaining", std::to_string(LIMIT - used)});
+    return reply;
+  });
+  NetworkManager &nm = NetworkManager::getInstance();
+  nm.init();
+
+  // RateLimiter only limits URLs under discord.com/api.
+  std::string url =
+      server.url("/discord.com/api/v10/channels/123456789012345678/messages");
+  std::atomic<int> ok{0};
+  std::atomic<int> done{0};
+  std::atomic<uint64_t> firstPostMs{0};
+  uint64_t start = osGetTime();
+  auto count = [&](HttpResponse &response) {
+    ok += response.statusCode == 200;
+    done++;
+  };
+  // Pages of history, so they are not coalesced into one GET.
+  for (int i = 0; i < 20; i++)
+    nm.enqueue(url + "?before=" + std::to_string(i), "GET", "",
+               RequestPriority::BACKGROUND, count);
+  pause(100);
+  for (int i = 0; i < 3; i++)
+    nm.enqueue(url, "POST", "{}", RequestPriority::INTERACTIVE,
+               [&](HttpResponse &response) {
+                 uint64_t expected = 0;
+                 firstPostMs.compare_exchange_strong(expected,
+                                                     elapsedMs(start));
+                 count(response);
+               });
+
+  CHECK(waitFor(done, 23, 15000));
+  CHECK(ok == 23);
+  // Background GETs leave each window's last slot to the POSTs.
+  CHECK(firstPostMs < 1000);
+  printf("  23 requests in %.1fs, %d 429s retried, first POST at %llums\n",
+         elapsedMs(start) / 1000.0, (int)limited,
+         (unsigned long long)firstPostMs);
+  nm.shutdown();
+}
+
+// [user-043] Identical GETs share one transfer: 8 rows asking for the same
+// 5 avatars, half of them in the background.
+void checkCoalesce() {
+  StandIn server(delayed(100));
+  NetworkManager &nm = NetworkManager::getInstance();
+  nm.init();
+
+  std::atomic<int> done{0};
+  std::atomic<int> ok{0};
+  auto callback = [&](HttpResponse &response) {
+    ok += response.statusCode == 200 && response.body.size() == 4096;
+    done++;
+  };
+  std::vector<RequestHandle> rows;
+  for (int row = 0; row < 8; row++)
+    for (int i = 0; i < 5; i++)
+      rows.push_back(nm.enqueue(server.url("/a" + std::to_string(i)), "GET",
+                                "",
+                                row < 4 ? RequestPriority::BACKGROUND
+                                        : RequestPriority::INTERACTIVE,
+                                callback));
+  // Another token is another request, and POSTs are never shared.
+  nm.enqueue(server.url("/a0"), "GET", "", RequestPriority::INTERACTIVE,
+             callback, {{"Authorization", "other"}});
+  for (int i = 0; i < 2; i++)
+    nm.enqueue(server.url("/p"), "POST", "x", RequestPriority::INTERACTIVE,
+               callback);
+
+  // The owner of /a0, one joiner of /a1 and every requester of /a4.
+  int cancelled = rows[0].cancel() + rows[5 + 1].cancel();
+  for (int row = 0; row < 8; row++)
+    cancelled += rows[row * 5 + 4].cancel();
+
+  CHECK(waitFor(done, 33));
+  pause(200);
+  CHECK(cancelled == 10);
+  CHECK(done == 33);
+  CHECK(ok == 33);
+  CHECK(nm.getTransferStats().coalesced == 35);
+  CHECK(server.hits("/a0") == 2);
+  for (int i = 1; i < 4; i++)
+    CHECK(server.hits("/a" + std::to_string(i)) == 1);
+  // It may have started before the cancels, and then been aborted.
+  CHECK(server.hits("/a4") <= 1);
+  CHECK(server.hits("/p") == 2);
+
+  // Once a GET has finished the next one goes to the server again.
+  CHECK(fetch(server.url("/a1")).status == 200);
+  CHECK(server.hits("/a1") == 2);
+  nm.shutdown();
+}
+
+// [user-044] RequestHandle::cancel() at every stage a request can be in.
+void checkHandles() {
+  StandIn server([](const Request &req) {
+    Reply reply;
+    reply.delayMs = req.path == "/b" ? 150 : 50;
+    reply.body = "ok";
+    return reply;
+  });
+  NetworkManager &nm = NetworkManager::getInstance();
+  nm.init();
+
+  // A's slow callback holds the callback thread while B's response waits
+  // behind it. Cancelling B drops it; cancelling A, too late to stop it,
+  // waits for it to finish.
+  std::atomic<bool> aDone{false};
+  std::atomic<bool> bRan{false};
+  RequestHandle a = nm.enqueue(server.url("/a"), "GET", "",
+                               RequestPriority::INTERACTIVE,
+                               [&](HttpResponse &) {
+                                 pause(400);
+                                 aDone = true;
+                               });
+  RequestHandle b =
+      nm.enqueue(server.url("/b"), "GET", "", RequestPriority::INTERACTIVE,
+                 [&](HttpResponse &) { bRan = true; });
+  pause(250);
+  CHECK(a.isPending() && b.isPending());
+  CHECK(b.cancel());
+  CHECK(!b);
+  uint64_t start = osGetTime();
+  CHECK(!a.cancel());
+  CHECK(aDone);
+  CHECK(elapsedMs(start) >= 100);
+  pause(100);
+  CHECK(!bRan);
+
+  // A callback cancelling its own handle does not deadlock.
+  std::atomic<int> self{0};
+  std::promise<RequestHandle> own;
+  std::shared_future<RequestHandle> ownHandle = own.get_future().share();
+  RequestHandle c = nm.enqueue(server.url("/c"), "GET", "",
+                               RequestPriority::INTERACTIVE,
+                               [&, ownHandle](HttpResponse &) {
+                                 RequestHandle handle = ownHandle.get();
+                                 handle.cancel();
+                                 self = 1;
+                               });
+  own.set_value(c);
+  CHECK(waitFor(self, 1));
+  CHECK(!c.isPending());
+
+  // Queued requests: cancelled ones never start, a raised one jumps ahead.
+  std::atomic<int> done{0};
+  std::vector<RequestHandle> queued;
+  for (int i = 0; i < 12; i++)
+    queued.push_back(nm.enqueue(server.url("/q" + std::to_string(i)), "GET",
+                                "", RequestPriority::BACKGROUND,
+                                [&](HttpResponse &) { done++; }));
+  CHECK(queued[11].setPriority(RequestPriority::INTERACTIVE));
+  int cancelled = 0;
+  for (int i = 2; i < 11; i++)
+    cancelled += queued[i].cancel();
+  CHECK(waitFor(done, 3));
+  pause(300);
+  CHECK(cancelled == 9);
+  CHECK(done == 3);
+  CHECK(nm.getCancelStats().dequeued >= 9);
+  for (int i = 2; i < 11; i++)
+    CHECK(server.hits("/q" + std::to_string(i)) == 0);
+  nm.shutdown();
+}
+
+// [user-046] Bodies streamed into sinks, and handed to callbacks by move.
+void checkSinks() {
+  StandIn server([](const Request &req) {
+    Reply reply;
+    if (req.path == "/missing") {
+      reply.status = 404;
+      reply.body = "not found";
+      return reply;
+    }
+    size_t n = strtoul(queryValue(req, "n").c_str(), nullptr, 10);
+    reply.delayMs = 50;
+    reply.chunk = 16384;
+    reply.body.resize(n);
+    for (size_t i = 0; i < n; i++)
+      reply.body[i] = (char)((i * 7) & 255);
+    return reply;
+  });
+  NetworkManager &nm = NetworkManager::getInstance();
+  nm.init();
+  std::atomic<int> done{0};
+
+  std::vector<char> buffer(100000);
+  auto exact = std::make_shared<BufferSink>(buffer.data(), buffer.size());
+  nm.enqueue(
+      server.url("/img?n=100000"), "GET", "", RequestPriority::INTERACTIVE,
+      [&](HttpResponse &response) {
+        CHECK(response.success && response.body.empty());
+        CHECK(exact->size() == buffer.size());
+        CHECK((unsigned char)buffer[99999] == ((99999 * 7) & 255));
+        done++;
+      },
+      {}, exact);
+  CHECK(waitFor(done, 1));
+
+  auto small = std::make_shared<BufferSink>(buffer.data(), 1000);
+  nm.enqueue(
+      server.url("/img?n=5000"), "GET", "", RequestPriority::INTERACTIVE,
+      [&](HttpResponse &response) {
+        CHECK(!response.success);
+        done++;
+      },
+      {}, small);
+  CHECK(waitFor(done, 2));
+
+  auto file = std::make_shared<FileSink>("sink.bin");
+  nm.enqueue(
+      server.url("/img?n=300000"), "GET", "", RequestPriority::INTERACTIVE,
+      [&](HttpResponse &response) {
+        CHECK(response.statusCode == 200 && response.body.empty());
+        CHECK(file->close());
+        struct stat st;
+        CHECK(stat("sink.bin", &st) == 0 && st.st_size == 300000);
+        done++;
+      },
+      {}, file);
+  CHECK(waitFor(done, 3));
+
+  // An error page goes to body, never the sink.
+  auto errorSink = std::make_shared<BufferSink>(buffer.data(), buffer.size());
+  nm.enqueue(
+      server.url("/missing"), "GET", "", RequestPriority::INTERACTIVE,
+      [&](HttpResponse &response) {
+        CHECK(response.statusCode == 404 && response.body == "not found");
+        CHECK(errorSink->size() == 0);
+        done++;
+      },
+      {}, errorSink);
+  CHECK(waitFor(done, 4));
+
+  // Of three coalesced callbacks only the last may take the body.
+  std::string taken[3];
+  bool shared[3];
+  for (int i = 0; i < 3; i++)
+    nm.enqueue(server.url("/img?n=50000"), "GET", "",
+               RequestPriority::INTERACTIVE,
+               [&, i](HttpResponse &response) {
+                 shared[i] = response.shared;
+                 taken[i] = response.takeBody();
+                 done++;
+               });
+  CHECK(waitFor(done, 7));
+  CHECK(shared[0] && shared[1] && !shared[2]);
+  for (int i = 0; i < 3; i++)
+    CHECK(taken[i].size() == 50000);
+
+  // One allocation per download, the consumer's included.
+  for (size_t n : {200 * 1024, 1024 * 1024, 3 * 1024 * 1024}) {
+    long allocs = largeAllocs;
+    long bytes = largeAllocBytes;
+    std::string kept;
+    nm.enqueue(server.url("/img?n=" + std::to_string(n)), "GET", "",
+               RequestPriority::INTERACTIVE, [&](HttpResponse &response) {
+                 kept = response.takeBody();
+                 done++;
+               });
+    CHECK(waitFor(done, 8));
+    done--;
+    allocs = largeAllocs - allocs;
+    bytes = largeAllocBytes - bytes;
+    CHECK(kept.size() == n);
+    CHECK(allocs == 1);
+    printf("  %7zu B body: %ld allocation(s) of 32KB or more, %ld KB\n", n,
+           allocs, bytes / 1024);
+  }
+  nm.shutdown();
+}
+
+int countCacheFiles() {
+  int count = 0;
+  DIR *dir = opendir(CONFIG_DIR_PATH "/cache/http");
+  if (!dir)
+    return 0;
+  while (struct dirent *ent = readdir(dir)) {
+    size_t len = strlen(ent->d_name);
+    count += len > 4 && strcmp(ent->d_name + len - 4, ".bin") == 0;
+  }
+  closedir(dir);
+  return count;
+}
+
+void corruptCacheFiles() {
+  std::string dirPath = CONFIG_DIR_PATH "/cache/http";
+  DIR *dir = opendir(dirPath.c_str());
+  if (!dir)
+    return;
+  while (struct dirent *ent = readdir(dir)) {
+    std::string name = ent->d_name;
+    if (name.size() <= 4 || name.compare(name.size() - 4, 4, ".bin") != 0 ||
+        name == "index.bin")
+      continue;
+    std::ofstream(dirPath + "/" + name, std::ios::trunc) << "garbage";
+  }
+  closedir(dir);
+}
+
+bool exists(const std::string &path) { return access(path.c_str(), F_OK) == 0; }
+
+// [user-047] GET responses kept on the SD card and revalidated with ETags.
+void checkCache() {
+  const std::string LAST_MODIFIED = "Wed, 21 Oct 2015 07:28:00 GMT";
+  std::atomic<int> notModified{0};
+  StandIn server([&](const Request &req) {
+    Reply reply;
+    auto header = [&](const char *name) {
+      auto it = req.headers.find(name);
+      return it == req.headers.end() ? std::string() : it->second;
+    };
+    if (req.path == "/immutable") {
+      reply.body.assign(32768, 'i');
+      reply.headers = {{"Cache-Control", "public, max-age=3600, immutable"},
+                       {"ETag", "\"big\""}};
+    } else if (req.path == "/etag") {
+      reply.headers = {{"ETag", "\"v1\""}, {"Cache-Control", "no-cache"}};
+      if (header("if-none-match") == "\"v1\"") {
+        notModified++;
+        reply.status = 304;
+      } else {
+        for (int i = 0; i < 100; i++)
+          reply.body += "{\"guild\":1}";
+      }
+    } else if (req.path == "/lm") {
+      if (header("if-modified-since") == LAST_MODIFIED) {
+        notModified++;
+        reply.status = 304;
+      } else {
+        reply.body = "lm-body";
+        reply.headers = {{"Last-Modified", LAST_MODIFIED}};
+      }
+    } else if (req.path == "/nostore") {
+      reply.body = "secret";
+      reply.headers = {{"Cache-Control", "no-store"}, {"ETag", "\"x\""}};
+    } else if (req.path == "/plain") {
+      reply.body = "plain";
+    } else {
+      reply.status = 404;
+    }
+    return reply;
+  });
+  NetworkManager &nm = NetworkManager::getInstance();
+  HttpCache &cache = HttpCache::getInstance();
+  nm.init();
+  cache.init();
+  // Gives each write time to land before the next request looks for it.
+  auto cachedFetch = [&](const char *path) {
+    Result result = fetch(server.url(path), true);
+    pause(100);
+    return result;
+  };
+
+  Result a = cachedFetch("/immutable");
+  Result b = cachedFetch("/immutable");
+  CHECK(a.status == 200 && a.body.size() == 32768);
+  CHECK(b.status == 200 && b.body == a.body);
+  CHECK(server.hits("/immutable") == 1);
+  Result etag = cachedFetch("/etag");
+  for (int i = 0; i < 2; i++) {
+    Result again = cachedFetch("/etag");
+    CHECK(again.status == 200 && again.body == etag.body);
+  }
+  cachedFetch("/lm");
+  Result lm = cachedFetch("/lm");
+  CHECK(lm.status == 200 && lm.body == "lm-body");
+  for (const char *path : {"/nostore", "/nostore", "/plain", "/plain"})
+    CHECK(cachedFetch(path).status == 200);
+  CHECK(server.hits("/nostore") == 2 && server.hits("/plain") == 2);
+  CHECK(notModified == 3);
+  NetworkManager::TransferStats stats = nm.getTransferStats();
+  CHECK(stats.cacheHits == 1 && stats.revalidated == 3);
+
+  // A cache read cancelled in time never calls back; joined ones all do.
+  std::atomic<int> ran{0};
+  int tooLate = 0;
+  for (int i = 0; i < 50; i++)
+    tooLate += !nm.enqueueCached(server.url("/immutable"),
+                                 RequestPriority::INTERACTIVE,
+                                 [&](HttpResponse &) { ran++; })
+                    .cancel();
+  std::atomic<int> joined{0};
+  for (int i = 0; i < 5; i++)
+    nm.enqueueCached(server.url("/immutable"), RequestPriority::INTERACTIVE,
+                     [&](HttpResponse &response) {
+                       joined += response.statusCode == 200 &&
+                                 response.body.size() == 32768;
+                     });
+  CHECK(waitFor(joined, 5));
+  pause(100);
+  CHECK(ran == tooLate);
+  CHECK(tooLate < 50);
+  CHECK(server.hits("/immutable") == 1);
+
+  // Entries that no longer read back fall back to the network.
+  corruptCacheFiles();
+  Result c = cachedFetch("/immutable");
+  Result d = cachedFetch("/etag");
+  CHECK(c.status == 200 && c.body.size() == 32768);
+  CHECK(d.status == 200 && d.body == etag.body);
+  CHECK(server.hits("/immutable") == 2);
+
+  // The index survives a restart, and files it doesn't list are deleted.
+  const std::string orphan =
+      CONFIG_DIR_PATH "/cache/http/0123456789abcdef.bin";
+  cache.shutdown();
+  std::ofstream(orphan) << "x";
+  cache.init();
+  pause(100);
+  CHECK(!exists(orphan));
+  CHECK(exists(CONFIG_DIR_PATH "/cache/http/index.bin"));
+  Result e = cachedFetch("/immutable");
+  CHECK(e.status == 200 && e.body.size() == 32768);
+  CHECK(server.hits("/immutable") == 2);
+
+  cache.clear();
+  CHECK(!cache.isFresh(server.url("/immutable")));
+  CHECK(countCacheFiles() == 0);
+  CHECK(cachedFetch("/immutable").status == 200);
+  CHECK(cache.isFresh(server.url("/immutable")));
+  nm.shutdown();
+  cache.shutdown();
+}
+
+// [user-048] A pooled connection the server has stopped answering: the
+// second request on it hangs, as on a keep-alive socket a router dropped.
+void checkStall() {
+  StandIn server([](const Request &req) {
+    Reply reply;
+    reply.hang = req.path == "/stall" && req.onConnection >= 2;
+    reply.body = "ok";
+    return reply;
+  });
+  NetworkManager &nm = NetworkManager::getInstance();
+  nm.init();
+
+  CHECK(fetch(server.url("/ok")).status == 200);
+  uint64_t start = osGetTime();
+  Result result = fetch(server.url("/stall"));
+  uint64_t took = elapsedMs(start);
+  CHECK(result.status == 200 && result.body == "ok");
+  // Without the stall check it waits out the 30s HTTP_TIMEOUT_SECONDS.
+  CHECK(took < 10000);
+  CHECK(nm.getTransferStats().staleRetries == 1);
+  CHECK(server.connections() == 2);
+  printf("  stalled reused GET: 200 after %.1fs, on a new connection\n",
+         took / 1000.0);
+  nm.shutdown();
+}
+
+// [user-050] Per-request timings, per-host totals and the CSV dump.
+void checkTimings() {
+  StandIn server(delayed(5, 1024));
+  NetworkManager &nm = NetworkManager::getInstance();
+  nm.init(2, 1);
+
+  std::atomic<int> done{0};
+  const int TOTAL = 300;
+  for (int i = 0; i < TOTAL; i++) {
+    // Two host names for the same server, for two sets of host totals.
+    std::string url = server.url("/t" + std::to_string(i),
+                                 i % 2 ? "127.0.0.1" : "localhost");
+    nm.enqueue(url, "GET", "",
+               i % 3 ? RequestPriority::INTERACTIVE
+                     : RequestPriority::BACKGROUND,
+               [&](HttpResponse &) { done++; });
+  }
+  std::atomic<long> refused{-1};
+  nm.enqueue("http://127.0.0.1:1/refused", "GET", "",
+             RequestPriority::INTERACTIVE, [&](HttpResponse &response) {
+               refused = response.statusCode;
+               done++;
+             });
+  CHECK(waitFor(done, TOTAL + 1, 30000));
+  CHECK(refused == 0);
+
+  std::vector<RequestTiming> recent = nm.getRecentTimings(30);
+  CHECK(recent.size() == 30);
+  for (size_t i = 1; i < recent.size(); i++)
+    CHECK(recent[i].startedAt + recent[i].totalUs / 1000 + 2 >=
+          recent[i - 1].startedAt);
+  for (const RequestTiming &timing : recent)
+    CHECK(timing.status != 200 ||
+          (timing.totalUs >= timing.firstByteUs && timing.bytes == 1024));
+
+  std::vector<HostTiming> hosts = nm.getHostTimings();
+  uint32_t requests = 0;
+  uint32_t failed = 0;
+  for (const HostTiming &host : hosts) {
+    requests += host.requests;
+    failed += host.failures;
+  }
+  CHECK(hosts.size() >= 2);
+  CHECK(requests == TOTAL + 1);
+  CHECK(failed == 1);
+
+  CHECK(nm.dumpTimings("network.csv"));
+  std::ifstream csv("network.csv");
+  std::string line;
+  int rows = -1; // not the header
+  while (std::getline(csv, line))
+    rows++;
+  CHECK(rows == (int)RequestLog::HISTORY);
+  nm.shutdown();
+}
+
+// The pool NetworkManager ran before the event loop: each worker blocks in
+// curl_easy_perform on an HttpClient of its own. Interactive workers only
+// take REALTIME and INTERACTIVE requests; background workers take those
+// first too, then BACKGROUND ones.
+class WorkerPool {
+public:
+  WorkerPool(int interactiveCount, int backgroundCount) {
+    share = curl_share_init();
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockShare);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    for (int i = 0; i < interactiveCount + backgroundCount; i++)
+      workers.emplace_back(&WorkerPool::work, this, i >= interactiveCount);
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    ready.notify_all();
+    for (std::thread &worker : workers)
+      worker.join();
+    curl_share_cleanup(share);
+  }
+
+  void enqueue(const std::string &url, RequestPriority priority,
+               ResponseCallback callback) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      (priority == RequestPriority::BACKGROUND ? background : urgent)
+          .push_back({url, std::move(callback)});
+    }
+    ready.notify_all();
+  }
+
+private:
+  struct Job {
+    std::string url;
+    ResponseCallback callback;
+  };
+
+  void work(bool takesBackground) {
+    HttpClient client;
+    client.setShareHandle(share);
+    while (true) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [&] {
+          return stop || !urgent.empty() ||
+                 (takesBackground && !background.empty());
+        });
+        if (stop)
+          return;
+        std::deque<Job> &from = urgent.empty() ? background : urgent;
+        job = std::move(from.front());
+        from.pop_front();
+      }
+      HttpResponse response = client.get(job.url);
+      job.callback(response);
+    }
+  }
+
+  static void lockShare(CURL *, curl_lock_data data, curl_lock_access,
+                        void *userptr) {
+    ((WorkerPool *)userptr)->shareMutex[data].lock();
+  }
+  static void unlockShare(CURL *, curl_lock_data data, void *userptr) {
+    ((WorkerPool *)userptr)->shareMutex[data].unlock();
+  }
+
+  CURLSH *share;
+  std::mutex shareMutex[CURL_LOCK_DATA_LAST];
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<Job> urgent;
+  std::deque<Job> background;
+  bool stop = false;
+};
+
+long threadCount() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.compare(0, 8, "Threads:") == 0)
+      return atol(line.c_str() + 8);
+  return 0;
+}
+
+size_t heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+struct Run {
+  double ms = 0;
+  long threads = 0;
+  size_t peakHeap = 0;
+};
+
+// 100 GETs of 4KB, every third one BACKGROUND when mixed. Threads are
+// counted over baseThreads and StandIn's; the heap, StandIn's included, over
+// baseHeap.
+template <typename Enqueue>
+Run timeRun(StandIn &server, bool mixed, long baseThreads, size_t baseHeap,
+            Enqueue enqueue) {
+  const int COUNT = 100;
+  std::atomic<int> done{0};
+  Run run;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < COUNT; i++)
+    enqueue("/avatar/" + std::to_string(i) + ".png",
+            mixed && i % 3 == 0 ? RequestPriority::BACKGROUND
+                                : RequestPriority::INTERACTIVE,
+            [&](HttpResponse &) { done++; });
+  while (done < COUNT) {
+    run.threads = std::max(run.threads, threadCount() - server.threads() -
+                                            baseThreads);
+    run.peakHeap = std::max(run.peakHeap, heapInUse() - baseHeap);
+    pause(2);
+  }
+  run.ms = std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+               .count();
+  return run;
+}
+
+void report(const char *name, const Run &before, const Run &after) {
+  printf("  %-16s %5.0f ms %4.0f/s %5zu KB %2ld   %5.0f ms %4.0f/s %5zu KB "
+         "%2ld\n",
+         name, before.ms, 100000 / before.ms, before.peakHeap / 1024,
+         before.threads, after.ms, 100000 / after.ms, after.peakHeap / 1024,
+         after.threads);
+}
+
+// [user-041] The event loop against the worker pool, init(3, 2) as the app
+// ran it, on a stand-in CDN that takes 50ms a request.
+void runThroughput() {
+  StandIn server(delayed(50));
+  pause(50);
+  long baseThreads = threadCount();
+  size_t baseHeap = heapInUse();
+  Run pool[2];
+  Run loop[2];
+  {
+    WorkerPool workers(3, 2);
+    auto enqueue = [&](const std::string &path, RequestPriority priority,
+                       ResponseCallback callback) {
+      workers.enqueue(server.url(path), priority, std::move(callback));
+    };
+    // The first run opens the connections.
+    timeRun(server, false, baseThreads, baseHeap, enqueue);
+    for (int mixed = 0; mixed < 2; mixed++)
+      pool[mixed] = timeRun(server, mixed, baseThreads, baseHeap, enqueue);
+  }
+
+  NetworkManager &nm = NetworkManager::getInstance();
+  nm.init();
+  // Let the warm-up thread finish so it isn't counted.
+  pause(1000);
+  auto enqueue = [&](const std::string &path, RequestPriority priority,
+                     ResponseCallback callback) {
+    nm.enqueue(server.url(path), "GET", "", priority, std::move(callback));
+  };
+  timeRun(server, false, baseThreads, baseHeap, enqueue);
+  for (int mixed = 0; mixed < 2; mixed++)
+    loop[mixed] = timeRun(server, mixed, baseThreads, baseHeap, enqueue);
+  nm.shutdown();
+
+  printf("  100 x 4KB GETs, 50ms server; time, rate, peak heap, threads\n");
+  printf("  %-16s %-29s  %s\n", "", "worker pool (before)", "event loop");
+  report("all interactive", pool[0], loop[0]);
+  report("1/3 background", pool[1], loop[1]);
+}
+
+struct Check {
+  const char *name;
+  void (*run)();
+};
+
+const Check CHECKS[] = {
+    {"cancel", checkCancel},     {"ratelimit", checkRateLimit},
+    {"coalesce", checkCoalesce}, {"handles", checkHandles},
+    {"sinks", checkSinks},       {"cache", checkCache},
+    {"stall", checkStall},       {"timings", checkTimings},
+    {"throughput", runThroughput},
+};
+
+// In a child process, in a directory of its own holding the "SD card".
+bool runCheck(const Check &check) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("nettest: fork");
+    return false;
+  }
+  if (pid == 0) {
+    mkdir(check.name, 0700);
+    if (chdir(check.name) != 0 || mkdir("sdmc:", 0700) != 0 ||
+        mkdir("sdmc:/3ds", 0700) != 0 || mkdir(CONFIG_DIR_PATH, 0700) != 0) {
+      perror("nettest: scratch directory");
+      exit(1);
+    }
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    check.run();
+    fflush(stdout);
+    exit(failures ? 1 : 0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  bool passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  printf("%-12s %s\n", check.name, passed ? "ok" : "FAILED");
+  return passed;
+}
+
+int removeEntry(const char *path, const struct stat *, int, struct FTW *) {
+  return remove(path);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<const Check *> selected;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+      continue;
+    }
+    const Check *found = nullptr;
+    for (const Check &check : CHECKS)
+      if (strcmp(check.name, argv[i]) == 0)
+        found = &check;
+    if (!found) {
+      fprintf(stderr, "usage: nettest [-v] [check...]\nchecks:");
+      for (const Check &check : CHECKS)
+        fprintf(stderr, " %s", check.name);
+      fprintf(stderr, "\n");
+      return 1;
+    }
+    selected.push_back(found);
+  }
+  if (selected.empty())
+    for (const Check &check : CHECKS)
+      selected.push_back(&check);
+
+  char scratch[] = "/tmp/nettest.XXXXXX";
+  if (!mkdtemp(scratch) || chdir(scratch) != 0) {
+    perror("nettest: mkdtemp");
+    return 1;
+  }
+  int failed = 0;
+  for (const Check *check : selected)
+    failed += !runCheck(*check);
+  if (chdir("/") == 0)
+    nftw(scratch, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+
+  if (failed)
+    printf("%d of %zu failed\n", failed, selected.size());
+  return failed ? 1 : 0;
+}
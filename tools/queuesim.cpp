@@ -0,0 +1,236 @@
+// Host-side simulation of the request scheduler in
+// source/network/transfer_slots.cpp against the per-class FIFOs it
+// replaced.
+//
+//   queuesim [seconds] [serviceMs]
+//
+// Replays a synthetic load through both policies in simulated time, a
+// millisecond per step: 40 background image prefetches a second, a burst of
+// 6 interactive requests every 500ms, one history page a second (BACKGROUND
+// with the 1s deadline DiscordClient gives it) and one REALTIME request
+// every 2s. Each transfer takes serviceMs, give or take a fifth, on the
+// slots NetworkManager::init() sets up by default.
+//
+// For each class it prints how many requests had started by 1.5s after the
+// load stopped, and the p50 and p99 of their queue wait, enqueue to start.
+// Rate limits and 429 retries are left out: they hold back single requests
+// whichever policy is running.
+
+#include "network/transfer_slots.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <vector>
+
+using namespace Network;
+
+namespace {
+
+const int INTERACTIVE_LIMIT = 6;
+const int BACKGROUND_LIMIT = 2;
+const uint64_t HISTORY_DEADLINE_MS = 1000;
+const uint64_t DRAIN_MS = 1500;
+
+enum Class {
+  REALTIME_CLASS,
+  INTERACTIVE_CLASS,
+  HISTORY_CLASS,
+  PREFETCH_CLASS
+};
+const int CLASS_COUNT = 4;
+const char *CLASS_NAMES[] = {"realtime", "interactive", "history",
+                             "background"};
+
+struct Request {
+  Class cls;
+  RequestPriority priority;
+  uint64_t enqueuedAt;
+  uint64_t deadline; // 0 for none
+};
+
+// The scheduler as NetworkManager::admit() runs it: one queue ordered by
+// due time, each request started in the share TransferSlots gives it.
+struct DueQueue {
+  TransferSlots slots;
+  std::deque<Request> queue;
+
+  DueQueue() { slots.setLimits(INTERACTIVE_LIMIT, BACKGROUND_LIMIT); }
+
+  static uint64_t dueOf(const Request &req) {
+    return TransferSlots::dueAt(req.priority, req.enqueuedAt, req.deadline);
+  }
+
+  void enqueue(const Request &req) {
+    uint64_t due = dueOf(req);
+    auto it = std::upper_bound(
+        queue.begin(), queue.end(), due,
+        [](uint64_t due, const Request &other) { return due < dueOf(other); });
+    queue.insert(it, req);
+  }
+
+  template <typename F> void admit(uint64_t now, F start) {
+    for (auto it = queue.begin(); it != queue.end();) {
+      uint64_t waitMs = 0;
+      TransferSlots::Share share =
+          slots.shareFor(it->priority, dueOf(*it), now, waitMs);
+      if (share == TransferSlots::Share::NONE) {
+        ++it;
+        continue;
+      }
+      slots.take(share);
+      start(*it, (int)share);
+      it = queue.erase(it);
+    }
+  }
+
+  void finish(int token) { slots.give((TransferSlots::Share)token); }
+};
+
+// The three FIFOs the scheduler replaced, one per priority, and the admit()
+// that drained them: REALTIME first, then INTERACTIVE while it had slots,
+// and BACKGROUND in its own slots only while no urgent request was waiting
+// for one.
+struct Fifos {
+  std::deque<Request> queues[3];
+  int active = 0;
+  int activeBackground = 0;
+
+  void enqueue(const Request &req) {
+    queues[(int)req.priority].push_back(req);
+  }
+
+  template <typename F> void admit(uint64_t, F start) {
+    std::deque<Request> &realtime = queues[0];
+    std::deque<Request> &interactive = queues[1];
+    std::deque<Request> &background = queues[2];
+    while (true) {
+      int urgent = active - activeBackground;
+      std::deque<Request> *from = nullptr;
+      if (!realtime.empty()) {
+        from = &realtime;
+      } else if (urgent < INTERACTIVE_LIMIT && !interactive.empty()) {
+        from = &interactive;
+      } else {
+        bool urgentWaiting = urgent >= INTERACTIVE_LIMIT &&
+                             (!realtime.empty() || !interactive.empty());
+        if (!urgentWaiting && activeBackground < BACKGROUND_LIMIT &&
+            !background.empty())
+          from = &background;
+      }
+      if (!from)
+        return;
+
+      bool isBackground = from == &background;
+      active++;
+      activeBackground += isBackground;
+      start(from->front(), (int)isBackground);
+      from->pop_front();
+    }
+  }
+
+  void finish(int token) {
+    active--;
+    activeBackground -= token;
+  }
+};
+
+struct Results {
+  int sent[CLASS_COUNT] = {};
+  std::vector<uint64_t> waits[CLASS_COUNT];
+};
+
+template <typename Policy>
+Results run(Policy &policy, uint64_t seconds, uint64_t serviceMs) {
+  struct Running {
+    uint64_t doneAt;
+    int token;
+  };
+  std::mt19937 rng(7);
+  int spread = (int)serviceMs / 5;
+  std::uniform_int_distribution<int> jitter(-spread, spread);
+  std::vector<Running> running;
+  Results results;
+
+  auto send = [&](Class cls, RequestPriority priority, uint64_t now,
+                  uint64_t deadline) {
+    policy.enqueue({cls, priority, now, deadline});
+    results.sent[cls]++;
+  };
+
+  uint64_t loadEnd = seconds * 1000;
+  for (uint64_t now = 0; now < loadEnd + DRAIN_MS; now++) {
+    if (now < loadEnd) {
+      if (now % 25 == 0)
+        send(PREFETCH_CLASS, RequestPriority::BACKGROUND, now, 0);
+      if (now % 500 == 0)
+        for (int i = 0; i < 6; i++)
+          send(INTERACTIVE_CLASS, RequestPriority::INTERACTIVE, now, 0);
+      if (now % 1000 == 500)
+        send(HISTORY_CLASS, RequestPriority::BACKGROUND, now,
+             now + HISTORY_DEADLINE_MS);
+      if (now % 2000 == 250)
+        send(REALTIME_CLASS, RequestPriority::REALTIME, now, 0);
+    }
+
+    for (auto it = running.begin(); it != running.end();) {
+      if (it->doneAt > now) {
+        ++it;
+        continue;
+      }
+      policy.finish(it->token);
+      it = running.erase(it);
+    }
+
+    policy.admit(now, [&](const Request &req, int token) {
+      results.waits[req.cls].push_back(now - req.enqueuedAt);
+      running.push_back({now + serviceMs + jitter(rng), token});
+    });
+  }
+  return results;
+}
+
+uint64_t percentile(std::vector<uint64_t> &waits, double p) {
+  if (waits.empty())
+    return 0;
+  std::sort(waits.begin(), waits.end());
+  return waits[std::min(waits.size() - 1, (size_t)(p * waits.size()))];
+}
+
+void report(Results &results, int cls) {
+  std::vector<uint64_t> &waits = results.waits[cls];
+  printf("  %4zu/%-4d p50 %5llu p99 %5llu", waits.size(), results.sent[cls],
+         (unsigned long long)percentile(waits, 0.50),
+         (unsigned long long)percentile(waits, 0.99));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 10;
+  int serviceMs = argc > 2 ? atoi(argv[2]) : 100;
+  if (seconds < 1 || serviceMs < 1) {
+    fprintf(stderr, "usage: queuesim [seconds] [serviceMs]\n");
+    return 1;
+  }
+
+  Fifos fifos;
+  DueQueue dueQueue;
+  Results before = run(fifos, seconds, serviceMs);
+  Results after = run(dueQueue, seconds, serviceMs);
+
+  printf("%ds of load, %dms transfers, %d interactive + %d background "
+         "slots; wait in ms\n",
+         seconds, serviceMs, INTERACTIVE_LIMIT, BACKGROUND_LIMIT);
+  printf("%-12s  %-31s  %s\n", "", "FIFOs (before)", "scheduler");
+  for (int cls = 0; cls < CLASS_COUNT; cls++) {
+    printf("%-12s", CLASS_NAMES[cls]);
+    report(before, cls);
+    report(after, cls);
+    printf("\n");
+  }
+  return 0;
+}